@@ -40,5 +40,45 @@
 #define CORK_CONFIG_ARCH_PPC  0
 #endif
 
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define CORK_CONFIG_ARCH_ARM64  1
+#else
+#define CORK_CONFIG_ARCH_ARM64  0
+#endif
+
+
+/*-----------------------------------------------------------------------
+ * SIMD instruction sets
+ */
+
+/* These reflect the instruction sets that the compiler is allowed to target
+ * (via -msse2, -mavx2, -march, etc), not what the CPU we happen to run on
+ * supports. */
+
+#if !defined(CORK_CONFIG_HAVE_SSE2)
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CORK_CONFIG_HAVE_SSE2  1
+#else
+#define CORK_CONFIG_HAVE_SSE2  0
+#endif
+#endif
+
+#if !defined(CORK_CONFIG_HAVE_AVX2)
+#if defined(__AVX2__)
+#define CORK_CONFIG_HAVE_AVX2  1
+#else
+#define CORK_CONFIG_HAVE_AVX2  0
+#endif
+#endif
+
+#if !defined(CORK_CONFIG_HAVE_NEON)
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CORK_CONFIG_HAVE_NEON  1
+#else
+#define CORK_CONFIG_HAVE_NEON  0
+#endif
+#endif
+
 
 #endif /* LIBCORK_CONFIG_ARCH_H */
@@ -28,6 +28,8 @@
 
 #define CORK_HAVE_REALLOCF  1
 #define CORK_HAVE_PTHREADS  1
+/* backtrace() lives in a separate libexecinfo on the BSDs */
+#define CORK_HAVE_BACKTRACE  0
 
 
 #endif /* LIBCORK_CONFIG_BSD_H */
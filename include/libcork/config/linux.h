@@ -29,5 +29,12 @@
 #define CORK_HAVE_REALLOCF  0
 #define CORK_HAVE_PTHREADS  1
 
+/* musl and other non-glibc C libraries don't provide execinfo.h */
+#if defined(__GLIBC__)
+#define CORK_HAVE_BACKTRACE  1
+#else
+#define CORK_HAVE_BACKTRACE  0
+#endif
+
 
 #endif /* LIBCORK_CONFIG_LINUX_H */
@@ -28,6 +28,7 @@
 
 #define CORK_HAVE_REALLOCF  1
 #define CORK_HAVE_PTHREADS  1
+#define CORK_HAVE_BACKTRACE  1
 
 
 #endif /* LIBCORK_CONFIG_MACOSX_H */
@@ -414,4 +414,112 @@ struct cork_alloc *
 cork_debug_alloc_new(const struct cork_alloc *parent);
 
 
+/*-----------------------------------------------------------------------
+ * Arena allocator
+ */
+
+/* An allocator that hands out memory by bumping a pointer through large
+ * chunks obtained from `parent`.  Freeing an object is a no-op (unless it's
+ * the most recent allocation); instead, cork_arena_reset releases everything
+ * that has been allocated from the arena at once.  The most recent allocation
+ * can be grown in place with cork_alloc_realloc, as long as there's room left
+ * in the current chunk.  (A large allocation has a chunk of its own, which we
+ * resize using `parent`.)  Arenas are not thread-safe.
+ *
+ * A chunk_size of 0 selects CORK_ARENA_DEFAULT_CHUNK_SIZE. */
+
+#define CORK_ARENA_DEFAULT_CHUNK_SIZE  65536
+
+CORK_API struct cork_alloc *
+cork_arena_alloc_new(const struct cork_alloc *parent, size_t chunk_size);
+
+/* Frees every object allocated from an arena.  One chunk is kept around to
+ * satisfy future allocations. */
+CORK_API void
+cork_arena_reset(const struct cork_alloc *arena);
+
+
+/*-----------------------------------------------------------------------
+ * Slab allocator
+ */
+
+/* An allocator that serves small objects from slabs that each hold objects of
+ * a single size class.  Since cork_alloc_free is always given the size of the
+ * object being freed, we can find its size class without storing a header in
+ * front of each object.  Requests larger than CORK_SLAB_ALLOC_MAX_SIZE are
+ * passed through to `parent`.
+ *
+ * Slab allocators are thread-safe, so you can install one as the default
+ * allocator with cork_set_allocator.  Each thread keeps a small cache of free
+ * objects; slab memory is never returned to `parent`. */
+
+#define CORK_SLAB_ALLOC_MAX_SIZE  512
+
+CORK_API struct cork_alloc *
+cork_slab_alloc_new(const struct cork_alloc *parent);
+
+/* Returns the objects in the current thread's cache to the slab allocator, and
+ * frees the cache.  This happens automatically when the thread exits; call
+ * this if you want other threads to be able to use the cached objects
+ * sooner. */
+CORK_API void
+cork_slab_alloc_release_thread_cache(const struct cork_alloc *alloc);
+
+
+/*-----------------------------------------------------------------------
+ * Statistics allocator
+ */
+
+/* An allocator that passes every request through to `parent`, keeping track of
+ * how much memory is in use along the way.  Since cork_alloc_free is always
+ * given the size of the object being freed, the counts are exact, and we don't
+ * need to store any extra header in front of each allocation.
+ *
+ * Allocations are grouped into power-of-two size classes; size class `i`
+ * contains allocations of (2^(i-1), 2^i] bytes (class 0 also includes empty
+ * allocations).  Statistics allocators are thread-safe. */
+
+struct cork_alloc_stats {
+    size_t  live_bytes;
+    size_t  peak_bytes;
+    size_t  alloc_count;
+    size_t  free_count;
+};
+
+#define CORK_STATS_ALLOC_CLASS_COUNT  (sizeof(size_t) * 8 + 1)
+
+CORK_API struct cork_alloc *
+cork_stats_alloc_new(const struct cork_alloc *parent);
+
+/* Fills in `dest` with statistics about every allocation made through
+ * `alloc`. */
+CORK_API void
+cork_stats_alloc_get_totals(const struct cork_alloc *alloc,
+                            struct cork_alloc_stats *dest);
+
+/* Fills in `dest` with statistics about the allocations in one size class. */
+CORK_API void
+cork_stats_alloc_get_class(const struct cork_alloc *alloc,
+                           unsigned int size_class,
+                           struct cork_alloc_stats *dest);
+
+/* Returns the size class that an allocation of `size` bytes belongs to. */
+CORK_API unsigned int
+cork_stats_alloc_size_class(size_t size);
+
+/* Records a backtrace for one out of every `rate` allocations, so that the
+ * report can show which call sites allocate the most memory.  A rate of 0 (the
+ * default) turns sampling off.  Has no effect on platforms where we can't
+ * collect backtraces. */
+CORK_API void
+cork_stats_alloc_set_sample_rate(const struct cork_alloc *alloc, size_t rate);
+
+struct cork_buffer;
+
+/* Appends a human-readable summary of the allocator's statistics to `dest`. */
+CORK_API void
+cork_stats_alloc_report(const struct cork_alloc *alloc,
+                        struct cork_buffer *dest);
+
+
 #endif /* LIBCORK_CORE_ALLOCATOR_H */
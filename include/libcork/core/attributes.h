@@ -131,6 +131,16 @@
 #define CORK_UNLIKELY(expr)  (expr)
 #endif
 
+/*
+ * Hint that we'll soon read from the given address.
+ */
+
+#if CORK_CONFIG_HAVE_GCC_ATTRIBUTES
+#define CORK_PREFETCH(addr)  __builtin_prefetch((addr))
+#else
+#define CORK_PREFETCH(addr)  ((void) (addr))
+#endif
+
 /*
  * Declare that a function is part of the current library's public API, or that
  * it's internal to the current library.
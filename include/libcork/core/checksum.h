@@ -0,0 +1,72 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_CORE_CHECKSUM_H
+#define LIBCORK_CORE_CHECKSUM_H
+
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+
+
+/*-----------------------------------------------------------------------
+ * CRC32C
+ */
+
+/* The checksum of an empty buffer */
+#define CORK_CRC32C_INIT  0
+
+/* Returns the CRC32C (Castagnoli) checksum of `src`, continuing on from `crc`,
+ * which should be CORK_CRC32C_INIT for the first buffer in a stream, or the
+ * result of the previous call for later buffers.  The result is the same no
+ * matter how the stream is divided into buffers. */
+CORK_API uint32_t
+cork_crc32c(uint32_t crc, const void *src, size_t len);
+
+/* Returns the name of the kernel that cork_crc32c uses. */
+CORK_API const char *
+cork_crc32c_get_kernel(void);
+
+/* Forces cork_crc32c to use a particular kernel ("table", "sse4.2", "pclmul",
+ * or "armv8").  Pass in NULL to go back to the best kernel that the CPU
+ * supports.  Returns an error if the kernel doesn't exist or isn't
+ * supported. */
+CORK_API int
+cork_crc32c_set_kernel(const char *name);
+
+
+/*-----------------------------------------------------------------------
+ * Adler-32
+ */
+
+/* The checksum of an empty buffer */
+#define CORK_ADLER32_INIT  1
+
+/* Returns the Adler-32 checksum of `src`, continuing on from `adler`, which
+ * should be CORK_ADLER32_INIT for the first buffer in a stream. */
+CORK_API uint32_t
+cork_adler32(uint32_t adler, const void *src, size_t len);
+
+
+/*-----------------------------------------------------------------------
+ * Checksum's stream consumer implementation
+ */
+
+#include <libcork/ds/stream.h>
+
+/* Checksums all of the data that the consumer receives, and stores the result
+ * into `dest` when it reaches the end of the stream. */
+CORK_API struct cork_stream_consumer *
+cork_crc32c_stream_consumer_new(uint32_t *dest);
+
+CORK_API struct cork_stream_consumer *
+cork_adler32_stream_consumer_new(uint32_t *dest);
+
+
+#endif /* LIBCORK_CORE_CHECKSUM_H */
@@ -45,6 +45,79 @@ CORK_API void
 cork_gc_done(void);
 
 
+/* Makes the current thread use the garbage collector that's shared by every
+ * thread that calls this function, instead of its own.  Objects allocated by
+ * any of these threads can be passed freely between them.  Must be called
+ * before the thread allocates any garbage-collected objects.  The thread must
+ * call cork_gc_done before it exits; otherwise every later collection will
+ * wait for it forever. */
+CORK_API void
+cork_gc_init_shared(void);
+
+/* Waits for any collection of the shared collector's garbage cycles that
+ * another thread has started.  Every other GC function that can allocate or
+ * free objects is also a safepoint. */
+CORK_API void
+cork_gc_safepoint(void);
+
+/* Call these around anything that might block for a while, such as waiting
+ * for another thread.  The current thread must not touch any shared objects in
+ * between. */
+CORK_API void
+cork_gc_begin_blocking(void);
+
+CORK_API void
+cork_gc_end_blocking(void);
+
+
+/* Bucket 0 of the pause histogram counts pauses shorter than 1µs; bucket i
+ * counts pauses of at least 2^(i-1)µs and less than 2^iµs.  The last bucket
+ * also counts anything longer. */
+#define CORK_GC_PAUSE_BUCKET_COUNT  32
+
+struct cork_gc_stats {
+    size_t  alloc_count;
+    size_t  free_count;
+    /* Including the collector's per-object overhead */
+    size_t  live_bytes;
+    /* The number of times we've looked for garbage cycles */
+    size_t  collection_count;
+    /* The number of possible roots of garbage cycles that we've examined */
+    size_t  roots_scanned;
+    /* The number of objects that we've freed as part of a garbage cycle */
+    size_t  garbage_found;
+    size_t  pause_counts[CORK_GC_PAUSE_BUCKET_COUNT];
+};
+
+/* Fills in `dest` with statistics about every collector in the process,
+ * including the shared one, by adding up the counters that each thread keeps
+ * for itself.  Threads that have finished still count.  Can be called from
+ * any thread. */
+CORK_API void
+cork_gc_get_stats(struct cork_gc_stats *dest);
+
+
+/* Once the current thread's collector has buffered `threshold` possible roots
+ * of garbage cycles, each call to cork_gc_decref examines at most `budget` of
+ * them, oldest first.  The buffer grows as needed.  A `threshold` of 0 selects
+ * the default; a `budget` of 0 examines every possible root at once. */
+CORK_API void
+cork_gc_set_incremental(size_t threshold, size_t budget);
+
+/* Examines up to `budget` possible roots (all of them if `budget` is 0), and
+ * returns the number of possible roots that are still buffered. */
+CORK_API size_t
+cork_gc_collect_step(size_t budget);
+
+/* Logs the current thread's reference count changes, and applies them in
+ * batches, instead of updating each object right away.  An increment and
+ * decrement of the same object cancel out without touching the object.  The
+ * log has room for about `log_size` objects; 0 turns logging off.  Ignored if
+ * the current thread uses the shared collector. */
+CORK_API void
+cork_gc_set_deferred(size_t log_size);
+
+
 CORK_API void *
 cork_gc_alloc(size_t instance_size, struct cork_gc_obj_iface *iface);
 
@@ -91,7 +91,7 @@ cork_stable_hash_buffer(cork_hash seed, const void *src, size_t len)
 
     /* This is exactly the same as cork_murmur_hash_x86_32, but with a byte swap
      * to make sure that we always process the uint32s little-endian. */
-    const unsigned int  nblocks = (unsigned int)(len / 4);
+    const size_t  nblocks = len / 4;
     const cork_aliased_uint32_t  *blocks = (const cork_aliased_uint32_t *) src;
     const cork_aliased_uint32_t  *end = blocks + nblocks;
     const cork_aliased_uint32_t  *curr;
@@ -124,7 +124,7 @@ cork_stable_hash_buffer(cork_hash seed, const void *src, size_t len)
     };
 
     /* finalization */
-    h1 ^= len;
+    h1 ^= (uint32_t) len;
     h1 = cork_fmix32(h1);
     return h1;
 }
@@ -133,7 +133,7 @@ cork_stable_hash_buffer(cork_hash seed, const void *src, size_t len)
 do { \
     typedef uint32_t __attribute__((__may_alias__))  cork_aliased_uint32_t; \
     \
-    const unsigned int  nblocks = len / 4; \
+    const size_t  nblocks = (len) / 4; \
     const cork_aliased_uint32_t  *blocks = (const cork_aliased_uint32_t *) src; \
     const cork_aliased_uint32_t  *end = blocks + nblocks; \
     const cork_aliased_uint32_t  *curr; \
@@ -166,7 +166,7 @@ do { \
     }; \
     \
     /* finalization */ \
-    h1 ^= len; \
+    h1 ^= (uint32_t) (len); \
     h1 = cork_fmix32(h1); \
     *(dest) = h1; \
 } while (0)
@@ -175,7 +175,7 @@ do { \
 do { \
     typedef uint32_t __attribute__((__may_alias__))  cork_aliased_uint32_t; \
     \
-    const unsigned int  nblocks = len / 16; \
+    const size_t  nblocks = (len) / 16; \
     const cork_aliased_uint32_t  *blocks = (const cork_aliased_uint32_t *) src; \
     const cork_aliased_uint32_t  *end = blocks + (nblocks * 4); \
     const cork_aliased_uint32_t  *curr; \
@@ -244,7 +244,8 @@ do { \
     \
     /* finalization */ \
     \
-    h1 ^= len; h2 ^= len; h3 ^= len; h4 ^= len; \
+    h1 ^= (uint32_t) (len); h2 ^= (uint32_t) (len); \
+    h3 ^= (uint32_t) (len); h4 ^= (uint32_t) (len); \
     \
     h1 += h2; h1 += h3; h1 += h4; \
     h2 += h1; h3 += h1; h4 += h1; \
@@ -264,7 +265,7 @@ do { \
 do { \
     typedef uint64_t __attribute__((__may_alias__))  cork_aliased_uint64_t; \
     \
-    const unsigned int  nblocks = len / 16; \
+    const size_t  nblocks = (len) / 16; \
     const cork_aliased_uint64_t  *blocks = (const cork_aliased_uint64_t *) src; \
     const cork_aliased_uint64_t  *end = blocks + (nblocks * 2); \
     const cork_aliased_uint64_t  *curr; \
@@ -315,7 +316,7 @@ do { \
     \
     /* finalization */ \
     \
-    h1 ^= len; h2 ^= len; \
+    h1 ^= (uint32_t) (len); h2 ^= (uint32_t) (len); \
     \
     h1 += h2; \
     h2 += h1; \
@@ -337,11 +338,11 @@ cork_hash_buffer(cork_hash seed, const void *src, size_t len)
 #if CORK_SIZEOF_POINTER == 8
     cork_big_hash  big_seed = {cork_u128_from_32(seed, seed, seed, seed)};
     cork_big_hash  hash;
-    cork_murmur_hash_x64_128(big_seed, src, (unsigned int)len, &hash);
+    cork_murmur_hash_x64_128(big_seed, src, len, &hash);
     return cork_u128_be32(hash.u128, 0);
 #else
     cork_hash  hash = 0;
-    cork_murmur_hash_x86_32(seed, src, (unsigned int)len, &hash);
+    cork_murmur_hash_x86_32(seed, src, len, &hash);
     return hash;
 #endif
 }
@@ -353,14 +354,38 @@ cork_big_hash_buffer(cork_big_hash seed, const void *src, size_t len)
 {
     cork_big_hash  result;
 #if CORK_SIZEOF_POINTER == 8
-    cork_murmur_hash_x64_128(seed, src, (unsigned int)len, &result);
+    cork_murmur_hash_x64_128(seed, src, len, &result);
 #else
-    cork_murmur_hash_x86_128(seed, src, (unsigned int)len, &result);
+    cork_murmur_hash_x86_128(seed, src, len, &result);
 #endif
     return result;
 }
 
 
+/* Hashes `count` separate buffers, storing the hash of each one into the
+ * corresponding element of `dest`.  Each hash is the same as what
+ * cork_hash_buffer would produce.  This is a convenience wrapper that calls
+ * cork_hash_buffer for each buffer, prefetching the ones it's about to hash. */
+CORK_API void
+cork_hash_buffers(cork_hash seed, const void * const *srcs, const size_t *lens,
+                  size_t count, cork_hash *dest);
+
+/* The same, for `count` keys of a fixed size that are stored next to each other
+ * in `src`.  These interleave the steps of several keys' hashes, so they're
+ * faster than hashing each key separately. */
+CORK_API void
+cork_hash_buffers_4(cork_hash seed, const void *src, size_t count,
+                    cork_hash *dest);
+
+CORK_API void
+cork_hash_buffers_8(cork_hash seed, const void *src, size_t count,
+                    cork_hash *dest);
+
+CORK_API void
+cork_hash_buffers_16(cork_hash seed, const void *src, size_t count,
+                     cork_hash *dest);
+
+
 #define cork_hash_variable(seed, val) \
     (cork_hash_buffer((seed), &(val), sizeof((val))))
 #define cork_stable_hash_variable(seed, val) \
@@ -369,4 +394,137 @@ cork_big_hash_buffer(cork_big_hash seed, const void *src, size_t len)
     (cork_big_hash_buffer((seed), &(val), sizeof((val))))
 
 
+/*-----------------------------------------------------------------------
+ * 64-bit hashes
+ */
+
+/* A fast 64-bit hash.  Long inputs are hashed using SIMD instructions if the
+ * CPU supports them.  The result is the same on every platform, regardless of
+ * which kernel computes it, so it's safe to store. */
+CORK_API uint64_t
+cork_hash64_buffer(uint64_t seed, const void *src, size_t len);
+
+#define cork_hash64_variable(seed, val) \
+    (cork_hash64_buffer((seed), &(val), sizeof((val))))
+
+/* Returns the name of the kernel that cork_hash64_buffer uses for long
+ * inputs. */
+CORK_API const char *
+cork_hash64_get_kernel(void);
+
+/* Forces cork_hash64_buffer to use a particular kernel ("scalar", "sse2",
+ * "avx2", or "neon").  Pass in NULL to go back to the best kernel that the CPU supports.
+ * Returns an error if the kernel doesn't exist or isn't supported. */
+CORK_API int
+cork_hash64_set_kernel(const char *name);
+
+
+/*-----------------------------------------------------------------------
+ * Keyed hashes
+ */
+
+/* SipHash and HalfSipHash [1] are keyed hashes: if you don't know the key,
+ * you can't construct inputs that collide with each other.  That makes them
+ * much slower than the other hashes in this file, so only use them for keys
+ * that might come from an untrusted source.  We use the reduced-round 1-3
+ * variants, which are plenty strong enough for hash tables.
+ *
+ * [1] https://github.com/veorq/SipHash
+ */
+
+#define CORK_SIPHASH_KEY_SIZE  16
+#define CORK_HALFSIPHASH_KEY_SIZE  8
+
+/* SipHash-1-3.  `key` must point at CORK_SIPHASH_KEY_SIZE bytes. */
+CORK_API uint64_t
+cork_siphash13(const uint8_t *key, const void *src, size_t len);
+
+/* HalfSipHash-1-3, with a 32-bit result.  `key` must point at
+ * CORK_HALFSIPHASH_KEY_SIZE bytes. */
+CORK_API uint32_t
+cork_halfsiphash13(const uint8_t *key, const void *src, size_t len);
+
+/* Hashes `src` with a key that's chosen randomly the first time it's needed,
+ * and which then stays the same for the rest of the process.  We use
+ * SipHash-1-3 on 64-bit platforms and HalfSipHash-1-3 on 32-bit platforms.
+ * Results will be different each time you run your program, so don't store
+ * them anywhere. */
+CORK_API cork_hash
+cork_keyed_hash_buffer(const void *src, size_t len);
+
+#define cork_keyed_hash_variable(val) \
+    (cork_keyed_hash_buffer(&(val), sizeof((val))))
+
+/* Replaces the random key that cork_keyed_hash_buffer uses.  `key` must point
+ * at CORK_SIPHASH_KEY_SIZE bytes.  Any hash values that you've already
+ * calculated (including those stored in hash tables) will be invalid, so you
+ * should only call this at the start of your program.  This is mostly useful
+ * for reproducing problems. */
+CORK_API void
+cork_keyed_hash_set_key(const uint8_t *key);
+
+
+/*-----------------------------------------------------------------------
+ * Streaming hashes
+ */
+
+/* Lets you hash data that arrives in pieces.  The result is the same as if you
+ * had passed all of the data to cork_hash_buffer or cork_big_hash_buffer at
+ * once.  The contents of these structs are private. */
+
+struct cork_murmur_state {
+    union {
+        uint32_t  u32[4];
+        uint64_t  u64[2];
+    } h;
+    uint8_t  tail[16];
+    size_t  tail_size;
+    size_t  len;
+};
+
+struct cork_hash_state {
+    struct cork_murmur_state  murmur;
+};
+
+struct cork_big_hash_state {
+    struct cork_murmur_state  murmur;
+};
+
+CORK_API void
+cork_hash_state_init(struct cork_hash_state *state, cork_hash seed);
+
+CORK_API void
+cork_hash_state_update(struct cork_hash_state *state,
+                       const void *src, size_t len);
+
+CORK_API cork_hash
+cork_hash_state_final(struct cork_hash_state *state);
+
+CORK_API void
+cork_big_hash_state_init(struct cork_big_hash_state *state,
+                         cork_big_hash seed);
+
+CORK_API void
+cork_big_hash_state_update(struct cork_big_hash_state *state,
+                           const void *src, size_t len);
+
+CORK_API cork_big_hash
+cork_big_hash_state_final(struct cork_big_hash_state *state);
+
+
+/*-----------------------------------------------------------------------
+ * Hash's stream consumer implementation
+ */
+
+#include <libcork/ds/stream.h>
+
+/* Hashes all of the data that the consumer receives, and stores the result
+ * into `dest` when it reaches the end of the stream. */
+CORK_API struct cork_stream_consumer *
+cork_hash_stream_consumer_new(cork_hash seed, cork_hash *dest);
+
+CORK_API struct cork_stream_consumer *
+cork_big_hash_stream_consumer_new(cork_big_hash seed, cork_big_hash *dest);
+
+
 #endif /* LIBCORK_CORE_HASH_H */
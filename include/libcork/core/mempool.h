@@ -72,4 +72,44 @@ CORK_API void
 cork_mempool_free_object(struct cork_mempool *mp, void *ptr);
 
 
+/* Allocates `count` objects at once, storing them into `objects`. */
+CORK_API void
+cork_mempool_new_objects(struct cork_mempool *mp, size_t count, void **objects);
+
+/* Frees `count` objects at once. */
+CORK_API void
+cork_mempool_free_objects(struct cork_mempool *mp, size_t count, void **objects);
+
+/* Ensures that the pool has at least `count` free objects available, so that
+ * allocating them won't need to allocate any new blocks. */
+CORK_API void
+cork_mempool_reserve(struct cork_mempool *mp, size_t count);
+
+
+/* Returns blocks whose objects are all free to the allocator, while keeping
+ * at least `keep_bytes` worth of free objects in the pool. */
+CORK_API void
+cork_mempool_trim(struct cork_mempool *mp, size_t keep_bytes);
+
+/* Automatically trims the pool down to `keep_bytes` of free objects whenever
+ * it holds more than `high_watermark` bytes of free objects.  A
+ * `high_watermark` of 0 turns automatic trimming off. */
+CORK_API void
+cork_mempool_set_high_watermark(struct cork_mempool *mp,
+                                size_t high_watermark, size_t keep_bytes);
+
+
+/* Makes the pool safe to use from multiple threads at once.  Each thread keeps
+ * a private cache of free objects, so most allocations and frees don't need
+ * any synchronization.  Must be called before allocating any objects. */
+CORK_API void
+cork_mempool_set_thread_safe(struct cork_mempool *mp);
+
+/* Returns the objects in the current thread's cache to the pool, and frees
+ * the cache.  This happens automatically when the thread exits; call this if
+ * you want other threads to be able to use the cached objects sooner. */
+CORK_API void
+cork_mempool_release_thread_cache(struct cork_mempool *mp);
+
+
 #endif /* LIBCORK_CORK_MEMPOOL_H */
@@ -17,8 +17,10 @@
 #include <libcork/ds/buffer.h>
 #include <libcork/ds/dllist.h>
 #include <libcork/ds/hash-table.h>
+#include <libcork/ds/concurrent-hash-table.h>
 #include <libcork/ds/managed-buffer.h>
 #include <libcork/ds/ring-buffer.h>
+#include <libcork/ds/rope.h>
 #include <libcork/ds/slice.h>
 #include <libcork/ds/stream.h>
 
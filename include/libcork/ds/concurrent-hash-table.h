@@ -0,0 +1,105 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_CONCURRENT_HASH_TABLE_H
+#define LIBCORK_DS_CONCURRENT_HASH_TABLE_H
+
+#include <libcork/core/api.h>
+#include <libcork/core/callbacks.h>
+#include <libcork/core/hash.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/hash-table.h>
+
+
+/*-----------------------------------------------------------------------
+ * Concurrent hash tables
+ */
+
+/* A hash table that can be shared between threads.  Lookups never block, and
+ * writers only lock the part of the table that their key lives in.  The table
+ * is resized incrementally, a few bins at a time, by the writers that happen to
+ * be modifying it while the resize is in progress.
+ *
+ * Entries that are deleted or overwritten are not freed until no thread can
+ * still be looking at them. */
+
+struct cork_concurrent_hash_table;
+
+CORK_API struct cork_concurrent_hash_table *
+cork_concurrent_hash_table_new(size_t initial_size, unsigned int flags);
+
+/* Not thread-safe; no other thread can be using the table. */
+CORK_API void
+cork_concurrent_hash_table_free(struct cork_concurrent_hash_table *table);
+
+
+/* None of these are thread-safe; call them before sharing the table. */
+
+CORK_API void
+cork_concurrent_hash_table_set_user_data
+(struct cork_concurrent_hash_table *table,
+ void *user_data, cork_free_f free_user_data);
+
+CORK_API void
+cork_concurrent_hash_table_set_equals(struct cork_concurrent_hash_table *table,
+                                      cork_equals_f equals);
+
+CORK_API void
+cork_concurrent_hash_table_set_free_key
+(struct cork_concurrent_hash_table *table, cork_free_f free);
+
+CORK_API void
+cork_concurrent_hash_table_set_free_value
+(struct cork_concurrent_hash_table *table, cork_free_f free);
+
+CORK_API void
+cork_concurrent_hash_table_set_hash(struct cork_concurrent_hash_table *table,
+                                    cork_hash_f hash);
+
+
+/* Everything else is thread-safe. */
+
+CORK_API size_t
+cork_concurrent_hash_table_size(const struct cork_concurrent_hash_table *table);
+
+
+CORK_API void *
+cork_concurrent_hash_table_get(struct cork_concurrent_hash_table *table,
+                               const void *key);
+
+CORK_API void *
+cork_concurrent_hash_table_get_hash(struct cork_concurrent_hash_table *table,
+                                    cork_hash hash, const void *key);
+
+CORK_API void
+cork_concurrent_hash_table_put(struct cork_concurrent_hash_table *table,
+                               void *key, void *value, bool *is_new);
+
+CORK_API void
+cork_concurrent_hash_table_put_hash(struct cork_concurrent_hash_table *table,
+                                    cork_hash hash, void *key, void *value,
+                                    bool *is_new);
+
+CORK_API bool
+cork_concurrent_hash_table_delete(struct cork_concurrent_hash_table *table,
+                                  const void *key);
+
+CORK_API bool
+cork_concurrent_hash_table_delete_hash
+(struct cork_concurrent_hash_table *table, cork_hash hash, const void *key);
+
+/* The entries passed to `mapper` are read-only.  Entries that are added or
+ * deleted by other threads while the map is in progress might or might not be
+ * visited. */
+CORK_API void
+cork_concurrent_hash_table_map(struct cork_concurrent_hash_table *table,
+                               void *user_data, cork_hash_table_map_f mapper);
+
+
+#endif /* LIBCORK_DS_CONCURRENT_HASH_TABLE_H */
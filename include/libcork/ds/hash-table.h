@@ -31,6 +31,23 @@ struct cork_hash_table_entry {
 
 struct cork_hash_table;
 
+/* Flags that can be passed in to cork_hash_table_new */
+
+/* Use open addressing, storing entries inline in a flat array instead of
+ * allocating and chaining each entry separately.  Entry pointers are only valid
+ * until the next operation that adds an entry to the table. */
+#define CORK_HASH_TABLE_FLAT  0x0001
+
+/* When the table grows, migrate entries into the new bins a few at a time
+ * during later operations, instead of all at once.  Ignored for flat tables. */
+#define CORK_HASH_TABLE_INCREMENTAL  0x0002
+
+/* Hash keys with cork_keyed_hash_buffer, so that an attacker can't choose keys
+ * that all land in the same bin.  Only used by the built-in string and buffer
+ * key types; if you provide your own hash function, it's up to you to use a
+ * keyed hash. */
+#define CORK_HASH_TABLE_KEYED  0x0004
+
 CORK_API struct cork_hash_table *
 cork_hash_table_new(size_t initial_size, unsigned int flags);
 
@@ -54,6 +71,20 @@ cork_hash_table_set_free_value(struct cork_hash_table *table, cork_free_f free);
 CORK_API void
 cork_hash_table_set_hash(struct cork_hash_table *table, cork_hash_f hash);
 
+/* Creates a memory pool whose objects are the right size to hold the entries of
+ * a chained hash table.  You can share one pool between several tables, as
+ * long as they're all used from the same thread, and the pool outlives them. */
+CORK_API struct cork_mempool *
+cork_hash_table_entry_mempool_new(void);
+
+/* Allocates new entries from `entry_pool` (which must have been created by
+ * cork_hash_table_entry_mempool_new) instead of from the heap.  Must be called
+ * while the table is empty.  Pass in NULL to go back to using the heap.  Flat
+ * tables store their entries inline and ignore this setting. */
+CORK_API void
+cork_hash_table_set_allocator(struct cork_hash_table *table,
+                              struct cork_mempool *entry_pool);
+
 
 CORK_API void
 cork_hash_table_clear(struct cork_hash_table *table);
@@ -74,6 +105,24 @@ CORK_API void *
 cork_hash_table_get_hash(const struct cork_hash_table *table,
                          cork_hash hash, const void *key);
 
+/* Looks up `count` keys at once, storing the value for each key (or NULL if
+ * it's not in the table) into the corresponding element of `values`.  Returns
+ * the number of keys that were found.  This is faster than calling
+ * cork_hash_table_get for each key when the table is too large to fit in the
+ * CPU's cache. */
+CORK_API size_t
+cork_hash_table_get_many(const struct cork_hash_table *table,
+                         const void * const *keys, size_t count,
+                         void **values);
+
+/* The same, with the hash of each key already computed (for instance, by
+ * cork_hash_buffers). */
+CORK_API size_t
+cork_hash_table_get_many_hash(const struct cork_hash_table *table,
+                              const cork_hash *hashes,
+                              const void * const *keys, size_t count,
+                              void **values);
+
 CORK_API struct cork_hash_table_entry *
 cork_hash_table_get_entry(const struct cork_hash_table *table,
                           const void *key);
@@ -155,5 +204,10 @@ cork_string_hash_table_new(size_t initial_size, unsigned int flags);
 CORK_API struct cork_hash_table *
 cork_pointer_hash_table_new(size_t initial_size, unsigned int flags);
 
+/* Keys must be pointers to cork_buffer instances, and are compared using their
+ * contents. */
+CORK_API struct cork_hash_table *
+cork_buffer_hash_table_new(size_t initial_size, unsigned int flags);
+
 
 #endif /* LIBCORK_DS_HASH_TABLE_H */
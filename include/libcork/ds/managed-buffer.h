@@ -72,4 +72,35 @@ cork_managed_buffer_slice_offset(struct cork_slice *dest,
                                  size_t offset);
 
 
+/*-----------------------------------------------------------------------
+ * Memory-mapped files
+ */
+
+/* Tells the kernel how you're going to read a memory-mapped file, so that it
+ * can decide how much to read ahead. */
+enum cork_mmap_advice {
+    CORK_MMAP_NORMAL,
+    CORK_MMAP_SEQUENTIAL,
+    CORK_MMAP_RANDOM
+};
+
+/* Creates a managed buffer containing the contents of a file, which we map
+ * into memory read-only instead of reading it.  The file is unmapped when the
+ * last reference to the buffer goes away.  If the file changes while it's
+ * mapped, you might or might not see the changes.  If it's truncated, reading
+ * the part of the buffer that's now past the end of the file crashes with
+ * SIGBUS, so only map files that won't shrink while the buffer is alive. */
+CORK_API struct cork_managed_buffer *
+cork_managed_buffer_new_mmap(const char *path, enum cork_mmap_advice advice);
+
+/* Initializes `dest` to a slice of an entire memory-mapped file.  Copies of
+ * the slice share the same mapping. */
+CORK_API int
+cork_slice_init_mmap(struct cork_slice *dest, const char *path);
+
+CORK_API int
+cork_slice_init_mmap_ex(struct cork_slice *dest, const char *path,
+                        enum cork_mmap_advice advice);
+
+
 #endif /* LIBCORK_DS_MANAGED_BUFFER_H */
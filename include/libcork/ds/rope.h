@@ -0,0 +1,121 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_DS_ROPE_H
+#define LIBCORK_DS_ROPE_H
+
+#include <sys/uio.h>
+
+#include <libcork/core/api.h>
+#include <libcork/core/types.h>
+#include <libcork/ds/buffer.h>
+#include <libcork/ds/dllist.h>
+#include <libcork/ds/managed-buffer.h>
+#include <libcork/ds/slice.h>
+
+
+/*-----------------------------------------------------------------------
+ * Ropes
+ */
+
+/* A byte string made up of a list of segments, each of which is a slice of
+ * some other buffer.  Adding data to either end of a rope, or moving all of
+ * one rope onto the end of another, never copies any of the data. */
+
+struct cork_rope {
+    /* The segments of the rope, in order.  Private. */
+    struct cork_dllist  segments;
+    /* The total number of bytes in the rope */
+    size_t  size;
+    /* The number of segments in the rope.  Empty segments are never
+     * stored. */
+    size_t  segment_count;
+};
+
+
+CORK_API void
+cork_rope_init(struct cork_rope *rope);
+
+CORK_API struct cork_rope *
+cork_rope_new(void);
+
+CORK_API void
+cork_rope_done(struct cork_rope *rope);
+
+CORK_API void
+cork_rope_free(struct cork_rope *rope);
+
+/* Removes every segment from the rope. */
+CORK_API void
+cork_rope_clear(struct cork_rope *rope);
+
+
+/* Adds a copy of `slice` to the end or the beginning of the rope.  The copy
+ * is made with cork_slice_copy, so for slices of a managed buffer, the rope
+ * only takes a new reference to the buffer. */
+CORK_API int
+cork_rope_append_slice(struct cork_rope *rope, const struct cork_slice *slice);
+
+CORK_API int
+cork_rope_prepend_slice(struct cork_rope *rope, const struct cork_slice *slice);
+
+/* Adds `length` bytes of `buffer`, starting at `offset`, to the end or the
+ * beginning of the rope.  The rope takes a new reference to `buffer`. */
+CORK_API int
+cork_rope_append_managed(struct cork_rope *rope,
+                         struct cork_managed_buffer *buffer,
+                         size_t offset, size_t length);
+
+CORK_API int
+cork_rope_prepend_managed(struct cork_rope *rope,
+                          struct cork_managed_buffer *buffer,
+                          size_t offset, size_t length);
+
+/* Copies `src` into a new managed buffer, and adds it to the end of the
+ * rope. */
+CORK_API void
+cork_rope_append_copy(struct cork_rope *rope, const void *src, size_t size);
+
+/* Moves all of the segments of `src` onto the end of `dest`, leaving `src`
+ * empty. */
+CORK_API void
+cork_rope_append_rope(struct cork_rope *dest, struct cork_rope *src);
+
+
+/* Moves everything after the first `offset` bytes of `rope` onto the end of
+ * `dest`.  If `offset` falls in the middle of a segment, both ropes end up
+ * with a slice of that segment's buffer. */
+CORK_API int
+cork_rope_split(struct cork_rope *rope, size_t offset, struct cork_rope *dest);
+
+/* Removes the first `size` bytes from the rope. */
+CORK_API int
+cork_rope_advance(struct cork_rope *rope, size_t size);
+
+
+/* Fills in up to `count` elements of `dest` with the segments at the start of
+ * the rope, and returns how many elements we filled in.  The iovecs are only
+ * valid until you next change the rope. */
+CORK_API size_t
+cork_rope_to_iovec(const struct cork_rope *rope, struct iovec *dest,
+                   size_t count);
+
+/* Copies the contents of the rope onto the end of `dest`. */
+CORK_API void
+cork_rope_append_to_buffer(const struct cork_rope *rope,
+                           struct cork_buffer *dest);
+
+/* Writes the entire contents of the rope to `fd` using as few writev calls as
+ * possible, removing each segment from the rope once it's written.  If there's
+ * an error, the rope will only contain the data that wasn't written. */
+CORK_API int
+cork_rope_write_fd(struct cork_rope *rope, int fd);
+
+
+#endif /* LIBCORK_DS_ROPE_H */
@@ -11,6 +11,7 @@
 #define LIBCORK_DS_STREAM_H
 
 #include <stdio.h>
+#include <sys/uio.h>
 
 #include <libcork/core/api.h>
 #include <libcork/core/attributes.h>
@@ -29,6 +30,41 @@ struct cork_stream_consumer {
     (*free)(struct cork_stream_consumer *consumer);
 };
 
+/* A stream consumer that can also process several chunks of data at once.
+ * You must fill this in with cork_stream_consumer_v_init, which is how
+ * cork_stream_consumer_data_v knows that the consumer has a data_v method;
+ * plain stream consumers don't have to change at all. */
+struct cork_stream_consumer_v {
+    struct cork_stream_consumer  parent;
+
+    /* Processes several chunks of data at once, exactly as if each non-empty
+     * one had been passed to the data method in turn.  is_first_chunk applies
+     * to the first non-empty chunk. */
+    int
+    (*data_v)(struct cork_stream_consumer *consumer,
+              const struct iovec *iov, size_t count, bool is_first_chunk);
+
+    /* The consumer's eof method.  parent.eof is a wrapper that calls this. */
+    int
+    (*eof)(struct cork_stream_consumer *consumer);
+};
+
+CORK_API void
+cork_stream_consumer_v_init
+    (struct cork_stream_consumer_v *consumer,
+     int (*data)(struct cork_stream_consumer *consumer,
+                 const void *buf, size_t size, bool is_first_chunk),
+     int (*data_v)(struct cork_stream_consumer *consumer,
+                   const struct iovec *iov, size_t count,
+                   bool is_first_chunk),
+     int (*eof)(struct cork_stream_consumer *consumer),
+     void (*free)(struct cork_stream_consumer *consumer));
+
+/* Returns `consumer` as a vectored stream consumer, or NULL if it wasn't
+ * created with cork_stream_consumer_v_init. */
+CORK_API struct cork_stream_consumer_v *
+cork_stream_consumer_get_v(struct cork_stream_consumer *consumer);
+
 
 CORK_INLINE
 int
@@ -38,6 +74,13 @@ cork_stream_consumer_data(struct cork_stream_consumer* consumer,
     return consumer->data(consumer, buf, size, is_first_chunk);
 }
 
+/* Sends several chunks of data at once.  If the consumer isn't a vectored
+ * consumer, we pass each non-empty chunk to its data method instead. */
+CORK_API int
+cork_stream_consumer_data_v(struct cork_stream_consumer *consumer,
+                            const struct iovec *iov, size_t count,
+                            bool is_first_chunk);
+
 CORK_INLINE
 int
 cork_stream_consumer_eof(struct cork_stream_consumer *consumer)
@@ -37,6 +37,26 @@
 #define cork_size_cas              __sync_val_compare_and_swap
 #define cork_ptr_cas               __sync_val_compare_and_swap
 
+/* Loads have acquire semantics, and stores have release semantics.  The
+ * __atomic intrinsics are available as of GCC 4.7; before that, we fall back
+ * on the (more expensive) full barriers provided by the __sync intrinsics. */
+#if defined(__ATOMIC_ACQUIRE)
+#define cork_atomic_load(ptr) \
+    __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define cork_atomic_store(ptr, value) \
+    __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#else
+#define cork_atomic_load(ptr) \
+    __sync_fetch_and_add((ptr), 0)
+#define cork_atomic_store(ptr, value) \
+    do { \
+        __sync_synchronize(); \
+        *(ptr) = (value); \
+    } while (0)
+#endif
+
+#define cork_memory_barrier        __sync_synchronize
+
 
 /*-----------------------------------------------------------------------
  * End of atomic implementations
@@ -0,0 +1,409 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "libcork/cli.h"
+#include "libcork/core.h"
+#include "libcork/ds.h"
+
+
+#define streq(s1, s2)  (strcmp((s1), (s2)) == 0)
+
+
+/*-----------------------------------------------------------------------
+ * Timing helpers
+ */
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+report(const char *engine, const char *phase, size_t count, uint64_t elapsed)
+{
+    printf("%-12s %-16s %10zu ops %10.2f ns/op\n",
+           engine, phase, count, (double) elapsed / count);
+}
+
+/* Keeps the compiler from optimizing away the results that we compute in our
+ * benchmark loops. */
+static volatile uintptr_t  sink;
+
+
+/*-----------------------------------------------------------------------
+ * Hash tables
+ */
+
+static size_t  hash_table_count = 1000000;
+
+static int
+hash_table_options(int argc, char **argv);
+
+static void
+hash_table_run(int argc, char **argv);
+
+static struct cork_command  hash_table =
+    cork_leaf_command("hash-table", "Benchmark hash table engines",
+                      "[-n <count>]",
+                      "Compares the chained and flat hash table engines, and the\n"
+                      "incremental resizing and pooled allocation modes of\n"
+                      "the chained engine.  Also compares string tables that\n"
+                      "use the default and keyed hash functions.\n",
+                      hash_table_options, hash_table_run);
+
+static int
+hash_table_options(int argc, char **argv)
+{
+    if (argc >= 3 && (streq(argv[1], "-n") || streq(argv[1], "--count"))) {
+        hash_table_count = strtoul(argv[2], NULL, 10);
+        if (hash_table_count == 0) {
+            cork_command_show_help(&hash_table, "Invalid --count");
+            exit(EXIT_FAILURE);
+        }
+        return 3;
+    }
+    return 1;
+}
+
+static cork_hash
+bench_uintptr_hash(void *user_data, const void *vkey)
+{
+    uintptr_t  key = (uintptr_t) vkey;
+    return cork_hash_buffer(0, &key, sizeof(key));
+}
+
+static bool
+bench_uintptr_equals(void *user_data, const void *vkey1, const void *vkey2)
+{
+    return vkey1 == vkey2;
+}
+
+static void
+bench_hash_table(const char *engine, unsigned int flags,
+                 struct cork_mempool *entry_pool,
+                 const uintptr_t *keys, size_t count)
+{
+    struct cork_hash_table  *table = cork_hash_table_new(0, flags);
+    struct cork_hash_table_iterator  iterator;
+    struct cork_hash_table_entry  *entry;
+    uintptr_t  sum = 0;
+    uint64_t  start;
+    uint64_t  worst = 0;
+    size_t  i;
+
+    cork_hash_table_set_hash(table, bench_uintptr_hash);
+    cork_hash_table_set_equals(table, bench_uintptr_equals);
+    cork_hash_table_set_allocator(table, entry_pool);
+
+    start = now_ns();
+    for (i = 0; i < count; i++) {
+        uint64_t  op_start = now_ns();
+        uint64_t  op_elapsed;
+        cork_hash_table_put
+            (table, (void *) keys[i], (void *) keys[i], NULL, NULL, NULL);
+        op_elapsed = now_ns() - op_start;
+        if (op_elapsed > worst) {
+            worst = op_elapsed;
+        }
+    }
+    report(engine, "insert", count, now_ns() - start);
+    report(engine, "insert (worst)", 1, worst);
+
+    start = now_ns();
+    for (i = 0; i < count; i++) {
+        sum += (uintptr_t) cork_hash_table_get(table, (void *) keys[i]);
+    }
+    report(engine, "get (hit)", count, now_ns() - start);
+
+    start = now_ns();
+    for (i = 0; i < count; i++) {
+        sum += (uintptr_t) cork_hash_table_get(table, (void *) ~keys[i]);
+    }
+    report(engine, "get (miss)", count, now_ns() - start);
+
+    start = now_ns();
+    cork_hash_table_iterator_init(table, &iterator);
+    while ((entry = cork_hash_table_iterator_next(&iterator)) != NULL) {
+        sum += (uintptr_t) entry->value;
+    }
+    report(engine, "iterate", count, now_ns() - start);
+
+    start = now_ns();
+    for (i = 0; i < count; i++) {
+        cork_hash_table_delete(table, (void *) keys[i], NULL, NULL);
+    }
+    report(engine, "delete", count, now_ns() - start);
+
+    sink = sum;
+    cork_hash_table_free(table);
+}
+
+static void
+bench_string_hash_table(const char *engine, unsigned int flags,
+                        const char * const *keys, size_t count)
+{
+    struct cork_hash_table  *table = cork_string_hash_table_new(0, flags);
+    uintptr_t  sum = 0;
+    uint64_t  start;
+    size_t  i;
+
+    start = now_ns();
+    for (i = 0; i < count; i++) {
+        cork_hash_table_put
+            (table, (void *) keys[i], (void *) (uintptr_t) i,
+             NULL, NULL, NULL);
+    }
+    report(engine, "insert", count, now_ns() - start);
+
+    start = now_ns();
+    for (i = 0; i < count; i++) {
+        sum += (uintptr_t) cork_hash_table_get(table, keys[i]);
+    }
+    report(engine, "get (hit)", count, now_ns() - start);
+
+    sink = sum;
+    cork_hash_table_free(table);
+}
+
+static void
+hash_table_run(int argc, char **argv)
+{
+    struct cork_mempool  *entry_pool;
+    uintptr_t  *keys;
+    const char  **string_keys;
+    size_t  i;
+
+    if (argc != 0) {
+        cork_command_show_help(&hash_table, NULL);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Use keys that are spread out, like pointers usually are, so that the
+     * keys we look up for misses can't collide with them. */
+    keys = cork_calloc(hash_table_count, sizeof(uintptr_t));
+    for (i = 0; i < hash_table_count; i++) {
+        keys[i] = (i + 1) * 64;
+    }
+
+    bench_hash_table("chained", 0, NULL, keys, hash_table_count);
+    bench_hash_table
+        ("flat", CORK_HASH_TABLE_FLAT, NULL, keys, hash_table_count);
+    bench_hash_table
+        ("incremental", CORK_HASH_TABLE_INCREMENTAL, NULL,
+         keys, hash_table_count);
+
+    entry_pool = cork_hash_table_entry_mempool_new();
+    bench_hash_table("pooled", 0, entry_pool, keys, hash_table_count);
+    cork_mempool_free(entry_pool);
+
+    cork_cfree(keys, hash_table_count, sizeof(uintptr_t));
+
+    string_keys = cork_calloc(hash_table_count, sizeof(const char *));
+    for (i = 0; i < hash_table_count; i++) {
+        char  key[64];
+        snprintf(key, sizeof(key), "/api/v1/users/%zu/profile", i);
+        string_keys[i] = cork_strdup(key);
+    }
+    bench_string_hash_table("string", 0, string_keys, hash_table_count);
+    bench_string_hash_table
+        ("keyed string", CORK_HASH_TABLE_KEYED, string_keys, hash_table_count);
+    for (i = 0; i < hash_table_count; i++) {
+        cork_strfree(string_keys[i]);
+    }
+    cork_cfree(string_keys, hash_table_count, sizeof(const char *));
+    exit(EXIT_SUCCESS);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Allocators
+ */
+
+static size_t  alloc_count = 1000000;
+
+static int
+alloc_options(int argc, char **argv);
+
+static void
+alloc_run(int argc, char **argv);
+
+static struct cork_command  alloc =
+    cork_leaf_command("alloc", "Benchmark allocators",
+                      "[-n <count>]",
+                      "Compares the slab allocator against the C library's\n"
+                      "malloc, using objects the size of libcork's own data\n"
+                      "structures.  Each allocator runs in a separate child\n"
+                      "process, so that their resident set sizes can be\n"
+                      "compared.\n",
+                      alloc_options, alloc_run);
+
+static int
+alloc_options(int argc, char **argv)
+{
+    if (argc >= 3 && (streq(argv[1], "-n") || streq(argv[1], "--count"))) {
+        alloc_count = strtoul(argv[2], NULL, 10);
+        if (alloc_count == 0) {
+            cork_command_show_help(&alloc, "Invalid --count");
+            exit(EXIT_FAILURE);
+        }
+        return 3;
+    }
+    return 1;
+}
+
+/* Returns the current resident set size in bytes, or 0 if we can't tell. */
+static size_t
+resident_size(void)
+{
+    FILE  *statm = fopen("/proc/self/statm", "r");
+    unsigned long  total;
+    unsigned long  resident = 0;
+    if (statm == NULL) {
+        return 0;
+    }
+    if (fscanf(statm, "%lu %lu", &total, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* The sizes of some of the small objects that libcork allocates: chained hash
+ * table entries, buffers, dllist items, and short strings (which have a size_t
+ * header). */
+static const size_t  alloc_sizes[] = {
+    sizeof(struct cork_hash_table_entry) + sizeof(struct cork_dllist_item),
+    sizeof(struct cork_buffer),
+    sizeof(struct cork_dllist_item),
+    sizeof(size_t) + 8,
+    sizeof(size_t) + 24,
+    sizeof(size_t) + 56,
+    sizeof(struct cork_hash_table_entry),
+    sizeof(size_t) + 120
+};
+
+#define alloc_size(i) \
+    (alloc_sizes[(i) % (sizeof(alloc_sizes) / sizeof(alloc_sizes[0]))])
+
+static void
+bench_alloc(const char *engine, const struct cork_alloc *alloc)
+{
+    void  **objects = cork_calloc(alloc_count, sizeof(void *));
+    size_t  *sizes = cork_calloc(alloc_count, sizeof(size_t));
+    size_t  rss_before;
+    size_t  live_bytes = 0;
+    uint64_t  rng = 0x9e3779b97f4a7c15ULL;
+    uint64_t  start;
+    size_t  i;
+
+    /* Touch our own bookkeeping arrays before measuring the baseline, so that
+     * they don't count towards the allocator's footprint. */
+    memset(objects, 0, alloc_count * sizeof(void *));
+    for (i = 0; i < alloc_count; i++) {
+        sizes[i] = alloc_size(i);
+    }
+    rss_before = resident_size();
+
+    start = now_ns();
+    for (i = 0; i < alloc_count; i++) {
+        objects[i] = cork_alloc_malloc(alloc, sizes[i]);
+        memset(objects[i], 0, sizes[i]);
+        live_bytes += sizes[i];
+    }
+    report(engine, "allocate", alloc_count, now_ns() - start);
+    printf("%-12s %-16s %10zu KB live %10zu KB resident\n",
+           engine, "footprint", live_bytes / 1024,
+           (resident_size() - rss_before) / 1024);
+
+    /* Free random objects and replace them with new ones of a different
+     * size, so that objects keep moving between size classes. */
+    start = now_ns();
+    for (i = 0; i < alloc_count; i++) {
+        size_t  index;
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        index = rng % alloc_count;
+        cork_alloc_free(alloc, objects[index], sizes[index]);
+        sizes[index] = alloc_size(index + i);
+        objects[index] = cork_alloc_malloc(alloc, sizes[index]);
+        *(char *) objects[index] = 0;
+    }
+    report(engine, "churn", alloc_count, now_ns() - start);
+
+    start = now_ns();
+    for (i = 0; i < alloc_count; i++) {
+        cork_alloc_free(alloc, objects[i], sizes[i]);
+    }
+    report(engine, "free", alloc_count, now_ns() - start);
+
+    cork_cfree(sizes, alloc_count, sizeof(size_t));
+    cork_cfree(objects, alloc_count, sizeof(void *));
+}
+
+static void
+bench_alloc_in_child(const char *engine, const struct cork_alloc *alloc)
+{
+    pid_t  pid;
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        bench_alloc(engine, alloc);
+        fflush(stdout);
+        _exit(EXIT_SUCCESS);
+    } else if (pid > 0) {
+        waitpid(pid, NULL, 0);
+    } else {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+alloc_run(int argc, char **argv)
+{
+    if (argc != 0) {
+        cork_command_show_help(&alloc, NULL);
+        exit(EXIT_FAILURE);
+    }
+
+    bench_alloc_in_child("malloc", cork_allocator);
+    bench_alloc_in_child("slab", cork_slab_alloc_new(cork_allocator));
+    exit(EXIT_SUCCESS);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Main program
+ */
+
+static struct cork_command  *root_subcommands[] = {
+    &alloc,
+    &hash_table,
+    NULL
+};
+
+static struct cork_command  root_command =
+    cork_command_set("cork-bench", NULL, NULL, root_subcommands);
+
+int
+main(int argc, char **argv)
+{
+    return cork_command_main(&root_command, argc, argv);
+}
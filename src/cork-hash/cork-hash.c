@@ -11,24 +11,51 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define HAVE_RDTSC  1
+#else
+#define HAVE_RDTSC  0
+#endif
 
 #include <libcork/core.h>
 
 enum cork_hash_type {
     CORK_HASH_BIG,
     CORK_HASH_FASTEST,
-    CORK_HASH_STABLE
+    CORK_HASH_STABLE,
+    CORK_HASH_WIDE,
+    CORK_HASH_KEYED
+};
+
+enum cork_hash_mode {
+    CORK_HASH_MODE_STRING,
+    CORK_HASH_MODE_BENCHMARK,
+    CORK_HASH_MODE_QUALITY
 };
 
 static enum cork_hash_type  type = CORK_HASH_STABLE;
+static bool  type_given = false;
+static enum cork_hash_mode  mode = CORK_HASH_MODE_STRING;
+static size_t  max_size = 1024 * 1024;
 static const char  *string = NULL;
 
 #define OPT_VERSION 1000
+#define OPT_BENCHMARK 1001
+#define OPT_QUALITY 1002
+#define OPT_MAX_SIZE 1003
 
 static struct option  opts[] = {
     { "big", no_argument, NULL, 'b' },
     { "fastest", no_argument, NULL, 'f' },
     { "stable", no_argument, NULL, 's' },
+    { "wide", no_argument, NULL, 'w' },
+    { "keyed", no_argument, NULL, 'k' },
+    { "benchmark", no_argument, NULL, OPT_BENCHMARK },
+    { "quality", no_argument, NULL, OPT_QUALITY },
+    { "max-size", required_argument, NULL, OPT_MAX_SIZE },
     { "version", no_argument, NULL, OPT_VERSION },
     { NULL, 0, NULL, 0 }
 };
@@ -38,11 +65,24 @@ usage(void)
 {
     fprintf(stderr,
             "Usage: cork-hash [<options>] <string>\n"
+            "       cork-hash --benchmark [--max-size <bytes>] [<options>]\n"
+            "       cork-hash --quality [<options>]\n"
             "\n"
             "Options:\n"
             "  -b, --big\n"
             "  -f, --fastest\n"
-            "  -s, --stable\n");
+            "  -s, --stable\n"
+            "  -w, --wide\n"
+            "  -k, --keyed\n"
+            "\n"
+            "--keyed hashes the string with SipHash-1-3, using an all-zero\n"
+            "key.\n"
+            "\n"
+            "--benchmark measures the throughput of each hash function for\n"
+            "inputs from 1 byte up to --max-size (default 1MB).  --quality\n"
+            "measures how well each hash function avalanches, and how evenly\n"
+            "it spreads keys across the bins of a hash table.  Both modes\n"
+            "test every hash function unless you select one.\n");
 }
 
 static void
@@ -61,16 +101,40 @@ static void
 parse_options(int argc, char **argv)
 {
     int  ch;
-    while ((ch = getopt_long(argc, argv, "+bfs", opts, NULL)) != -1) {
+    while ((ch = getopt_long(argc, argv, "+bfswk", opts, NULL)) != -1) {
         switch (ch) {
             case 'b':
                 type = CORK_HASH_BIG;
+                type_given = true;
                 break;
             case 'f':
                 type = CORK_HASH_FASTEST;
+                type_given = true;
                 break;
             case 's':
                 type = CORK_HASH_STABLE;
+                type_given = true;
+                break;
+            case 'w':
+                type = CORK_HASH_WIDE;
+                type_given = true;
+                break;
+            case 'k':
+                type = CORK_HASH_KEYED;
+                type_given = true;
+                break;
+            case OPT_BENCHMARK:
+                mode = CORK_HASH_MODE_BENCHMARK;
+                break;
+            case OPT_QUALITY:
+                mode = CORK_HASH_MODE_QUALITY;
+                break;
+            case OPT_MAX_SIZE:
+                max_size = strtoul(optarg, NULL, 10);
+                if (max_size == 0) {
+                    usage();
+                    exit(EXIT_FAILURE);
+                }
                 break;
             case OPT_VERSION:
                 print_version();
@@ -81,6 +145,14 @@ parse_options(int argc, char **argv)
         }
     }
 
+    if (mode != CORK_HASH_MODE_STRING) {
+        if (optind != argc) {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+
     if (optind != argc-1) {
         usage();
         exit(EXIT_FAILURE);
@@ -89,11 +161,381 @@ parse_options(int argc, char **argv)
     string = argv[optind];
 }
 
+
+/*-----------------------------------------------------------------------
+ * Hash families
+ */
+
+struct hash_family {
+    const char  *name;
+    enum cork_hash_type  type;
+    /* The number of bits in each hash value */
+    unsigned int  bits;
+    /* Fills in the first (bits/64) elements of dest, rounding up */
+    void
+    (*hash)(uint64_t seed, const void *src, size_t len, uint64_t *dest);
+};
+
+static void
+hash_big(uint64_t seed, const void *src, size_t len, uint64_t *dest)
+{
+    cork_big_hash  big_seed = {cork_u128_from_64(0, seed)};
+    cork_big_hash  result = cork_big_hash_buffer(big_seed, src, len);
+    dest[0] = cork_u128_be64(result.u128, 1);
+    dest[1] = cork_u128_be64(result.u128, 0);
+}
+
+static void
+hash_fastest(uint64_t seed, const void *src, size_t len, uint64_t *dest)
+{
+    dest[0] = cork_hash_buffer((cork_hash) seed, src, len);
+}
+
+static void
+hash_stable(uint64_t seed, const void *src, size_t len, uint64_t *dest)
+{
+    dest[0] = cork_stable_hash_buffer((cork_hash) seed, src, len);
+}
+
+static void
+hash_wide(uint64_t seed, const void *src, size_t len, uint64_t *dest)
+{
+    dest[0] = cork_hash64_buffer(seed, src, len);
+}
+
+/* The keyed families use the seed as the first half of the key, so that the
+ * results are reproducible. */
+static void
+hash_siphash(uint64_t seed, const void *src, size_t len, uint64_t *dest)
+{
+    uint8_t  key[CORK_SIPHASH_KEY_SIZE] = { 0 };
+    memcpy(key, &seed, sizeof(seed));
+    dest[0] = cork_siphash13(key, src, len);
+}
+
+static void
+hash_halfsiphash(uint64_t seed, const void *src, size_t len, uint64_t *dest)
+{
+    uint8_t  key[CORK_HALFSIPHASH_KEY_SIZE];
+    memcpy(key, &seed, sizeof(seed));
+    dest[0] = cork_halfsiphash13(key, src, len);
+}
+
+static const struct hash_family  families[] = {
+    { "big", CORK_HASH_BIG, 128, hash_big },
+    { "fastest", CORK_HASH_FASTEST, 32, hash_fastest },
+    { "stable", CORK_HASH_STABLE, 32, hash_stable },
+    { "wide", CORK_HASH_WIDE, 64, hash_wide },
+    { "siphash", CORK_HASH_KEYED, 64, hash_siphash },
+    { "halfsip", CORK_HASH_KEYED, 32, hash_halfsiphash },
+    { NULL, 0, 0, NULL }
+};
+
+static bool
+family_selected(const struct hash_family *family)
+{
+    return !type_given || family->type == type;
+}
+
+/* A small deterministic PRNG (splitmix64), so that the quality results are
+ * reproducible. */
+static uint64_t
+next_random(uint64_t *state)
+{
+    uint64_t  z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+static void
+fill_random(uint64_t *state, uint8_t *buf, size_t len)
+{
+    size_t  i;
+    for (i = 0; i < len; i++) {
+        buf[i] = (uint8_t) next_random(state);
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Benchmarks
+ */
+
+/* Each measurement runs for at least this long */
+#define BENCHMARK_MIN_NS  20000000
+
+/* Keeps the compiler from optimizing away the hashes that we compute. */
+static volatile uint64_t  sink;
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t
+now_cycles(void)
+{
+#if HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void
+benchmark_one(const struct hash_family *family, const uint8_t *buf,
+              size_t len)
+{
+    size_t  iterations = 1;
+    uint64_t  elapsed_ns;
+    uint64_t  elapsed_cycles;
+
+    for (;;) {
+        uint64_t  result[2] = { 0, 0 };
+        uint64_t  start_ns = now_ns();
+        uint64_t  start_cycles = now_cycles();
+        size_t  i;
+        for (i = 0; i < iterations; i++) {
+            family->hash(i, buf, len, result);
+            sink += result[0];
+        }
+        elapsed_cycles = now_cycles() - start_cycles;
+        elapsed_ns = now_ns() - start_ns;
+        if (elapsed_ns >= BENCHMARK_MIN_NS) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    printf("%-8s %8zu %10.3f", family->name, len,
+           (double) len * iterations / elapsed_ns);
+    if (HAVE_RDTSC) {
+        printf(" %14.1f\n", (double) elapsed_cycles / iterations);
+    } else {
+        printf(" %14s\n", "-");
+    }
+}
+
+static void
+benchmark(void)
+{
+    const struct hash_family  *family;
+    uint64_t  random_state = 0;
+    uint8_t  *buf = cork_malloc(max_size);
+    fill_random(&random_state, buf, max_size);
+
+    printf("%-8s %8s %10s %14s\n", "family", "bytes", "GB/s", "cycles/hash");
+    for (family = families; family->name != NULL; family++) {
+        size_t  len;
+        if (!family_selected(family)) {
+            continue;
+        }
+        for (len = 1; len <= max_size; len *= 4) {
+            benchmark_one(family, buf, len);
+        }
+    }
+
+    cork_free(buf, max_size);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Quality tests
+ */
+
+#define AVALANCHE_TRIALS  2000
+#define AVALANCHE_MAX_LENGTH  64
+
+/* Flips each bit of a bunch of random keys, and counts how often each bit of
+ * the hash changes.  Ideally every output bit changes half of the time.  We
+ * report the worst and mean bias for any (input bit, output bit) pair, where 0
+ * means that the output bit flips exactly half of the time, and 1 means that it
+ * always or never flips. */
+static void
+avalanche(const struct hash_family *family, size_t len)
+{
+    size_t  input_bits = len * 8;
+    size_t  count_size = input_bits * family->bits * sizeof(uint32_t);
+    uint32_t  *counts = cork_malloc(count_size);
+    uint8_t  key[AVALANCHE_MAX_LENGTH];
+    uint64_t  random_state = len;
+    double  worst = 0.0;
+    double  total = 0.0;
+    size_t  trial;
+    size_t  i;
+    size_t  j;
+
+    memset(counts, 0, count_size);
+    for (trial = 0; trial < AVALANCHE_TRIALS; trial++) {
+        uint64_t  original[2] = { 0, 0 };
+        fill_random(&random_state, key, len);
+        family->hash(0, key, len, original);
+        for (i = 0; i < input_bits; i++) {
+            uint64_t  flipped[2] = { 0, 0 };
+            key[i / 8] ^= (1 << (i % 8));
+            family->hash(0, key, len, flipped);
+            key[i / 8] ^= (1 << (i % 8));
+            for (j = 0; j < family->bits; j++) {
+                uint64_t  diff = original[j / 64] ^ flipped[j / 64];
+                counts[i * family->bits + j] += (diff >> (j % 64)) & 1;
+            }
+        }
+    }
+
+    for (i = 0; i < input_bits * family->bits; i++) {
+        double  bias = 2.0 * counts[i] / AVALANCHE_TRIALS - 1.0;
+        if (bias < 0) {
+            bias = -bias;
+        }
+        total += bias;
+        if (bias > worst) {
+            worst = bias;
+        }
+    }
+
+    printf("%-8s avalanche %2zu-byte keys         worst bias %.3f"
+           "  mean bias %.3f\n",
+           family->name, len, worst, total / (input_bits * family->bits));
+    cork_free(counts, count_size);
+}
+
+#define BUCKET_KEY_COUNT  65536
+
+/* The kinds of keys that we put into hash tables */
+enum key_set {
+    KEYS_SEQUENTIAL_32,
+    KEYS_SEQUENTIAL_64,
+    KEYS_IPV4,
+    KEYS_STRINGS,
+    KEYS_RANDOM_16
+};
+
+static const char  *key_set_names[] = {
+    "sequential 32-bit",
+    "sequential 64-bit",
+    "ipv4 10.0.0.0/16",
+    "decimal strings",
+    "random 16-byte"
+};
+
+static size_t
+make_key(enum key_set set, uint64_t *random_state, uint32_t i, uint8_t *key)
+{
+    switch (set) {
+        case KEYS_SEQUENTIAL_32:
+        {
+            uint32_t  value = CORK_UINT32_HOST_TO_LITTLE(i);
+            memcpy(key, &value, sizeof(value));
+            return sizeof(value);
+        }
+        case KEYS_SEQUENTIAL_64:
+        {
+            uint64_t  value = CORK_UINT64_HOST_TO_LITTLE((uint64_t) i << 32);
+            memcpy(key, &value, sizeof(value));
+            return sizeof(value);
+        }
+        case KEYS_IPV4:
+        {
+            key[0] = 10;
+            key[1] = 0;
+            key[2] = (uint8_t) (i >> 8);
+            key[3] = (uint8_t) i;
+            return 4;
+        }
+        case KEYS_STRINGS:
+            return sprintf((char *) key, "key%" PRIu32, i);
+        case KEYS_RANDOM_16:
+            fill_random(random_state, key, 16);
+            return 16;
+        default:
+            cork_unreachable();
+    }
+}
+
+/* Puts a set of keys into `bin_count` bins, using the low bits of the hash
+ * like cork_hash_table does, and reports the chi-squared statistic divided by
+ * its degrees of freedom (which should be close to 1.0), and the fullest bin's
+ * load relative to the average. */
+static void
+bucket_distribution(const struct hash_family *family, enum key_set set,
+                    size_t bin_count)
+{
+    size_t  *bins = cork_calloc(bin_count, sizeof(size_t));
+    uint64_t  random_state = set;
+    double  expected = (double) BUCKET_KEY_COUNT / bin_count;
+    double  chi2 = 0.0;
+    size_t  fullest = 0;
+    uint32_t  i;
+
+    for (i = 0; i < BUCKET_KEY_COUNT; i++) {
+        uint8_t  key[32];
+        uint64_t  hash[2] = { 0, 0 };
+        size_t  len = make_key(set, &random_state, i, key);
+        family->hash(0, key, len, hash);
+        bins[hash[0] & (bin_count - 1)]++;
+    }
+
+    for (i = 0; i < bin_count; i++) {
+        double  diff = bins[i] - expected;
+        chi2 += diff * diff / expected;
+        if (bins[i] > fullest) {
+            fullest = bins[i];
+        }
+    }
+
+    printf("%-8s buckets %-18s mask 0x%04zx  chi2/df %.3f  max load %.2fx\n",
+           family->name, key_set_names[set], bin_count - 1,
+           chi2 / (bin_count - 1), fullest / expected);
+    cork_cfree(bins, bin_count, sizeof(size_t));
+}
+
+static void
+quality(void)
+{
+    static const size_t  avalanche_lengths[] = { 4, 8, 16, 64 };
+    /* An average load of 4 entries per bin (roughly where a chained table sits
+     * just before it grows), and of 1 entry per bin. */
+    static const size_t  bin_counts[] = {
+        BUCKET_KEY_COUNT / 4, BUCKET_KEY_COUNT
+    };
+    const struct hash_family  *family;
+
+    for (family = families; family->name != NULL; family++) {
+        size_t  i;
+        size_t  j;
+        if (!family_selected(family)) {
+            continue;
+        }
+        for (i = 0; i < sizeof(avalanche_lengths) / sizeof(size_t); i++) {
+            avalanche(family, avalanche_lengths[i]);
+        }
+        for (i = KEYS_SEQUENTIAL_32; i <= KEYS_RANDOM_16; i++) {
+            for (j = 0; j < sizeof(bin_counts) / sizeof(size_t); j++) {
+                bucket_distribution(family, i, bin_counts[j]);
+            }
+        }
+    }
+}
+
 int
 main(int argc, char **argv)
 {
     parse_options(argc, argv);
 
+    if (mode == CORK_HASH_MODE_BENCHMARK) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == CORK_HASH_MODE_QUALITY) {
+        quality();
+        return EXIT_SUCCESS;
+    }
+
     if (type == CORK_HASH_BIG) {
         cork_big_hash  result = CORK_BIG_HASH_INIT();
         result = cork_big_hash_buffer(result, string, strlen(string));
@@ -116,5 +558,16 @@ main(int argc, char **argv)
         printf("0x%08" PRIx32 "\n", result);
     }
 
+    if (type == CORK_HASH_WIDE) {
+        uint64_t  result = cork_hash64_buffer(0, string, strlen(string));
+        printf("0x%016" PRIx64 "\n", result);
+    }
+
+    if (type == CORK_HASH_KEYED) {
+        uint8_t  key[CORK_SIPHASH_KEY_SIZE] = { 0 };
+        uint64_t  result = cork_siphash13(key, string, strlen(string));
+        printf("0x%016" PRIx64 "\n", result);
+    }
+
     return EXIT_SUCCESS;
 }
@@ -8,6 +8,7 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -16,7 +17,14 @@
 #include "libcork/core/attributes.h"
 #include "libcork/core/error.h"
 #include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
 #include "libcork/os/process.h"
+#include "libcork/threads/atomics.h"
+#include "libcork/threads/basics.h"
+
+#if CORK_HAVE_BACKTRACE
+#include <execinfo.h>
+#endif
 
 
 /*-----------------------------------------------------------------------
@@ -422,6 +430,1226 @@ cork_debug_alloc_new(const struct cork_alloc *parent)
     return debug;
 }
 
+/*-----------------------------------------------------------------------
+ * Arena allocator
+ */
+
+/* All arena allocations are aligned to this many bytes. */
+#define CORK_ARENA_ALIGNMENT  16
+
+#define cork_arena_align(size) \
+    (((size) + (CORK_ARENA_ALIGNMENT - 1)) & \
+     ~((size_t) (CORK_ARENA_ALIGNMENT - 1)))
+
+/* Requests larger than this fraction of the chunk size get a chunk of their
+ * own, so that they don't waste the rest of the current chunk. */
+#define CORK_ARENA_LARGE_FRACTION  4
+
+struct cork_arena_chunk {
+    struct cork_arena_chunk  *next;
+    size_t  size;
+};
+
+/* The parent allocator might not align things as strictly as we do, so we
+ * leave room to round the start of the chunk's data up to our alignment. */
+#define cork_arena_chunk_alloc_size(size) \
+    (sizeof(struct cork_arena_chunk) + (size) + (CORK_ARENA_ALIGNMENT - 1))
+
+#define cork_arena_chunk_data(chunk) \
+    ((char *) cork_arena_align((uintptr_t) ((chunk) + 1)))
+
+struct cork_arena {
+    const struct cork_alloc  *parent;
+    size_t  chunk_size;
+    /* The chunk we're currently bump-allocating from is always first. */
+    struct cork_arena_chunk  *chunks;
+    char  *next;
+    char  *end;
+    /* The most recent allocation, which is the only one that we can grow,
+     * shrink, or free in place. */
+    char  *last;
+    /* If the most recent allocation was large enough to get a chunk of its
+     * own, this is that chunk.  It's always either the first or the second
+     * chunk in the list. */
+    struct cork_arena_chunk  *last_chunk;
+};
+
+static struct cork_arena_chunk *
+cork_arena_new_chunk(struct cork_arena *arena, size_t size)
+{
+    struct cork_arena_chunk  *chunk = cork_alloc_xmalloc
+        (arena->parent, cork_arena_chunk_alloc_size(size));
+    if (CORK_UNLIKELY(chunk == NULL)) {
+        return NULL;
+    }
+    chunk->size = size;
+    return chunk;
+}
+
+static void
+cork_arena_free_chunk(struct cork_arena *arena, struct cork_arena_chunk *chunk)
+{
+    cork_alloc_free
+        (arena->parent, chunk, cork_arena_chunk_alloc_size(chunk->size));
+}
+
+static void *
+cork_arena__xmalloc(const struct cork_alloc *alloc, size_t size)
+{
+    struct cork_arena  *arena = alloc->user_data;
+    struct cork_arena_chunk  *chunk;
+    size_t  aligned = cork_arena_align(size);
+
+    /* If there's no current chunk yet, next and end are both NULL, and even a
+     * zero-byte request has to get one so that we don't return NULL. */
+    if (CORK_LIKELY(arena->next != NULL &&
+                    aligned <= (size_t) (arena->end - arena->next))) {
+        arena->last = arena->next;
+        arena->last_chunk = NULL;
+        arena->next += aligned;
+        return arena->last;
+    }
+
+    if (aligned > arena->chunk_size / CORK_ARENA_LARGE_FRACTION) {
+        /* Give large requests their own chunk, and link it in behind the
+         * current chunk so that we can keep filling the current one. */
+        chunk = cork_arena_new_chunk(arena, aligned);
+        if (CORK_UNLIKELY(chunk == NULL)) {
+            return NULL;
+        }
+        if (arena->chunks == NULL) {
+            chunk->next = NULL;
+            arena->chunks = chunk;
+        } else {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        }
+        arena->last = cork_arena_chunk_data(chunk);
+        arena->last_chunk = chunk;
+        return arena->last;
+    }
+
+    chunk = cork_arena_new_chunk(arena, arena->chunk_size);
+    if (CORK_UNLIKELY(chunk == NULL)) {
+        return NULL;
+    }
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->last = cork_arena_chunk_data(chunk);
+    arena->last_chunk = NULL;
+    arena->next = arena->last + aligned;
+    arena->end = arena->last + chunk->size;
+    return arena->last;
+}
+
+/* Returns the link that points at the chunk holding the most recent
+ * allocation, which must be a large one. */
+static struct cork_arena_chunk **
+cork_arena_last_chunk_link(struct cork_arena *arena)
+{
+    if (arena->chunks == arena->last_chunk) {
+        return &arena->chunks;
+    } else {
+        return &arena->chunks->next;
+    }
+}
+
+/* Grows or shrinks the most recent allocation, which must be a large one.  We
+ * can ask the parent allocator to resize its chunk, since nothing else lives
+ * in it. */
+static void *
+cork_arena_realloc_large(struct cork_arena *arena, size_t old_size,
+                         size_t new_size)
+{
+    struct cork_arena_chunk  *chunk = arena->last_chunk;
+    struct cork_arena_chunk  **link = cork_arena_last_chunk_link(arena);
+    size_t  aligned = cork_arena_align(new_size);
+    size_t  old_offset;
+    char  *data;
+
+    if (aligned <= chunk->size) {
+        return arena->last;
+    }
+
+    old_offset = arena->last - (char *) chunk;
+    chunk = cork_alloc_xrealloc
+        (arena->parent, chunk, cork_arena_chunk_alloc_size(chunk->size),
+         cork_arena_chunk_alloc_size(aligned));
+    if (CORK_UNLIKELY(chunk == NULL)) {
+        return NULL;
+    }
+    chunk->size = aligned;
+    *link = chunk;
+
+    /* The new chunk might be aligned differently than the old one. */
+    data = cork_arena_chunk_data(chunk);
+    if (data != (char *) chunk + old_offset) {
+        memmove(data, (char *) chunk + old_offset, old_size);
+    }
+    arena->last = data;
+    arena->last_chunk = chunk;
+    return data;
+}
+
+static void *
+cork_arena__xrealloc(const struct cork_alloc *alloc, void *ptr,
+                     size_t old_size, size_t new_size)
+{
+    struct cork_arena  *arena = alloc->user_data;
+    void  *result;
+
+    if (ptr != NULL && ptr == arena->last) {
+        /* The most recent allocation can grow or shrink in place, as long as
+         * it still fits in its chunk. */
+        if (arena->last_chunk != NULL) {
+            return cork_arena_realloc_large(arena, old_size, new_size);
+        }
+        if (cork_arena_align(new_size) <=
+            (size_t) (arena->end - arena->last)) {
+            arena->next = arena->last + cork_arena_align(new_size);
+            return ptr;
+        }
+    }
+
+    result = cork_arena__xmalloc(alloc, new_size);
+    if (CORK_LIKELY(result != NULL) && ptr != NULL) {
+        memcpy(result, ptr, (new_size < old_size)? new_size: old_size);
+    }
+    return result;
+}
+
+static void
+cork_arena__free(const struct cork_alloc *alloc, void *ptr, size_t size)
+{
+    /* Memory is only reclaimed by cork_arena_reset, except that freeing the
+     * most recent allocation gives its space back right away. */
+    struct cork_arena  *arena = alloc->user_data;
+    if (ptr != NULL && ptr == arena->last) {
+        if (arena->last_chunk != NULL) {
+            /* A large allocation has its chunk all to itself. */
+            struct cork_arena_chunk  **link = cork_arena_last_chunk_link(arena);
+            *link = arena->last_chunk->next;
+            cork_arena_free_chunk(arena, arena->last_chunk);
+            arena->last_chunk = NULL;
+        } else {
+            arena->next = arena->last;
+        }
+        arena->last = NULL;
+    }
+}
+
+static void
+cork_arena_free_chunks(struct cork_arena *arena, bool keep_one)
+{
+    struct cork_arena_chunk  *kept = NULL;
+    struct cork_arena_chunk  *curr;
+    struct cork_arena_chunk  *next;
+
+    for (curr = arena->chunks; curr != NULL; curr = next) {
+        next = curr->next;
+        if (keep_one && kept == NULL && curr->size == arena->chunk_size) {
+            kept = curr;
+        } else {
+            cork_arena_free_chunk(arena, curr);
+        }
+    }
+
+    arena->chunks = kept;
+    arena->last = NULL;
+    arena->last_chunk = NULL;
+    if (kept == NULL) {
+        arena->next = NULL;
+        arena->end = NULL;
+    } else {
+        kept->next = NULL;
+        arena->next = cork_arena_chunk_data(kept);
+        arena->end = arena->next + kept->size;
+    }
+}
+
+static void
+cork_arena__free_user_data(void *user_data)
+{
+    struct cork_arena  *arena = user_data;
+    cork_arena_free_chunks(arena, false);
+    cork_alloc_delete(arena->parent, struct cork_arena, arena);
+}
+
+struct cork_alloc *
+cork_arena_alloc_new(const struct cork_alloc *parent, size_t chunk_size)
+{
+    struct cork_alloc  *alloc = cork_alloc_new_alloc(parent);
+    struct cork_arena  *arena = cork_alloc_new(parent, struct cork_arena);
+    if (chunk_size == 0) {
+        chunk_size = CORK_ARENA_DEFAULT_CHUNK_SIZE;
+    }
+    arena->parent = parent;
+    arena->chunk_size = cork_arena_align(chunk_size);
+    arena->chunks = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+    arena->last = NULL;
+    arena->last_chunk = NULL;
+    cork_alloc_set_user_data(alloc, arena, cork_arena__free_user_data);
+    cork_alloc_set_xmalloc(alloc, cork_arena__xmalloc);
+    cork_alloc_set_xrealloc(alloc, cork_arena__xrealloc);
+    cork_alloc_set_free(alloc, cork_arena__free);
+    return alloc;
+}
+
+void
+cork_arena_reset(const struct cork_alloc *alloc)
+{
+    struct cork_arena  *arena = alloc->user_data;
+    cork_arena_free_chunks(arena, true);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Slab allocator
+ */
+
+/* Objects up to 128 bytes are rounded up to a multiple of 8 bytes; larger
+ * objects are rounded up to a multiple of 16.  (An object whose size isn't a
+ * multiple of 16 can't need 16-byte alignment, so the smaller classes are
+ * still aligned correctly for anything that fits in them.) */
+#define CORK_SLAB_SMALL_MAX_SIZE  128
+#define CORK_SLAB_SMALL_CLASS_COUNT  (CORK_SLAB_SMALL_MAX_SIZE / 8)
+#define CORK_SLAB_CLASS_COUNT \
+    (CORK_SLAB_SMALL_CLASS_COUNT + \
+     (CORK_SLAB_ALLOC_MAX_SIZE - CORK_SLAB_SMALL_MAX_SIZE) / 16)
+
+/* The amount of memory that we request from the parent allocator at a time.
+ * Each chunk is carved into objects of a single size class, but only as
+ * they're needed, so that we don't touch pages before we have to. */
+#define CORK_SLAB_CHUNK_SIZE  65536
+#define CORK_SLAB_ALIGNMENT  16
+
+/* The number of objects that move between a thread cache and the shared free
+ * lists at a time.  Each thread cache can hold two batches' worth of objects
+ * for each size class. */
+#define CORK_SLAB_BATCH_SIZE  32
+#define CORK_SLAB_CACHE_SIZE  (2 * CORK_SLAB_BATCH_SIZE)
+
+/* The number of slab allocators whose caches each thread can find without
+ * taking a lock. */
+#define CORK_SLAB_TLS_ENTRIES  4
+
+/* While an object is free, its first word links it into a free list. */
+struct cork_slab_object {
+    struct cork_slab_object  *next;
+};
+
+struct cork_slab_chunk {
+    struct cork_slab_chunk  *next;
+};
+
+#define cork_slab_chunk_alloc_size() \
+    (sizeof(struct cork_slab_chunk) + CORK_SLAB_CHUNK_SIZE + \
+     (CORK_SLAB_ALIGNMENT - 1))
+
+#define cork_slab_chunk_data(chunk) \
+    ((char *) (((uintptr_t) ((chunk) + 1) + (CORK_SLAB_ALIGNMENT - 1)) & \
+               ~((uintptr_t) (CORK_SLAB_ALIGNMENT - 1))))
+
+struct cork_slab_class {
+    volatile int  lock;
+    struct cork_slab_object  *free_list;
+    /* The part of this class's newest chunk that hasn't been carved into
+     * objects yet. */
+    char  *next;
+    char  *end;
+};
+
+struct cork_slab_cache_class {
+    struct cork_slab_object  *free_list;
+    size_t  count;
+};
+
+/* Each cache is linked into its slab's list of caches and its thread's list
+ * of caches.  Both lists are protected by cork_slab_caches_lock. */
+struct cork_slab_cache {
+    struct cork_slab  *slab;
+    struct cork_slab_cache  *slab_next;
+    struct cork_slab_cache  **slab_prev_next;
+    struct cork_slab_cache  *thread_next;
+    struct cork_slab_cache  **thread_prev_next;
+    struct cork_slab_cache_class  classes[CORK_SLAB_CLASS_COUNT];
+};
+
+struct cork_slab_thread {
+    struct cork_slab_cache  *caches;
+};
+
+struct cork_slab {
+    const struct cork_alloc  *parent;
+    unsigned int  id;
+    /* Protects `chunks`.  (`caches` is protected by cork_slab_caches_lock.) */
+    volatile int  lock;
+    struct cork_slab_chunk  *chunks;
+    struct cork_slab_cache  *caches;
+    struct cork_slab_class  classes[CORK_SLAB_CLASS_COUNT];
+};
+
+struct cork_slab_tls_entry {
+    unsigned int  slab_id;
+    struct cork_slab_cache  *cache;
+};
+
+struct cork_slab_tls {
+    struct cork_slab_tls_entry  entries[CORK_SLAB_TLS_ENTRIES];
+};
+
+/* If we have to fall back on pthread keys, the thread-local table can't come
+ * from cork_allocator, since that might be a slab allocator itself. */
+CORK_ATTR_UNUSED
+static struct cork_slab_tls *
+cork_slab_tls__allocate(void)
+{
+    return calloc(1, sizeof(struct cork_slab_tls));
+}
+
+CORK_ATTR_UNUSED
+static void
+cork_slab_tls__deallocate(void *vself)
+{
+    free(vself);
+}
+
+cork_tls_with_alloc(struct cork_slab_tls, cork_slab_tls,
+                    cork_slab_tls__allocate, cork_slab_tls__deallocate);
+
+static volatile unsigned int  cork_slab_last_id = 0;
+
+/* Protects every slab's and every thread's list of caches.  We only need it
+ * when creating or freeing a cache. */
+static volatile int  cork_slab_caches_lock = 0;
+
+/* Each thread's list of caches is stored in a pthread key, so that we can
+ * release them when the thread exits. */
+static pthread_key_t  cork_slab_thread_key;
+cork_once_barrier(cork_slab_thread_key_barrier);
+
+static inline unsigned int
+cork_slab_class_index(size_t size)
+{
+    if (size <= CORK_SLAB_SMALL_MAX_SIZE) {
+        return (size == 0)? 0: (unsigned int) ((size + 7) / 8) - 1;
+    } else {
+        return CORK_SLAB_SMALL_CLASS_COUNT +
+            (unsigned int) ((size - CORK_SLAB_SMALL_MAX_SIZE + 15) / 16) - 1;
+    }
+}
+
+static size_t
+cork_slab_class_size(unsigned int index)
+{
+    if (index < CORK_SLAB_SMALL_CLASS_COUNT) {
+        return (index + 1) * 8;
+    } else {
+        return CORK_SLAB_SMALL_MAX_SIZE +
+            (index - CORK_SLAB_SMALL_CLASS_COUNT + 1) * 16;
+    }
+}
+
+static void
+cork_slab_lock(volatile int *lock)
+{
+    while (cork_int_cas(lock, 0, 1) != 0) {
+        while (cork_atomic_load(lock)) {
+            cork_pause();
+        }
+    }
+}
+
+static void
+cork_slab_unlock(volatile int *lock)
+{
+    cork_atomic_store(lock, 0);
+}
+
+/* Moves every object in a cache back to the slab's shared free lists.  The
+ * cache can't be in use by any other thread. */
+static void
+cork_slab_cache_flush_all(struct cork_slab *slab, struct cork_slab_cache *cache)
+{
+    unsigned int  index;
+    for (index = 0; index < CORK_SLAB_CLASS_COUNT; index++) {
+        struct cork_slab_cache_class  *cache_class = &cache->classes[index];
+        struct cork_slab_class  *cls = &slab->classes[index];
+        struct cork_slab_object  *tail = cache_class->free_list;
+        if (tail == NULL) {
+            continue;
+        }
+        while (tail->next != NULL) {
+            tail = tail->next;
+        }
+        cork_slab_lock(&cls->lock);
+        tail->next = cls->free_list;
+        cls->free_list = cache_class->free_list;
+        cork_slab_unlock(&cls->lock);
+        cache_class->free_list = NULL;
+        cache_class->count = 0;
+    }
+}
+
+/* Removes a cache from its slab's and its thread's lists.  The caller must
+ * hold cork_slab_caches_lock. */
+static void
+cork_slab_cache_unlink(struct cork_slab_cache *cache)
+{
+    *cache->slab_prev_next = cache->slab_next;
+    if (cache->slab_next != NULL) {
+        cache->slab_next->slab_prev_next = cache->slab_prev_next;
+    }
+    *cache->thread_prev_next = cache->thread_next;
+    if (cache->thread_next != NULL) {
+        cache->thread_next->thread_prev_next = cache->thread_prev_next;
+    }
+}
+
+/* Returns an unlinked cache's objects to its slab, and frees it.  We don't
+ * hold cork_slab_caches_lock while doing this, since the slab's parent might
+ * be a slab allocator too. */
+static void
+cork_slab_cache_free(struct cork_slab_cache *cache)
+{
+    struct cork_slab  *slab = cache->slab;
+    cork_slab_cache_flush_all(slab, cache);
+    cork_alloc_free(slab->parent, cache, sizeof(struct cork_slab_cache));
+}
+
+/* Unlinks every cache in a slab's or a thread's list, and then frees them. */
+static void
+cork_slab_release_caches(struct cork_slab_cache **head)
+{
+    struct cork_slab_cache  *released = NULL;
+    cork_slab_lock(&cork_slab_caches_lock);
+    while (*head != NULL) {
+        struct cork_slab_cache  *cache = *head;
+        cork_slab_cache_unlink(cache);
+        cache->slab_next = released;
+        released = cache;
+    }
+    cork_slab_unlock(&cork_slab_caches_lock);
+    while (released != NULL) {
+        struct cork_slab_cache  *next = released->slab_next;
+        cork_slab_cache_free(released);
+        released = next;
+    }
+}
+
+/* Called when a thread that has used a slab allocator exits. */
+static void
+cork_slab_thread_done(void *vthread)
+{
+    struct cork_slab_thread  *thread = vthread;
+    /* If another thread-exit handler allocates from a slab after this, it
+     * must not find the caches that we're about to free. */
+    memset(cork_slab_tls_get(), 0, sizeof(struct cork_slab_tls));
+    cork_slab_release_caches(&thread->caches);
+    free(thread);
+}
+
+static void
+cork_slab_thread_key_create(void)
+{
+    CORK_ATTR_UNUSED int  rc;
+    rc = pthread_key_create(&cork_slab_thread_key, cork_slab_thread_done);
+    assert(rc == 0);
+}
+
+/* Returns the current thread's list of caches.  This can't come from
+ * cork_allocator, since that might be a slab allocator itself. */
+static struct cork_slab_thread *
+cork_slab_thread_get(void)
+{
+    struct cork_slab_thread  *thread;
+    cork_once(cork_slab_thread_key_barrier, cork_slab_thread_key_create());
+    thread = pthread_getspecific(cork_slab_thread_key);
+    if (thread == NULL) {
+        thread = calloc(1, sizeof(struct cork_slab_thread));
+        if (CORK_UNLIKELY(thread == NULL)) {
+            abort();
+        }
+        pthread_setspecific(cork_slab_thread_key, thread);
+    }
+    return thread;
+}
+
+/* Finds the current thread's cache for slab, or NULL if it doesn't have one.
+ * The caller must hold cork_slab_caches_lock. */
+static struct cork_slab_cache *
+cork_slab_thread_find_cache(struct cork_slab_thread *thread,
+                            struct cork_slab *slab)
+{
+    struct cork_slab_cache  *cache;
+    for (cache = thread->caches; cache != NULL; cache = cache->thread_next) {
+        if (cache->slab == slab) {
+            return cache;
+        }
+    }
+    return NULL;
+}
+
+/* Finds (or creates) the current thread's cache for slab. */
+static struct cork_slab_cache *
+cork_slab_find_cache(struct cork_slab *slab, struct cork_slab_tls_entry *entry)
+{
+    struct cork_slab_thread  *thread;
+    struct cork_slab_cache  *cache;
+
+    cork_slab_lock(&cork_slab_caches_lock);
+    thread = cork_slab_thread_get();
+    cache = cork_slab_thread_find_cache(thread, slab);
+    cork_slab_unlock(&cork_slab_caches_lock);
+
+    if (cache == NULL) {
+        /* Only this thread adds caches to its own list, so no one else can
+         * create this cache while we're not holding the lock. */
+        cache = cork_alloc_calloc
+            (slab->parent, 1, sizeof(struct cork_slab_cache));
+        cork_slab_lock(&cork_slab_caches_lock);
+        cache->slab = slab;
+        cache->slab_next = slab->caches;
+        cache->slab_prev_next = &slab->caches;
+        if (slab->caches != NULL) {
+            slab->caches->slab_prev_next = &cache->slab_next;
+        }
+        slab->caches = cache;
+        cache->thread_next = thread->caches;
+        cache->thread_prev_next = &thread->caches;
+        if (thread->caches != NULL) {
+            thread->caches->thread_prev_next = &cache->thread_next;
+        }
+        thread->caches = cache;
+        cork_slab_unlock(&cork_slab_caches_lock);
+    }
+
+    entry->slab_id = slab->id;
+    entry->cache = cache;
+    return cache;
+}
+
+static inline struct cork_slab_cache *
+cork_slab_get_cache(struct cork_slab *slab)
+{
+    struct cork_slab_tls  *tls = cork_slab_tls_get();
+    struct cork_slab_tls_entry  *entry =
+        &tls->entries[slab->id % CORK_SLAB_TLS_ENTRIES];
+    if (CORK_LIKELY(entry->slab_id == slab->id)) {
+        return entry->cache;
+    }
+    return cork_slab_find_cache(slab, entry);
+}
+
+/* Carves a new chunk into objects for the given size class.  The caller must
+ * hold the class's lock. */
+static bool
+cork_slab_new_chunk(struct cork_slab *slab, struct cork_slab_class *cls)
+{
+    struct cork_slab_chunk  *chunk =
+        cork_alloc_xmalloc(slab->parent, cork_slab_chunk_alloc_size());
+    if (CORK_UNLIKELY(chunk == NULL)) {
+        return false;
+    }
+    cork_slab_lock(&slab->lock);
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    cork_slab_unlock(&slab->lock);
+    cls->next = cork_slab_chunk_data(chunk);
+    cls->end = cls->next + CORK_SLAB_CHUNK_SIZE;
+    return true;
+}
+
+/* Fills an empty cache class with a batch of objects, taken from the class's
+ * shared free list if possible, and carved out of a chunk if not. */
+static bool
+cork_slab_cache_refill(struct cork_slab *slab,
+                       struct cork_slab_cache_class *cache_class,
+                       unsigned int index)
+{
+    struct cork_slab_class  *cls = &slab->classes[index];
+    size_t  object_size = cork_slab_class_size(index);
+    struct cork_slab_object  *head = NULL;
+    size_t  count = 0;
+
+    cork_slab_lock(&cls->lock);
+    while (count < CORK_SLAB_BATCH_SIZE && cls->free_list != NULL) {
+        struct cork_slab_object  *obj = cls->free_list;
+        cls->free_list = obj->next;
+        obj->next = head;
+        head = obj;
+        count++;
+    }
+    while (count < CORK_SLAB_BATCH_SIZE) {
+        struct cork_slab_object  *obj;
+        if ((size_t) (cls->end - cls->next) < object_size) {
+            if (CORK_UNLIKELY(!cork_slab_new_chunk(slab, cls))) {
+                break;
+            }
+        }
+        obj = (struct cork_slab_object *) cls->next;
+        cls->next += object_size;
+        obj->next = head;
+        head = obj;
+        count++;
+    }
+    cork_slab_unlock(&cls->lock);
+
+    cache_class->free_list = head;
+    cache_class->count = count;
+    return count > 0;
+}
+
+/* Moves a batch of objects from a full cache class back to the class's shared
+ * free list. */
+static void
+cork_slab_cache_flush(struct cork_slab *slab,
+                      struct cork_slab_cache_class *cache_class,
+                      unsigned int index)
+{
+    struct cork_slab_class  *cls = &slab->classes[index];
+    struct cork_slab_object  *head = cache_class->free_list;
+    struct cork_slab_object  *tail = head;
+    size_t  i;
+
+    for (i = 1; i < CORK_SLAB_BATCH_SIZE; i++) {
+        tail = tail->next;
+    }
+    cache_class->free_list = tail->next;
+    cache_class->count -= CORK_SLAB_BATCH_SIZE;
+
+    cork_slab_lock(&cls->lock);
+    tail->next = cls->free_list;
+    cls->free_list = head;
+    cork_slab_unlock(&cls->lock);
+}
+
+static void *
+cork_slab__xmalloc(const struct cork_alloc *alloc, size_t size)
+{
+    struct cork_slab  *slab = alloc->user_data;
+    struct cork_slab_cache_class  *cache_class;
+    struct cork_slab_object  *obj;
+    unsigned int  index;
+
+    if (CORK_UNLIKELY(size > CORK_SLAB_ALLOC_MAX_SIZE)) {
+        return cork_alloc_xmalloc(alloc->parent, size);
+    }
+
+    index = cork_slab_class_index(size);
+    cache_class = &cork_slab_get_cache(slab)->classes[index];
+    if (CORK_UNLIKELY(cache_class->count == 0)) {
+        if (CORK_UNLIKELY(!cork_slab_cache_refill(slab, cache_class, index))) {
+            return NULL;
+        }
+    }
+    obj = cache_class->free_list;
+    cache_class->free_list = obj->next;
+    cache_class->count--;
+    return obj;
+}
+
+static void *
+cork_slab__xcalloc(const struct cork_alloc *alloc, size_t count, size_t size)
+{
+    void  *result;
+    assert(count < (SIZE_MAX / size));
+    if (count * size > CORK_SLAB_ALLOC_MAX_SIZE) {
+        return cork_alloc_xcalloc(alloc->parent, count, size);
+    }
+    result = cork_slab__xmalloc(alloc, count * size);
+    if (CORK_LIKELY(result != NULL)) {
+        memset(result, 0, count * size);
+    }
+    return result;
+}
+
+static void
+cork_slab__free(const struct cork_alloc *alloc, void *ptr, size_t size)
+{
+    struct cork_slab  *slab = alloc->user_data;
+    struct cork_slab_cache_class  *cache_class;
+    struct cork_slab_object  *obj = ptr;
+    unsigned int  index;
+
+    if (CORK_UNLIKELY(size > CORK_SLAB_ALLOC_MAX_SIZE)) {
+        cork_alloc_free(alloc->parent, ptr, size);
+        return;
+    }
+
+    index = cork_slab_class_index(size);
+    cache_class = &cork_slab_get_cache(slab)->classes[index];
+    if (CORK_UNLIKELY(cache_class->count == CORK_SLAB_CACHE_SIZE)) {
+        cork_slab_cache_flush(slab, cache_class, index);
+    }
+    obj->next = cache_class->free_list;
+    cache_class->free_list = obj;
+    cache_class->count++;
+}
+
+static void *
+cork_slab__xrealloc(const struct cork_alloc *alloc, void *ptr,
+                    size_t old_size, size_t new_size)
+{
+    void  *result;
+
+    if (ptr != NULL) {
+        if (old_size > CORK_SLAB_ALLOC_MAX_SIZE &&
+            new_size > CORK_SLAB_ALLOC_MAX_SIZE) {
+            return cork_alloc_xrealloc
+                (alloc->parent, ptr, old_size, new_size);
+        }
+        if (old_size <= CORK_SLAB_ALLOC_MAX_SIZE &&
+            new_size <= CORK_SLAB_ALLOC_MAX_SIZE &&
+            cork_slab_class_index(old_size) ==
+            cork_slab_class_index(new_size)) {
+            return ptr;
+        }
+    }
+
+    result = cork_slab__xmalloc(alloc, new_size);
+    if (CORK_LIKELY(result != NULL) && ptr != NULL) {
+        memcpy(result, ptr, (new_size < old_size)? new_size: old_size);
+        cork_slab__free(alloc, ptr, old_size);
+    }
+    return result;
+}
+
+static void
+cork_slab__free_user_data(void *user_data)
+{
+    struct cork_slab  *slab = user_data;
+    struct cork_slab_chunk  *chunk;
+
+    /* The caches are also linked into their threads' lists, so we need to
+     * unlink them before we can free them. */
+    cork_slab_release_caches(&slab->caches);
+
+    for (chunk = slab->chunks; chunk != NULL; ) {
+        struct cork_slab_chunk  *next = chunk->next;
+        cork_alloc_free(slab->parent, chunk, cork_slab_chunk_alloc_size());
+        chunk = next;
+    }
+    cork_alloc_free(slab->parent, slab, sizeof(struct cork_slab));
+}
+
+struct cork_alloc *
+cork_slab_alloc_new(const struct cork_alloc *parent)
+{
+    struct cork_alloc  *alloc = cork_alloc_new_alloc(parent);
+    struct cork_slab  *slab =
+        cork_alloc_calloc(parent, 1, sizeof(struct cork_slab));
+    slab->parent = parent;
+    slab->id = cork_uint_atomic_add(&cork_slab_last_id, 1);
+    cork_alloc_set_user_data(alloc, slab, cork_slab__free_user_data);
+    cork_alloc_set_xcalloc(alloc, cork_slab__xcalloc);
+    cork_alloc_set_xmalloc(alloc, cork_slab__xmalloc);
+    cork_alloc_set_xrealloc(alloc, cork_slab__xrealloc);
+    cork_alloc_set_free(alloc, cork_slab__free);
+    return alloc;
+}
+
+void
+cork_slab_alloc_release_thread_cache(const struct cork_alloc *alloc)
+{
+    struct cork_slab  *slab = alloc->user_data;
+    struct cork_slab_tls_entry  *entry =
+        &cork_slab_tls_get()->entries[slab->id % CORK_SLAB_TLS_ENTRIES];
+    struct cork_slab_cache  *cache;
+
+    /* Make sure that we don't use the cache after we've freed it. */
+    if (entry->slab_id == slab->id) {
+        entry->slab_id = 0;
+        entry->cache = NULL;
+    }
+
+    cork_slab_lock(&cork_slab_caches_lock);
+    cache = cork_slab_thread_find_cache(cork_slab_thread_get(), slab);
+    if (cache != NULL) {
+        cork_slab_cache_unlink(cache);
+    }
+    cork_slab_unlock(&cork_slab_caches_lock);
+    if (cache != NULL) {
+        cork_slab_cache_free(cache);
+    }
+}
+
+/*-----------------------------------------------------------------------
+ * Statistics allocator
+ */
+
+/* Maximum number of distinct call sites that we'll keep track of when sampling
+ * allocations, and the number of stack frames we'll record for each one. */
+#define CORK_STATS_ALLOC_MAX_SITES  64
+#define CORK_STATS_ALLOC_MAX_FRAMES  16
+
+/* Number of frames at the top of each backtrace that belong to the statistics
+ * allocator itself. */
+#define CORK_STATS_ALLOC_SKIP_FRAMES  2
+
+struct cork_stats_alloc_counters {
+    size_t  live_bytes;
+    size_t  peak_bytes;
+    size_t  alloc_count;
+    size_t  free_count;
+};
+
+struct cork_stats_alloc_site {
+    void  *frames[CORK_STATS_ALLOC_MAX_FRAMES];
+    unsigned int  depth;
+    size_t  alloc_count;
+    size_t  bytes;
+};
+
+struct cork_stats_alloc {
+    const struct cork_alloc  *parent;
+    struct cork_stats_alloc_counters  totals;
+    struct cork_stats_alloc_counters  classes[CORK_STATS_ALLOC_CLASS_COUNT];
+    size_t  sample_rate;
+    size_t  sample_counter;
+    /* Protects the sampled call sites. */
+    volatile int  lock;
+    size_t  site_count;
+    size_t  dropped_samples;
+    struct cork_stats_alloc_site  sites[CORK_STATS_ALLOC_MAX_SITES];
+};
+
+unsigned int
+cork_stats_alloc_size_class(size_t size)
+{
+    unsigned int  result = 0;
+    if (size <= 1) {
+        return 0;
+    }
+    /* The number of bits needed to hold size-1 gives us the smallest power of
+     * two that is >= size. */
+    size--;
+    while (size != 0) {
+        result++;
+        size >>= 1;
+    }
+    return result;
+}
+
+static void
+cork_stats_alloc_counters_add(struct cork_stats_alloc_counters *counters,
+                              size_t size)
+{
+    size_t  live = cork_size_atomic_add(&counters->live_bytes, size);
+    size_t  peak = cork_atomic_load(&counters->peak_bytes);
+    cork_size_atomic_add(&counters->alloc_count, 1);
+    while (live > peak) {
+        size_t  actual = cork_size_cas(&counters->peak_bytes, peak, live);
+        if (actual == peak) {
+            break;
+        }
+        peak = actual;
+    }
+}
+
+static void
+cork_stats_alloc_counters_remove(struct cork_stats_alloc_counters *counters,
+                                 size_t size)
+{
+    cork_size_atomic_sub(&counters->live_bytes, size);
+    cork_size_atomic_add(&counters->free_count, 1);
+}
+
+static void
+cork_stats_alloc_counters_get(struct cork_stats_alloc_counters *counters,
+                              struct cork_alloc_stats *dest)
+{
+    dest->live_bytes = cork_atomic_load(&counters->live_bytes);
+    dest->peak_bytes = cork_atomic_load(&counters->peak_bytes);
+    dest->alloc_count = cork_atomic_load(&counters->alloc_count);
+    dest->free_count = cork_atomic_load(&counters->free_count);
+}
+
+static void
+cork_stats_alloc_lock(struct cork_stats_alloc *stats)
+{
+    while (cork_int_cas(&stats->lock, 0, 1) != 0) {
+        while (cork_atomic_load(&stats->lock)) {
+            cork_pause();
+        }
+    }
+}
+
+static void
+cork_stats_alloc_unlock(struct cork_stats_alloc *stats)
+{
+    cork_atomic_store(&stats->lock, 0);
+}
+
+#if CORK_HAVE_BACKTRACE
+CORK_ATTR_NOINLINE
+static void
+cork_stats_alloc_sample(struct cork_stats_alloc *stats, size_t size)
+{
+    void  *frames[CORK_STATS_ALLOC_MAX_FRAMES + CORK_STATS_ALLOC_SKIP_FRAMES];
+    unsigned int  depth;
+    size_t  i;
+
+    depth = backtrace(frames, sizeof(frames) / sizeof(frames[0]));
+    if (depth <= CORK_STATS_ALLOC_SKIP_FRAMES) {
+        return;
+    }
+    depth -= CORK_STATS_ALLOC_SKIP_FRAMES;
+
+    cork_stats_alloc_lock(stats);
+    for (i = 0; i < stats->site_count; i++) {
+        struct cork_stats_alloc_site  *site = &stats->sites[i];
+        if (site->depth == depth &&
+            memcmp(site->frames, frames + CORK_STATS_ALLOC_SKIP_FRAMES,
+                   depth * sizeof(void *)) == 0) {
+            site->alloc_count++;
+            site->bytes += size;
+            cork_stats_alloc_unlock(stats);
+            return;
+        }
+    }
+
+    if (stats->site_count < CORK_STATS_ALLOC_MAX_SITES) {
+        struct cork_stats_alloc_site  *site = &stats->sites[stats->site_count++];
+        memcpy(site->frames, frames + CORK_STATS_ALLOC_SKIP_FRAMES,
+               depth * sizeof(void *));
+        site->depth = depth;
+        site->alloc_count = 1;
+        site->bytes = size;
+    } else {
+        stats->dropped_samples++;
+    }
+    cork_stats_alloc_unlock(stats);
+}
+#endif
+
+static void
+cork_stats_alloc_record_alloc(struct cork_stats_alloc *stats, size_t size)
+{
+    unsigned int  size_class = cork_stats_alloc_size_class(size);
+    cork_stats_alloc_counters_add(&stats->totals, size);
+    cork_stats_alloc_counters_add(&stats->classes[size_class], size);
+#if CORK_HAVE_BACKTRACE
+    {
+        size_t  rate = cork_atomic_load(&stats->sample_rate);
+        if (CORK_UNLIKELY(rate != 0) &&
+            cork_size_atomic_add(&stats->sample_counter, 1) % rate == 0) {
+            cork_stats_alloc_sample(stats, size);
+        }
+    }
+#endif
+}
+
+static void
+cork_stats_alloc_record_free(struct cork_stats_alloc *stats, size_t size)
+{
+    unsigned int  size_class = cork_stats_alloc_size_class(size);
+    cork_stats_alloc_counters_remove(&stats->totals, size);
+    cork_stats_alloc_counters_remove(&stats->classes[size_class], size);
+}
+
+static void *
+cork_stats_alloc__xcalloc(const struct cork_alloc *alloc,
+                          size_t count, size_t size)
+{
+    struct cork_stats_alloc  *stats = alloc->user_data;
+    void  *result = cork_alloc_xcalloc(alloc->parent, count, size);
+    if (CORK_LIKELY(result != NULL)) {
+        cork_stats_alloc_record_alloc(stats, count * size);
+    }
+    return result;
+}
+
+static void *
+cork_stats_alloc__xmalloc(const struct cork_alloc *alloc, size_t size)
+{
+    struct cork_stats_alloc  *stats = alloc->user_data;
+    void  *result = cork_alloc_xmalloc(alloc->parent, size);
+    if (CORK_LIKELY(result != NULL)) {
+        cork_stats_alloc_record_alloc(stats, size);
+    }
+    return result;
+}
+
+static void *
+cork_stats_alloc__xrealloc(const struct cork_alloc *alloc, void *ptr,
+                           size_t old_size, size_t new_size)
+{
+    struct cork_stats_alloc  *stats = alloc->user_data;
+    void  *result =
+        cork_alloc_xrealloc(alloc->parent, ptr, old_size, new_size);
+    if (CORK_LIKELY(result != NULL)) {
+        /* Count a reallocation as allocating a new object and then freeing
+         * the old one, so that each size class's counts stay balanced.  (The
+         * parent might well have needed both objects at the same time.) */
+        cork_stats_alloc_record_alloc(stats, new_size);
+        if (ptr != NULL) {
+            cork_stats_alloc_record_free(stats, old_size);
+        }
+    }
+    return result;
+}
+
+static void
+cork_stats_alloc__free(const struct cork_alloc *alloc, void *ptr, size_t size)
+{
+    struct cork_stats_alloc  *stats = alloc->user_data;
+    cork_alloc_free(alloc->parent, ptr, size);
+    cork_stats_alloc_record_free(stats, size);
+}
+
+static void
+cork_stats_alloc__free_user_data(void *user_data)
+{
+    struct cork_stats_alloc  *stats = user_data;
+    cork_alloc_delete(stats->parent, struct cork_stats_alloc, stats);
+}
+
+struct cork_alloc *
+cork_stats_alloc_new(const struct cork_alloc *parent)
+{
+    struct cork_alloc  *alloc = cork_alloc_new_alloc(parent);
+    struct cork_stats_alloc  *stats =
+        cork_alloc_calloc(parent, 1, sizeof(struct cork_stats_alloc));
+    stats->parent = parent;
+    cork_alloc_set_user_data(alloc, stats, cork_stats_alloc__free_user_data);
+    cork_alloc_set_xcalloc(alloc, cork_stats_alloc__xcalloc);
+    cork_alloc_set_xmalloc(alloc, cork_stats_alloc__xmalloc);
+    cork_alloc_set_xrealloc(alloc, cork_stats_alloc__xrealloc);
+    cork_alloc_set_free(alloc, cork_stats_alloc__free);
+    return alloc;
+}
+
+void
+cork_stats_alloc_get_totals(const struct cork_alloc *alloc,
+                            struct cork_alloc_stats *dest)
+{
+    struct cork_stats_alloc  *stats = alloc->user_data;
+    cork_stats_alloc_counters_get(&stats->totals, dest);
+}
+
+void
+cork_stats_alloc_get_class(const struct cork_alloc *alloc,
+                           unsigned int size_class,
+                           struct cork_alloc_stats *dest)
+{
+    struct cork_stats_alloc  *stats = alloc->user_data;
+    assert(size_class < CORK_STATS_ALLOC_CLASS_COUNT);
+    cork_stats_alloc_counters_get(&stats->classes[size_class], dest);
+}
+
+void
+cork_stats_alloc_set_sample_rate(const struct cork_alloc *alloc, size_t rate)
+{
+    struct cork_stats_alloc  *stats = alloc->user_data;
+    cork_atomic_store(&stats->sample_rate, rate);
+}
+
+static int
+cork_stats_alloc_site__compare(const void *va, const void *vb)
+{
+    const struct cork_stats_alloc_site  *a = va;
+    const struct cork_stats_alloc_site  *b = vb;
+    return (a->bytes < b->bytes)? 1: (a->bytes > b->bytes)? -1: 0;
+}
+
+static void
+cork_stats_alloc_report_sites(struct cork_stats_alloc *stats,
+                              struct cork_buffer *dest)
+{
+#if CORK_HAVE_BACKTRACE
+    struct cork_stats_alloc_site  *sites;
+    size_t  site_count;
+    size_t  dropped_samples;
+    size_t  i;
+
+    if (cork_atomic_load(&stats->sample_rate) == 0) {
+        return;
+    }
+
+    /* Copy the sites out while holding the lock; appending to `dest` might
+     * allocate, and `dest` might be using this very allocator. */
+    sites = cork_alloc_malloc
+        (stats->parent, CORK_STATS_ALLOC_MAX_SITES * sizeof(*sites));
+    cork_stats_alloc_lock(stats);
+    site_count = stats->site_count;
+    dropped_samples = stats->dropped_samples;
+    memcpy(sites, stats->sites, site_count * sizeof(*sites));
+    cork_stats_alloc_unlock(stats);
+    qsort(sites, site_count, sizeof(*sites), cork_stats_alloc_site__compare);
+
+    cork_buffer_append_printf
+        (dest, "Sampled call sites (1 in %zu allocations)\n",
+         cork_atomic_load(&stats->sample_rate));
+    for (i = 0; i < site_count; i++) {
+        char  **symbols = backtrace_symbols(sites[i].frames, sites[i].depth);
+        unsigned int  j;
+        cork_buffer_append_printf
+            (dest, "  %zu bytes in %zu sampled allocations\n",
+             sites[i].bytes, sites[i].alloc_count);
+        for (j = 0; j < sites[i].depth; j++) {
+            if (symbols == NULL) {
+                cork_buffer_append_printf(dest, "    %p\n", sites[i].frames[j]);
+            } else {
+                cork_buffer_append_printf(dest, "    %s\n", symbols[j]);
+            }
+        }
+        /* backtrace_symbols allocates its result with the C library's
+         * malloc. */
+        free(symbols);
+    }
+    if (dropped_samples > 0) {
+        cork_buffer_append_printf
+            (dest, "  (%zu samples from other call sites not shown)\n",
+             dropped_samples);
+    }
+
+    cork_alloc_free
+        (stats->parent, sites, CORK_STATS_ALLOC_MAX_SITES * sizeof(*sites));
+#endif
+}
+
+void
+cork_stats_alloc_report(const struct cork_alloc *alloc,
+                        struct cork_buffer *dest)
+{
+    struct cork_stats_alloc  *stats = alloc->user_data;
+    struct cork_alloc_stats  totals;
+    struct cork_alloc_stats  classes[CORK_STATS_ALLOC_CLASS_COUNT];
+    unsigned int  i;
+
+    /* Take a snapshot of every counter before we append anything to `dest`,
+     * for the same reason as above. */
+    cork_stats_alloc_counters_get(&stats->totals, &totals);
+    for (i = 0; i < CORK_STATS_ALLOC_CLASS_COUNT; i++) {
+        cork_stats_alloc_counters_get(&stats->classes[i], &classes[i]);
+    }
+
+    cork_buffer_append_printf
+        (dest, "Live: %zu bytes (peak %zu bytes), "
+         "%zu allocations, %zu frees\n",
+         totals.live_bytes, totals.peak_bytes,
+         totals.alloc_count, totals.free_count);
+    cork_buffer_append_printf
+        (dest, "%12s %12s %12s %14s %14s\n",
+         "max size", "allocs", "frees", "live bytes", "peak bytes");
+    for (i = 0; i < CORK_STATS_ALLOC_CLASS_COUNT; i++) {
+        if (classes[i].alloc_count == 0) {
+            continue;
+        }
+        cork_buffer_append_printf
+            (dest, "%12zu %12zu %12zu %14zu %14zu\n",
+             (i == 0)? (size_t) 1: ((size_t) 1) << (i - 1) << 1,
+             classes[i].alloc_count, classes[i].free_count,
+             classes[i].live_bytes, classes[i].peak_bytes);
+    }
+
+    cork_stats_alloc_report_sites(stats, dest);
+}
+
+
 /*-----------------------------------------------------------------------
  * Inline declarations
  */
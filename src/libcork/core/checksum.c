@@ -0,0 +1,431 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/attributes.h"
+#include "libcork/core/byte-order.h"
+#include "libcork/core/checksum.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/stream.h"
+#include "libcork/threads/atomics.h"
+
+#include "digest.h"
+
+
+/*-----------------------------------------------------------------------
+ * CRC32C
+ */
+
+/* All of the kernels work on the "raw" CRC register, without the bit inversions
+ * that CRC32C applies at the beginning and end; cork_crc32c takes care of
+ * those.  We use the reflected form of the polynomial, so the first byte of
+ * the input goes into the low bits of the register, which is also what the
+ * SSE4.2 and ARMv8 instructions do. */
+
+#define CORK_CRC32C_POLY  UINT32_C(0x82f63b78)
+
+typedef uint32_t
+(*cork_crc32c_f)(uint32_t crc, const uint8_t *src, size_t len);
+
+struct cork_crc32c_kernel {
+    struct cork_digest_kernel  kernel;
+    cork_crc32c_f  crc32c;
+};
+
+static inline uint64_t
+cork_crc32c_read64(const uint8_t *p)
+{
+    uint64_t  v;
+    memcpy(&v, p, sizeof(v));
+    return CORK_UINT64_LITTLE_TO_HOST(v);
+}
+
+
+/* The portable kernel uses "slicing-by-8": table[k][b] is the CRC of byte b
+ * followed by k zero bytes, which lets us process 8 bytes with 8 independent
+ * lookups. */
+
+static uint32_t  cork_crc32c_table[8][256];
+
+/* Returns x^n mod P, in the same reflected representation as the CRC
+ * register. */
+static uint32_t
+cork_crc32c_xpow(size_t n)
+{
+    uint32_t  result = UINT32_C(0x80000000);  /* x^0 */
+    size_t  i;
+    for (i = 0; i < n; i++) {
+        result = (result & 1)? (result >> 1) ^ CORK_CRC32C_POLY: result >> 1;
+    }
+    return result;
+}
+
+static uint32_t
+cork_crc32c_table_kernel(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len >= 8) {
+        uint64_t  word = cork_crc32c_read64(p) ^ crc;
+        crc = cork_crc32c_table[7][word & 0xff] ^
+              cork_crc32c_table[6][(word >> 8) & 0xff] ^
+              cork_crc32c_table[5][(word >> 16) & 0xff] ^
+              cork_crc32c_table[4][(word >> 24) & 0xff] ^
+              cork_crc32c_table[3][(word >> 32) & 0xff] ^
+              cork_crc32c_table[2][(word >> 40) & 0xff] ^
+              cork_crc32c_table[1][(word >> 48) & 0xff] ^
+              cork_crc32c_table[0][word >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = cork_crc32c_table[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+        p++;
+        len--;
+    }
+    return crc;
+}
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CORK_CRC32C_X86  1
+#include <immintrin.h>
+
+static bool
+cork_crc32c_sse42_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t
+cork_crc32c_sse42_kernel(uint32_t crc, const uint8_t *p, size_t len)
+{
+#if defined(__x86_64__)
+    uint64_t  crc64 = crc;
+    while (len >= 8) {
+        crc64 = _mm_crc32_u64(crc64, cork_crc32c_read64(p));
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t) crc64;
+#else
+    while (len >= 4) {
+        uint32_t  word;
+        memcpy(&word, p, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+        p += 4;
+        len -= 4;
+    }
+#endif
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *p);
+        p++;
+        len--;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+#define CORK_CRC32C_PCLMUL  1
+
+static bool
+cork_crc32c_pclmul_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") &&
+        __builtin_cpu_supports("pclmul");
+}
+
+/* The crc32 instruction has a latency of 3 cycles but a throughput of 1 per
+ * cycle, so a single dependent chain only uses a third of what the CPU can do.
+ * For large buffers, we compute the CRCs of three adjacent blocks at once, and
+ * then combine them.  Combining needs us to "shift" a CRC past the blocks that
+ * follow it, which we do with a carry-less multiply by a precomputed power of
+ * x, followed by a crc32 instruction to reduce the product. */
+
+#define CORK_CRC32C_LONG_BLOCK  8192
+#define CORK_CRC32C_SHORT_BLOCK  256
+
+/* cork_crc32c_shift(crc, k) multiplies crc by k * x^33, so to shift a CRC past
+ * n bytes we need k = x^(8n - 33). */
+static uint32_t  cork_crc32c_long_shift[2];
+static uint32_t  cork_crc32c_short_shift[2];
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t
+cork_crc32c_shift(uint32_t crc, uint32_t k)
+{
+    __m128i  product = _mm_clmulepi64_si128
+        (_mm_cvtsi32_si128((int) crc), _mm_cvtsi32_si128((int) k), 0);
+    return (uint32_t) _mm_crc32_u64(0, (uint64_t) _mm_cvtsi128_si64(product));
+}
+
+#define cork_crc32c_three_way(block_size, shifts) \
+    while (len >= 3 * (block_size)) { \
+        uint64_t  crc0 = crc; \
+        uint64_t  crc1 = 0; \
+        uint64_t  crc2 = 0; \
+        size_t  i; \
+        for (i = 0; i < (block_size); i += 8) { \
+            crc0 = _mm_crc32_u64(crc0, cork_crc32c_read64(p + i)); \
+            crc1 = _mm_crc32_u64 \
+                (crc1, cork_crc32c_read64(p + (block_size) + i)); \
+            crc2 = _mm_crc32_u64 \
+                (crc2, cork_crc32c_read64(p + 2 * (block_size) + i)); \
+        } \
+        crc = cork_crc32c_shift((uint32_t) crc0, (shifts)[1]) ^ \
+              cork_crc32c_shift((uint32_t) crc1, (shifts)[0]) ^ \
+              (uint32_t) crc2; \
+        p += 3 * (block_size); \
+        len -= 3 * (block_size); \
+    }
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t
+cork_crc32c_pclmul_kernel(uint32_t crc, const uint8_t *p, size_t len)
+{
+    cork_crc32c_three_way(CORK_CRC32C_LONG_BLOCK, cork_crc32c_long_shift);
+    cork_crc32c_three_way(CORK_CRC32C_SHORT_BLOCK, cork_crc32c_short_shift);
+    return cork_crc32c_sse42_kernel(crc, p, len);
+}
+#endif
+#endif
+
+
+/* On AArch64 we compile the kernel for the CRC32 extension even if the rest of
+ * the library doesn't target it, and check whether the CPU has it at runtime.
+ * On 32-bit ARM we only use it if the whole library targets it. */
+#if defined(__GNUC__) && defined(__aarch64__)
+#define CORK_CRC32C_ARMV8  1
+#define CORK_CRC32C_ARMV8_TARGET  __attribute__((target("+crc")))
+#elif defined(__ARM_FEATURE_CRC32)
+#define CORK_CRC32C_ARMV8  1
+#define CORK_CRC32C_ARMV8_TARGET
+#endif
+
+#if CORK_CRC32C_ARMV8
+#include <arm_acle.h>
+#if defined(__linux__) && !defined(__ARM_FEATURE_CRC32)
+#include <sys/auxv.h>
+#endif
+
+static bool
+cork_crc32c_armv8_supported(void)
+{
+#if defined(__ARM_FEATURE_CRC32)
+    return true;
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return false;
+#endif
+}
+
+CORK_CRC32C_ARMV8_TARGET
+static uint32_t
+cork_crc32c_armv8_kernel(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len >= 8) {
+        crc = __crc32cd(crc, cork_crc32c_read64(p));
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = __crc32cb(crc, *p);
+        p++;
+        len--;
+    }
+    return crc;
+}
+#endif
+
+
+CORK_INITIALIZER(cork_crc32c_init)
+{
+    unsigned int  i;
+    unsigned int  k;
+    for (i = 0; i < 256; i++) {
+        uint32_t  crc = i;
+        for (k = 0; k < 8; k++) {
+            crc = (crc & 1)? (crc >> 1) ^ CORK_CRC32C_POLY: crc >> 1;
+        }
+        cork_crc32c_table[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++) {
+        for (k = 1; k < 8; k++) {
+            uint32_t  prev = cork_crc32c_table[k - 1][i];
+            cork_crc32c_table[k][i] =
+                (prev >> 8) ^ cork_crc32c_table[0][prev & 0xff];
+        }
+    }
+
+#if CORK_CRC32C_PCLMUL
+    cork_crc32c_long_shift[0] = cork_crc32c_xpow(CORK_CRC32C_LONG_BLOCK*8 - 33);
+    cork_crc32c_long_shift[1] =
+        cork_crc32c_xpow(2*CORK_CRC32C_LONG_BLOCK*8 - 33);
+    cork_crc32c_short_shift[0] =
+        cork_crc32c_xpow(CORK_CRC32C_SHORT_BLOCK*8 - 33);
+    cork_crc32c_short_shift[1] =
+        cork_crc32c_xpow(2*CORK_CRC32C_SHORT_BLOCK*8 - 33);
+#else
+    (void) cork_crc32c_xpow;
+#endif
+}
+
+
+/* In order of preference, best last */
+static const struct cork_crc32c_kernel  cork_crc32c_kernel_list[] = {
+    { { "table", NULL }, cork_crc32c_table_kernel },
+#if CORK_CRC32C_X86
+    { { "sse4.2", cork_crc32c_sse42_supported }, cork_crc32c_sse42_kernel },
+#endif
+#if CORK_CRC32C_PCLMUL
+    { { "pclmul", cork_crc32c_pclmul_supported }, cork_crc32c_pclmul_kernel },
+#endif
+#if CORK_CRC32C_ARMV8
+    { { "armv8", cork_crc32c_armv8_supported }, cork_crc32c_armv8_kernel },
+#endif
+    { { NULL, NULL }, NULL }
+};
+
+static struct cork_digest_kernels  cork_crc32c_kernels = {
+    "CRC32C", cork_crc32c_kernel_list, sizeof(struct cork_crc32c_kernel), NULL
+};
+
+const char *
+cork_crc32c_get_kernel(void)
+{
+    return cork_digest_kernels_get(&cork_crc32c_kernels)->name;
+}
+
+int
+cork_crc32c_set_kernel(const char *name)
+{
+    return cork_digest_kernels_set(&cork_crc32c_kernels, name);
+}
+
+uint32_t
+cork_crc32c(uint32_t crc, const void *src, size_t len)
+{
+    const struct cork_crc32c_kernel  *kernel = cork_container_of
+        (cork_digest_kernels_get(&cork_crc32c_kernels),
+         struct cork_crc32c_kernel, kernel);
+    return ~kernel->crc32c(~crc, src, len);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Adler-32
+ */
+
+#define CORK_ADLER32_BASE  65521
+
+/* The largest number of bytes that we can add up before b might overflow 32
+ * bits, and we have to reduce a and b modulo CORK_ADLER32_BASE. */
+#define CORK_ADLER32_NMAX  5552
+
+#define cork_adler32_step(i)  a += p[i]; b += a;
+
+uint32_t
+cork_adler32(uint32_t adler, const void *src, size_t len)
+{
+    const uint8_t  *p = src;
+    uint32_t  a = adler & 0xffff;
+    uint32_t  b = adler >> 16;
+
+    while (len > 0) {
+        size_t  chunk = (len < CORK_ADLER32_NMAX)? len: CORK_ADLER32_NMAX;
+        len -= chunk;
+        while (chunk >= 16) {
+            cork_adler32_step(0);  cork_adler32_step(1);
+            cork_adler32_step(2);  cork_adler32_step(3);
+            cork_adler32_step(4);  cork_adler32_step(5);
+            cork_adler32_step(6);  cork_adler32_step(7);
+            cork_adler32_step(8);  cork_adler32_step(9);
+            cork_adler32_step(10); cork_adler32_step(11);
+            cork_adler32_step(12); cork_adler32_step(13);
+            cork_adler32_step(14); cork_adler32_step(15);
+            p += 16;
+            chunk -= 16;
+        }
+        while (chunk > 0) {
+            cork_adler32_step(0);
+            p++;
+            chunk--;
+        }
+        a %= CORK_ADLER32_BASE;
+        b %= CORK_ADLER32_BASE;
+    }
+
+    return (b << 16) | a;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Checksum's stream consumer implementation
+ */
+
+struct cork_checksum__stream_consumer {
+    struct cork_digest_consumer  digest;
+    uint32_t  initial;
+    uint32_t  sum;
+};
+
+static void
+cork_crc32c_digest_update(void *vsum, const void *src, size_t len)
+{
+    uint32_t  *sum = vsum;
+    *sum = cork_crc32c(*sum, src, len);
+}
+
+static void
+cork_adler32_digest_update(void *vsum, const void *src, size_t len)
+{
+    uint32_t  *sum = vsum;
+    *sum = cork_adler32(*sum, src, len);
+}
+
+static void
+cork_checksum_digest_finish(void *vsum, void *vdest)
+{
+    uint32_t  *sum = vsum;
+    uint32_t  *dest = vdest;
+    *dest = *sum;
+}
+
+static struct cork_stream_consumer *
+cork_checksum_stream_consumer_new(cork_digest_update_f update,
+                                  uint32_t initial, uint32_t *dest)
+{
+    struct cork_checksum__stream_consumer  *cconsumer =
+        cork_new(struct cork_checksum__stream_consumer);
+    cconsumer->initial = initial;
+    cork_digest_consumer_init
+        (&cconsumer->digest, sizeof(struct cork_checksum__stream_consumer),
+         &cconsumer->initial, &cconsumer->sum, sizeof(uint32_t),
+         update, cork_checksum_digest_finish, dest);
+    return &cconsumer->digest.consumer;
+}
+
+struct cork_stream_consumer *
+cork_crc32c_stream_consumer_new(uint32_t *dest)
+{
+    return cork_checksum_stream_consumer_new
+        (cork_crc32c_digest_update, CORK_CRC32C_INIT, dest);
+}
+
+struct cork_stream_consumer *
+cork_adler32_stream_consumer_new(uint32_t *dest)
+{
+    return cork_checksum_stream_consumer_new
+        (cork_adler32_digest_update, CORK_ADLER32_INIT, dest);
+}
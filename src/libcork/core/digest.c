@@ -0,0 +1,126 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/stream.h"
+#include "libcork/threads/atomics.h"
+
+#include "digest.h"
+
+
+/*-----------------------------------------------------------------------
+ * Kernel selection
+ */
+
+#define cork_digest_kernel_at(kernels, i) \
+    ((const struct cork_digest_kernel *) \
+     ((const char *) (kernels)->kernels + (i) * (kernels)->kernel_size))
+
+static bool
+cork_digest_kernel_supported(const struct cork_digest_kernel *kernel)
+{
+    return kernel->supported == NULL || kernel->supported();
+}
+
+const struct cork_digest_kernel *
+cork_digest_kernels_detect(struct cork_digest_kernels *kernels)
+{
+    const struct cork_digest_kernel  *best = cork_digest_kernel_at(kernels, 0);
+    const struct cork_digest_kernel  *kernel;
+    size_t  i;
+    for (i = 0; (kernel = cork_digest_kernel_at(kernels, i))->name != NULL;
+         i++) {
+        if (cork_digest_kernel_supported(kernel)) {
+            best = kernel;
+        }
+    }
+    cork_atomic_store(&kernels->current, best);
+    return best;
+}
+
+int
+cork_digest_kernels_set(struct cork_digest_kernels *kernels, const char *name)
+{
+    const struct cork_digest_kernel  *kernel;
+    size_t  i;
+    if (name == NULL) {
+        cork_digest_kernels_detect(kernels);
+        return 0;
+    }
+    for (i = 0; (kernel = cork_digest_kernel_at(kernels, i))->name != NULL;
+         i++) {
+        if (strcmp(kernel->name, name) == 0) {
+            if (!cork_digest_kernel_supported(kernel)) {
+                cork_undefined("This CPU doesn't support %s", name);
+                return -1;
+            }
+            cork_atomic_store(&kernels->current, kernel);
+            return 0;
+        }
+    }
+    cork_undefined("Unknown %s kernel %s", kernels->description, name);
+    return -1;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Stream consumers
+ */
+
+static int
+cork_digest_consumer_data(struct cork_stream_consumer *consumer,
+                          const void *buf, size_t size, bool is_first_chunk)
+{
+    struct cork_digest_consumer  *self = cork_container_of
+        (consumer, struct cork_digest_consumer, consumer);
+    self->update(self->state, buf, size);
+    return 0;
+}
+
+static int
+cork_digest_consumer_eof(struct cork_stream_consumer *consumer)
+{
+    struct cork_digest_consumer  *self = cork_container_of
+        (consumer, struct cork_digest_consumer, consumer);
+    self->finish(self->state, self->dest);
+    /* Get ready in case the consumer is reused for another stream. */
+    memcpy(self->state, self->initial, self->state_size);
+    return 0;
+}
+
+static void
+cork_digest_consumer_free(struct cork_stream_consumer *consumer)
+{
+    struct cork_digest_consumer  *self = cork_container_of
+        (consumer, struct cork_digest_consumer, consumer);
+    cork_free(self, self->self_size);
+}
+
+void
+cork_digest_consumer_init(struct cork_digest_consumer *self, size_t self_size,
+                          const void *initial, void *state, size_t state_size,
+                          cork_digest_update_f update,
+                          cork_digest_finish_f finish, void *dest)
+{
+    self->consumer.data = cork_digest_consumer_data;
+    self->consumer.eof = cork_digest_consumer_eof;
+    self->consumer.free = cork_digest_consumer_free;
+    self->update = update;
+    self->finish = finish;
+    self->self_size = self_size;
+    self->state_size = state_size;
+    self->initial = initial;
+    self->state = state;
+    self->dest = dest;
+    memcpy(state, initial, state_size);
+}
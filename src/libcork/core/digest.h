@@ -0,0 +1,99 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef LIBCORK_CORE_DIGEST_H
+#define LIBCORK_CORE_DIGEST_H
+
+/* Internal helpers that are shared by the hash and checksum implementations.
+ * None of this is part of the public API. */
+
+#include "libcork/core/attributes.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/stream.h"
+#include "libcork/threads/atomics.h"
+
+
+/*-----------------------------------------------------------------------
+ * Kernel selection
+ */
+
+/* Each kernel table is an array of structs that start with one of these, in
+ * order of preference (best last), and ending with one whose name is NULL. */
+struct cork_digest_kernel {
+    const char  *name;
+    /* Whether the current CPU can use this kernel.  NULL means always. */
+    bool  (*supported)(void);
+};
+
+struct cork_digest_kernels {
+    /* What the kernels compute, for error messages */
+    const char  *description;
+    const void  *kernels;
+    /* The size of each entry in kernels */
+    size_t  kernel_size;
+    /* The kernel that we're using, or NULL if we haven't chosen one yet. */
+    const struct cork_digest_kernel * volatile  current;
+};
+
+/* Selects the best kernel that the current CPU supports. */
+CORK_LOCAL const struct cork_digest_kernel *
+cork_digest_kernels_detect(struct cork_digest_kernels *kernels);
+
+/* Selects the kernel with the given name, or the best one if `name` is NULL.
+ * Returns an error if the kernel doesn't exist or isn't supported. */
+CORK_LOCAL int
+cork_digest_kernels_set(struct cork_digest_kernels *kernels, const char *name);
+
+static inline const struct cork_digest_kernel *
+cork_digest_kernels_get(struct cork_digest_kernels *kernels)
+{
+    const struct cork_digest_kernel  *kernel =
+        cork_atomic_load(&kernels->current);
+    if (CORK_UNLIKELY(kernel == NULL)) {
+        kernel = cork_digest_kernels_detect(kernels);
+    }
+    return kernel;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Stream consumers
+ */
+
+typedef void
+(*cork_digest_update_f)(void *state, const void *src, size_t len);
+
+typedef void
+(*cork_digest_finish_f)(void *state, void *dest);
+
+/* A stream consumer that feeds everything it receives into a hash or checksum
+ * state, and stores the result into `dest` at the end of each stream.  This
+ * must be the first field of a larger struct that also holds `initial` and
+ * `state`. */
+struct cork_digest_consumer {
+    struct cork_stream_consumer  consumer;
+    cork_digest_update_f  update;
+    cork_digest_finish_f  finish;
+    /* The size of the struct that contains this one */
+    size_t  self_size;
+    size_t  state_size;
+    const void  *initial;
+    void  *state;
+    void  *dest;
+};
+
+/* Fills in `self`, and copies `initial` into `state`. */
+CORK_LOCAL void
+cork_digest_consumer_init(struct cork_digest_consumer *self, size_t self_size,
+                          const void *initial, void *state, size_t state_size,
+                          cork_digest_update_f update,
+                          cork_digest_finish_f finish, void *dest);
+
+
+#endif /* LIBCORK_CORE_DIGEST_H */
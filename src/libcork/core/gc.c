@@ -7,13 +7,20 @@
  * ----------------------------------------------------------------------
  */
 
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "libcork/config/config.h"
 #include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
 #include "libcork/core/gc.h"
+#include "libcork/core/mempool.h"
 #include "libcork/core/types.h"
 #include "libcork/ds/dllist.h"
+#include "libcork/threads/atomics.h"
 #include "libcork/threads/basics.h"
 
 
@@ -33,23 +40,317 @@
  * GC context life cycle
  */
 
+/* The default number of possible garbage cycle roots that we collect before
+ * looking for garbage cycles. */
 #define ROOTS_SIZE  1024
 
 /* An internal structure allocated with every garbage-collected object. */
 struct cork_gc_header;
 
-/* A garbage collector context. */
+/* Objects (including their header) of up to CORK_GC_POOL_MAX_SIZE bytes are
+ * allocated from per-collector memory pools, one for each multiple of
+ * CORK_GC_SIZE_CLASS_STEP bytes.  An object's size class is stored in its
+ * header, so we don't need to store its size.  Larger objects use size class
+ * 0, and are allocated directly from the heap. */
+#define CORK_GC_SIZE_CLASS_BITS  6
+#define CORK_GC_SIZE_CLASS_COUNT  (1 << CORK_GC_SIZE_CLASS_BITS)
+#define CORK_GC_SIZE_CLASS_STEP  8
+#define CORK_GC_POOL_MAX_SIZE \
+    ((CORK_GC_SIZE_CLASS_COUNT - 1) * CORK_GC_SIZE_CLASS_STEP)
+#define CORK_GC_POOL_BLOCK_SIZE  (16 * 1024)
+
+/* The roots buffer can't be any larger than this, since we store each
+ * object's index into it in the rest of the word that holds its size class. */
+#define CORK_GC_MAX_ROOTS  (1u << (32 - CORK_GC_SIZE_CLASS_BITS))
+
+/* A deferred change to an object's reference count. */
+struct cork_gc_log_entry {
+    struct cork_gc_header  *header;
+    int  delta;
+};
+
+/* A garbage collector context.  Every field is zero-initialized when the
+ * context is first used, which gives us the default synchronous behavior. */
 struct cork_gc {
     /* The number of used entries in roots. */
     size_t  root_count;
-    /* The possible roots of garbage cycles */
-    struct cork_gc_header  *roots[ROOTS_SIZE];
+    /* The number of entries that roots has room for. */
+    size_t  roots_size;
+    /* The possible roots of garbage cycles.  Entries can be NULL if the
+     * corresponding object has already been examined, or freed as part of a
+     * garbage cycle. */
+    struct cork_gc_header  **roots;
+    /* The number of NULL entries in roots.  We squeeze them out once they
+     * make up a large enough fraction of the buffer. */
+    size_t  root_holes;
+    /* Where the next incremental collection will start examining roots.  We
+     * work through the buffer from oldest to newest, wrapping around at the
+     * end, so that every possible root is eventually examined. */
+    size_t  collect_cursor;
+    /* Look for garbage cycles once we have this many possible roots.  0
+     * means ROOTS_SIZE. */
+    size_t  collect_threshold;
+    /* The maximum number of possible roots to examine at a time.  0 means
+     * to examine all of them at once. */
+    size_t  collect_budget;
+    /* Whether we're in the middle of looking for garbage cycles. */
+    bool  collecting;
+    /* The members of the garbage cycles that we've found.  We can't free
+     * them until we've found all of them, since one garbage cycle might
+     * point into another one that we've already found. */
+    size_t  garbage_count;
+    size_t  garbage_size;
+    struct cork_gc_header  **garbage;
+    /* For a thread's collector, whether the thread is using the shared
+     * collector instead.  For the shared collector, always true. */
+    bool  shared;
+    /* The number of entries in log and pending, or 0 if we apply reference
+     * count changes right away.  Always a power of 2. */
+    size_t  log_size;
+    /* The net reference count changes that we haven't applied yet, as a
+     * direct-mapped cache indexed by object address.  An increment followed
+     * by a decrement of the same object cancel out without touching the
+     * object. */
+    struct cork_gc_log_entry  *log;
+    /* Net decrements that have been evicted from log.  We can't apply these
+     * until we've applied every pending increment, since one of the objects
+     * that an increment refers to might only be kept alive by an object
+     * that we're decrementing. */
+    size_t  pending_count;
+    struct cork_gc_log_entry  *pending;
+    /* The pools for each size class, which we create as needed.  The shared
+     * collector's pools are thread-safe. */
+    struct cork_mempool * volatile  pools[CORK_GC_SIZE_CLASS_COUNT];
+    /* The number of live objects from each pool, so that we know which pools
+     * we can free in cork_gc_done.  Not maintained for the shared collector,
+     * whose pools last as long as the process. */
+    size_t  pool_counts[CORK_GC_SIZE_CLASS_COUNT];
+    /* For a thread's collector, the statistics about the work that this
+     * thread has done, which we create the first time we need them.  Not
+     * used for the shared collector; each thread counts its work with the
+     * shared collector in its own counters. */
+    struct cork_gc_counters  *counters;
 };
 
+/* The number of possible roots that are actually buffered. */
+#define cork_gc_live_root_count(gc) \
+    (cork_atomic_load(&(gc)->root_count) - cork_atomic_load(&(gc)->root_holes))
+
 cork_tls(struct cork_gc, cork_gc);
 
+/* The collector that's shared by every thread that calls cork_gc_init_shared.
+ * Reference counts are updated atomically, and the roots buffer is protected
+ * by a lock.  Cycle collection stops the world: the collecting thread waits
+ * for every other attached thread to reach a safepoint before starting. */
+static struct {
+    struct cork_gc  gc;
+    /* Protects every field in this struct, and the roots buffer in gc. */
+    volatile int  lock;
+    /* The number of threads that are using the shared collector, not counting
+     * any that are blocked in cork_gc_begin_blocking. */
+    size_t  attached;
+    /* The number of threads waiting at a safepoint for the current
+     * collection to finish. */
+    size_t  parked;
+    /* Whether a thread has started a collection. */
+    volatile int  stopping;
+    /* Incremented whenever a collection finishes. */
+    volatile unsigned int  epoch;
+    /* Parked threads sleep on this condition variable until epoch changes,
+     * instead of spinning for the whole collection. */
+    pthread_mutex_t  park_mutex;
+    pthread_cond_t  park_cond;
+} cork_gc_shared = {
+    .gc = { .shared = true },
+    .park_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .park_cond = PTHREAD_COND_INITIALIZER
+};
+
+static void
+cork_gc_shared_lock(void)
+{
+    while (CORK_UNLIKELY(cork_int_cas(&cork_gc_shared.lock, 0, 1) != 0)) {
+        while (cork_atomic_load(&cork_gc_shared.lock)) {
+            cork_pause();
+        }
+    }
+}
+
 static void
-cork_gc_collect_cycles(struct cork_gc *gc);
+cork_gc_shared_unlock(void)
+{
+    cork_atomic_store(&cork_gc_shared.lock, 0);
+}
+
+/* Returns the collector that the current thread should use. */
+static struct cork_gc *
+cork_gc_current(void)
+{
+    struct cork_gc  *gc = cork_gc_get();
+    return gc->shared? &cork_gc_shared.gc: gc;
+}
+
+static void
+cork_gc_collect_cycles(struct cork_gc *gc, size_t budget);
+
+static void
+cork_gc_flush_log(struct cork_gc *gc);
+
+static void
+cork_gc_free_log(struct cork_gc *gc);
+
+static void
+cork_gc_log(struct cork_gc *gc, struct cork_gc_header *header, int delta);
+
+
+/*-----------------------------------------------------------------------
+ * Statistics
+ */
+
+/* The statistics for one thread.  Only that thread updates them, so that
+ * allocating and freeing objects doesn't bounce a shared cache line between
+ * threads; cork_gc_get_stats adds up every thread's counters. */
+struct cork_gc_counters {
+    struct cork_gc_stats  stats;
+    struct cork_gc_counters  *next;
+    struct cork_gc_counters  **prev_next;
+};
+
+/* Protects the list of counters, and the totals for threads that have
+ * finished. */
+static volatile int  cork_gc_counters_lock = 0;
+static struct cork_gc_counters  *cork_gc_counters_list = NULL;
+static struct cork_gc_stats  cork_gc_finished_stats;
+
+/* Adds each thread's counters to the finished totals when the thread exits. */
+static pthread_key_t  cork_gc_counters_key;
+cork_once_barrier(cork_gc_counters_barrier);
+
+static void
+cork_gc_counters_spin_lock(void)
+{
+    while (CORK_UNLIKELY(cork_int_cas(&cork_gc_counters_lock, 0, 1) != 0)) {
+        while (cork_atomic_load(&cork_gc_counters_lock)) {
+            cork_pause();
+        }
+    }
+}
+
+static void
+cork_gc_counters_spin_unlock(void)
+{
+    cork_atomic_store(&cork_gc_counters_lock, 0);
+}
+
+static void
+cork_gc_stats_add(struct cork_gc_stats *dest, struct cork_gc_stats *src)
+{
+    size_t  i;
+    dest->alloc_count += cork_atomic_load(&src->alloc_count);
+    dest->free_count += cork_atomic_load(&src->free_count);
+    dest->live_bytes += cork_atomic_load(&src->live_bytes);
+    dest->collection_count += cork_atomic_load(&src->collection_count);
+    dest->roots_scanned += cork_atomic_load(&src->roots_scanned);
+    dest->garbage_found += cork_atomic_load(&src->garbage_found);
+    for (i = 0; i < CORK_GC_PAUSE_BUCKET_COUNT; i++) {
+        dest->pause_counts[i] += cork_atomic_load(&src->pause_counts[i]);
+    }
+}
+
+static void
+cork_gc_counters_done(void *vcounters)
+{
+    struct cork_gc_counters  *counters = vcounters;
+    cork_gc_counters_spin_lock();
+    cork_gc_stats_add(&cork_gc_finished_stats, &counters->stats);
+    *counters->prev_next = counters->next;
+    if (counters->next != NULL) {
+        counters->next->prev_next = counters->prev_next;
+    }
+    cork_gc_counters_spin_unlock();
+    free(counters);
+    /* In case anything else that runs as the thread exits uses the
+     * collector. */
+    cork_gc_get()->counters = NULL;
+}
+
+static void
+cork_gc_counters_key_create(void)
+{
+    CORK_ATTR_UNUSED int  rc;
+    rc = pthread_key_create(&cork_gc_counters_key, cork_gc_counters_done);
+    assert(rc == 0);
+}
+
+static struct cork_gc_counters *
+cork_gc_counters_new(void)
+{
+    struct cork_gc_counters  *counters = calloc(1, sizeof(*counters));
+    if (CORK_UNLIKELY(counters == NULL)) {
+        cork_abort("Cannot allocate %zu bytes", sizeof(*counters));
+    }
+    cork_once(cork_gc_counters_barrier, cork_gc_counters_key_create());
+    pthread_setspecific(cork_gc_counters_key, counters);
+    cork_gc_counters_spin_lock();
+    counters->next = cork_gc_counters_list;
+    counters->prev_next = &cork_gc_counters_list;
+    if (cork_gc_counters_list != NULL) {
+        cork_gc_counters_list->prev_next = &counters->next;
+    }
+    cork_gc_counters_list = counters;
+    cork_gc_counters_spin_unlock();
+    return counters;
+}
+
+/* Returns the current thread's statistics. */
+static struct cork_gc_stats *
+cork_gc_local_stats(void)
+{
+    struct cork_gc  *local = cork_gc_get();
+    if (CORK_UNLIKELY(local->counters == NULL)) {
+        local->counters = cork_gc_counters_new();
+    }
+    return &local->counters->stats;
+}
+
+/* Only the owning thread updates a counter, so we don't need an atomic
+ * read-modify-write; the store only has to be atomic for cork_gc_get_stats's
+ * sake. */
+#define cork_gc_count(counter, delta) \
+    cork_atomic_store(&(counter), (counter) + (delta))
+
+void
+cork_gc_get_stats(struct cork_gc_stats *dest)
+{
+    struct cork_gc_counters  *counters;
+    cork_gc_counters_spin_lock();
+    *dest = cork_gc_finished_stats;
+    for (counters = cork_gc_counters_list; counters != NULL;
+         counters = counters->next) {
+        cork_gc_stats_add(dest, &counters->stats);
+    }
+    cork_gc_counters_spin_unlock();
+}
+
+static uint64_t
+cork_gc_now_ns(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+cork_gc_record_pause(uint64_t elapsed_ns)
+{
+    uint64_t  usec = elapsed_ns / 1000;
+    unsigned int  bucket = 0;
+    while (usec > 0 && bucket < CORK_GC_PAUSE_BUCKET_COUNT - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+    cork_gc_count(cork_gc_local_stats()->pause_counts[bucket], 1);
+}
 
 
 /*-----------------------------------------------------------------------
@@ -61,9 +362,12 @@ struct cork_gc_header {
      * during the mark/sweep process. */
     volatile int  ref_count_color;
 
-    /* The allocated size of this garbage-collected object (including
-     * the header). */
-    size_t  allocated_size;
+    /* This object's index in the roots buffer, if it's buffered. */
+    unsigned int  root_index : 32 - CORK_GC_SIZE_CLASS_BITS;
+
+    /* The pool that this object was allocated from, or 0 if it was allocated
+     * directly from the heap. */
+    unsigned int  size_class : CORK_GC_SIZE_CLASS_BITS;
 
     /* The garbage collection interface for this object. */
     struct cork_gc_obj_iface  *iface;
@@ -114,13 +418,20 @@ struct cork_gc_header {
             ((hdr)->ref_count_color & ~0x4) | (((buffered) & 1) << 2); \
     } while (0)
 
-#define cork_gc_free(hdr) \
-    do { \
-        if ((hdr)->iface->free != NULL) { \
-            (hdr)->iface->free(cork_gc_get_object((hdr))); \
-        } \
-        cork_free((hdr), (hdr)->allocated_size); \
-    } while (0)
+/* Objects that are too large for any of the pools have their size stored
+ * just before their header. */
+struct cork_gc_large_header {
+    size_t  allocated_size;
+};
+
+#define cork_gc_get_large_header(hdr) \
+    (((struct cork_gc_large_header *) (hdr)) - 1)
+
+/* The number of bytes that an object uses, including its header. */
+#define cork_gc_allocated_size(hdr) \
+    ((hdr)->size_class == 0? \
+     cork_gc_get_large_header((hdr))->allocated_size: \
+     (size_t) (hdr)->size_class * CORK_GC_SIZE_CLASS_STEP)
 
 #define cork_gc_recurse(gc, hdr, recurser) \
     do { \
@@ -147,6 +458,206 @@ enum cork_gc_color {
 #define cork_gc_get_object(hdr) \
     ((void *) (((struct cork_gc_header *) (hdr)) + 1))
 
+static struct cork_mempool *
+cork_gc_get_pool(struct cork_gc *gc, unsigned int size_class)
+{
+    struct cork_mempool  *pool = cork_atomic_load(&gc->pools[size_class]);
+    if (CORK_LIKELY(pool != NULL)) {
+        return pool;
+    }
+
+    if (gc->shared) {
+        cork_gc_shared_lock();
+        pool = gc->pools[size_class];
+    }
+    if (pool == NULL) {
+        DEBUG("Creating pool for %zu-byte objects\n",
+              (size_t) size_class * CORK_GC_SIZE_CLASS_STEP);
+        pool = cork_mempool_new_size_ex
+            (size_class * CORK_GC_SIZE_CLASS_STEP, CORK_GC_POOL_BLOCK_SIZE);
+        if (gc->shared) {
+            cork_mempool_set_thread_safe(pool);
+        }
+        cork_atomic_store(&gc->pools[size_class], pool);
+    }
+    if (gc->shared) {
+        cork_gc_shared_unlock();
+    }
+    return pool;
+}
+
+static void
+cork_gc_free(struct cork_gc *gc, struct cork_gc_header *header)
+{
+    struct cork_gc_stats  *stats = cork_gc_local_stats();
+    size_t  allocated_size = cork_gc_allocated_size(header);
+    unsigned int  size_class = header->size_class;
+    if (header->iface->free != NULL) {
+        header->iface->free(cork_gc_get_object(header));
+    }
+    cork_gc_count(stats->free_count, 1);
+    cork_gc_count(stats->live_bytes, -allocated_size);
+    if (size_class == 0) {
+        cork_free(cork_gc_get_large_header(header),
+                  allocated_size + sizeof(struct cork_gc_large_header));
+    } else {
+        cork_mempool_free_object
+            (cork_atomic_load(&gc->pools[size_class]), header);
+        if (!gc->shared) {
+            gc->pool_counts[size_class]--;
+        }
+    }
+}
+
+/* Returns the memory used by any empty pools, and frees any pools that don't
+ * have any live objects. */
+static void
+cork_gc_trim_pools(struct cork_gc *gc)
+{
+    unsigned int  i;
+    for (i = 1; i < CORK_GC_SIZE_CLASS_COUNT; i++) {
+        struct cork_mempool  *pool = gc->pools[i];
+        if (pool == NULL) {
+            continue;
+        }
+        if (gc->shared) {
+            cork_mempool_release_thread_cache(pool);
+            cork_mempool_trim(pool, 0);
+        } else if (gc->pool_counts[i] == 0) {
+            cork_mempool_free(pool);
+            gc->pools[i] = NULL;
+        } else {
+            cork_mempool_trim(pool, 0);
+        }
+    }
+}
+
+
+static void
+cork_gc_drain(struct cork_gc *gc)
+{
+    cork_gc_free_log(gc);
+    /* Freeing a garbage cycle might make new possible roots, so keep going
+     * until there aren't any left. */
+    while (gc->root_count > 0) {
+        cork_gc_collect_cycles(gc, 0);
+    }
+    if (gc->roots != NULL) {
+        cork_cfree(gc->roots, gc->roots_size, sizeof(struct cork_gc_header *));
+        gc->roots = NULL;
+        gc->roots_size = 0;
+    }
+    if (gc->garbage != NULL) {
+        cork_cfree(gc->garbage, gc->garbage_size,
+                   sizeof(struct cork_gc_header *));
+        gc->garbage = NULL;
+        gc->garbage_size = 0;
+    }
+    cork_gc_trim_pools(gc);
+}
+
+/* Waits for the current collection of the shared collector to finish.  Must
+ * be called with the shared collector's lock held; returns with the lock
+ * released. */
+static void
+cork_gc_shared_park(void)
+{
+    unsigned int  epoch = cork_gc_shared.epoch;
+    cork_gc_shared.parked++;
+    cork_gc_shared_unlock();
+    pthread_mutex_lock(&cork_gc_shared.park_mutex);
+    while (cork_atomic_load(&cork_gc_shared.epoch) == epoch) {
+        pthread_cond_wait(&cork_gc_shared.park_cond,
+                          &cork_gc_shared.park_mutex);
+    }
+    pthread_mutex_unlock(&cork_gc_shared.park_mutex);
+}
+
+/* Called with the shared collector's lock held. */
+static void
+cork_gc_shared_finish_collection(void)
+{
+    cork_gc_shared.parked = 0;
+    cork_atomic_store(&cork_gc_shared.stopping, 0);
+    /* A parked thread checks epoch while holding park_mutex, so it can't miss
+     * this wakeup. */
+    pthread_mutex_lock(&cork_gc_shared.park_mutex);
+    cork_atomic_store(&cork_gc_shared.epoch, cork_gc_shared.epoch + 1);
+    pthread_cond_broadcast(&cork_gc_shared.park_cond);
+    pthread_mutex_unlock(&cork_gc_shared.park_mutex);
+}
+
+/* Every call into the collector is a safepoint, where the current thread
+ * won't be in the middle of updating any references.  If another thread
+ * wants to collect the shared collector's garbage cycles, wait for it to
+ * finish. */
+static void
+cork_gc_shared_safepoint(struct cork_gc *local)
+{
+    if (local->shared && !local->collecting &&
+        CORK_UNLIKELY(cork_atomic_load(&cork_gc_shared.stopping))) {
+        cork_gc_shared_lock();
+        if (cork_gc_shared.stopping) {
+            cork_gc_shared_park();
+        } else {
+            cork_gc_shared_unlock();
+        }
+    }
+}
+
+/* Stops the world and looks for garbage cycles in the shared collector.  If
+ * another thread has already started a collection, waits for it to finish
+ * instead. */
+static void
+cork_gc_shared_collect(struct cork_gc *local, size_t budget)
+{
+    cork_gc_shared_lock();
+    if (cork_gc_shared.stopping) {
+        cork_gc_shared_park();
+        return;
+    }
+
+    DEBUG("Stopping the world\n");
+    cork_atomic_store(&cork_gc_shared.stopping, 1);
+    while (cork_gc_shared.parked + 1 < cork_gc_shared.attached) {
+        /* The other threads might not reach a safepoint for a while, so
+         * don't hog the CPU that they need to get there. */
+        cork_gc_shared_unlock();
+        sched_yield();
+        cork_gc_shared_lock();
+    }
+    cork_gc_shared_unlock();
+
+    local->collecting = true;
+    cork_gc_collect_cycles(&cork_gc_shared.gc, budget);
+    local->collecting = false;
+
+    cork_gc_shared_lock();
+    cork_gc_shared_finish_collection();
+    cork_gc_shared_unlock();
+}
+
+static void
+cork_gc_shared_attach(void)
+{
+    cork_gc_shared_lock();
+    while (cork_gc_shared.stopping) {
+        cork_gc_shared_unlock();
+        sched_yield();
+        cork_gc_shared_lock();
+    }
+    cork_gc_shared.attached++;
+    cork_gc_shared_unlock();
+}
+
+static void
+cork_gc_shared_detach(void)
+{
+    cork_gc_shared_lock();
+    cork_gc_shared.attached--;
+    cork_gc_shared_unlock();
+}
+
 
 void
 cork_gc_init(void)
@@ -154,22 +665,167 @@ cork_gc_init(void)
     cork_gc_get();
 }
 
+void
+cork_gc_init_shared(void)
+{
+    struct cork_gc  *local = cork_gc_get();
+    if (!local->shared) {
+        assert(local->root_count == 0);
+        cork_gc_free_log(local);
+        cork_gc_shared_attach();
+        local->shared = true;
+    }
+}
+
+/* Lets other threads use any objects that are in the current thread's caches
+ * for the shared collector's pools. */
+static void
+cork_gc_release_thread_caches(struct cork_gc *gc)
+{
+    unsigned int  i;
+    for (i = 1; i < CORK_GC_SIZE_CLASS_COUNT; i++) {
+        struct cork_mempool  *pool = cork_atomic_load(&gc->pools[i]);
+        if (pool != NULL) {
+            cork_mempool_release_thread_cache(pool);
+        }
+    }
+}
+
 void
 cork_gc_done(void)
 {
-    cork_gc_collect_cycles(cork_gc_get());
+    struct cork_gc  *local = cork_gc_get();
+    if (local->shared) {
+        cork_gc_shared_lock();
+        while (cork_gc_shared.stopping) {
+            cork_gc_shared_park();
+            cork_gc_shared_lock();
+        }
+        if (cork_gc_shared.attached == 1) {
+            /* We're the last thread using the shared collector, so collect
+             * any garbage cycles that are left, and trim the pools.  Shared
+             * objects that are still referenced aren't freed.  Keep any
+             * blocked threads from coming back until we're done. */
+            cork_atomic_store(&cork_gc_shared.stopping, 1);
+            cork_gc_shared_unlock();
+            local->collecting = true;
+            cork_gc_drain(&cork_gc_shared.gc);
+            local->collecting = false;
+            cork_gc_shared_lock();
+            cork_gc_shared_finish_collection();
+        }
+        cork_gc_shared.attached--;
+        cork_gc_shared_unlock();
+        cork_gc_release_thread_caches(&cork_gc_shared.gc);
+        local->shared = false;
+    } else {
+        cork_gc_drain(local);
+    }
+}
+
+void
+cork_gc_safepoint(void)
+{
+    cork_gc_shared_safepoint(cork_gc_get());
+}
+
+void
+cork_gc_begin_blocking(void)
+{
+    struct cork_gc  *local = cork_gc_get();
+    if (local->shared) {
+        cork_gc_shared_detach();
+    }
+}
+
+void
+cork_gc_end_blocking(void)
+{
+    struct cork_gc  *local = cork_gc_get();
+    if (local->shared) {
+        cork_gc_shared_attach();
+    }
+}
+
+void
+cork_gc_set_incremental(size_t threshold, size_t budget)
+{
+    struct cork_gc  *gc = cork_gc_current();
+    cork_atomic_store(&gc->collect_threshold, threshold);
+    cork_atomic_store(&gc->collect_budget, budget);
+}
+
+void
+cork_gc_set_deferred(size_t log_size)
+{
+    struct cork_gc  *gc = cork_gc_get();
+    cork_gc_free_log(gc);
+    if (log_size != 0 && !gc->shared) {
+        size_t  size = 1;
+        while (size < log_size) {
+            size <<= 1;
+        }
+        gc->log = cork_calloc(size, sizeof(struct cork_gc_log_entry));
+        gc->pending = cork_calloc(size, sizeof(struct cork_gc_log_entry));
+        gc->pending_count = 0;
+        gc->log_size = size;
+    }
+}
+
+size_t
+cork_gc_collect_step(size_t budget)
+{
+    struct cork_gc  *local = cork_gc_get();
+    if (local->collecting) {
+        /* We're being called from a free method. */
+    } else if (local->shared) {
+        cork_gc_shared_collect(local, budget);
+        return cork_gc_live_root_count(&cork_gc_shared.gc);
+    } else {
+        cork_gc_flush_log(local);
+        if (local->root_count > 0) {
+            cork_gc_collect_cycles(local, budget);
+        }
+    }
+    return cork_gc_live_root_count(cork_gc_current());
 }
 
 void *
 cork_gc_alloc(size_t instance_size, struct cork_gc_obj_iface *iface)
 {
+    struct cork_gc  *local = cork_gc_get();
+    struct cork_gc  *gc;
     size_t  full_size = instance_size + sizeof(struct cork_gc_header);
+    struct cork_gc_header  *header;
+    struct cork_gc_stats  *stats;
+    cork_gc_shared_safepoint(local);
+    gc = local->shared? &cork_gc_shared.gc: local;
     DEBUG("Allocating %zu (%zu) bytes\n", instance_size, full_size);
-    struct cork_gc_header  *header = cork_malloc(full_size);
+
+    if (CORK_LIKELY(full_size <= CORK_GC_POOL_MAX_SIZE)) {
+        unsigned int  size_class =
+            (full_size + CORK_GC_SIZE_CLASS_STEP - 1) /
+            CORK_GC_SIZE_CLASS_STEP;
+        header = cork_mempool_new_object(cork_gc_get_pool(gc, size_class));
+        header->size_class = size_class;
+        full_size = size_class * CORK_GC_SIZE_CLASS_STEP;
+        if (!gc->shared) {
+            gc->pool_counts[size_class]++;
+        }
+    } else {
+        struct cork_gc_large_header  *large =
+            cork_malloc(sizeof(struct cork_gc_large_header) + full_size);
+        large->allocated_size = full_size;
+        header = (struct cork_gc_header *) (large + 1);
+        header->size_class = 0;
+    }
+
     DEBUG("  Result is %p[%p]\n", cork_gc_get_object(header), header);
     header->ref_count_color = cork_gc_ref_count_color(1, false, GC_BLACK);
-    header->allocated_size = full_size;
     header->iface = iface;
+    stats = cork_gc_local_stats();
+    cork_gc_count(stats->alloc_count, 1);
+    cork_gc_count(stats->live_bytes, full_size);
     return cork_gc_get_object(header);
 }
 
@@ -177,11 +833,24 @@ void *
 cork_gc_incref(void *obj)
 {
     if (obj != NULL) {
+        struct cork_gc  *local = cork_gc_get();
         struct cork_gc_header  *header = cork_gc_get_header(obj);
-        cork_gc_inc_ref_count(header);
+        if (local->log_size != 0 && !local->collecting) {
+            cork_gc_log(local, header, 1);
+            return obj;
+        } else if (local->shared) {
+            int  old;
+            int  new;
+            do {
+                old = cork_atomic_load(&header->ref_count_color);
+                new = (old + (1 << 3)) & ~0x3;
+            } while (cork_int_cas(&header->ref_count_color, old, new) != old);
+        } else {
+            cork_gc_inc_ref_count(header);
+            cork_gc_set_color(header, GC_BLACK);
+        }
         DEBUG("Incrementing %p -> %d\n",
               obj, cork_gc_get_ref_count(header));
-        cork_gc_set_color(header, GC_BLACK);
     }
     return obj;
 }
@@ -195,7 +864,31 @@ cork_gc_release(struct cork_gc *gc, struct cork_gc_header *header)
     cork_gc_recurse(gc, header, cork_gc_decref_step);
     cork_gc_set_color(header, GC_BLACK);
     if (!cork_gc_get_buffered(header)) {
-        cork_gc_free(header);
+        cork_gc_free(gc, header);
+    }
+}
+
+static void
+cork_gc_add_root(struct cork_gc *gc, struct cork_gc_header *header)
+{
+    if (gc->shared) {
+        cork_gc_shared_lock();
+    }
+    if (CORK_UNLIKELY(gc->root_count == gc->roots_size)) {
+        size_t  new_size =
+            (gc->roots_size == 0)? ROOTS_SIZE: gc->roots_size * 2;
+        DEBUG("  Growing roots buffer to %zu entries\n", new_size);
+        gc->roots = cork_realloc
+            (gc->roots, gc->roots_size * sizeof(struct cork_gc_header *),
+             new_size * sizeof(struct cork_gc_header *));
+        gc->roots_size = new_size;
+    }
+    assert(gc->root_count < CORK_GC_MAX_ROOTS);
+    header->root_index = gc->root_count;
+    gc->roots[gc->root_count] = header;
+    cork_atomic_store(&gc->root_count, gc->root_count + 1);
+    if (gc->shared) {
+        cork_gc_shared_unlock();
     }
 }
 
@@ -207,21 +900,48 @@ cork_gc_possible_root(struct cork_gc *gc, struct cork_gc_header *header)
         cork_gc_set_color(header, GC_PURPLE);
         if (!cork_gc_get_buffered(header)) {
             cork_gc_set_buffered(header, true);
-            if (gc->root_count >= ROOTS_SIZE) {
-                cork_gc_collect_cycles(gc);
-            }
-            gc->roots[gc->root_count++] = header;
+            cork_gc_add_root(gc, header);
         }
     } else {
         DEBUG("  Already marked as possible garbage cycle root\n");
     }
 }
 
+/* Shared objects can be referenced from several threads, so we have to update
+ * the reference count, color, and buffered flag in a single atomic step. */
+static void
+cork_gc_shared_decref(struct cork_gc *gc, struct cork_gc_header *header)
+{
+    int  old;
+    int  new;
+    do {
+        old = cork_atomic_load(&header->ref_count_color);
+        new = old - (1 << 3);
+        if ((new >> 3) > 0) {
+            new = (new & ~0x7) | (1 << 2) | GC_PURPLE;
+        }
+    } while (cork_int_cas(&header->ref_count_color, old, new) != old);
+    DEBUG("Decrementing %p -> %d\n",
+          cork_gc_get_object(header), new >> 3);
+
+    if ((new >> 3) == 0) {
+        DEBUG("  Releasing %p\n", header);
+        cork_gc_release(gc, header);
+    } else if ((old & (1 << 2)) == 0) {
+        DEBUG("  Possible garbage cycle root\n");
+        cork_gc_add_root(gc, header);
+    }
+}
+
 static void
 cork_gc_decref_step(struct cork_gc *gc, void *obj, void *ud)
 {
     if (obj != NULL) {
         struct cork_gc_header  *header = cork_gc_get_header(obj);
+        if (gc->shared) {
+            cork_gc_shared_decref(gc, header);
+            return;
+        }
         cork_gc_dec_ref_count(header);
         DEBUG("Decrementing %p -> %d\n",
               obj, cork_gc_get_ref_count(header));
@@ -234,20 +954,132 @@ cork_gc_decref_step(struct cork_gc *gc, void *obj, void *ud)
     }
 }
 
+static void
+cork_gc_apply_increment(struct cork_gc_header *header, int delta)
+{
+    header->ref_count_color += delta << 3;
+    cork_gc_set_color(header, GC_BLACK);
+}
+
+static void
+cork_gc_apply_decrement(struct cork_gc *gc, struct cork_gc_header *header,
+                        int delta)
+{
+    for (; delta < 0; delta++) {
+        cork_gc_decref_step(gc, cork_gc_get_object(header), NULL);
+    }
+}
+
+static void
+cork_gc_flush_log(struct cork_gc *gc)
+{
+    size_t  i;
+    if (gc->log_size == 0) {
+        return;
+    }
+
+    /* Apply every increment before any of the decrements.  Any reference
+     * count changes made while we're doing this (by an object's free method,
+     * for instance) are applied right away. */
+    gc->collecting = true;
+    for (i = 0; i < gc->log_size; i++) {
+        struct cork_gc_log_entry  *entry = &gc->log[i];
+        if (entry->header != NULL && entry->delta > 0) {
+            cork_gc_apply_increment(entry->header, entry->delta);
+            entry->header = NULL;
+        }
+    }
+    for (i = 0; i < gc->pending_count; i++) {
+        struct cork_gc_log_entry  *entry = &gc->pending[i];
+        cork_gc_apply_decrement(gc, entry->header, entry->delta);
+    }
+    gc->pending_count = 0;
+    for (i = 0; i < gc->log_size; i++) {
+        struct cork_gc_log_entry  *entry = &gc->log[i];
+        if (entry->header != NULL) {
+            struct cork_gc_header  *header = entry->header;
+            entry->header = NULL;
+            cork_gc_apply_decrement(gc, header, entry->delta);
+        }
+    }
+    gc->collecting = false;
+}
+
+static void
+cork_gc_free_log(struct cork_gc *gc)
+{
+    if (gc->log_size != 0) {
+        cork_gc_flush_log(gc);
+        cork_cfree(gc->log, gc->log_size, sizeof(struct cork_gc_log_entry));
+        cork_cfree(gc->pending, gc->log_size,
+                   sizeof(struct cork_gc_log_entry));
+        gc->log = NULL;
+        gc->pending = NULL;
+        gc->log_size = 0;
+    }
+}
+
+/* Records a change to an object's reference count in the current thread's
+ * log, without touching the object unless we have to evict another entry. */
+static void
+cork_gc_log(struct cork_gc *gc, struct cork_gc_header *header, int delta)
+{
+    size_t  index = (((uintptr_t) header) >> 3) & (gc->log_size - 1);
+    struct cork_gc_log_entry  *entry = &gc->log[index];
+
+    if (CORK_LIKELY(entry->header == header)) {
+        entry->delta += delta;
+        if (entry->delta == 0) {
+            DEBUG("Reference count changes for %p cancel out\n",
+                  cork_gc_get_object(header));
+            entry->header = NULL;
+        }
+        return;
+    }
+
+    if (entry->header != NULL) {
+        /* Increments are always safe to apply early. */
+        if (entry->delta > 0) {
+            cork_gc_apply_increment(entry->header, entry->delta);
+        } else if (gc->pending_count < gc->log_size) {
+            gc->pending[gc->pending_count++] = *entry;
+        } else {
+            /* This also takes care of the entry we're evicting. */
+            cork_gc_flush_log(gc);
+        }
+    }
+
+    entry->header = header;
+    entry->delta = delta;
+}
+
 void
 cork_gc_decref(void *obj)
 {
     if (obj != NULL) {
-        struct cork_gc  *gc = cork_gc_get();
-        struct cork_gc_header  *header = cork_gc_get_header(obj);
-        cork_gc_dec_ref_count(header);
-        DEBUG("Decrementing %p -> %d\n",
-              obj, cork_gc_get_ref_count(header));
-        if (cork_gc_get_ref_count(header) == 0) {
-            DEBUG("  Releasing %p\n", header);
-            cork_gc_release(gc, header);
+        struct cork_gc  *local = cork_gc_get();
+        struct cork_gc  *gc;
+        size_t  threshold;
+        cork_gc_shared_safepoint(local);
+        gc = local->shared? &cork_gc_shared.gc: local;
+        if (local->log_size != 0 && !local->collecting) {
+            cork_gc_log(gc, cork_gc_get_header(obj), -1);
         } else {
-            cork_gc_possible_root(gc, header);
+            cork_gc_decref_step(gc, obj, NULL);
+        }
+
+        /* We only look for garbage cycles here, and not while we're in the
+         * middle of releasing a tree of objects. */
+        threshold = cork_atomic_load(&gc->collect_threshold);
+        if (CORK_UNLIKELY(cork_gc_live_root_count(gc) >=
+                          (threshold == 0? ROOTS_SIZE: threshold)) &&
+            !local->collecting) {
+            size_t  budget = cork_atomic_load(&gc->collect_budget);
+            if (gc->shared) {
+                cork_gc_shared_collect(local, budget);
+            } else {
+                cork_gc_collect_cycles(gc, budget);
+            }
         }
     }
 }
@@ -279,11 +1111,14 @@ cork_gc_mark_gray_step(struct cork_gc *gc, void *obj, void *ud)
 }
 
 static void
-cork_gc_mark_roots(struct cork_gc *gc)
+cork_gc_mark_roots(struct cork_gc *gc, size_t start, size_t end)
 {
     size_t  i;
-    for (i = 0; i < gc->root_count; i++) {
+    for (i = start; i < end; i++) {
         struct cork_gc_header  *header = gc->roots[i];
+        if (header == NULL) {
+            continue;
+        }
         if (cork_gc_get_color(header) == GC_PURPLE) {
             DEBUG("  Checking possible garbage cycle root %p\n",
                   cork_gc_get_object(header));
@@ -295,10 +1130,11 @@ cork_gc_mark_roots(struct cork_gc *gc)
                   cork_gc_get_object(header));
             cork_gc_set_buffered(header, false);
             gc->roots[i] = NULL;
+            gc->root_holes++;
             if (cork_gc_get_color(header) == GC_BLACK &&
                 cork_gc_get_ref_count(header) == 0) {
                 DEBUG("  Freeing %p\n", header);
-                cork_gc_free(header);
+                cork_gc_free(gc, header);
             }
         }
     }
@@ -352,10 +1188,10 @@ cork_gc_scan(struct cork_gc *gc, void *obj, void *ud)
 }
 
 static void
-cork_gc_scan_roots(struct cork_gc *gc)
+cork_gc_scan_roots(struct cork_gc *gc, size_t start, size_t end)
 {
     size_t  i;
-    for (i = 0; i < gc->root_count; i++) {
+    for (i = start; i < end; i++) {
         if (gc->roots[i] != NULL) {
             void  *obj = cork_gc_get_object(gc->roots[i]);
             cork_gc_scan(gc, obj, NULL);
@@ -368,22 +1204,39 @@ cork_gc_collect_white(struct cork_gc *gc, void *obj, void *ud)
 {
     if (obj != NULL) {
         struct cork_gc_header  *header = cork_gc_get_header(obj);
-        if (cork_gc_get_color(header) == GC_WHITE &&
-            !cork_gc_get_buffered(header)) {
+        if (cork_gc_get_color(header) == GC_WHITE) {
+            /* If we're only examining some of the possible roots, this
+             * object might be one of the others.  It's still garbage, but
+             * we have to remove it from the roots buffer before freeing
+             * it. */
+            if (cork_gc_get_buffered(header)) {
+                gc->roots[header->root_index] = NULL;
+                gc->root_holes++;
+                cork_gc_set_buffered(header, false);
+            }
             DEBUG("  Releasing %p\n", obj);
             cork_gc_set_color(header, GC_BLACK);
             cork_gc_recurse(gc, header, cork_gc_collect_white);
-            DEBUG("  Freeing %p\n", header);
-            cork_gc_free(header);
+            if (CORK_UNLIKELY(gc->garbage_count == gc->garbage_size)) {
+                size_t  new_size =
+                    (gc->garbage_size == 0)? ROOTS_SIZE: gc->garbage_size * 2;
+                gc->garbage = cork_realloc
+                    (gc->garbage,
+                     gc->garbage_size * sizeof(struct cork_gc_header *),
+                     new_size * sizeof(struct cork_gc_header *));
+                gc->garbage_size = new_size;
+            }
+            gc->garbage[gc->garbage_count++] = header;
         }
     }
 }
 
 static void
-cork_gc_collect_roots(struct cork_gc *gc)
+cork_gc_collect_roots(struct cork_gc *gc, size_t start, size_t end)
 {
+    struct cork_gc_stats  *stats;
     size_t  i;
-    for (i = 0; i < gc->root_count; i++) {
+    for (i = start; i < end; i++) {
         if (gc->roots[i] != NULL) {
             struct cork_gc_header  *header = gc->roots[i];
             void  *obj = cork_gc_get_object(header);
@@ -391,16 +1244,89 @@ cork_gc_collect_roots(struct cork_gc *gc)
             DEBUG("Collecting cycles from garbage root %p\n", obj);
             cork_gc_collect_white(gc, obj, NULL);
             gc->roots[i] = NULL;
+            gc->root_holes++;
         }
     }
-    gc->root_count = 0;
+
+    stats = cork_gc_local_stats();
+    cork_gc_count(stats->garbage_found, gc->garbage_count);
+    for (i = 0; i < gc->garbage_count; i++) {
+        DEBUG("  Freeing %p\n", gc->garbage[i]);
+        cork_gc_free(gc, gc->garbage[i]);
+    }
+    gc->garbage_count = 0;
 }
 
+/* Removes the NULL entries from the roots buffer, keeping the remaining
+ * entries in order. */
 static void
-cork_gc_collect_cycles(struct cork_gc *gc)
+cork_gc_compact_roots(struct cork_gc *gc)
 {
-    DEBUG("Collecting garbage cycles\n");
-    cork_gc_mark_roots(gc);
-    cork_gc_scan_roots(gc);
-    cork_gc_collect_roots(gc);
+    size_t  i;
+    size_t  dest = 0;
+    size_t  cursor = 0;
+    DEBUG("Compacting %zu holes out of %zu roots\n",
+          gc->root_holes, gc->root_count);
+    for (i = 0; i < gc->root_count; i++) {
+        struct cork_gc_header  *header = gc->roots[i];
+        if (i == gc->collect_cursor) {
+            cursor = dest;
+        }
+        if (header != NULL) {
+            header->root_index = dest;
+            gc->roots[dest++] = header;
+        }
+    }
+    gc->collect_cursor = cursor;
+    gc->root_holes = 0;
+    cork_atomic_store(&gc->root_count, dest);
+}
+
+/* Looks for garbage cycles among the next `budget` possible roots (or among
+ * all of them, if `budget` is 0).  The cycle collection algorithm works fine
+ * on any subset of the roots; garbage cycles that aren't reachable from this
+ * subset will be found when we examine the rest.  Each call picks up where the
+ * previous one left off, so the oldest roots can't be starved by newer ones. */
+static void
+cork_gc_collect_cycles(struct cork_gc *gc, size_t budget)
+{
+    uint64_t  start_time = cork_gc_now_ns();
+    struct cork_gc_stats  *stats;
+    size_t  end;
+    size_t  start;
+
+    /* We need up-to-date reference counts to find garbage cycles. */
+    cork_gc_flush_log(gc);
+    if (budget == 0 || budget >= gc->root_count) {
+        start = 0;
+        end = gc->root_count;
+    } else {
+        start = (gc->collect_cursor < gc->root_count)? gc->collect_cursor: 0;
+        end = (budget < gc->root_count - start)?
+            start + budget: gc->root_count;
+    }
+    stats = cork_gc_local_stats();
+    cork_gc_count(stats->collection_count, 1);
+    cork_gc_count(stats->roots_scanned, end - start);
+
+    DEBUG("Collecting garbage cycles from roots %zu-%zu\n", start, end);
+    gc->collecting = true;
+    cork_gc_mark_roots(gc, start, end);
+    cork_gc_scan_roots(gc, start, end);
+    cork_gc_collect_roots(gc, start, end);
+    gc->collect_cursor = end;
+
+    /* Every root that we just examined is now a hole.  (An object's free
+     * method might have buffered new roots at the end while we were
+     * collecting.)  Squeeze out the holes once they make up a quarter of the
+     * buffer, which keeps the cost amortized across collections. */
+    if (gc->root_holes == gc->root_count) {
+        gc->root_holes = 0;
+        gc->collect_cursor = 0;
+        cork_atomic_store(&gc->root_count, 0);
+    } else if (gc->root_holes * 4 >= gc->root_count) {
+        cork_gc_compact_roots(gc);
+    }
+    gc->collecting = false;
+    cork_gc_record_pause(cork_gc_now_ns() - start_time);
 }
@@ -7,8 +7,20 @@
  * ----------------------------------------------------------------------
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
 #include "libcork/core/hash.h"
 #include "libcork/core/types.h"
+#include "libcork/threads/atomics.h"
+#include "libcork/threads/basics.h"
+
+#include "digest.h"
 
 bool
 cork_big_hash_equal(const cork_big_hash h1, const cork_big_hash h2);
@@ -21,3 +33,1244 @@ cork_hash_buffer(cork_hash seed, const void *src, size_t len);
 
 cork_big_hash
 cork_big_hash_buffer(cork_big_hash seed, const void *src, size_t len);
+
+
+/*-----------------------------------------------------------------------
+ * Batch hashing
+ */
+
+/* cork_hash_buffers is a convenience wrapper around cork_hash_buffer: each
+ * key can have a different length, so there isn't much we can share between
+ * them, but we do prefetch the keys that we're about to hash.
+ *
+ * The fixed-width variants are where batching pays off.  The hashes of
+ * different keys don't depend on each other, so we run each step of the hash
+ * for every key in the batch before moving on to the next step.  That gives
+ * the CPU several independent multiply chains to overlap, instead of waiting
+ * for each key's hash to finish before starting on the next.  Since every key
+ * has the same width, we can also drop all of the length-dependent branches. */
+
+#define CORK_HASH_BATCH_SIZE  4
+
+/* How many keys ahead to prefetch */
+#define CORK_HASH_PREFETCH_DISTANCE  8
+
+void
+cork_hash_buffers(cork_hash seed, const void * const *srcs, const size_t *lens,
+                  size_t count, cork_hash *dest)
+{
+    size_t  i;
+    for (i = 0; i < count; i++) {
+        if (i + CORK_HASH_PREFETCH_DISTANCE < count) {
+            CORK_PREFETCH(srcs[i + CORK_HASH_PREFETCH_DISTANCE]);
+        }
+        dest[i] = cork_hash_buffer(seed, srcs[i], lens[i]);
+    }
+}
+
+#if CORK_SIZEOF_POINTER == 8
+/* Runs `stmt` for each key in a batch, with `j` set to the key's index.  We
+ * spell out each key instead of using a loop, so that the compiler keeps every
+ * key's state in registers. */
+#define cork_hash_each_key(stmt) \
+    do { \
+        j = 0; stmt; \
+        j = 1; stmt; \
+        j = 2; stmt; \
+        j = 3; stmt; \
+    } while (0)
+
+/* The same as calling cork_hash_buffer (which uses MurmurHash3 x64_128) on
+ * CORK_HASH_BATCH_SIZE keys of `width` bytes each, where `width` is 4, 8, or
+ * 16.  Each cork_hash_each_key performs one step of the hash for every key.
+ * This must be inlined into each caller, so that `width` is a constant. */
+__attribute__((always_inline))
+static inline void
+cork_hash_batch_fixed(cork_hash seed, const uint8_t *src, size_t width,
+                      cork_hash *dest)
+{
+    const uint64_t  c1 = UINT64_C(0x87c37b91114253d5);
+    const uint64_t  c2 = UINT64_C(0x4cf5ad432745937f);
+    const uint64_t  h = ((uint64_t) seed << 32) | seed;
+    uint64_t  h1[CORK_HASH_BATCH_SIZE];
+    uint64_t  h2[CORK_HASH_BATCH_SIZE];
+    uint64_t  k1[CORK_HASH_BATCH_SIZE];
+    uint64_t  k2[CORK_HASH_BATCH_SIZE];
+    size_t  j;
+
+    if (width == 16) {
+        /* One full block, and no tail */
+        cork_hash_each_key({
+            k1[j] = cork_getblock64((const uint64_t *) (src + 16*j), 0);
+            k2[j] = cork_getblock64((const uint64_t *) (src + 16*j), 1);
+        });
+        cork_hash_each_key({
+            k1[j] *= c1; k1[j] = CORK_ROTL64(k1[j], 31); k1[j] *= c2;
+            h1[j] = h ^ k1[j];
+            h1[j] = CORK_ROTL64(h1[j], 27); h1[j] += h;
+            h1[j] = h1[j]*5 + 0x52dce729;
+        });
+        cork_hash_each_key({
+            k2[j] *= c2; k2[j] = CORK_ROTL64(k2[j], 33); k2[j] *= c1;
+            h2[j] = h ^ k2[j];
+            h2[j] = CORK_ROTL64(h2[j], 31); h2[j] += h1[j];
+            h2[j] = h2[j]*5 + 0x38495ab5;
+        });
+    } else {
+        /* No blocks; the tail is a single little-endian word */
+        cork_hash_each_key({
+            if (width == 8) {
+                uint64_t  word;
+                memcpy(&word, src + 8*j, sizeof(word));
+                k1[j] = CORK_UINT64_LITTLE_TO_HOST(word);
+            } else {
+                uint32_t  word;
+                memcpy(&word, src + 4*j, sizeof(word));
+                k1[j] = CORK_UINT32_LITTLE_TO_HOST(word);
+            }
+        });
+        cork_hash_each_key({
+            k1[j] *= c1; k1[j] = CORK_ROTL64(k1[j], 31); k1[j] *= c2;
+            h1[j] = h ^ k1[j];
+            h2[j] = h;
+        });
+    }
+
+    cork_hash_each_key({
+        h1[j] ^= width; h2[j] ^= width;
+        h1[j] += h2[j];
+        h2[j] += h1[j];
+    });
+    cork_hash_each_key({
+        h1[j] = cork_fmix64(h1[j]);
+        h2[j] = cork_fmix64(h2[j]);
+    });
+    /* cork_hash_buffer keeps the most significant 32 bits of the 128-bit
+     * result, which come from h1. */
+    cork_hash_each_key(dest[j] = (cork_hash) ((h1[j] + h2[j]) >> 32));
+}
+
+#undef cork_hash_each_key
+#else
+/* MurmurHash3 x86_32 only has one short multiply chain per key, so there's
+ * nothing to gain from interleaving its steps by hand. */
+static inline void
+cork_hash_batch_fixed(cork_hash seed, const uint8_t *src, size_t width,
+                      cork_hash *dest)
+{
+    size_t  j;
+    for (j = 0; j < CORK_HASH_BATCH_SIZE; j++) {
+        dest[j] = cork_hash_buffer(seed, src + j*width, width);
+    }
+}
+#endif
+
+#define cork_define_hash_buffers(width) \
+void \
+cork_hash_buffers_##width(cork_hash seed, const void *src, size_t count, \
+                          cork_hash *dest) \
+{ \
+    const uint8_t  *curr = src; \
+    size_t  i; \
+    for (i = 0; i + CORK_HASH_BATCH_SIZE <= count; \
+         i += CORK_HASH_BATCH_SIZE, curr += CORK_HASH_BATCH_SIZE * width) { \
+        cork_hash_batch_fixed(seed, curr, width, dest + i); \
+    } \
+    for (; i < count; i++, curr += width) { \
+        dest[i] = cork_hash_buffer(seed, curr, width); \
+    } \
+}
+
+cork_define_hash_buffers(4)
+cork_define_hash_buffers(8)
+cork_define_hash_buffers(16)
+
+
+/*-----------------------------------------------------------------------
+ * 64-bit hashes
+ */
+
+/* Inputs of up to CORK_HASH64_SHORT_MAX bytes are hashed by repeatedly
+ * multiplying 64-bit words into a 128-bit product and folding the halves back
+ * together (similar to wyhash), which has very little setup cost.  Longer
+ * inputs are processed in 64-byte stripes using eight independent 64-bit
+ * lanes (similar to XXH3), which lets us use SIMD instructions if the CPU has
+ * them.  Every kernel produces exactly the same result, and we always read the
+ * input as little-endian words, so hash values are the same on every
+ * platform. */
+
+#define CORK_HASH64_SHORT_MAX  256
+#define CORK_HASH64_STRIPE_SIZE  64
+#define CORK_HASH64_LANE_COUNT  8
+#define CORK_HASH64_SECRET_COUNT  24
+#define CORK_HASH64_STRIPES_PER_BLOCK \
+    (CORK_HASH64_SECRET_COUNT - CORK_HASH64_LANE_COUNT)
+#define CORK_HASH64_BLOCK_SIZE \
+    (CORK_HASH64_STRIPES_PER_BLOCK * CORK_HASH64_STRIPE_SIZE)
+
+#define CORK_HASH64_PRIME32_1  UINT32_C(0x9e3779b1)
+#define CORK_HASH64_PRIME32_2  UINT32_C(0x85ebca77)
+#define CORK_HASH64_PRIME32_3  UINT32_C(0xc2b2ae3d)
+#define CORK_HASH64_PRIME64_1  UINT64_C(0x9e3779b185ebca87)
+#define CORK_HASH64_PRIME64_2  UINT64_C(0xc2b2ae3d27d4eb4f)
+#define CORK_HASH64_PRIME64_3  UINT64_C(0x165667b19e3779f9)
+#define CORK_HASH64_PRIME64_4  UINT64_C(0x85ebca77c2b2ae63)
+#define CORK_HASH64_PRIME64_5  UINT64_C(0x27d4eb2f165667c5)
+
+/* Generated with splitmix64. */
+static const uint64_t  cork_hash64_secret[CORK_HASH64_SECRET_COUNT] = {
+    UINT64_C(0x41a615766ec36cd6), UINT64_C(0xfd3f137dd07c7d24),
+    UINT64_C(0xcd19d9f8055c035a), UINT64_C(0x5a9903ab0f78e923),
+    UINT64_C(0xb49ba780fed2cd4f), UINT64_C(0x7ce4ecc5c8efd1a7),
+    UINT64_C(0x0968c39409e048f2), UINT64_C(0x1f14e4b760fd091a),
+    UINT64_C(0x565bb8fe45c37084), UINT64_C(0xbc382cca62e1638f),
+    UINT64_C(0x6446009ab95944ef), UINT64_C(0x488596528a64e4ee),
+    UINT64_C(0x8c680667e06c6895), UINT64_C(0xea1aa682b863e1a1),
+    UINT64_C(0x8167ce47dae49fe1), UINT64_C(0xa87863f4b3ae8f6a),
+    UINT64_C(0xaa547d35b0f64dff), UINT64_C(0x2e418c15e715d066),
+    UINT64_C(0xd0b43e1f45de99c8), UINT64_C(0xd3fbebde71ae77f5),
+    UINT64_C(0xa87b56fe6f436eda), UINT64_C(0x4dcac4c9446ec041),
+    UINT64_C(0xb362816596668d0a), UINT64_C(0x952d617fc6708835)
+};
+
+static const uint64_t  cork_hash64_short_secret[4] = {
+    UINT64_C(0x5a8e0fccf464e917), UINT64_C(0x02f268d55c26f5cb),
+    UINT64_C(0xb68d811b8196f3db), UINT64_C(0xd34ce6eb224eeae5)
+};
+
+static inline uint64_t
+cork_hash64_read64(const uint8_t *p)
+{
+    uint64_t  v;
+    memcpy(&v, p, sizeof(v));
+    return CORK_UINT64_LITTLE_TO_HOST(v);
+}
+
+static inline uint64_t
+cork_hash64_read32(const uint8_t *p)
+{
+    uint32_t  v;
+    memcpy(&v, p, sizeof(v));
+    return CORK_UINT32_LITTLE_TO_HOST(v);
+}
+
+/* Replaces a and b with the low and high halves of their 128-bit product. */
+static inline void
+cork_hash64_mum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t  r = (__uint128_t) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#else
+    uint64_t  ha = *a >> 32;
+    uint64_t  hb = *b >> 32;
+    uint64_t  la = (uint32_t) *a;
+    uint64_t  lb = (uint32_t) *b;
+    uint64_t  rh = ha * hb;
+    uint64_t  rm0 = ha * lb;
+    uint64_t  rm1 = hb * la;
+    uint64_t  rl = la * lb;
+    uint64_t  t = rl + (rm0 << 32);
+    uint64_t  carry = t < rl;
+    uint64_t  lo = t + (rm1 << 32);
+    carry += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+static inline uint64_t
+cork_hash64_mix(uint64_t a, uint64_t b)
+{
+    cork_hash64_mum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t
+cork_hash64_short(uint64_t seed, const uint8_t *p, size_t len)
+{
+    const uint64_t  *s = cork_hash64_short_secret;
+    uint64_t  a;
+    uint64_t  b;
+
+    seed ^= cork_hash64_mix(seed ^ s[0], s[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t  mid = (len >> 3) << 2;
+            a = (cork_hash64_read32(p) << 32) | cork_hash64_read32(p + mid);
+            b = (cork_hash64_read32(p + len - 4) << 32) |
+                cork_hash64_read32(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) |
+                p[len - 1];
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        size_t  i = len;
+        if (i > 48) {
+            uint64_t  see1 = seed;
+            uint64_t  see2 = seed;
+            do {
+                seed = cork_hash64_mix(cork_hash64_read64(p) ^ s[1],
+                                       cork_hash64_read64(p + 8) ^ seed);
+                see1 = cork_hash64_mix(cork_hash64_read64(p + 16) ^ s[2],
+                                       cork_hash64_read64(p + 24) ^ see1);
+                see2 = cork_hash64_mix(cork_hash64_read64(p + 32) ^ s[3],
+                                       cork_hash64_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = cork_hash64_mix(cork_hash64_read64(p) ^ s[1],
+                                   cork_hash64_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = cork_hash64_read64(p + i - 16);
+        b = cork_hash64_read64(p + i - 8);
+    }
+
+    a ^= s[1];
+    b ^= seed;
+    cork_hash64_mum(&a, &b);
+    return cork_hash64_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+
+/* Kernels for long inputs.  accumulate processes `stripe_count` stripes,
+ * using secret[i..i+7] for stripe i; scramble is called at the end of each
+ * block, with the last 8 words of the secret. */
+
+typedef void
+(*cork_hash64_accumulate_f)(uint64_t *acc, const uint8_t *p,
+                            const uint64_t *secret, size_t stripe_count);
+
+typedef void
+(*cork_hash64_scramble_f)(uint64_t *acc, const uint64_t *secret);
+
+struct cork_hash64_kernel {
+    struct cork_digest_kernel  kernel;
+    cork_hash64_accumulate_f  accumulate;
+    cork_hash64_scramble_f  scramble;
+};
+
+static void
+cork_hash64_accumulate_scalar(uint64_t *acc, const uint8_t *p,
+                              const uint64_t *secret, size_t stripe_count)
+{
+    size_t  i;
+    size_t  j;
+    for (i = 0; i < stripe_count; i++, p += CORK_HASH64_STRIPE_SIZE) {
+        for (j = 0; j < CORK_HASH64_LANE_COUNT; j++) {
+            uint64_t  data = cork_hash64_read64(p + 8*j);
+            uint64_t  key = data ^ secret[i + j];
+            acc[j ^ 1] += data;
+            acc[j] += (key & 0xffffffff) * (key >> 32);
+        }
+    }
+}
+
+static void
+cork_hash64_scramble_scalar(uint64_t *acc, const uint64_t *secret)
+{
+    size_t  j;
+    for (j = 0; j < CORK_HASH64_LANE_COUNT; j++) {
+        uint64_t  a = acc[j];
+        a ^= a >> 47;
+        a ^= secret[j];
+        acc[j] = a * CORK_HASH64_PRIME32_1;
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CORK_HASH64_X86  1
+#include <immintrin.h>
+
+static bool
+cork_hash64_sse2_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static bool
+cork_hash64_avx2_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("sse2")))
+static void
+cork_hash64_accumulate_sse2(uint64_t *acc, const uint8_t *p,
+                            const uint64_t *secret, size_t stripe_count)
+{
+    __m128i  a[4];
+    size_t  i;
+    size_t  j;
+    for (j = 0; j < 4; j++) {
+        a[j] = _mm_loadu_si128((const __m128i *) (acc + 2*j));
+    }
+    for (i = 0; i < stripe_count; i++, p += CORK_HASH64_STRIPE_SIZE) {
+        for (j = 0; j < 4; j++) {
+            __m128i  data = _mm_loadu_si128((const __m128i *) (p + 16*j));
+            __m128i  key = _mm_loadu_si128
+                ((const __m128i *) (secret + i + 2*j));
+            __m128i  data_key = _mm_xor_si128(data, key);
+            __m128i  data_key_hi =
+                _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i  product = _mm_mul_epu32(data_key, data_key_hi);
+            __m128i  swapped =
+                _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            a[j] = _mm_add_epi64(a[j], _mm_add_epi64(product, swapped));
+        }
+    }
+    for (j = 0; j < 4; j++) {
+        _mm_storeu_si128((__m128i *) (acc + 2*j), a[j]);
+    }
+}
+
+__attribute__((target("sse2")))
+static void
+cork_hash64_scramble_sse2(uint64_t *acc, const uint64_t *secret)
+{
+    const __m128i  prime = _mm_set1_epi32((int) CORK_HASH64_PRIME32_1);
+    size_t  j;
+    for (j = 0; j < 4; j++) {
+        __m128i  a = _mm_loadu_si128((const __m128i *) (acc + 2*j));
+        __m128i  key = _mm_loadu_si128((const __m128i *) (secret + 2*j));
+        __m128i  lo;
+        __m128i  hi;
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, key);
+        lo = _mm_mul_epu32(a, prime);
+        hi = _mm_mul_epu32
+            (_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        a = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+        _mm_storeu_si128((__m128i *) (acc + 2*j), a);
+    }
+}
+
+__attribute__((target("avx2")))
+static void
+cork_hash64_accumulate_avx2(uint64_t *acc, const uint8_t *p,
+                            const uint64_t *secret, size_t stripe_count)
+{
+    __m256i  a[2];
+    size_t  i;
+    size_t  j;
+    for (j = 0; j < 2; j++) {
+        a[j] = _mm256_loadu_si256((const __m256i *) (acc + 4*j));
+    }
+    for (i = 0; i < stripe_count; i++, p += CORK_HASH64_STRIPE_SIZE) {
+        for (j = 0; j < 2; j++) {
+            __m256i  data = _mm256_loadu_si256((const __m256i *) (p + 32*j));
+            __m256i  key = _mm256_loadu_si256
+                ((const __m256i *) (secret + i + 4*j));
+            __m256i  data_key = _mm256_xor_si256(data, key);
+            __m256i  data_key_hi =
+                _mm256_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+            __m256i  product = _mm256_mul_epu32(data_key, data_key_hi);
+            __m256i  swapped =
+                _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            a[j] = _mm256_add_epi64(a[j], _mm256_add_epi64(product, swapped));
+        }
+    }
+    for (j = 0; j < 2; j++) {
+        _mm256_storeu_si256((__m256i *) (acc + 4*j), a[j]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void
+cork_hash64_scramble_avx2(uint64_t *acc, const uint64_t *secret)
+{
+    const __m256i  prime = _mm256_set1_epi32((int) CORK_HASH64_PRIME32_1);
+    size_t  j;
+    for (j = 0; j < 2; j++) {
+        __m256i  a = _mm256_loadu_si256((const __m256i *) (acc + 4*j));
+        __m256i  key = _mm256_loadu_si256((const __m256i *) (secret + 4*j));
+        __m256i  lo;
+        __m256i  hi;
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, key);
+        lo = _mm256_mul_epu32(a, prime);
+        hi = _mm256_mul_epu32
+            (_mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        a = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        _mm256_storeu_si256((__m256i *) (acc + 4*j), a);
+    }
+}
+#endif
+
+/* NEON is always available when the compiler targets it, so we don't need to
+ * check for it at runtime.  The kernel loads the input with vld1q_u8, which
+ * only gives us little-endian lanes on a little-endian CPU. */
+#if CORK_CONFIG_HAVE_NEON && CORK_CONFIG_IS_LITTLE_ENDIAN
+#define CORK_HASH64_NEON  1
+#include <arm_neon.h>
+
+static void
+cork_hash64_accumulate_neon(uint64_t *acc, const uint8_t *p,
+                            const uint64_t *secret, size_t stripe_count)
+{
+    uint64x2_t  a[4];
+    size_t  i;
+    size_t  j;
+    for (j = 0; j < 4; j++) {
+        a[j] = vld1q_u64(acc + 2*j);
+    }
+    for (i = 0; i < stripe_count; i++, p += CORK_HASH64_STRIPE_SIZE) {
+        for (j = 0; j < 4; j++) {
+            uint64x2_t  data = vreinterpretq_u64_u8(vld1q_u8(p + 16*j));
+            uint64x2_t  key = vld1q_u64(secret + i + 2*j);
+            uint64x2_t  data_key = veorq_u64(data, key);
+            uint64x2_t  product = vmull_u32
+                (vmovn_u64(data_key), vshrn_n_u64(data_key, 32));
+            uint64x2_t  swapped = vextq_u64(data, data, 1);
+            a[j] = vaddq_u64(a[j], vaddq_u64(product, swapped));
+        }
+    }
+    for (j = 0; j < 4; j++) {
+        vst1q_u64(acc + 2*j, a[j]);
+    }
+}
+
+static void
+cork_hash64_scramble_neon(uint64_t *acc, const uint64_t *secret)
+{
+    const uint32x2_t  prime = vdup_n_u32(CORK_HASH64_PRIME32_1);
+    size_t  j;
+    for (j = 0; j < 4; j++) {
+        uint64x2_t  a = vld1q_u64(acc + 2*j);
+        uint64x2_t  key = vld1q_u64(secret + 2*j);
+        uint64x2_t  lo;
+        uint64x2_t  hi;
+        a = veorq_u64(a, vshrq_n_u64(a, 47));
+        a = veorq_u64(a, key);
+        lo = vmull_u32(vmovn_u64(a), prime);
+        hi = vmull_u32(vshrn_n_u64(a, 32), prime);
+        a = vaddq_u64(lo, vshlq_n_u64(hi, 32));
+        vst1q_u64(acc + 2*j, a);
+    }
+}
+#endif
+
+/* In order of preference, best last */
+static const struct cork_hash64_kernel  cork_hash64_kernel_list[] = {
+    { { "scalar", NULL },
+      cork_hash64_accumulate_scalar, cork_hash64_scramble_scalar },
+#if CORK_HASH64_X86
+    { { "sse2", cork_hash64_sse2_supported },
+      cork_hash64_accumulate_sse2, cork_hash64_scramble_sse2 },
+    { { "avx2", cork_hash64_avx2_supported },
+      cork_hash64_accumulate_avx2, cork_hash64_scramble_avx2 },
+#endif
+#if CORK_HASH64_NEON
+    { { "neon", NULL },
+      cork_hash64_accumulate_neon, cork_hash64_scramble_neon },
+#endif
+    { { NULL, NULL }, NULL, NULL }
+};
+
+static struct cork_digest_kernels  cork_hash64_kernels = {
+    "hash", cork_hash64_kernel_list, sizeof(struct cork_hash64_kernel), NULL
+};
+
+const char *
+cork_hash64_get_kernel(void)
+{
+    return cork_digest_kernels_get(&cork_hash64_kernels)->name;
+}
+
+int
+cork_hash64_set_kernel(const char *name)
+{
+    return cork_digest_kernels_set(&cork_hash64_kernels, name);
+}
+
+static uint64_t
+cork_hash64_long(uint64_t seed, const uint8_t *p, size_t len)
+{
+    const struct cork_hash64_kernel  *kernel = cork_container_of
+        (cork_digest_kernels_get(&cork_hash64_kernels),
+         struct cork_hash64_kernel, kernel);
+    uint64_t  acc[CORK_HASH64_LANE_COUNT] = {
+        CORK_HASH64_PRIME32_3, CORK_HASH64_PRIME64_1,
+        CORK_HASH64_PRIME64_2, CORK_HASH64_PRIME64_3,
+        CORK_HASH64_PRIME64_4, CORK_HASH64_PRIME32_2,
+        CORK_HASH64_PRIME64_5, CORK_HASH64_PRIME32_1
+    };
+    uint64_t  seeded_secret[CORK_HASH64_SECRET_COUNT];
+    const uint64_t  *secret = cork_hash64_secret;
+    size_t  block_count = (len - 1) / CORK_HASH64_BLOCK_SIZE;
+    size_t  remaining;
+    uint64_t  result;
+    size_t  i;
+
+    if (seed != 0) {
+        for (i = 0; i < CORK_HASH64_SECRET_COUNT; i += 2) {
+            seeded_secret[i] = cork_hash64_secret[i] + seed;
+            seeded_secret[i + 1] = cork_hash64_secret[i + 1] - seed;
+        }
+        secret = seeded_secret;
+    }
+
+    for (i = 0; i < block_count; i++) {
+        kernel->accumulate(acc, p, secret, CORK_HASH64_STRIPES_PER_BLOCK);
+        kernel->scramble(acc, secret + CORK_HASH64_STRIPES_PER_BLOCK);
+        p += CORK_HASH64_BLOCK_SIZE;
+    }
+
+    /* The last block might be partial.  We always finish with a full stripe,
+     * consisting of the last 64 bytes of input, which might overlap with the
+     * stripes that we've already processed. */
+    remaining = len - block_count * CORK_HASH64_BLOCK_SIZE;
+    kernel->accumulate(acc, p, secret,
+                       (remaining - 1) / CORK_HASH64_STRIPE_SIZE);
+    kernel->accumulate(acc, p + remaining - CORK_HASH64_STRIPE_SIZE,
+                       secret + CORK_HASH64_STRIPES_PER_BLOCK - 1, 1);
+
+    result = len * CORK_HASH64_PRIME64_1;
+    for (i = 0; i < CORK_HASH64_LANE_COUNT; i += 2) {
+        result += cork_hash64_mix(acc[i] ^ secret[i + 1],
+                                  acc[i + 1] ^ secret[i + 2]);
+    }
+    return cork_fmix64(result);
+}
+
+uint64_t
+cork_hash64_buffer(uint64_t seed, const void *src, size_t len)
+{
+    if (len <= CORK_HASH64_SHORT_MAX) {
+        return cork_hash64_short(seed, src, len);
+    } else {
+        return cork_hash64_long(seed, src, len);
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Keyed hashes
+ */
+
+#define CORK_SIPROUND(v0, v1, v2, v3) \
+    do { \
+        v0 += v1; v1 = CORK_ROTL64(v1, 13); v1 ^= v0; \
+        v0 = CORK_ROTL64(v0, 32); \
+        v2 += v3; v3 = CORK_ROTL64(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = CORK_ROTL64(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = CORK_ROTL64(v1, 17); v1 ^= v2; \
+        v2 = CORK_ROTL64(v2, 32); \
+    } while (0)
+
+#define CORK_HALFSIPROUND(v0, v1, v2, v3) \
+    do { \
+        v0 += v1; v1 = CORK_ROTL32(v1, 5); v1 ^= v0; \
+        v0 = CORK_ROTL32(v0, 16); \
+        v2 += v3; v3 = CORK_ROTL32(v3, 8); v3 ^= v2; \
+        v0 += v3; v3 = CORK_ROTL32(v3, 7); v3 ^= v0; \
+        v2 += v1; v1 = CORK_ROTL32(v1, 13); v1 ^= v2; \
+        v2 = CORK_ROTL32(v2, 16); \
+    } while (0)
+
+uint64_t
+cork_siphash13(const uint8_t *key, const void *src, size_t len)
+{
+    const uint8_t  *p = src;
+    const uint8_t  *end = p + (len & ~(size_t) 7);
+    uint64_t  k0 = cork_hash64_read64(key);
+    uint64_t  k1 = cork_hash64_read64(key + 8);
+    uint64_t  v0 = k0 ^ UINT64_C(0x736f6d6570736575);
+    uint64_t  v1 = k1 ^ UINT64_C(0x646f72616e646f6d);
+    uint64_t  v2 = k0 ^ UINT64_C(0x6c7967656e657261);
+    uint64_t  v3 = k1 ^ UINT64_C(0x7465646279746573);
+    uint64_t  m;
+    uint64_t  b = ((uint64_t) len) << 56;
+
+    for (; p != end; p += 8) {
+        m = cork_hash64_read64(p);
+        v3 ^= m;
+        CORK_SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    switch (len & 7) {
+        case 7: b |= ((uint64_t) p[6]) << 48;  /* fall through */
+        case 6: b |= ((uint64_t) p[5]) << 40;  /* fall through */
+        case 5: b |= ((uint64_t) p[4]) << 32;  /* fall through */
+        case 4: b |= ((uint64_t) p[3]) << 24;  /* fall through */
+        case 3: b |= ((uint64_t) p[2]) << 16;  /* fall through */
+        case 2: b |= ((uint64_t) p[1]) << 8;   /* fall through */
+        case 1: b |= ((uint64_t) p[0]);
+    }
+
+    v3 ^= b;
+    CORK_SIPROUND(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    CORK_SIPROUND(v0, v1, v2, v3);
+    CORK_SIPROUND(v0, v1, v2, v3);
+    CORK_SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint32_t
+cork_halfsiphash13(const uint8_t *key, const void *src, size_t len)
+{
+    const uint8_t  *p = src;
+    const uint8_t  *end = p + (len & ~(size_t) 3);
+    uint32_t  k0 = cork_hash64_read32(key);
+    uint32_t  k1 = cork_hash64_read32(key + 4);
+    uint32_t  v0 = k0;
+    uint32_t  v1 = k1;
+    uint32_t  v2 = k0 ^ UINT32_C(0x6c796765);
+    uint32_t  v3 = k1 ^ UINT32_C(0x74656462);
+    uint32_t  m;
+    uint32_t  b = ((uint32_t) len) << 24;
+
+    for (; p != end; p += 4) {
+        m = cork_hash64_read32(p);
+        v3 ^= m;
+        CORK_HALFSIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    switch (len & 3) {
+        case 3: b |= ((uint32_t) p[2]) << 16;  /* fall through */
+        case 2: b |= ((uint32_t) p[1]) << 8;   /* fall through */
+        case 1: b |= ((uint32_t) p[0]);
+    }
+
+    v3 ^= b;
+    CORK_HALFSIPROUND(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    CORK_HALFSIPROUND(v0, v1, v2, v3);
+    CORK_HALFSIPROUND(v0, v1, v2, v3);
+    CORK_HALFSIPROUND(v0, v1, v2, v3);
+    return v1 ^ v3;
+}
+
+
+/* The key that cork_keyed_hash_buffer uses.  We read it from /dev/urandom the
+ * first time it's needed.  If that doesn't work, we fall back on mixing
+ * together whatever varies from one run to the next. */
+
+static uint8_t  cork_keyed_hash_key[CORK_SIPHASH_KEY_SIZE];
+cork_once_barrier(cork_keyed_hash_key);
+
+static bool
+cork_keyed_hash_read_urandom(uint8_t *dest, size_t size)
+{
+    int  fd;
+    do {
+        fd = open("/dev/urandom", O_RDONLY);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        return false;
+    }
+
+    while (size > 0) {
+        ssize_t  bytes_read = read(fd, dest, size);
+        if (bytes_read > 0) {
+            dest += bytes_read;
+            size -= bytes_read;
+        } else if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        } else {
+            close(fd);
+            return false;
+        }
+    }
+
+    close(fd);
+    return true;
+}
+
+static void
+cork_keyed_hash_init_key(void)
+{
+    if (!cork_keyed_hash_read_urandom
+        (cork_keyed_hash_key, sizeof(cork_keyed_hash_key))) {
+        struct timeval  tv;
+        uint64_t  state;
+        uint64_t  words[2];
+        gettimeofday(&tv, NULL);
+        state = ((uint64_t) tv.tv_sec << 20) ^ (uint64_t) tv.tv_usec;
+        state ^= ((uint64_t) getpid()) << 40;
+        state ^= (uint64_t) (uintptr_t) &state;
+        words[0] = cork_fmix64(state += CORK_HASH64_PRIME64_1);
+        words[1] = cork_fmix64(state += CORK_HASH64_PRIME64_1);
+        memcpy(cork_keyed_hash_key, words, sizeof(cork_keyed_hash_key));
+    }
+}
+
+cork_hash
+cork_keyed_hash_buffer(const void *src, size_t len)
+{
+    cork_once(cork_keyed_hash_key, cork_keyed_hash_init_key());
+#if CORK_SIZEOF_POINTER == 8
+    return (cork_hash) cork_siphash13(cork_keyed_hash_key, src, len);
+#else
+    return cork_halfsiphash13(cork_keyed_hash_key, src, len);
+#endif
+}
+
+void
+cork_keyed_hash_set_key(const uint8_t *key)
+{
+    cork_once(cork_keyed_hash_key, cork_keyed_hash_init_key());
+    memcpy(cork_keyed_hash_key, key, sizeof(cork_keyed_hash_key));
+}
+
+
+/*-----------------------------------------------------------------------
+ * Streaming hashes
+ */
+
+/* These must produce exactly the same results as the MurmurHash3 macros in
+ * hash.h.  Like those macros, we only use the low 32 bits of the total length
+ * in the finalization step. */
+
+typedef void
+(*cork_murmur_blocks_f)(struct cork_murmur_state *state,
+                        const uint8_t *src, size_t block_count);
+
+static void
+cork_murmur_state_update(struct cork_murmur_state *state,
+                         const uint8_t *src, size_t len, size_t block_size,
+                         cork_murmur_blocks_f blocks)
+{
+    size_t  block_count;
+    state->len += len;
+
+    /* Fill up any partial block left over from the last update. */
+    if (state->tail_size > 0) {
+        size_t  needed = block_size - state->tail_size;
+        if (len < needed) {
+            memcpy(state->tail + state->tail_size, src, len);
+            state->tail_size += len;
+            return;
+        }
+        memcpy(state->tail + state->tail_size, src, needed);
+        blocks(state, state->tail, 1);
+        src += needed;
+        len -= needed;
+    }
+
+    block_count = len / block_size;
+    blocks(state, src, block_count);
+    src += block_count * block_size;
+    len -= block_count * block_size;
+
+    memcpy(state->tail, src, len);
+    state->tail_size = len;
+}
+
+#if CORK_SIZEOF_POINTER == 8
+
+static void
+cork_murmur_x64_128_init(struct cork_murmur_state *state, cork_big_hash seed)
+{
+    state->h.u64[0] = cork_u128_be64(seed.u128, 0);
+    state->h.u64[1] = cork_u128_be64(seed.u128, 1);
+    state->tail_size = 0;
+    state->len = 0;
+}
+
+static void
+cork_murmur_x64_128_blocks(struct cork_murmur_state *state,
+                           const uint8_t *src, size_t block_count)
+{
+    uint64_t  h1 = state->h.u64[0];
+    uint64_t  h2 = state->h.u64[1];
+    uint64_t  c1 = UINT64_C(0x87c37b91114253d5);
+    uint64_t  c2 = UINT64_C(0x4cf5ad432745937f);
+    size_t  i;
+
+    for (i = 0; i < block_count; i++, src += 16) {
+        uint64_t  k1;
+        uint64_t  k2;
+        memcpy(&k1, src, sizeof(k1));
+        memcpy(&k2, src + 8, sizeof(k2));
+
+        k1 *= c1; k1  = CORK_ROTL64(k1,31); k1 *= c2; h1 ^= k1;
+        h1 = CORK_ROTL64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;
+
+        k2 *= c2; k2  = CORK_ROTL64(k2,33); k2 *= c1; h2 ^= k2;
+        h2 = CORK_ROTL64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;
+    }
+
+    state->h.u64[0] = h1;
+    state->h.u64[1] = h2;
+}
+
+static cork_big_hash
+cork_murmur_x64_128_final(struct cork_murmur_state *state)
+{
+    cork_big_hash  result;
+    const uint8_t  *tail = state->tail;
+    unsigned int  len = (unsigned int) state->len;
+    uint64_t  h1 = state->h.u64[0];
+    uint64_t  h2 = state->h.u64[1];
+    uint64_t  c1 = UINT64_C(0x87c37b91114253d5);
+    uint64_t  c2 = UINT64_C(0x4cf5ad432745937f);
+    uint64_t  k1 = 0;
+    uint64_t  k2 = 0;
+
+    switch (state->tail_size) {
+        case 15: k2 ^= (uint64_t) (tail[14]) << 48;
+        case 14: k2 ^= (uint64_t) (tail[13]) << 40;
+        case 13: k2 ^= (uint64_t) (tail[12]) << 32;
+        case 12: k2 ^= (uint64_t) (tail[11]) << 24;
+        case 11: k2 ^= (uint64_t) (tail[10]) << 16;
+        case 10: k2 ^= (uint64_t) (tail[ 9]) << 8;
+        case  9: k2 ^= (uint64_t) (tail[ 8]) << 0;
+                 k2 *= c2; k2 = CORK_ROTL64(k2,33); k2 *= c1; h2 ^= k2;
+
+        case  8: k1 ^= (uint64_t) (tail[ 7]) << 56;
+        case  7: k1 ^= (uint64_t) (tail[ 6]) << 48;
+        case  6: k1 ^= (uint64_t) (tail[ 5]) << 40;
+        case  5: k1 ^= (uint64_t) (tail[ 4]) << 32;
+        case  4: k1 ^= (uint64_t) (tail[ 3]) << 24;
+        case  3: k1 ^= (uint64_t) (tail[ 2]) << 16;
+        case  2: k1 ^= (uint64_t) (tail[ 1]) << 8;
+        case  1: k1 ^= (uint64_t) (tail[ 0]) << 0;
+                 k1 *= c1; k1 = CORK_ROTL64(k1,31); k1 *= c2; h1 ^= k1;
+    };
+
+    h1 ^= len; h2 ^= len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = cork_fmix64(h1);
+    h2 = cork_fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    result.u128 = cork_u128_from_64(h1, h2);
+    return result;
+}
+
+#else
+
+static void
+cork_murmur_x86_32_init(struct cork_murmur_state *state, cork_hash seed)
+{
+    state->h.u32[0] = seed;
+    state->tail_size = 0;
+    state->len = 0;
+}
+
+static void
+cork_murmur_x86_32_blocks(struct cork_murmur_state *state,
+                          const uint8_t *src, size_t block_count)
+{
+    uint32_t  h1 = state->h.u32[0];
+    uint32_t  c1 = 0xcc9e2d51;
+    uint32_t  c2 = 0x1b873593;
+    size_t  i;
+
+    for (i = 0; i < block_count; i++, src += 4) {
+        uint32_t  k1;
+        memcpy(&k1, src, sizeof(k1));
+
+        k1 *= c1;
+        k1 = CORK_ROTL32(k1,15);
+        k1 *= c2;
+
+        h1 ^= k1;
+        h1 = CORK_ROTL32(h1,13);
+        h1 = h1*5+0xe6546b64;
+    }
+
+    state->h.u32[0] = h1;
+}
+
+static cork_hash
+cork_murmur_x86_32_final(struct cork_murmur_state *state)
+{
+    const uint8_t  *tail = state->tail;
+    unsigned int  len = (unsigned int) state->len;
+    uint32_t  h1 = state->h.u32[0];
+    uint32_t  c1 = 0xcc9e2d51;
+    uint32_t  c2 = 0x1b873593;
+    uint32_t  k1 = 0;
+
+    switch (state->tail_size) {
+        case 3: k1 ^= tail[2] << 16;
+        case 2: k1 ^= tail[1] << 8;
+        case 1: k1 ^= tail[0];
+                k1 *= c1; k1 = CORK_ROTL32(k1,15); k1 *= c2; h1 ^= k1;
+    };
+
+    h1 ^= len;
+    return cork_fmix32(h1);
+}
+
+static void
+cork_murmur_x86_128_init(struct cork_murmur_state *state, cork_big_hash seed)
+{
+    state->h.u32[0] = cork_u128_be32(seed.u128, 0);
+    state->h.u32[1] = cork_u128_be32(seed.u128, 1);
+    state->h.u32[2] = cork_u128_be32(seed.u128, 2);
+    state->h.u32[3] = cork_u128_be32(seed.u128, 3);
+    state->tail_size = 0;
+    state->len = 0;
+}
+
+static void
+cork_murmur_x86_128_blocks(struct cork_murmur_state *state,
+                           const uint8_t *src, size_t block_count)
+{
+    uint32_t  h1 = state->h.u32[0];
+    uint32_t  h2 = state->h.u32[1];
+    uint32_t  h3 = state->h.u32[2];
+    uint32_t  h4 = state->h.u32[3];
+    uint32_t  c1 = 0x239b961b;
+    uint32_t  c2 = 0xab0e9789;
+    uint32_t  c3 = 0x38b34ae5;
+    uint32_t  c4 = 0xa1e38b93;
+    size_t  i;
+
+    for (i = 0; i < block_count; i++, src += 16) {
+        uint32_t  k1;
+        uint32_t  k2;
+        uint32_t  k3;
+        uint32_t  k4;
+        memcpy(&k1, src, sizeof(k1));
+        memcpy(&k2, src + 4, sizeof(k2));
+        memcpy(&k3, src + 8, sizeof(k3));
+        memcpy(&k4, src + 12, sizeof(k4));
+
+        k1 *= c1; k1  = CORK_ROTL32(k1,15); k1 *= c2; h1 ^= k1;
+        h1 = CORK_ROTL32(h1,19); h1 += h2; h1 = h1*5+0x561ccd1b;
+
+        k2 *= c2; k2  = CORK_ROTL32(k2,16); k2 *= c3; h2 ^= k2;
+        h2 = CORK_ROTL32(h2,17); h2 += h3; h2 = h2*5+0x0bcaa747;
+
+        k3 *= c3; k3  = CORK_ROTL32(k3,17); k3 *= c4; h3 ^= k3;
+        h3 = CORK_ROTL32(h3,15); h3 += h4; h3 = h3*5+0x96cd1c35;
+
+        k4 *= c4; k4  = CORK_ROTL32(k4,18); k4 *= c1; h4 ^= k4;
+        h4 = CORK_ROTL32(h4,13); h4 += h1; h4 = h4*5+0x32ac3b17;
+    }
+
+    state->h.u32[0] = h1;
+    state->h.u32[1] = h2;
+    state->h.u32[2] = h3;
+    state->h.u32[3] = h4;
+}
+
+static cork_big_hash
+cork_murmur_x86_128_final(struct cork_murmur_state *state)
+{
+    cork_big_hash  result;
+    const uint8_t  *tail = state->tail;
+    unsigned int  len = (unsigned int) state->len;
+    uint32_t  h1 = state->h.u32[0];
+    uint32_t  h2 = state->h.u32[1];
+    uint32_t  h3 = state->h.u32[2];
+    uint32_t  h4 = state->h.u32[3];
+    uint32_t  c1 = 0x239b961b;
+    uint32_t  c2 = 0xab0e9789;
+    uint32_t  c3 = 0x38b34ae5;
+    uint32_t  c4 = 0xa1e38b93;
+    uint32_t  k1 = 0;
+    uint32_t  k2 = 0;
+    uint32_t  k3 = 0;
+    uint32_t  k4 = 0;
+
+    switch (state->tail_size) {
+        case 15: k4 ^= tail[14] << 16;
+        case 14: k4 ^= tail[13] << 8;
+        case 13: k4 ^= tail[12] << 0;
+                 k4 *= c4; k4 = CORK_ROTL32(k4,18); k4 *= c1; h4 ^= k4;
+
+        case 12: k3 ^= tail[11] << 24;
+        case 11: k3 ^= tail[10] << 16;
+        case 10: k3 ^= tail[ 9] << 8;
+        case  9: k3 ^= tail[ 8] << 0;
+                 k3 *= c3; k3 = CORK_ROTL32(k3,17); k3 *= c4; h3 ^= k3;
+
+        case  8: k2 ^= tail[ 7] << 24;
+        case  7: k2 ^= tail[ 6] << 16;
+        case  6: k2 ^= tail[ 5] << 8;
+        case  5: k2 ^= tail[ 4] << 0;
+                 k2 *= c2; k2 = CORK_ROTL32(k2,16); k2 *= c3; h2 ^= k2;
+
+        case  4: k1 ^= tail[ 3] << 24;
+        case  3: k1 ^= tail[ 2] << 16;
+        case  2: k1 ^= tail[ 1] << 8;
+        case  1: k1 ^= tail[ 0] << 0;
+                 k1 *= c1; k1 = CORK_ROTL32(k1,15); k1 *= c2; h1 ^= k1;
+    };
+
+    h1 ^= len; h2 ^= len; h3 ^= len; h4 ^= len;
+
+    h1 += h2; h1 += h3; h1 += h4;
+    h2 += h1; h3 += h1; h4 += h1;
+
+    h1 = cork_fmix32(h1);
+    h2 = cork_fmix32(h2);
+    h3 = cork_fmix32(h3);
+    h4 = cork_fmix32(h4);
+
+    h1 += h2; h1 += h3; h1 += h4;
+    h2 += h1; h3 += h1; h4 += h1;
+
+    result.u128 = cork_u128_from_32(h1, h2, h3, h4);
+    return result;
+}
+
+#endif
+
+void
+cork_hash_state_init(struct cork_hash_state *state, cork_hash seed)
+{
+#if CORK_SIZEOF_POINTER == 8
+    cork_big_hash  big_seed = {cork_u128_from_32(seed, seed, seed, seed)};
+    cork_murmur_x64_128_init(&state->murmur, big_seed);
+#else
+    cork_murmur_x86_32_init(&state->murmur, seed);
+#endif
+}
+
+void
+cork_hash_state_update(struct cork_hash_state *state,
+                       const void *src, size_t len)
+{
+#if CORK_SIZEOF_POINTER == 8
+    cork_murmur_state_update
+        (&state->murmur, src, len, 16, cork_murmur_x64_128_blocks);
+#else
+    cork_murmur_state_update
+        (&state->murmur, src, len, 4, cork_murmur_x86_32_blocks);
+#endif
+}
+
+cork_hash
+cork_hash_state_final(struct cork_hash_state *state)
+{
+#if CORK_SIZEOF_POINTER == 8
+    cork_big_hash  hash = cork_murmur_x64_128_final(&state->murmur);
+    return cork_u128_be32(hash.u128, 0);
+#else
+    return cork_murmur_x86_32_final(&state->murmur);
+#endif
+}
+
+void
+cork_big_hash_state_init(struct cork_big_hash_state *state,
+                         cork_big_hash seed)
+{
+#if CORK_SIZEOF_POINTER == 8
+    cork_murmur_x64_128_init(&state->murmur, seed);
+#else
+    cork_murmur_x86_128_init(&state->murmur, seed);
+#endif
+}
+
+void
+cork_big_hash_state_update(struct cork_big_hash_state *state,
+                           const void *src, size_t len)
+{
+#if CORK_SIZEOF_POINTER == 8
+    cork_murmur_state_update
+        (&state->murmur, src, len, 16, cork_murmur_x64_128_blocks);
+#else
+    cork_murmur_state_update
+        (&state->murmur, src, len, 16, cork_murmur_x86_128_blocks);
+#endif
+}
+
+cork_big_hash
+cork_big_hash_state_final(struct cork_big_hash_state *state)
+{
+#if CORK_SIZEOF_POINTER == 8
+    return cork_murmur_x64_128_final(&state->murmur);
+#else
+    return cork_murmur_x86_128_final(&state->murmur);
+#endif
+}
+
+
+/*-----------------------------------------------------------------------
+ * Hash's stream consumer implementation
+ */
+
+static void
+cork_hash_digest_update(void *state, const void *src, size_t len)
+{
+    cork_hash_state_update(state, src, len);
+}
+
+static void
+cork_hash_digest_finish(void *state, void *dest)
+{
+    *(cork_hash *) dest = cork_hash_state_final(state);
+}
+
+struct cork_hash__stream_consumer {
+    struct cork_digest_consumer  digest;
+    struct cork_hash_state  initial;
+    struct cork_hash_state  state;
+};
+
+struct cork_stream_consumer *
+cork_hash_stream_consumer_new(cork_hash seed, cork_hash *dest)
+{
+    struct cork_hash__stream_consumer  *hconsumer =
+        cork_new(struct cork_hash__stream_consumer);
+    cork_hash_state_init(&hconsumer->initial, seed);
+    cork_digest_consumer_init
+        (&hconsumer->digest, sizeof(struct cork_hash__stream_consumer),
+         &hconsumer->initial, &hconsumer->state,
+         sizeof(struct cork_hash_state),
+         cork_hash_digest_update, cork_hash_digest_finish, dest);
+    return &hconsumer->digest.consumer;
+}
+
+
+static void
+cork_big_hash_digest_update(void *state, const void *src, size_t len)
+{
+    cork_big_hash_state_update(state, src, len);
+}
+
+static void
+cork_big_hash_digest_finish(void *state, void *dest)
+{
+    *(cork_big_hash *) dest = cork_big_hash_state_final(state);
+}
+
+struct cork_big_hash__stream_consumer {
+    struct cork_digest_consumer  digest;
+    struct cork_big_hash_state  initial;
+    struct cork_big_hash_state  state;
+};
+
+struct cork_stream_consumer *
+cork_big_hash_stream_consumer_new(cork_big_hash seed, cork_big_hash *dest)
+{
+    struct cork_big_hash__stream_consumer  *hconsumer =
+        cork_new(struct cork_big_hash__stream_consumer);
+    cork_big_hash_state_init(&hconsumer->initial, seed);
+    cork_digest_consumer_init
+        (&hconsumer->digest, sizeof(struct cork_big_hash__stream_consumer),
+         &hconsumer->initial, &hconsumer->state,
+         sizeof(struct cork_big_hash_state),
+         cork_big_hash_digest_update, cork_big_hash_digest_finish, dest);
+    return &hconsumer->digest.consumer;
+}
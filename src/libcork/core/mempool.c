@@ -8,12 +8,16 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "libcork/core/callbacks.h"
 #include "libcork/core/mempool.h"
 #include "libcork/core/types.h"
 #include "libcork/helpers/errors.h"
+#include "libcork/threads/atomics.h"
+#include "libcork/threads/basics.h"
 
 
 #if !defined(CORK_DEBUG_MEMPOOL)
@@ -33,15 +37,39 @@ struct cork_mempool {
     size_t  element_size;
     size_t  block_size;
     struct cork_mempool_object  *free_list;
+    /* The number of objects in free_list. */
+    size_t  free_count;
     /* The number of objects that have been given out by
      * cork_mempool_new but not returned via cork_mempool_free. */
     size_t  allocated_count;
     struct cork_mempool_block  *blocks;
+    size_t  block_count;
+
+    /* Automatic trimming.  Once free_count (plus depot_count, for a
+     * thread-safe pool) reaches trim_at, we trim the pool down to
+     * trim_keep_count free objects.  trim_at is SIZE_MAX if automatic
+     * trimming is turned off. */
+    size_t  trim_at;
+    size_t  trim_high_count;
+    size_t  trim_keep_count;
 
     void  *user_data;
     cork_free_f  free_user_data;
     cork_init_f  init_object;
     cork_done_f  done_object;
+
+    /* The remaining fields are only used by thread-safe pools.  In a
+     * thread-safe pool, allocated_count includes the objects that are sitting
+     * in thread caches and in the depot, and `lock` protects everything except
+     * for the contents of the thread caches. */
+    bool  thread_safe;
+    unsigned int  id;
+    volatile int  lock;
+    struct cork_mempool_cache  *caches;
+    struct cork_mempool_magazine  *full_magazines;
+    struct cork_mempool_magazine  *empty_magazines;
+    /* The number of objects in full_magazines. */
+    size_t  depot_count;
 };
 
 struct cork_mempool_object {
@@ -71,19 +99,37 @@ cork_mempool_new_size_ex(size_t element_size, size_t block_size)
     mp->element_size = element_size;
     mp->block_size = block_size;
     mp->free_list = NULL;
+    mp->free_count = 0;
     mp->allocated_count = 0;
     mp->blocks = NULL;
+    mp->block_count = 0;
+    mp->trim_at = SIZE_MAX;
+    mp->trim_high_count = SIZE_MAX;
+    mp->trim_keep_count = 0;
     mp->user_data = NULL;
     mp->free_user_data = NULL;
     mp->init_object = NULL;
     mp->done_object = NULL;
+    mp->thread_safe = false;
+    mp->id = 0;
+    mp->lock = 0;
+    mp->caches = NULL;
+    mp->full_magazines = NULL;
+    mp->empty_magazines = NULL;
+    mp->depot_count = 0;
     return mp;
 }
 
+static void
+cork_mempool_release_caches(struct cork_mempool *mp);
+
 void
 cork_mempool_free(struct cork_mempool *mp)
 {
     struct cork_mempool_block  *curr;
+    if (mp->thread_safe) {
+        cork_mempool_release_caches(mp);
+    }
     assert(mp->allocated_count == 0);
 
     if (mp->done_object != NULL) {
@@ -147,14 +193,25 @@ cork_mempool_new_block(struct cork_mempool *mp)
 {
     /* Allocate the new block and add it to mp's block list. */
     struct cork_mempool_block  *block;
+    struct cork_mempool_object  *first = NULL;
+    struct cork_mempool_object  **prev_next = &first;
     void  *vblock;
     DEBUG("Allocating new %zu-byte block\n", mp->block_size);
     block = cork_malloc(mp->block_size);
     block->next_block = mp->blocks;
     mp->blocks = block;
+    mp->block_count++;
     vblock = block;
 
-    /* Divide the block's memory region into a bunch of objects. */
+    /* We only run out of free objects once any earlier burst is over, so
+     * this is a good time to reset the automatic trimming threshold. */
+    if (mp->trim_high_count != SIZE_MAX) {
+        mp->trim_at = mp->trim_high_count;
+    }
+
+    /* Divide the block's memory region into a bunch of objects.  We link them
+     * together in address order, so that successive allocations from a fresh
+     * block walk forward through memory. */
     size_t  index = sizeof(struct cork_mempool_block);
     for (index = sizeof(struct cork_mempool_block);
          (index + cork_mempool_object_size(mp)) <= mp->block_size;
@@ -165,23 +222,54 @@ cork_mempool_new_block(struct cork_mempool *mp)
             mp->init_object
                 (mp->user_data, cork_mempool_get_object(obj));
         }
-        obj->next_free = mp->free_list;
-        mp->free_list = obj;
+        *prev_next = obj;
+        prev_next = &obj->next_free;
+        mp->free_count++;
     }
+    *prev_next = mp->free_list;
+    mp->free_list = first;
 }
 
+static void *
+cork_mempool_cache_new_object(struct cork_mempool *mp);
+
+static void
+cork_mempool_cache_free_object(struct cork_mempool *mp, void *ptr);
+
+static void
+cork_mempool_cache_new_objects(struct cork_mempool *mp,
+                               size_t count, void **objects);
+
+static void
+cork_mempool_cache_free_objects(struct cork_mempool *mp,
+                                size_t count, void **objects);
+
+static void
+cork_mempool_lock(struct cork_mempool *mp);
+
+static void
+cork_mempool_trim_locked(struct cork_mempool *mp, size_t keep_count);
+
+static void
+cork_mempool_unlock(struct cork_mempool *mp);
+
 void *
 cork_mempool_new_object(struct cork_mempool *mp)
 {
     struct cork_mempool_object  *obj;
     void  *ptr;
 
+    if (mp->thread_safe) {
+        return cork_mempool_cache_new_object(mp);
+    }
+
     if (CORK_UNLIKELY(mp->free_list == NULL)) {
         cork_mempool_new_block(mp);
     }
 
     obj = mp->free_list;
     mp->free_list = obj ? obj->next_free : NULL;
+    mp->free_count--;
     mp->allocated_count++;
     ptr = cork_mempool_get_object(obj);
     return ptr;
@@ -190,13 +278,731 @@ cork_mempool_new_object(struct cork_mempool *mp)
 void
 cork_mempool_free_object(struct cork_mempool *mp, void *ptr)
 {
-    struct cork_mempool_object  *obj = cork_mempool_get_header(ptr);
+    struct cork_mempool_object  *obj;
+    if (mp->thread_safe) {
+        cork_mempool_cache_free_object(mp, ptr);
+        return;
+    }
+    obj = cork_mempool_get_header(ptr);
     DEBUG("Returning %p[%p] to memory pool\n", ptr, obj);
     obj->next_free = mp->free_list;
     mp->free_list = obj;
+    mp->free_count++;
     mp->allocated_count--;
+    if (CORK_UNLIKELY(mp->free_count >= mp->trim_at)) {
+        cork_mempool_trim_locked(mp, mp->trim_keep_count);
+    }
+}
+
+void
+cork_mempool_reserve(struct cork_mempool *mp, size_t count)
+{
+    if (mp->thread_safe) {
+        cork_mempool_lock(mp);
+    }
+    while (mp->free_count < count) {
+        cork_mempool_new_block(mp);
+    }
+    if (mp->thread_safe) {
+        cork_mempool_unlock(mp);
+    }
+}
+
+void
+cork_mempool_new_objects(struct cork_mempool *mp, size_t count, void **objects)
+{
+    struct cork_mempool_object  *obj;
+    size_t  i;
+
+    if (mp->thread_safe) {
+        cork_mempool_cache_new_objects(mp, count, objects);
+        return;
+    }
+
+    /* Make sure the free list is long enough, and then detach the first
+     * `count` objects from it in one go. */
+    cork_mempool_reserve(mp, count);
+    obj = mp->free_list;
+    for (i = 0; i < count; i++) {
+        objects[i] = cork_mempool_get_object(obj);
+        obj = obj->next_free;
+    }
+    mp->free_list = obj;
+    mp->free_count -= count;
+    mp->allocated_count += count;
+}
+
+void
+cork_mempool_free_objects(struct cork_mempool *mp, size_t count, void **objects)
+{
+    struct cork_mempool_object  *first;
+    struct cork_mempool_object  *last;
+    size_t  i;
+
+    if (count == 0) {
+        return;
+    }
+    if (mp->thread_safe) {
+        cork_mempool_cache_free_objects(mp, count, objects);
+        return;
+    }
+
+    /* Chain the objects together, and then splice the whole chain onto the
+     * front of the free list. */
+    first = last = cork_mempool_get_header(objects[0]);
+    for (i = 1; i < count; i++) {
+        struct cork_mempool_object  *obj = cork_mempool_get_header(objects[i]);
+        last->next_free = obj;
+        last = obj;
+    }
+    last->next_free = mp->free_list;
+    mp->free_list = first;
+    mp->free_count += count;
+    mp->allocated_count -= count;
+    if (CORK_UNLIKELY(mp->free_count >= mp->trim_at)) {
+        cork_mempool_trim_locked(mp, mp->trim_keep_count);
+    }
+}
+
+/*-----------------------------------------------------------------------
+ * Thread-safe pools
+ */
+
+/* Each thread that uses a thread-safe pool gets its own cache of free objects,
+ * which it can allocate from and free into without any synchronization.  When
+ * a cache runs dry, we refill it with a full magazine of objects from the
+ * pool's depot (or, if the depot is empty, from the pool's free list); when it
+ * overflows, we move a magazine's worth of objects into the depot, where any
+ * other thread can pick them up.  This lets objects that are allocated in one
+ * thread and freed in another flow back to where they're needed.
+ *
+ * Threads find their cache for a pool via a small direct-mapped thread-local
+ * table, keyed by the pool's ID.  Pool IDs are never reused, so an entry for a
+ * pool that has since been freed can never be mistaken for a live one.
+ *
+ * Each cache is linked into two lists: one for the pool that it belongs to,
+ * and one for the thread that owns it.  A cache is freed, and its objects
+ * returned to the pool, when its thread calls
+ * cork_mempool_release_thread_cache, when its thread exits, or when the pool
+ * is freed, whichever comes first.  Both lists are protected by a single
+ * global lock, which we only need when creating or freeing a cache. */
+
+/* The number of objects that move between a thread cache and the depot at a
+ * time.  Each thread cache can hold two magazines' worth of objects. */
+#define CORK_MEMPOOL_MAGAZINE_SIZE  32
+#define CORK_MEMPOOL_CACHE_SIZE  (2 * CORK_MEMPOOL_MAGAZINE_SIZE)
+
+/* The number of pools whose caches each thread can find without taking a
+ * lock. */
+#define CORK_MEMPOOL_TLS_ENTRIES  8
+
+struct cork_mempool_magazine {
+    struct cork_mempool_magazine  *next;
+    void  *objects[CORK_MEMPOOL_MAGAZINE_SIZE];
+};
+
+struct cork_mempool_thread {
+    struct cork_mempool_cache  *caches;
+};
+
+struct cork_mempool_cache {
+    struct cork_mempool  *mp;
+    struct cork_mempool_cache  *pool_next;
+    struct cork_mempool_cache  **pool_prev_next;
+    struct cork_mempool_cache  *thread_next;
+    struct cork_mempool_cache  **thread_prev_next;
+    size_t  count;
+    void  *objects[CORK_MEMPOOL_CACHE_SIZE];
+};
+
+struct cork_mempool_tls_entry {
+    unsigned int  pool_id;
+    struct cork_mempool_cache  *cache;
+};
+
+struct cork_mempool_tls {
+    struct cork_mempool_tls_entry  entries[CORK_MEMPOOL_TLS_ENTRIES];
+};
+
+cork_tls(struct cork_mempool_tls, cork_mempool_tls);
+
+static volatile unsigned int  cork_mempool_last_id = 0;
+
+/* Protects every pool's and every thread's list of caches. */
+static volatile int  cork_mempool_caches_lock = 0;
+
+/* Each thread's list of caches is stored in a pthread key, so that we can
+ * release them when the thread exits. */
+static pthread_key_t  cork_mempool_thread_key;
+cork_once_barrier(cork_mempool_thread_key_barrier);
+
+static void
+cork_mempool_spin_lock(volatile int *lock)
+{
+    while (cork_int_cas(lock, 0, 1) != 0) {
+        while (cork_atomic_load(lock)) {
+            cork_pause();
+        }
+    }
+}
+
+static void
+cork_mempool_spin_unlock(volatile int *lock)
+{
+    cork_atomic_store(lock, 0);
+}
+
+static void
+cork_mempool_lock(struct cork_mempool *mp)
+{
+    cork_mempool_spin_lock(&mp->lock);
+}
+
+static void
+cork_mempool_unlock(struct cork_mempool *mp)
+{
+    cork_mempool_spin_unlock(&mp->lock);
+}
+
+void
+cork_mempool_set_thread_safe(struct cork_mempool *mp)
+{
+    /* We can't switch modes once objects have been handed out. */
+    assert(mp->blocks == NULL);
+    mp->thread_safe = true;
+    mp->id = cork_uint_atomic_add(&cork_mempool_last_id, 1);
+}
+
+/* Returns some cached objects to the pool's free list.  The caller must hold
+ * the pool's lock. */
+static void
+cork_mempool_return_objects(struct cork_mempool *mp,
+                            void **objects, size_t count)
+{
+    size_t  i;
+    for (i = 0; i < count; i++) {
+        struct cork_mempool_object  *obj = cork_mempool_get_header(objects[i]);
+        obj->next_free = mp->free_list;
+        mp->free_list = obj;
+    }
+    mp->free_count += count;
+    mp->allocated_count -= count;
+}
+
+/* Removes a cache from its pool's and its thread's lists.  The caller must
+ * hold cork_mempool_caches_lock. */
+static void
+cork_mempool_cache_unlink(struct cork_mempool_cache *cache)
+{
+    *cache->pool_prev_next = cache->pool_next;
+    if (cache->pool_next != NULL) {
+        cache->pool_next->pool_prev_next = cache->pool_prev_next;
+    }
+    *cache->thread_prev_next = cache->thread_next;
+    if (cache->thread_next != NULL) {
+        cache->thread_next->thread_prev_next = cache->thread_prev_next;
+    }
+}
+
+/* Unlinks a cache, returns its objects to its pool, and frees it.  The caller
+ * must hold cork_mempool_caches_lock, which keeps the pool from being freed
+ * out from under us. */
+static void
+cork_mempool_cache_release(struct cork_mempool_cache *cache)
+{
+    struct cork_mempool  *mp = cache->mp;
+    DEBUG("Releasing cache with %zu objects\n", cache->count);
+    cork_mempool_cache_unlink(cache);
+    cork_mempool_lock(mp);
+    cork_mempool_return_objects(mp, cache->objects, cache->count);
+    if (CORK_UNLIKELY(mp->free_count + mp->depot_count >= mp->trim_at)) {
+        cork_mempool_trim_locked(mp, mp->trim_keep_count);
+    }
+    cork_mempool_unlock(mp);
+    cork_delete(struct cork_mempool_cache, cache);
+}
+
+/* Called when a thread that has used a thread-safe pool exits. */
+static void
+cork_mempool_thread_done(void *vthread)
+{
+    struct cork_mempool_thread  *thread = vthread;
+    /* Any other thread-exit handlers that use a pool after this must not find
+     * the caches that we're about to free. */
+    memset(cork_mempool_tls_get(), 0, sizeof(struct cork_mempool_tls));
+    cork_mempool_spin_lock(&cork_mempool_caches_lock);
+    while (thread->caches != NULL) {
+        cork_mempool_cache_release(thread->caches);
+    }
+    cork_mempool_spin_unlock(&cork_mempool_caches_lock);
+    cork_delete(struct cork_mempool_thread, thread);
+}
+
+static void
+cork_mempool_thread_key_create(void)
+{
+    CORK_ATTR_UNUSED int  rc;
+    rc = pthread_key_create
+        (&cork_mempool_thread_key, cork_mempool_thread_done);
+    assert(rc == 0);
+}
+
+/* Returns the current thread's list of caches.  The caller must hold
+ * cork_mempool_caches_lock. */
+static struct cork_mempool_thread *
+cork_mempool_thread_get(void)
+{
+    struct cork_mempool_thread  *thread;
+    cork_once(cork_mempool_thread_key_barrier,
+              cork_mempool_thread_key_create());
+    thread = pthread_getspecific(cork_mempool_thread_key);
+    if (thread == NULL) {
+        thread = cork_new(struct cork_mempool_thread);
+        thread->caches = NULL;
+        pthread_setspecific(cork_mempool_thread_key, thread);
+    }
+    return thread;
+}
+
+/* Finds the current thread's cache for mp, or NULL if it doesn't have one.
+ * The caller must hold cork_mempool_caches_lock. */
+static struct cork_mempool_cache *
+cork_mempool_thread_find_cache(struct cork_mempool_thread *thread,
+                               struct cork_mempool *mp)
+{
+    struct cork_mempool_cache  *cache;
+    for (cache = thread->caches; cache != NULL; cache = cache->thread_next) {
+        if (cache->mp == mp) {
+            return cache;
+        }
+    }
+    return NULL;
+}
+
+/* Finds (or creates) the current thread's cache for mp. */
+static struct cork_mempool_cache *
+cork_mempool_find_cache(struct cork_mempool *mp,
+                        struct cork_mempool_tls_entry *entry)
+{
+    struct cork_mempool_thread  *thread;
+    struct cork_mempool_cache  *cache;
+
+    cork_mempool_spin_lock(&cork_mempool_caches_lock);
+    thread = cork_mempool_thread_get();
+    cache = cork_mempool_thread_find_cache(thread, mp);
+    if (cache == NULL) {
+        DEBUG("Creating cache for thread %u\n",
+              cork_current_thread_get_id());
+        cache = cork_new(struct cork_mempool_cache);
+        cache->mp = mp;
+        cache->count = 0;
+        cache->pool_next = mp->caches;
+        cache->pool_prev_next = &mp->caches;
+        if (mp->caches != NULL) {
+            mp->caches->pool_prev_next = &cache->pool_next;
+        }
+        mp->caches = cache;
+        cache->thread_next = thread->caches;
+        cache->thread_prev_next = &thread->caches;
+        if (thread->caches != NULL) {
+            thread->caches->thread_prev_next = &cache->thread_next;
+        }
+        thread->caches = cache;
+    }
+    cork_mempool_spin_unlock(&cork_mempool_caches_lock);
+
+    entry->pool_id = mp->id;
+    entry->cache = cache;
+    return cache;
+}
+
+static inline struct cork_mempool_cache *
+cork_mempool_get_cache(struct cork_mempool *mp)
+{
+    struct cork_mempool_tls  *tls = cork_mempool_tls_get();
+    struct cork_mempool_tls_entry  *entry =
+        &tls->entries[mp->id % CORK_MEMPOOL_TLS_ENTRIES];
+    if (CORK_LIKELY(entry->pool_id == mp->id)) {
+        return entry->cache;
+    }
+    return cork_mempool_find_cache(mp, entry);
+}
+
+/* Fills an empty cache with a magazine's worth of objects. */
+static void
+cork_mempool_cache_refill(struct cork_mempool *mp,
+                          struct cork_mempool_cache *cache)
+{
+    struct cork_mempool_magazine  *magazine;
+    size_t  i;
+
+    cork_mempool_lock(mp);
+    magazine = mp->full_magazines;
+    if (magazine != NULL) {
+        DEBUG("Refilling cache from depot\n");
+        mp->full_magazines = magazine->next;
+        mp->depot_count -= CORK_MEMPOOL_MAGAZINE_SIZE;
+        memcpy(cache->objects, magazine->objects,
+               sizeof(magazine->objects));
+        magazine->next = mp->empty_magazines;
+        mp->empty_magazines = magazine;
+    } else {
+        DEBUG("Refilling cache from free list\n");
+        for (i = 0; i < CORK_MEMPOOL_MAGAZINE_SIZE; i++) {
+            struct cork_mempool_object  *obj;
+            if (CORK_UNLIKELY(mp->free_list == NULL)) {
+                cork_mempool_new_block(mp);
+            }
+            obj = mp->free_list;
+            mp->free_list = obj->next_free;
+            cache->objects[i] = cork_mempool_get_object(obj);
+        }
+        mp->free_count -= CORK_MEMPOOL_MAGAZINE_SIZE;
+        mp->allocated_count += CORK_MEMPOOL_MAGAZINE_SIZE;
+    }
+    cork_mempool_unlock(mp);
+    cache->count = CORK_MEMPOOL_MAGAZINE_SIZE;
+}
+
+/* Moves a magazine's worth of objects from a full cache into the depot. */
+static void
+cork_mempool_cache_flush(struct cork_mempool *mp,
+                         struct cork_mempool_cache *cache)
+{
+    struct cork_mempool_magazine  *magazine;
+
+    cork_mempool_lock(mp);
+    magazine = mp->empty_magazines;
+    if (magazine != NULL) {
+        mp->empty_magazines = magazine->next;
+    }
+    cork_mempool_unlock(mp);
+
+    if (magazine == NULL) {
+        magazine = cork_new(struct cork_mempool_magazine);
+    }
+
+    DEBUG("Flushing cache to depot\n");
+    cache->count -= CORK_MEMPOOL_MAGAZINE_SIZE;
+    memcpy(magazine->objects, &cache->objects[cache->count],
+           sizeof(magazine->objects));
+
+    cork_mempool_lock(mp);
+    magazine->next = mp->full_magazines;
+    mp->full_magazines = magazine;
+    mp->depot_count += CORK_MEMPOOL_MAGAZINE_SIZE;
+    if (CORK_UNLIKELY(mp->free_count + mp->depot_count >= mp->trim_at)) {
+        cork_mempool_trim_locked(mp, mp->trim_keep_count);
+    }
+    cork_mempool_unlock(mp);
+}
+
+static void *
+cork_mempool_cache_new_object(struct cork_mempool *mp)
+{
+    struct cork_mempool_cache  *cache = cork_mempool_get_cache(mp);
+    if (CORK_UNLIKELY(cache->count == 0)) {
+        cork_mempool_cache_refill(mp, cache);
+    }
+    return cache->objects[--cache->count];
+}
+
+static void
+cork_mempool_cache_free_object(struct cork_mempool *mp, void *ptr)
+{
+    struct cork_mempool_cache  *cache = cork_mempool_get_cache(mp);
+    if (CORK_UNLIKELY(cache->count == CORK_MEMPOOL_CACHE_SIZE)) {
+        cork_mempool_cache_flush(mp, cache);
+    }
+    cache->objects[cache->count++] = ptr;
+}
+
+static void
+cork_mempool_cache_new_objects(struct cork_mempool *mp,
+                               size_t count, void **objects)
+{
+    struct cork_mempool_cache  *cache = cork_mempool_get_cache(mp);
+    while (count > 0) {
+        size_t  batch;
+        if (cache->count == 0) {
+            cork_mempool_cache_refill(mp, cache);
+        }
+        batch = (count < cache->count)? count: cache->count;
+        cache->count -= batch;
+        memcpy(objects, &cache->objects[cache->count],
+               batch * sizeof(void *));
+        objects += batch;
+        count -= batch;
+    }
+}
+
+static void
+cork_mempool_cache_free_objects(struct cork_mempool *mp,
+                                size_t count, void **objects)
+{
+    struct cork_mempool_cache  *cache = cork_mempool_get_cache(mp);
+    while (count > 0) {
+        size_t  batch;
+        if (cache->count == CORK_MEMPOOL_CACHE_SIZE) {
+            cork_mempool_cache_flush(mp, cache);
+        }
+        batch = CORK_MEMPOOL_CACHE_SIZE - cache->count;
+        if (count < batch) {
+            batch = count;
+        }
+        memcpy(&cache->objects[cache->count], objects,
+               batch * sizeof(void *));
+        cache->count += batch;
+        objects += batch;
+        count -= batch;
+    }
+}
+
+void
+cork_mempool_release_thread_cache(struct cork_mempool *mp)
+{
+    struct cork_mempool_tls_entry  *entry;
+    struct cork_mempool_cache  *cache;
+    if (!mp->thread_safe) {
+        return;
+    }
+
+    /* Make sure that we don't use the cache after we've freed it. */
+    entry = &cork_mempool_tls_get()->entries
+        [mp->id % CORK_MEMPOOL_TLS_ENTRIES];
+    if (entry->pool_id == mp->id) {
+        entry->pool_id = 0;
+        entry->cache = NULL;
+    }
+
+    cork_mempool_spin_lock(&cork_mempool_caches_lock);
+    cache = cork_mempool_thread_find_cache(cork_mempool_thread_get(), mp);
+    if (cache != NULL) {
+        cork_mempool_cache_release(cache);
+    }
+    cork_mempool_spin_unlock(&cork_mempool_caches_lock);
 }
 
+/* Moves every cached object back into the free list, and frees the caches and
+ * magazines.  No other thread can be using the pool. */
+static void
+cork_mempool_release_caches(struct cork_mempool *mp)
+{
+    struct cork_mempool_magazine  *magazine;
+
+    /* We still need the global lock, since the caches are also linked into
+     * their threads' lists, and those threads might be exiting right now. */
+    cork_mempool_spin_lock(&cork_mempool_caches_lock);
+    while (mp->caches != NULL) {
+        cork_mempool_cache_release(mp->caches);
+    }
+    cork_mempool_spin_unlock(&cork_mempool_caches_lock);
+
+    for (magazine = mp->full_magazines; magazine != NULL; ) {
+        struct cork_mempool_magazine  *next = magazine->next;
+        cork_mempool_return_objects
+            (mp, magazine->objects, CORK_MEMPOOL_MAGAZINE_SIZE);
+        cork_delete(struct cork_mempool_magazine, magazine);
+        magazine = next;
+    }
+    mp->full_magazines = NULL;
+    mp->depot_count = 0;
+
+    for (magazine = mp->empty_magazines; magazine != NULL; ) {
+        struct cork_mempool_magazine  *next = magazine->next;
+        cork_delete(struct cork_mempool_magazine, magazine);
+        magazine = next;
+    }
+    mp->empty_magazines = NULL;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Trimming
+ */
+
+/* We don't keep track of which block each object belongs to as objects are
+ * allocated and freed, since that would slow down the common case.  Instead,
+ * when we trim the pool, we sort the blocks by address, and use that to count
+ * how many of each block's objects are on the free list.  Any block whose
+ * objects are all free can be given back to the allocator. */
+
+struct cork_mempool_block_info {
+    struct cork_mempool_block  *block;
+    size_t  free_count;
+    bool  release;
+};
+
+static int
+cork_mempool_block_info__compare(const void *va, const void *vb)
+{
+    const struct cork_mempool_block_info  *a = va;
+    const struct cork_mempool_block_info  *b = vb;
+    return (a->block < b->block)? -1: (a->block > b->block)? 1: 0;
+}
+
+/* Returns the block that contains obj. */
+static struct cork_mempool_block_info *
+cork_mempool_find_block(struct cork_mempool *mp,
+                        struct cork_mempool_block_info *infos,
+                        struct cork_mempool_object *obj)
+{
+    size_t  lo = 0;
+    size_t  hi = mp->block_count;
+    char  *addr = (char *) obj;
+    while (hi - lo > 1) {
+        size_t  mid = lo + (hi - lo) / 2;
+        if (addr < (char *) infos[mid].block) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    assert(addr >= (char *) infos[lo].block &&
+           addr < (char *) infos[lo].block + mp->block_size);
+    return &infos[lo];
+}
+
+/* The caller must hold the pool's lock, if it's thread-safe. */
+static void
+cork_mempool_trim_locked(struct cork_mempool *mp, size_t keep_count)
+{
+    struct cork_mempool_block_info  *infos;
+    struct cork_mempool_object  *obj;
+    struct cork_mempool_object  **prev_next;
+    struct cork_mempool_block  *block;
+    struct cork_mempool_block  **block_prev_next;
+    size_t  objects_per_block =
+        (mp->block_size - sizeof(struct cork_mempool_block)) /
+        cork_mempool_object_size(mp);
+    size_t  free_count;
+    size_t  release_count = 0;
+    size_t  i;
+
+    /* Objects sitting in the depot can't be released until we move them back
+     * onto the free list. */
+    while (mp->full_magazines != NULL) {
+        struct cork_mempool_magazine  *magazine = mp->full_magazines;
+        mp->full_magazines = magazine->next;
+        cork_mempool_return_objects
+            (mp, magazine->objects, CORK_MEMPOOL_MAGAZINE_SIZE);
+        magazine->next = mp->empty_magazines;
+        mp->empty_magazines = magazine;
+    }
+    mp->depot_count = 0;
+
+    if (mp->free_count <= keep_count || mp->free_count < objects_per_block) {
+        goto done;
+    }
+
+    /* Count the free objects in each block. */
+    infos = cork_calloc(mp->block_count, sizeof(*infos));
+    for (i = 0, block = mp->blocks; block != NULL;
+         i++, block = block->next_block) {
+        infos[i].block = block;
+    }
+    qsort(infos, mp->block_count, sizeof(*infos),
+          cork_mempool_block_info__compare);
+    for (obj = mp->free_list; obj != NULL; obj = obj->next_free) {
+        cork_mempool_find_block(mp, infos, obj)->free_count++;
+    }
+
+    /* Decide which of the completely free blocks to release. */
+    free_count = mp->free_count;
+    for (i = 0; i < mp->block_count; i++) {
+        if (free_count < keep_count + objects_per_block) {
+            break;
+        }
+        if (infos[i].free_count == objects_per_block) {
+            infos[i].release = true;
+            free_count -= objects_per_block;
+            release_count++;
+        }
+    }
+
+    if (release_count > 0) {
+        DEBUG("Releasing %zu of %zu blocks\n", release_count, mp->block_count);
+
+        /* Remove the released blocks' objects from the free list. */
+        prev_next = &mp->free_list;
+        for (obj = mp->free_list; obj != NULL; obj = obj->next_free) {
+            if (cork_mempool_find_block(mp, infos, obj)->release) {
+                if (mp->done_object != NULL) {
+                    mp->done_object
+                        (mp->user_data, cork_mempool_get_object(obj));
+                }
+            } else {
+                *prev_next = obj;
+                prev_next = &obj->next_free;
+            }
+        }
+        *prev_next = NULL;
+
+        /* And then remove the blocks themselves. */
+        block_prev_next = &mp->blocks;
+        for (i = 0; i < mp->block_count; i++) {
+            if (infos[i].release) {
+                cork_free(infos[i].block, mp->block_size);
+            } else {
+                *block_prev_next = infos[i].block;
+                block_prev_next = &infos[i].block->next_block;
+            }
+        }
+        *block_prev_next = NULL;
+
+        mp->free_count = free_count;
+        mp->block_count -= release_count;
+    }
+
+    cork_cfree(infos, mp->block_count + release_count, sizeof(*infos));
+
+done:
+    /* If we weren't able to get below the automatic trimming threshold (because
+     * the free objects are spread across blocks that are still partly in use),
+     * wait until another (high - keep) objects have been freed before trying
+     * again, so that the cost of trimming is amortized across those frees. */
+    if (mp->trim_high_count != SIZE_MAX) {
+        mp->trim_at = mp->free_count +
+            (mp->trim_high_count - mp->trim_keep_count);
+        if (mp->trim_at < mp->trim_high_count) {
+            mp->trim_at = mp->trim_high_count;
+        }
+    }
+}
+
+void
+cork_mempool_trim(struct cork_mempool *mp, size_t keep_bytes)
+{
+    size_t  keep_count = keep_bytes / cork_mempool_object_size(mp);
+    if (mp->thread_safe) {
+        cork_mempool_lock(mp);
+        cork_mempool_trim_locked(mp, keep_count);
+        cork_mempool_unlock(mp);
+    } else {
+        cork_mempool_trim_locked(mp, keep_count);
+    }
+}
+
+void
+cork_mempool_set_high_watermark(struct cork_mempool *mp,
+                                size_t high_watermark, size_t keep_bytes)
+{
+    if (high_watermark == 0) {
+        mp->trim_at = SIZE_MAX;
+        mp->trim_high_count = SIZE_MAX;
+        mp->trim_keep_count = 0;
+        return;
+    }
+    assert(keep_bytes < high_watermark);
+    mp->trim_high_count = high_watermark / cork_mempool_object_size(mp);
+    mp->trim_keep_count = keep_bytes / cork_mempool_object_size(mp);
+    if (mp->trim_high_count <= mp->trim_keep_count) {
+        mp->trim_high_count = mp->trim_keep_count + 1;
+    }
+    mp->trim_at = mp->trim_high_count;
+}
+
+
 /*-----------------------------------------------------------------------
  * Inline declarations
  */
@@ -375,7 +375,7 @@ cork_buffer_to_slice(struct cork_buffer *buffer, struct cork_slice *slice)
 
 
 struct cork_buffer__stream_consumer {
-    struct cork_stream_consumer  consumer;
+    struct cork_stream_consumer_v  consumer;
     struct cork_buffer  *buffer;
 };
 
@@ -385,11 +385,35 @@ cork_buffer_stream_consumer_data(struct cork_stream_consumer *consumer,
                                  bool is_first_chunk)
 {
     struct cork_buffer__stream_consumer  *bconsumer = cork_container_of
-        (consumer, struct cork_buffer__stream_consumer, consumer);
+        (consumer, struct cork_buffer__stream_consumer, consumer.parent);
     cork_buffer_append(bconsumer->buffer, buf, size);
     return 0;
 }
 
+static int
+cork_buffer_stream_consumer_data_v(struct cork_stream_consumer *consumer,
+                                   const struct iovec *iov, size_t count,
+                                   bool is_first_chunk)
+{
+    struct cork_buffer__stream_consumer  *bconsumer = cork_container_of
+        (consumer, struct cork_buffer__stream_consumer, consumer.parent);
+    struct cork_buffer  *buffer = bconsumer->buffer;
+    size_t  total = 0;
+    size_t  i;
+
+    /* Grow the buffer at most once, instead of once per chunk. */
+    for (i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+    cork_buffer_ensure_size(buffer, buffer->size + total + 1);
+    for (i = 0; i < count; i++) {
+        memcpy(buffer->buf + buffer->size, iov[i].iov_base, iov[i].iov_len);
+        buffer->size += iov[i].iov_len;
+    }
+    ((char *) buffer->buf)[buffer->size] = '\0';
+    return 0;
+}
+
 static int
 cork_buffer_stream_consumer_eof(struct cork_stream_consumer *consumer)
 {
@@ -401,7 +425,7 @@ cork_buffer_stream_consumer_free(struct cork_stream_consumer *consumer)
 {
     struct cork_buffer__stream_consumer  *bconsumer =
         cork_container_of
-        (consumer, struct cork_buffer__stream_consumer, consumer);
+        (consumer, struct cork_buffer__stream_consumer, consumer.parent);
     cork_delete(struct cork_buffer__stream_consumer, bconsumer);
 }
 
@@ -410,9 +434,10 @@ cork_buffer_to_stream_consumer(struct cork_buffer *buffer)
 {
     struct cork_buffer__stream_consumer  *bconsumer =
         cork_new(struct cork_buffer__stream_consumer);
-    bconsumer->consumer.data = cork_buffer_stream_consumer_data;
-    bconsumer->consumer.eof = cork_buffer_stream_consumer_eof;
-    bconsumer->consumer.free = cork_buffer_stream_consumer_free;
+    cork_stream_consumer_v_init
+        (&bconsumer->consumer, cork_buffer_stream_consumer_data,
+         cork_buffer_stream_consumer_data_v, cork_buffer_stream_consumer_eof,
+         cork_buffer_stream_consumer_free);
     bconsumer->buffer = buffer;
-    return &bconsumer->consumer;
+    return &bconsumer->consumer.parent;
 }
@@ -0,0 +1,750 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/callbacks.h"
+#include "libcork/core/hash.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/concurrent-hash-table.h"
+#include "libcork/ds/hash-table.h"
+#include "libcork/threads/atomics.h"
+#include "libcork/threads/basics.h"
+
+
+/*-----------------------------------------------------------------------
+ * Concurrent hash tables
+ */
+
+/* The table is a chained hash table whose bin heads and chain links are only
+ * ever updated with release stores, so that readers can walk the chains without
+ * taking any locks.  Writers serialize on a spinlock chosen from a fixed set of
+ * stripes.  A key's stripe only depends on the low bits of its hash, and there
+ * are never fewer bins than stripes, so a key stays in the same stripe across
+ * resizes.
+ *
+ * To resize, we allocate a new bins array and link it into the `next` field of
+ * the current one.  Bins are then migrated one at a time, under their stripe's
+ * lock, by copying their entries into the new array and replacing the old bin's
+ * head with the MOVED marker.  Readers that see MOVED just continue in the next
+ * array.  Writers migrate the bin that they're about to modify, and then help
+ * out by migrating a few more, so the resize is spread across many operations.
+ *
+ * Nodes and bins arrays that have been unlinked can't be freed right away,
+ * since a reader might still be looking at them.  We use epoch-based
+ * reclamation for this: each reader announces which epoch it started in (by
+ * incrementing one of two counters), and garbage that was retired in epoch `e`
+ * is freed once we've been able to advance the global epoch to `e+2`, which
+ * can only happen after every reader that started in epoch `e` or earlier has
+ * finished.  The counters are sharded by thread ID to reduce contention. */
+
+#define CORK_CHT_CACHE_LINE_SIZE  64
+
+/* The number of writer locks. */
+#define CORK_CHT_STRIPE_COUNT  64
+
+/* The number of shards of reader counters. */
+#define CORK_CHT_READER_SHARD_COUNT  16
+
+/* The average number of entries per bin to allow before resizing. */
+#define CORK_CHT_MAX_DENSITY  2
+
+/* The number of extra bins that each write migrates during a resize. */
+#define CORK_CHT_MIGRATE_STEP  8
+
+/* How many retired objects we let pile up before trying to free them. */
+#define CORK_CHT_RECLAIM_THRESHOLD  128
+
+#define CORK_CHT_FREE_KEY    0x01
+#define CORK_CHT_FREE_VALUE  0x02
+
+struct cork_cht_node {
+    struct cork_hash_table_entry  public;
+    struct cork_cht_node * volatile  next;
+    /* Links together retired nodes.  We can't reuse `next` for this, since a
+     * reader might be about to follow it. */
+    struct cork_cht_node  *retired_next;
+    unsigned int  retired_flags;
+};
+
+struct cork_cht_bins {
+    size_t  bin_count;
+    size_t  bin_mask;
+    struct cork_cht_node * volatile  *bins;
+    /* The bins that we're migrating into, if a resize is in progress. */
+    struct cork_cht_bins * volatile  next;
+    volatile size_t  migrate_cursor;
+    volatile size_t  migrated_count;
+    struct cork_cht_bins  *retired_next;
+};
+
+union cork_cht_lock {
+    volatile int  locked;
+    char  padding[CORK_CHT_CACHE_LINE_SIZE];
+};
+
+union cork_cht_readers {
+    volatile size_t  active[2];
+    char  padding[CORK_CHT_CACHE_LINE_SIZE];
+};
+
+struct cork_concurrent_hash_table {
+    struct cork_cht_bins * volatile  current;
+    volatile size_t  entry_count;
+    void  *user_data;
+    cork_free_f  free_user_data;
+    cork_hash_f  hash;
+    cork_equals_f  equals;
+    cork_free_f  free_key;
+    cork_free_f  free_value;
+
+    /* Memory reclamation.  The retired lists are protected by reclaim_lock. */
+    volatile unsigned int  epoch;
+    union cork_cht_lock  reclaim_lock;
+    struct cork_cht_node  *retired_nodes[2];
+    struct cork_cht_bins  *retired_bins[2];
+    volatile size_t  retired_count;
+    union cork_cht_readers  readers[CORK_CHT_READER_SHARD_COUNT];
+
+    union cork_cht_lock  locks[CORK_CHT_STRIPE_COUNT];
+};
+
+/* Stored into a bin once its entries have been migrated to the next array. */
+static struct cork_cht_node  cork_cht_moved;
+#define CORK_CHT_MOVED  (&cork_cht_moved)
+
+#define cork_cht_stripe(table, index) \
+    (&(table)->locks[(index) & (CORK_CHT_STRIPE_COUNT - 1)])
+
+
+/*-----------------------------------------------------------------------
+ * Locks
+ */
+
+static void
+cork_cht_lock(union cork_cht_lock *lock)
+{
+    while (cork_int_cas(&lock->locked, 0, 1) != 0) {
+        while (cork_atomic_load(&lock->locked)) {
+            cork_pause();
+        }
+    }
+}
+
+static bool
+cork_cht_try_lock(union cork_cht_lock *lock)
+{
+    return cork_int_cas(&lock->locked, 0, 1) == 0;
+}
+
+static void
+cork_cht_unlock(union cork_cht_lock *lock)
+{
+    cork_atomic_store(&lock->locked, 0);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Memory reclamation
+ */
+
+struct cork_cht_guard {
+    union cork_cht_readers  *shard;
+    unsigned int  epoch;
+};
+
+static void
+cork_cht_enter(struct cork_concurrent_hash_table *table,
+               struct cork_cht_guard *guard)
+{
+    cork_thread_id  id = cork_current_thread_get_id();
+    guard->shard = &table->readers[id % CORK_CHT_READER_SHARD_COUNT];
+    for (;;) {
+        guard->epoch = cork_atomic_load(&table->epoch);
+        /* The atomic add is a full barrier, so we re-read the epoch after our
+         * increment is visible.  If the epoch hasn't changed, anyone trying to
+         * advance it will see us. */
+        cork_size_atomic_add(&guard->shard->active[guard->epoch & 1], 1);
+        if (CORK_LIKELY(cork_atomic_load(&table->epoch) == guard->epoch)) {
+            return;
+        }
+        cork_size_atomic_sub(&guard->shard->active[guard->epoch & 1], 1);
+    }
+}
+
+static void
+cork_cht_leave(struct cork_concurrent_hash_table *table,
+               struct cork_cht_guard *guard)
+{
+    cork_size_atomic_sub(&guard->shard->active[guard->epoch & 1], 1);
+}
+
+static void
+cork_cht_free_node(struct cork_concurrent_hash_table *table,
+                   struct cork_cht_node *node, unsigned int flags)
+{
+    if ((flags & CORK_CHT_FREE_KEY) && table->free_key != NULL) {
+        table->free_key(node->public.key);
+    }
+    if ((flags & CORK_CHT_FREE_VALUE) && table->free_value != NULL) {
+        table->free_value(node->public.value);
+    }
+    cork_delete(struct cork_cht_node, node);
+}
+
+static struct cork_cht_bins *
+cork_cht_bins_new(size_t bin_count)
+{
+    struct cork_cht_bins  *bins = cork_new(struct cork_cht_bins);
+    bins->bin_count = bin_count;
+    bins->bin_mask = bin_count - 1;
+    bins->bins = cork_calloc(bin_count, sizeof(struct cork_cht_node *));
+    bins->next = NULL;
+    bins->migrate_cursor = 0;
+    bins->migrated_count = 0;
+    bins->retired_next = NULL;
+    return bins;
+}
+
+static void
+cork_cht_bins_free(struct cork_cht_bins *bins)
+{
+    cork_cfree((void *) bins->bins, bins->bin_count,
+               sizeof(struct cork_cht_node *));
+    cork_delete(struct cork_cht_bins, bins);
+}
+
+/* Retires a chain of nodes (linked together via retired_next). */
+static void
+cork_cht_retire_nodes(struct cork_concurrent_hash_table *table,
+                      struct cork_cht_node *head, struct cork_cht_node *tail,
+                      size_t count)
+{
+    cork_cht_lock(&table->reclaim_lock);
+    tail->retired_next = table->retired_nodes[table->epoch & 1];
+    table->retired_nodes[table->epoch & 1] = head;
+    cork_size_atomic_add(&table->retired_count, count);
+    cork_cht_unlock(&table->reclaim_lock);
+}
+
+static void
+cork_cht_retire_node(struct cork_concurrent_hash_table *table,
+                     struct cork_cht_node *node, unsigned int flags)
+{
+    node->retired_flags = flags;
+    cork_cht_retire_nodes(table, node, node, 1);
+}
+
+static void
+cork_cht_retire_bins(struct cork_concurrent_hash_table *table,
+                     struct cork_cht_bins *bins)
+{
+    cork_cht_lock(&table->reclaim_lock);
+    bins->retired_next = table->retired_bins[table->epoch & 1];
+    table->retired_bins[table->epoch & 1] = bins;
+    cork_size_atomic_add(&table->retired_count, 1);
+    cork_cht_unlock(&table->reclaim_lock);
+}
+
+/* Tries to advance the epoch, freeing everything that was retired two epochs
+ * ago.  This never succeeds if the calling thread is itself still inside of a
+ * critical section from the previous epoch. */
+static void
+cork_cht_reclaim(struct cork_concurrent_hash_table *table)
+{
+    unsigned int  epoch;
+    unsigned int  old_parity;
+    struct cork_cht_node  *nodes;
+    struct cork_cht_bins  *bins;
+    size_t  count = 0;
+    size_t  i;
+
+    /* If someone else is already reclaiming, let them do it. */
+    if (!cork_cht_try_lock(&table->reclaim_lock)) {
+        return;
+    }
+
+    epoch = table->epoch;
+    old_parity = (epoch + 1) & 1;
+    cork_memory_barrier();
+    for (i = 0; i < CORK_CHT_READER_SHARD_COUNT; i++) {
+        if (cork_atomic_load(&table->readers[i].active[old_parity]) != 0) {
+            /* There's still a reader from the previous epoch. */
+            cork_cht_unlock(&table->reclaim_lock);
+            return;
+        }
+    }
+
+    /* Everyone from the previous epoch is done, so nothing retired during
+     * that epoch (or earlier) can be reached anymore. */
+    nodes = table->retired_nodes[old_parity];
+    bins = table->retired_bins[old_parity];
+    table->retired_nodes[old_parity] = NULL;
+    table->retired_bins[old_parity] = NULL;
+    cork_memory_barrier();
+    cork_atomic_store(&table->epoch, epoch + 1);
+    cork_memory_barrier();
+    cork_cht_unlock(&table->reclaim_lock);
+
+    while (nodes != NULL) {
+        struct cork_cht_node  *next = nodes->retired_next;
+        cork_cht_free_node(table, nodes, nodes->retired_flags);
+        nodes = next;
+        count++;
+    }
+    while (bins != NULL) {
+        struct cork_cht_bins  *next = bins->retired_next;
+        cork_cht_bins_free(bins);
+        bins = next;
+        count++;
+    }
+    cork_size_atomic_sub(&table->retired_count, count);
+}
+
+static void
+cork_cht_maybe_reclaim(struct cork_concurrent_hash_table *table)
+{
+    if (cork_atomic_load(&table->retired_count) >=
+        CORK_CHT_RECLAIM_THRESHOLD) {
+        cork_cht_reclaim(table);
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Resizing
+ */
+
+/* Moves the contents of one bin into the next bins array.  The caller must hold
+ * the bin's stripe lock. */
+static void
+cork_cht_migrate_bin(struct cork_concurrent_hash_table *table,
+                     struct cork_cht_bins *bins, size_t index)
+{
+    struct cork_cht_bins  *next = cork_atomic_load(&bins->next);
+    struct cork_cht_node  *head = bins->bins[index];
+    struct cork_cht_node  *curr;
+    size_t  count = 0;
+
+    if (head == CORK_CHT_MOVED) {
+        return;
+    }
+
+    for (curr = head; curr != NULL; curr = curr->next) {
+        struct cork_cht_node  *copy = cork_new(struct cork_cht_node);
+        size_t  new_index = curr->public.hash & next->bin_mask;
+        copy->public = curr->public;
+        copy->next = next->bins[new_index];
+        cork_atomic_store(&next->bins[new_index], copy);
+        /* The copy owns the key and value now. */
+        curr->retired_next = curr->next;
+        curr->retired_flags = 0;
+        count++;
+    }
+
+    /* Only mark the bin as moved once all of the copies are visible. */
+    cork_atomic_store(&bins->bins[index], CORK_CHT_MOVED);
+    if (head != NULL) {
+        struct cork_cht_node  *tail = head;
+        while (tail->retired_next != NULL) {
+            tail = tail->retired_next;
+        }
+        cork_cht_retire_nodes(table, head, tail, count);
+    }
+
+    if (cork_size_atomic_add(&bins->migrated_count, 1) == bins->bin_count) {
+        /* That was the last one; the new array is now the current one. */
+        cork_atomic_store(&table->current, next);
+        cork_cht_retire_bins(table, bins);
+    }
+}
+
+static void
+cork_cht_maybe_grow(struct cork_concurrent_hash_table *table)
+{
+    struct cork_cht_bins  *bins = cork_atomic_load(&table->current);
+    if (cork_atomic_load(&bins->next) == NULL &&
+        cork_atomic_load(&table->entry_count) >
+        bins->bin_count * CORK_CHT_MAX_DENSITY) {
+        struct cork_cht_bins  *next = cork_cht_bins_new(bins->bin_count * 2);
+        if (cork_ptr_cas(&bins->next, NULL, next) != NULL) {
+            /* Someone else started a resize first. */
+            cork_cht_bins_free(next);
+        }
+    }
+}
+
+static void
+cork_cht_help_migrate(struct cork_concurrent_hash_table *table)
+{
+    struct cork_cht_bins  *bins = cork_atomic_load(&table->current);
+    size_t  i;
+
+    if (cork_atomic_load(&bins->next) == NULL) {
+        return;
+    }
+
+    for (i = 0; i < CORK_CHT_MIGRATE_STEP; i++) {
+        size_t  index = cork_size_atomic_pre_add(&bins->migrate_cursor, 1);
+        union cork_cht_lock  *lock;
+        if (index >= bins->bin_count) {
+            return;
+        }
+        lock = cork_cht_stripe(table, index);
+        cork_cht_lock(lock);
+        cork_cht_migrate_bin(table, bins, index);
+        cork_cht_unlock(lock);
+    }
+}
+
+/* Returns the bin that a writer should modify for `hash`, migrating it first if
+ * a resize is in progress.  The caller must hold the hash's stripe lock. */
+static struct cork_cht_node * volatile *
+cork_cht_writer_bin(struct cork_concurrent_hash_table *table, cork_hash hash)
+{
+    struct cork_cht_bins  *bins = cork_atomic_load(&table->current);
+    for (;;) {
+        size_t  index = hash & bins->bin_mask;
+        struct cork_cht_bins  *next = cork_atomic_load(&bins->next);
+        if (next == NULL) {
+            return &bins->bins[index];
+        }
+        cork_cht_migrate_bin(table, bins, index);
+        bins = next;
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Public interface
+ */
+
+static cork_hash
+cork_cht__default_hash(void *user_data, const void *key)
+{
+    return (cork_hash) (uintptr_t) key;
+}
+
+static bool
+cork_cht__default_equals(void *user_data, const void *key1, const void *key2)
+{
+    return key1 == key2;
+}
+
+struct cork_concurrent_hash_table *
+cork_concurrent_hash_table_new(size_t initial_size, unsigned int flags)
+{
+    struct cork_concurrent_hash_table  *table =
+        cork_new(struct cork_concurrent_hash_table);
+    size_t  bin_count = CORK_CHT_STRIPE_COUNT;
+    while (bin_count * CORK_CHT_MAX_DENSITY < initial_size) {
+        bin_count *= 2;
+    }
+
+    memset(table, 0, sizeof(struct cork_concurrent_hash_table));
+    table->current = cork_cht_bins_new(bin_count);
+    table->hash = cork_cht__default_hash;
+    table->equals = cork_cht__default_equals;
+    return table;
+}
+
+static void
+cork_cht_free_chains(struct cork_concurrent_hash_table *table,
+                     struct cork_cht_bins *bins)
+{
+    size_t  i;
+    for (i = 0; i < bins->bin_count; i++) {
+        struct cork_cht_node  *curr = bins->bins[i];
+        if (curr == CORK_CHT_MOVED) {
+            continue;
+        }
+        while (curr != NULL) {
+            struct cork_cht_node  *next = curr->next;
+            cork_cht_free_node
+                (table, curr, CORK_CHT_FREE_KEY | CORK_CHT_FREE_VALUE);
+            curr = next;
+        }
+    }
+}
+
+void
+cork_concurrent_hash_table_free(struct cork_concurrent_hash_table *table)
+{
+    struct cork_cht_bins  *bins = table->current;
+    unsigned int  parity;
+
+    cork_cht_free_chains(table, bins);
+    if (bins->next != NULL) {
+        cork_cht_free_chains(table, bins->next);
+        cork_cht_bins_free(bins->next);
+    }
+    cork_cht_bins_free(bins);
+
+    for (parity = 0; parity < 2; parity++) {
+        struct cork_cht_node  *node = table->retired_nodes[parity];
+        struct cork_cht_bins  *retired = table->retired_bins[parity];
+        while (node != NULL) {
+            struct cork_cht_node  *next = node->retired_next;
+            cork_cht_free_node(table, node, node->retired_flags);
+            node = next;
+        }
+        while (retired != NULL) {
+            struct cork_cht_bins  *next = retired->retired_next;
+            cork_cht_bins_free(retired);
+            retired = next;
+        }
+    }
+
+    cork_free_user_data(table);
+    cork_delete(struct cork_concurrent_hash_table, table);
+}
+
+void
+cork_concurrent_hash_table_set_user_data
+(struct cork_concurrent_hash_table *table,
+ void *user_data, cork_free_f free_user_data)
+{
+    table->user_data = user_data;
+    table->free_user_data = free_user_data;
+}
+
+void
+cork_concurrent_hash_table_set_hash(struct cork_concurrent_hash_table *table,
+                                    cork_hash_f hash)
+{
+    table->hash = hash;
+}
+
+void
+cork_concurrent_hash_table_set_equals(struct cork_concurrent_hash_table *table,
+                                      cork_equals_f equals)
+{
+    table->equals = equals;
+}
+
+void
+cork_concurrent_hash_table_set_free_key
+(struct cork_concurrent_hash_table *table, cork_free_f free)
+{
+    table->free_key = free;
+}
+
+void
+cork_concurrent_hash_table_set_free_value
+(struct cork_concurrent_hash_table *table, cork_free_f free)
+{
+    table->free_value = free;
+}
+
+size_t
+cork_concurrent_hash_table_size(const struct cork_concurrent_hash_table *table)
+{
+    return cork_atomic_load(&table->entry_count);
+}
+
+
+void *
+cork_concurrent_hash_table_get_hash(struct cork_concurrent_hash_table *table,
+                                    cork_hash hash, const void *key)
+{
+    struct cork_cht_guard  guard;
+    struct cork_cht_bins  *bins;
+    struct cork_cht_node  *curr;
+    void  *result = NULL;
+
+    cork_cht_enter(table, &guard);
+    bins = cork_atomic_load(&table->current);
+    for (;;) {
+        curr = cork_atomic_load(&bins->bins[hash & bins->bin_mask]);
+        if (CORK_LIKELY(curr != CORK_CHT_MOVED)) {
+            break;
+        }
+        bins = cork_atomic_load(&bins->next);
+    }
+
+    for (; curr != NULL; curr = cork_atomic_load(&curr->next)) {
+        if (curr->public.hash == hash &&
+            table->equals(table->user_data, key, curr->public.key)) {
+            result = curr->public.value;
+            break;
+        }
+    }
+    cork_cht_leave(table, &guard);
+    return result;
+}
+
+void *
+cork_concurrent_hash_table_get(struct cork_concurrent_hash_table *table,
+                               const void *key)
+{
+    cork_hash  hash = table->hash(table->user_data, key);
+    return cork_concurrent_hash_table_get_hash(table, hash, key);
+}
+
+
+void
+cork_concurrent_hash_table_put_hash(struct cork_concurrent_hash_table *table,
+                                    cork_hash hash, void *key, void *value,
+                                    bool *is_new)
+{
+    struct cork_cht_guard  guard;
+    union cork_cht_lock  *lock = cork_cht_stripe(table, hash);
+    struct cork_cht_node * volatile  *bin;
+    struct cork_cht_node * volatile  *prev;
+    struct cork_cht_node  *curr;
+    struct cork_cht_node  *node = cork_new(struct cork_cht_node);
+
+    node->public.hash = hash;
+    node->public.key = key;
+    node->public.value = value;
+
+    cork_cht_enter(table, &guard);
+    cork_cht_lock(lock);
+    bin = cork_cht_writer_bin(table, hash);
+    for (prev = bin; (curr = *prev) != NULL; prev = &curr->next) {
+        if (curr->public.hash == hash &&
+            table->equals(table->user_data, key, curr->public.key)) {
+            /* Replace the existing node, so that readers never see a
+             * half-updated entry. */
+            unsigned int  flags = 0;
+            node->next = curr->next;
+            cork_atomic_store(prev, node);
+            cork_cht_unlock(lock);
+            if (curr->public.key != key) {
+                flags |= CORK_CHT_FREE_KEY;
+            }
+            if (curr->public.value != value) {
+                flags |= CORK_CHT_FREE_VALUE;
+            }
+            cork_cht_retire_node(table, curr, flags);
+            if (is_new != NULL) {
+                *is_new = false;
+            }
+            goto done;
+        }
+    }
+
+    node->next = *bin;
+    cork_atomic_store(bin, node);
+    cork_size_atomic_add(&table->entry_count, 1);
+    cork_cht_unlock(lock);
+    cork_cht_maybe_grow(table);
+    if (is_new != NULL) {
+        *is_new = true;
+    }
+
+done:
+    cork_cht_help_migrate(table);
+    cork_cht_leave(table, &guard);
+    cork_cht_maybe_reclaim(table);
+}
+
+void
+cork_concurrent_hash_table_put(struct cork_concurrent_hash_table *table,
+                               void *key, void *value, bool *is_new)
+{
+    cork_hash  hash = table->hash(table->user_data, key);
+    cork_concurrent_hash_table_put_hash(table, hash, key, value, is_new);
+}
+
+
+bool
+cork_concurrent_hash_table_delete_hash
+(struct cork_concurrent_hash_table *table, cork_hash hash, const void *key)
+{
+    struct cork_cht_guard  guard;
+    union cork_cht_lock  *lock = cork_cht_stripe(table, hash);
+    struct cork_cht_node * volatile  *prev;
+    struct cork_cht_node  *curr;
+    bool  found = false;
+
+    cork_cht_enter(table, &guard);
+    cork_cht_lock(lock);
+    for (prev = cork_cht_writer_bin(table, hash); (curr = *prev) != NULL;
+         prev = &curr->next) {
+        if (curr->public.hash == hash &&
+            table->equals(table->user_data, key, curr->public.key)) {
+            cork_atomic_store(prev, curr->next);
+            cork_size_atomic_sub(&table->entry_count, 1);
+            found = true;
+            break;
+        }
+    }
+    cork_cht_unlock(lock);
+
+    if (found) {
+        cork_cht_retire_node
+            (table, curr, CORK_CHT_FREE_KEY | CORK_CHT_FREE_VALUE);
+    }
+    cork_cht_help_migrate(table);
+    cork_cht_leave(table, &guard);
+    cork_cht_maybe_reclaim(table);
+    return found;
+}
+
+bool
+cork_concurrent_hash_table_delete(struct cork_concurrent_hash_table *table,
+                                  const void *key)
+{
+    cork_hash  hash = table->hash(table->user_data, key);
+    return cork_concurrent_hash_table_delete_hash(table, hash, key);
+}
+
+
+/* Returns false if the mapping should be aborted. */
+static bool
+cork_cht_map_bin(struct cork_concurrent_hash_table *table,
+                 struct cork_cht_bins *bins, size_t index,
+                 void *user_data, cork_hash_table_map_f map)
+{
+    struct cork_cht_node  *curr = cork_atomic_load(&bins->bins[index]);
+
+    if (curr == CORK_CHT_MOVED) {
+        /* This bin has been split into two bins in the next array. */
+        struct cork_cht_bins  *next = cork_atomic_load(&bins->next);
+        return cork_cht_map_bin(table, next, index, user_data, map) &&
+            cork_cht_map_bin
+            (table, next, index + bins->bin_count, user_data, map);
+    }
+
+    for (; curr != NULL; curr = cork_atomic_load(&curr->next)) {
+        enum cork_hash_table_map_result  result =
+            map(user_data, &curr->public);
+        if (result == CORK_HASH_TABLE_MAP_ABORT) {
+            return false;
+        } else if (result == CORK_HASH_TABLE_MAP_DELETE) {
+            /* We're still inside of our own critical section, so curr won't
+             * be freed out from under us. */
+            cork_concurrent_hash_table_delete_hash
+                (table, curr->public.hash, curr->public.key);
+        }
+    }
+    return true;
+}
+
+void
+cork_concurrent_hash_table_map(struct cork_concurrent_hash_table *table,
+                               void *user_data, cork_hash_table_map_f map)
+{
+    struct cork_cht_guard  guard;
+    struct cork_cht_bins  *bins;
+    size_t  i;
+
+    cork_cht_enter(table, &guard);
+    bins = cork_atomic_load(&table->current);
+    for (i = 0; i < bins->bin_count; i++) {
+        if (!cork_cht_map_bin(table, bins, i, user_data, map)) {
+            break;
+        }
+    }
+    cork_cht_leave(table, &guard);
+    cork_cht_maybe_reclaim(table);
+}
@@ -9,9 +9,11 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "libcork/ds/stream.h"
 #include "libcork/helpers/errors.h"
@@ -19,6 +21,13 @@
 
 #define BUFFER_SIZE  4096
 
+/* The most iovecs we'll pass to a single writev call */
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define IOV_COUNT  IOV_MAX
+#else
+#define IOV_COUNT  64
+#endif
+
 
 /*-----------------------------------------------------------------------
  * Producers
@@ -141,7 +150,7 @@ cork_file_consumer_new(FILE *fp)
 
 
 struct cork_fd_consumer {
-    struct cork_stream_consumer  parent;
+    struct cork_stream_consumer_v  parent;
     int  fd;
 };
 
@@ -150,14 +159,16 @@ cork_fd_consumer__data(struct cork_stream_consumer *vself,
                        const void *buf, size_t size, bool is_first)
 {
     struct cork_fd_consumer  *self =
-        cork_container_of(vself, struct cork_fd_consumer, parent);
+        cork_container_of(vself, struct cork_fd_consumer, parent.parent);
     size_t  bytes_left = size;
 
     while (bytes_left > 0) {
         ssize_t  rc = write(self->fd, buf, bytes_left);
-        if (rc == -1 && errno != EINTR) {
-            cork_system_error_set();
-            return -1;
+        if (rc == -1) {
+            if (errno != EINTR) {
+                cork_system_error_set();
+                return -1;
+            }
         } else {
             bytes_left -= rc;
             buf += rc;
@@ -167,12 +178,68 @@ cork_fd_consumer__data(struct cork_stream_consumer *vself,
     return 0;
 }
 
+static int
+cork_fd_consumer__data_v(struct cork_stream_consumer *vself,
+                         const struct iovec *iov, size_t count,
+                         bool is_first)
+{
+    struct cork_fd_consumer  *self =
+        cork_container_of(vself, struct cork_fd_consumer, parent.parent);
+    struct iovec  batch[IOV_COUNT];
+    /* The next chunk to write, and how much of it we've already written */
+    size_t  next = 0;
+    size_t  skip = 0;
+
+    while (true) {
+        size_t  batch_count;
+        ssize_t  rc;
+
+        while (next < count && iov[next].iov_len == 0) {
+            next++;
+        }
+        if (next == count) {
+            return 0;
+        }
+
+        batch[0].iov_base = (char *) iov[next].iov_base + skip;
+        batch[0].iov_len = iov[next].iov_len - skip;
+        for (batch_count = 1;
+             batch_count < IOV_COUNT && next + batch_count < count;
+             batch_count++) {
+            batch[batch_count] = iov[next + batch_count];
+        }
+
+        rc = writev(self->fd, batch, batch_count);
+        if (rc == -1) {
+            if (errno != EINTR) {
+                cork_system_error_set();
+                return -1;
+            }
+            continue;
+        }
+
+        /* Skip over whatever was written; a short write leaves us in the
+         * middle of a chunk. */
+        while (rc > 0) {
+            size_t  left_in_chunk = iov[next].iov_len - skip;
+            if ((size_t) rc < left_in_chunk) {
+                skip += rc;
+                rc = 0;
+            } else {
+                rc -= left_in_chunk;
+                next++;
+                skip = 0;
+            }
+        }
+    }
+}
+
 static int
 cork_fd_consumer__eof_close(struct cork_stream_consumer *vself)
 {
     int  rc;
     struct cork_fd_consumer  *self =
-        cork_container_of(vself, struct cork_fd_consumer, parent);
+        cork_container_of(vself, struct cork_fd_consumer, parent.parent);
     rii_check_posix(rc = close(self->fd));
     return 0;
 }
@@ -181,7 +248,7 @@ static void
 cork_fd_consumer__free(struct cork_stream_consumer *vself)
 {
     struct cork_fd_consumer  *self =
-        cork_container_of(vself, struct cork_fd_consumer, parent);
+        cork_container_of(vself, struct cork_fd_consumer, parent.parent);
     cork_delete(struct cork_fd_consumer, self);
 }
 
@@ -189,12 +256,12 @@ struct cork_stream_consumer *
 cork_fd_consumer_new(int fd)
 {
     struct cork_fd_consumer  *self = cork_new(struct cork_fd_consumer);
-    self->parent.data = cork_fd_consumer__data;
     /* We don't want to close fd, so we reuse file_consumer's eof method */
-    self->parent.eof = cork_file_consumer__eof;
-    self->parent.free = cork_fd_consumer__free;
+    cork_stream_consumer_v_init
+        (&self->parent, cork_fd_consumer__data, cork_fd_consumer__data_v,
+         cork_file_consumer__eof, cork_fd_consumer__free);
     self->fd = fd;
-    return &self->parent;
+    return &self->parent.parent;
 }
 
 struct cork_stream_consumer *
@@ -206,9 +273,9 @@ cork_file_from_path_consumer_new(const char *path, int flags)
 
     rpi_check_posix(fd = open(path, flags));
     self = cork_new(struct cork_fd_consumer);
-    self->parent.data = cork_fd_consumer__data;
-    self->parent.eof = cork_fd_consumer__eof_close;
-    self->parent.free = cork_fd_consumer__free;
+    cork_stream_consumer_v_init
+        (&self->parent, cork_fd_consumer__data, cork_fd_consumer__data_v,
+         cork_fd_consumer__eof_close, cork_fd_consumer__free);
     self->fd = fd;
-    return &self->parent;
+    return &self->parent.parent;
 }
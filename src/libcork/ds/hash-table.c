@@ -7,12 +7,23 @@
  * ----------------------------------------------------------------------
  */
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "libcork/config.h"
+
+#if CORK_CONFIG_HAVE_SSE2
+#include <emmintrin.h>
+#elif CORK_CONFIG_HAVE_NEON && CORK_CONFIG_ARCH_ARM64
+#include <arm_neon.h>
+#endif
+
 #include "libcork/core/callbacks.h"
 #include "libcork/core/hash.h"
+#include "libcork/core/mempool.h"
 #include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
 #include "libcork/ds/dllist.h"
 #include "libcork/ds/hash-table.h"
 #include "libcork/helpers/errors.h"
@@ -43,11 +54,29 @@ struct cork_hash_table_entry_priv {
     struct cork_dllist_item  insertion_order;
 };
 
+/* An entry in a flat table.  Entries are stored densely, in insertion order, in
+ * the table's entries array; `slot` is the index of the control byte that
+ * refers to this entry, or CORK_HASH_TABLE_NO_SLOT if the entry has been
+ * deleted. */
+struct cork_hash_table_flat_entry {
+    struct cork_hash_table_entry  public;
+    size_t  slot;
+};
+
+#define CORK_HASH_TABLE_NO_SLOT  SIZE_MAX
+
 struct cork_hash_table {
+    unsigned int  flags;
     struct cork_dllist  *bins;
     struct cork_dllist  insertion_order;
     size_t  bin_count;
     size_t  bin_mask;
+    /* While an incremental resize is in progress, the bins that we're still
+     * migrating entries out of.  Every old bin before rehash_index has already
+     * been migrated into the new bins array. */
+    struct cork_dllist  *old_bins;
+    size_t  old_bin_count;
+    size_t  rehash_index;
     size_t  entry_count;
     void  *user_data;
     cork_free_f  free_user_data;
@@ -55,8 +84,27 @@ struct cork_hash_table {
     cork_equals_f  equals;
     cork_free_f  free_key;
     cork_free_f  free_value;
+    /* If non-NULL, chained entries are allocated from this pool instead of
+     * from the heap.  The table doesn't own the pool. */
+    struct cork_mempool  *entry_pool;
+
+    /* The remaining fields are only used by flat tables. */
+    uint8_t  *ctrl;
+    size_t  *slots;
+    size_t  slot_count;
+    size_t  group_mask;
+    struct cork_hash_table_flat_entry  *entries;
+    /* Includes deleted entries that haven't been compacted away yet. */
+    size_t  entries_used;
+    size_t  entries_allocated;
 };
 
+#define cork_hash_table_is_flat(table) \
+    (((table)->flags & CORK_HASH_TABLE_FLAT) != 0)
+
+#define cork_hash_table_is_incremental(table) \
+    (((table)->flags & CORK_HASH_TABLE_INCREMENTAL) != 0)
+
 static cork_hash
 cork_hash_table__default_hash(void *user_data, const void *key)
 {
@@ -94,6 +142,10 @@ cork_hash_table_new_size(size_t desired_count)
     return r;
 }
 
+/* The number of old bins that each operation migrates while an incremental
+ * resize is in progress. */
+#define CORK_HASH_TABLE_REHASH_STEP  8
+
 #define bin_index(table, hash)  ((hash) & (table)->bin_mask)
 
 /* Allocates a new bins array in a hash table.  We overwrite the old
@@ -113,13 +165,73 @@ cork_hash_table_allocate_bins(struct cork_hash_table *table,
     }
 }
 
+/* Returns the bin that should contain any entry with the given hash value.
+ * During an incremental resize, that might be in the old bins array. */
+static inline struct cork_dllist *
+cork_hash_table_bin(const struct cork_hash_table *table, cork_hash hash)
+{
+    if (CORK_UNLIKELY(table->old_bins != NULL)) {
+        size_t  old_bin_index = hash & (table->old_bin_count - 1);
+        if (old_bin_index >= table->rehash_index) {
+            return &table->old_bins[old_bin_index];
+        }
+    }
+    return &table->bins[bin_index(table, hash)];
+}
+
+/* Moves all of the entries in an old bin into the current bins array. */
+static void
+cork_hash_table_migrate_bin(struct cork_hash_table *table,
+                            struct cork_dllist *bin)
+{
+    struct cork_dllist_item  *curr = cork_dllist_start(bin);
+    while (!cork_dllist_is_end(bin, curr)) {
+        struct cork_hash_table_entry_priv  *entry =
+            cork_container_of
+            (curr, struct cork_hash_table_entry_priv, in_bucket);
+        struct cork_dllist_item  *next = curr->next;
+        size_t  bin_index = bin_index(table, entry->public.hash);
+        DEBUG("      Rehash %p to bin %zu", entry, bin_index);
+        cork_dllist_add(&table->bins[bin_index], curr);
+        curr = next;
+    }
+}
+
+/* Migrates up to `count` bins of an in-progress incremental resize. */
+static void
+cork_hash_table_rehash_step(struct cork_hash_table *table, size_t count)
+{
+    if (CORK_LIKELY(table->old_bins == NULL)) {
+        return;
+    }
+
+    DEBUG("    Migrate %zu bins starting at %zu", count, table->rehash_index);
+    while (count-- > 0 && table->rehash_index < table->old_bin_count) {
+        cork_hash_table_migrate_bin
+            (table, &table->old_bins[table->rehash_index++]);
+    }
+
+    if (table->rehash_index == table->old_bin_count) {
+        DEBUG("    Finished incremental resize");
+        cork_cfree(table->old_bins, table->old_bin_count,
+                   sizeof(struct cork_dllist));
+        table->old_bins = NULL;
+        table->old_bin_count = 0;
+        table->rehash_index = 0;
+    }
+}
+
 
 static struct cork_hash_table_entry_priv *
 cork_hash_table_new_entry(struct cork_hash_table *table,
                           cork_hash hash, void *key, void *value)
 {
-    struct cork_hash_table_entry_priv  *entry =
-        cork_new(struct cork_hash_table_entry_priv);
+    struct cork_hash_table_entry_priv  *entry;
+    if (table->entry_pool == NULL) {
+        entry = cork_new(struct cork_hash_table_entry_priv);
+    } else {
+        entry = cork_mempool_new_object(table->entry_pool);
+    }
     cork_dllist_add(&table->insertion_order, &entry->insertion_order);
     entry->public.hash = hash;
     entry->public.key = key;
@@ -138,14 +250,496 @@ cork_hash_table_free_entry(struct cork_hash_table *table,
         table->free_value(entry->public.value);
     }
     cork_dllist_remove(&entry->insertion_order);
-    cork_delete(struct cork_hash_table_entry_priv, entry);
+    if (table->entry_pool == NULL) {
+        cork_delete(struct cork_hash_table_entry_priv, entry);
+    } else {
+        cork_mempool_free_object(table->entry_pool, entry);
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Flat tables
+ */
+
+/* A flat table uses open addressing instead of chaining.  Each slot in the
+ * probe array has a one-byte control value, which is either EMPTY, DELETED, or
+ * a 7-bit tag taken from the entry's hash value; the slot array then holds the
+ * index of the entry in the dense entries array.  Slots are grouped together
+ * into groups of CORK_HASH_TABLE_GROUP_SIZE, and we probe a group at a time,
+ * using the tags to filter out most non-matching entries without touching the
+ * entries themselves.  Because the entries array is kept in insertion order,
+ * iteration order is the same as for chained tables. */
+
+#define CORK_HASH_TABLE_GROUP_SIZE  16
+
+#define CORK_HASH_TABLE_CTRL_EMPTY    0x80
+#define CORK_HASH_TABLE_CTRL_DELETED  0xfe
+
+/* The low bits of the hash select a group; the high bits provide the tag. */
+#define cork_hash_table_tag(hash)  ((uint8_t) (((hash) >> 25) & 0x7f))
+#define cork_hash_table_group(table, hash)  ((hash) & (table)->group_mask)
+
+/* We keep the probe array at most 7/8 full. */
+#define cork_hash_table_max_load(slot_count) \
+    ((slot_count) - ((slot_count) / 8))
+
+static inline unsigned int
+cork_hash_table_first_bit(unsigned int mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    unsigned int  i = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/* Each of the following returns a bitmask with one bit for each of the control
+ * bytes in a group.  We use SIMD instructions to examine the entire group at
+ * once when they're available; which implementation to use is decided at
+ * build time via the CORK_CONFIG_HAVE_* macros.  (A group is exactly one SSE2
+ * or NEON register, so AVX2 doesn't buy us anything here.) */
+
+#if CORK_CONFIG_HAVE_SSE2
+
+/* Returns the control bytes in a group that equal `value`. */
+static inline unsigned int
+cork_hash_table_group_match(const uint8_t *ctrl, uint8_t value)
+{
+    __m128i  group = _mm_loadu_si128((const __m128i *) ctrl);
+    __m128i  match = _mm_cmpeq_epi8(group, _mm_set1_epi8((char) value));
+    return (unsigned int) _mm_movemask_epi8(match);
+}
+
+/* Returns the control bytes in a group that are EMPTY or DELETED.  (These are
+ * the only control values with the high bit set.) */
+static inline unsigned int
+cork_hash_table_group_match_free(const uint8_t *ctrl)
+{
+    __m128i  group = _mm_loadu_si128((const __m128i *) ctrl);
+    return (unsigned int) _mm_movemask_epi8(group);
+}
+
+#elif CORK_CONFIG_HAVE_NEON && CORK_CONFIG_ARCH_ARM64
+
+/* NEON doesn't have a movemask instruction, so we select a different bit from
+ * each byte of the comparison result, and then add each half together. */
+static inline unsigned int
+cork_hash_table_neon_movemask(uint8x16_t match)
+{
+    static const uint8_t  bits[CORK_HASH_TABLE_GROUP_SIZE] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    uint8x16_t  masked = vandq_u8(match, vld1q_u8(bits));
+    return (unsigned int) vaddv_u8(vget_low_u8(masked))
+        | ((unsigned int) vaddv_u8(vget_high_u8(masked)) << 8);
+}
+
+/* Returns the control bytes in a group that equal `value`. */
+static inline unsigned int
+cork_hash_table_group_match(const uint8_t *ctrl, uint8_t value)
+{
+    uint8x16_t  group = vld1q_u8(ctrl);
+    return cork_hash_table_neon_movemask(vceqq_u8(group, vdupq_n_u8(value)));
+}
+
+/* Returns the control bytes in a group that are EMPTY or DELETED.  (These are
+ * the only control values with the high bit set.) */
+static inline unsigned int
+cork_hash_table_group_match_free(const uint8_t *ctrl)
+{
+    uint8x16_t  group = vld1q_u8(ctrl);
+    return cork_hash_table_neon_movemask
+        (vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(group), 7)));
+}
+
+#else
+
+/* Returns the control bytes in a group that equal `value`. */
+static inline unsigned int
+cork_hash_table_group_match(const uint8_t *ctrl, uint8_t value)
+{
+    unsigned int  result = 0;
+    unsigned int  i;
+    for (i = 0; i < CORK_HASH_TABLE_GROUP_SIZE; i++) {
+        if (ctrl[i] == value) {
+            result |= (1u << i);
+        }
+    }
+    return result;
+}
+
+/* Returns the control bytes in a group that are EMPTY or DELETED.  (These are
+ * the only control values with the high bit set.) */
+static inline unsigned int
+cork_hash_table_group_match_free(const uint8_t *ctrl)
+{
+    unsigned int  result = 0;
+    unsigned int  i;
+    for (i = 0; i < CORK_HASH_TABLE_GROUP_SIZE; i++) {
+        if ((ctrl[i] & 0x80) != 0) {
+            result |= (1u << i);
+        }
+    }
+    return result;
+}
+
+#endif
+
+#define cork_hash_table_group_match_empty(ctrl) \
+    cork_hash_table_group_match((ctrl), CORK_HASH_TABLE_CTRL_EMPTY)
+
+/* Return a slot count that can hold at least `desired_count` entries without
+ * exceeding our maximum load factor. */
+static size_t
+cork_hash_table_flat_new_size(size_t desired_count)
+{
+    size_t  slot_count =
+        cork_hash_table_new_size(desired_count + (desired_count / 7) + 1);
+    if (slot_count < CORK_HASH_TABLE_GROUP_SIZE) {
+        slot_count = CORK_HASH_TABLE_GROUP_SIZE;
+    }
+    return slot_count;
+}
+
+static void
+cork_hash_table_flat_allocate(struct cork_hash_table *table,
+                              size_t slot_count)
+{
+    DEBUG("Allocate %zu slots", slot_count);
+    table->slot_count = slot_count;
+    table->group_mask = (slot_count / CORK_HASH_TABLE_GROUP_SIZE) - 1;
+    table->ctrl = cork_malloc(slot_count);
+    memset(table->ctrl, CORK_HASH_TABLE_CTRL_EMPTY, slot_count);
+    table->slots = cork_calloc(slot_count, sizeof(size_t));
+    table->entries_allocated = cork_hash_table_max_load(slot_count);
+    table->entries = cork_calloc
+        (table->entries_allocated, sizeof(struct cork_hash_table_flat_entry));
+    table->entries_used = 0;
+}
+
+static void
+cork_hash_table_flat_deallocate(struct cork_hash_table *table)
+{
+    cork_free(table->ctrl, table->slot_count);
+    cork_cfree(table->slots, table->slot_count, sizeof(size_t));
+    cork_cfree(table->entries, table->entries_allocated,
+               sizeof(struct cork_hash_table_flat_entry));
+}
+
+/* Returns the slot containing `key`, or CORK_HASH_TABLE_NO_SLOT if there isn't
+ * one. */
+static size_t
+cork_hash_table_flat_find(const struct cork_hash_table *table,
+                          cork_hash hash, const void *key)
+{
+    uint8_t  tag = cork_hash_table_tag(hash);
+    size_t  group = cork_hash_table_group(table, hash);
+    size_t  step = 0;
+
+    for (;;) {
+        size_t  base = group * CORK_HASH_TABLE_GROUP_SIZE;
+        const uint8_t  *ctrl = &table->ctrl[base];
+        unsigned int  matches = cork_hash_table_group_match(ctrl, tag);
+        while (matches != 0) {
+            size_t  slot = base + cork_hash_table_first_bit(matches);
+            struct cork_hash_table_flat_entry  *entry =
+                &table->entries[table->slots[slot]];
+            DEBUG("  Check entry %p in slot %zu", entry, slot);
+            if (entry->public.hash == hash &&
+                table->equals(table->user_data, key, entry->public.key)) {
+                DEBUG("  Match");
+                return slot;
+            }
+            matches &= matches - 1;
+        }
+
+        /* An EMPTY slot means that no entry was ever pushed past this group,
+         * so the key can't be in any later group. */
+        if (cork_hash_table_group_match_empty(ctrl) != 0) {
+            return CORK_HASH_TABLE_NO_SLOT;
+        }
+
+        /* Triangular probing visits every group, since the number of groups is
+         * a power of 2. */
+        step++;
+        group = (group + step) & table->group_mask;
+    }
+}
+
+/* Returns the first EMPTY or DELETED slot in `hash`'s probe sequence.  We
+ * never let the probe array fill up, so there's always at least one. */
+static size_t
+cork_hash_table_flat_find_free(const struct cork_hash_table *table,
+                               cork_hash hash)
+{
+    size_t  group = cork_hash_table_group(table, hash);
+    size_t  step = 0;
+
+    for (;;) {
+        size_t  base = group * CORK_HASH_TABLE_GROUP_SIZE;
+        unsigned int  matches =
+            cork_hash_table_group_match_free(&table->ctrl[base]);
+        if (matches != 0) {
+            return base + cork_hash_table_first_bit(matches);
+        }
+        step++;
+        group = (group + step) & table->group_mask;
+    }
+}
+
+/* Rebuilds the probe array with `slot_count` slots, compacting away any
+ * deleted entries. */
+static void
+cork_hash_table_flat_rehash(struct cork_hash_table *table, size_t slot_count)
+{
+    struct cork_hash_table  old = *table;
+    size_t  i;
+
+    DEBUG("    Rebuild flat table with %zu slots", slot_count);
+    cork_hash_table_flat_allocate(table, slot_count);
+    for (i = 0; i < old.entries_used; i++) {
+        struct cork_hash_table_flat_entry  *old_entry = &old.entries[i];
+        if (old_entry->slot != CORK_HASH_TABLE_NO_SLOT) {
+            cork_hash  hash = old_entry->public.hash;
+            size_t  index = table->entries_used++;
+            size_t  slot = cork_hash_table_flat_find_free(table, hash);
+            table->entries[index] = *old_entry;
+            table->entries[index].slot = slot;
+            table->ctrl[slot] = cork_hash_table_tag(hash);
+            table->slots[slot] = index;
+        }
+    }
+    cork_hash_table_flat_deallocate(&old);
+}
+
+/* Makes sure that there's room for at least one more entry. */
+static void
+cork_hash_table_flat_reserve_one(struct cork_hash_table *table)
+{
+    if (CORK_UNLIKELY(table->entries_used == table->entries_allocated)) {
+        /* If at least half of the used entries are deleted, we can make room
+         * just by compacting; otherwise we double the size of the table. */
+        if (table->entry_count <= table->entries_allocated / 2) {
+            cork_hash_table_flat_rehash(table, table->slot_count);
+        } else {
+            cork_hash_table_flat_rehash(table, table->slot_count * 2);
+        }
+    }
+}
+
+static struct cork_hash_table_flat_entry *
+cork_hash_table_flat_add(struct cork_hash_table *table,
+                         cork_hash hash, void *key, void *value)
+{
+    struct cork_hash_table_flat_entry  *entry;
+    size_t  index;
+    size_t  slot;
+
+    cork_hash_table_flat_reserve_one(table);
+    slot = cork_hash_table_flat_find_free(table, hash);
+    index = table->entries_used++;
+    DEBUG("    Add entry %zu into slot %zu", index, slot);
+    entry = &table->entries[index];
+    entry->public.hash = hash;
+    entry->public.key = key;
+    entry->public.value = value;
+    entry->slot = slot;
+    table->ctrl[slot] = cork_hash_table_tag(hash);
+    table->slots[slot] = index;
+    table->entry_count++;
+    return entry;
 }
 
+static void
+cork_hash_table_flat_remove(struct cork_hash_table *table,
+                            struct cork_hash_table_flat_entry *entry)
+{
+    size_t  slot = entry->slot;
+    size_t  base = slot & ~((size_t) CORK_HASH_TABLE_GROUP_SIZE - 1);
+
+    /* If this slot's group still has an EMPTY slot, then the group has never
+     * been full, and no probe sequence can have continued past it.  That means
+     * we can mark this slot EMPTY instead of leaving a tombstone behind. */
+    if (cork_hash_table_group_match_empty(&table->ctrl[base]) != 0) {
+        table->ctrl[slot] = CORK_HASH_TABLE_CTRL_EMPTY;
+    } else {
+        table->ctrl[slot] = CORK_HASH_TABLE_CTRL_DELETED;
+    }
+
+    DEBUG("    Remove entry %p from slot %zu", entry, slot);
+    if (table->free_key != NULL) {
+        table->free_key(entry->public.key);
+    }
+    if (table->free_value != NULL) {
+        table->free_value(entry->public.value);
+    }
+    entry->slot = CORK_HASH_TABLE_NO_SLOT;
+    table->entry_count--;
+}
+
+static void
+cork_hash_table_flat_clear(struct cork_hash_table *table)
+{
+    size_t  i;
+    DEBUG("(clear) Remove all entries");
+    for (i = 0; i < table->entries_used; i++) {
+        struct cork_hash_table_flat_entry  *entry = &table->entries[i];
+        if (entry->slot != CORK_HASH_TABLE_NO_SLOT) {
+            if (table->free_key != NULL) {
+                table->free_key(entry->public.key);
+            }
+            if (table->free_value != NULL) {
+                table->free_value(entry->public.value);
+            }
+        }
+    }
+    memset(table->ctrl, CORK_HASH_TABLE_CTRL_EMPTY, table->slot_count);
+    table->entries_used = 0;
+    table->entry_count = 0;
+}
+
+static struct cork_hash_table_entry *
+cork_hash_table_flat_get_entry(const struct cork_hash_table *table,
+                               cork_hash hash, const void *key)
+{
+    size_t  slot;
+    DEBUG("(get) Search for key %p (hash 0x%08" PRIx32 ")", key, hash);
+    slot = cork_hash_table_flat_find(table, hash, key);
+    if (slot == CORK_HASH_TABLE_NO_SLOT) {
+        DEBUG("  Entry not found");
+        return NULL;
+    }
+    return &table->entries[table->slots[slot]].public;
+}
+
+static struct cork_hash_table_entry *
+cork_hash_table_flat_get_or_create(struct cork_hash_table *table,
+                                   cork_hash hash, void *key, bool *is_new)
+{
+    size_t  slot;
+    struct cork_hash_table_flat_entry  *entry;
+
+    DEBUG("(get_or_create) Search for key %p (hash 0x%08" PRIx32 ")",
+          key, hash);
+    slot = cork_hash_table_flat_find(table, hash, key);
+    if (slot != CORK_HASH_TABLE_NO_SLOT) {
+        *is_new = false;
+        return &table->entries[table->slots[slot]].public;
+    }
+
+    DEBUG("  Entry not found");
+    entry = cork_hash_table_flat_add(table, hash, key, NULL);
+    *is_new = true;
+    return &entry->public;
+}
+
+static void
+cork_hash_table_flat_put(struct cork_hash_table *table,
+                         cork_hash hash, void *key, void *value,
+                         bool *is_new, void **old_key, void **old_value)
+{
+    size_t  slot;
+
+    DEBUG("(put) Search for key %p (hash 0x%08" PRIx32 ")", key, hash);
+    slot = cork_hash_table_flat_find(table, hash, key);
+    if (slot != CORK_HASH_TABLE_NO_SLOT) {
+        struct cork_hash_table_flat_entry  *entry =
+            &table->entries[table->slots[slot]];
+        DEBUG("    Found existing entry; overwriting");
+        if (old_key != NULL) {
+            *old_key = entry->public.key;
+        }
+        if (old_value != NULL) {
+            *old_value = entry->public.value;
+        }
+        entry->public.key = key;
+        entry->public.value = value;
+        if (is_new != NULL) {
+            *is_new = false;
+        }
+        return;
+    }
+
+    DEBUG("  Entry not found");
+    cork_hash_table_flat_add(table, hash, key, value);
+    if (old_key != NULL) {
+        *old_key = NULL;
+    }
+    if (old_value != NULL) {
+        *old_value = NULL;
+    }
+    if (is_new != NULL) {
+        *is_new = true;
+    }
+}
+
+static bool
+cork_hash_table_flat_delete(struct cork_hash_table *table,
+                            cork_hash hash, const void *key,
+                            void **deleted_key, void **deleted_value)
+{
+    size_t  slot;
+    struct cork_hash_table_flat_entry  *entry;
+
+    DEBUG("(delete) Search for key %p (hash 0x%08" PRIx32 ")", key, hash);
+    slot = cork_hash_table_flat_find(table, hash, key);
+    if (slot == CORK_HASH_TABLE_NO_SLOT) {
+        DEBUG("  Entry not found");
+        return false;
+    }
+
+    entry = &table->entries[table->slots[slot]];
+    if (deleted_key != NULL) {
+        *deleted_key = entry->public.key;
+    }
+    if (deleted_value != NULL) {
+        *deleted_value = entry->public.value;
+    }
+    cork_hash_table_flat_remove(table, entry);
+    return true;
+}
+
+static void
+cork_hash_table_flat_map(struct cork_hash_table *table, void *user_data,
+                         cork_hash_table_map_f map)
+{
+    size_t  i;
+    DEBUG("Map across flat hash table");
+    for (i = 0; i < table->entries_used; i++) {
+        struct cork_hash_table_flat_entry  *entry = &table->entries[i];
+        enum cork_hash_table_map_result  result;
+
+        if (entry->slot == CORK_HASH_TABLE_NO_SLOT) {
+            continue;
+        }
+
+        DEBUG("    Apply function to entry %p", entry);
+        result = map(user_data, &entry->public);
+        if (result == CORK_HASH_TABLE_MAP_ABORT) {
+            return;
+        } else if (result == CORK_HASH_TABLE_MAP_DELETE) {
+            DEBUG("      Delete requested");
+            cork_hash_table_flat_remove(table, entry);
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------------------
+ * Public interface
+ */
 
 struct cork_hash_table *
 cork_hash_table_new(size_t initial_size, unsigned int flags)
 {
     struct cork_hash_table  *table = cork_new(struct cork_hash_table);
+    table->flags = flags;
     table->entry_count = 0;
     table->user_data = NULL;
     table->free_user_data = NULL;
@@ -153,11 +747,30 @@ cork_hash_table_new(size_t initial_size, unsigned int flags)
     table->equals = cork_hash_table__default_equals;
     table->free_key = NULL;
     table->free_value = NULL;
+    table->entry_pool = NULL;
+    table->old_bins = NULL;
+    table->old_bin_count = 0;
+    table->rehash_index = 0;
     cork_dllist_init(&table->insertion_order);
     if (initial_size < CORK_HASH_TABLE_DEFAULT_INITIAL_SIZE) {
         initial_size = CORK_HASH_TABLE_DEFAULT_INITIAL_SIZE;
     }
-    cork_hash_table_allocate_bins(table, initial_size);
+    if (cork_hash_table_is_flat(table)) {
+        table->bins = NULL;
+        table->bin_count = 0;
+        table->bin_mask = 0;
+        cork_hash_table_flat_allocate
+            (table, cork_hash_table_flat_new_size(initial_size));
+    } else {
+        table->ctrl = NULL;
+        table->slots = NULL;
+        table->slot_count = 0;
+        table->group_mask = 0;
+        table->entries = NULL;
+        table->entries_used = 0;
+        table->entries_allocated = 0;
+        cork_hash_table_allocate_bins(table, initial_size);
+    }
     return table;
 }
 
@@ -168,6 +781,11 @@ cork_hash_table_clear(struct cork_hash_table *table)
     struct cork_dllist_item  *curr;
     struct cork_dllist_item  *next;
 
+    if (cork_hash_table_is_flat(table)) {
+        cork_hash_table_flat_clear(table);
+        return;
+    }
+
     DEBUG("(clear) Remove all entries");
     for (curr = cork_dllist_start(&table->insertion_order);
          !cork_dllist_is_end(&table->insertion_order, curr);
@@ -180,6 +798,15 @@ cork_hash_table_clear(struct cork_hash_table *table)
     }
     cork_dllist_init(&table->insertion_order);
 
+    if (table->old_bins != NULL) {
+        DEBUG("(clear) Abandon incremental resize");
+        cork_cfree(table->old_bins, table->old_bin_count,
+                   sizeof(struct cork_dllist));
+        table->old_bins = NULL;
+        table->old_bin_count = 0;
+        table->rehash_index = 0;
+    }
+
     DEBUG("(clear) Clear bins");
     for (i = 0; i < table->bin_count; i++) {
         DEBUG("  Bin %zu", i);
@@ -193,7 +820,11 @@ void
 cork_hash_table_free(struct cork_hash_table *table)
 {
     cork_hash_table_clear(table);
-    cork_cfree(table->bins, table->bin_count, sizeof(struct cork_dllist));
+    if (cork_hash_table_is_flat(table)) {
+        cork_hash_table_flat_deallocate(table);
+    } else {
+        cork_cfree(table->bins, table->bin_count, sizeof(struct cork_dllist));
+    }
     cork_delete(struct cork_hash_table, table);
 }
 
@@ -235,37 +866,61 @@ cork_hash_table_set_free_value(struct cork_hash_table *table, cork_free_f free)
     table->free_value = free;
 }
 
+struct cork_mempool *
+cork_hash_table_entry_mempool_new(void)
+{
+    return cork_mempool_new(struct cork_hash_table_entry_priv);
+}
+
+void
+cork_hash_table_set_allocator(struct cork_hash_table *table,
+                              struct cork_mempool *entry_pool)
+{
+    /* Entries are always freed back to the allocator that they came from. */
+    assert(table->entry_count == 0);
+    table->entry_pool = entry_pool;
+}
+
 
 void
 cork_hash_table_ensure_size(struct cork_hash_table *table, size_t desired_count)
 {
+    if (cork_hash_table_is_flat(table)) {
+        if (desired_count > table->entries_allocated) {
+            cork_hash_table_flat_rehash
+                (table, cork_hash_table_flat_new_size(desired_count));
+        }
+        return;
+    }
+
     if (desired_count > table->bin_count) {
-        struct cork_dllist  *old_bins = table->bins;
-        size_t  old_bin_count = table->bin_count;
+        struct cork_dllist  *old_bins;
+        size_t  old_bin_count;
+
+        /* We can only have one incremental resize in progress at a time, so
+         * finish off the previous one before starting another. */
+        cork_hash_table_rehash_step(table, SIZE_MAX);
 
+        old_bins = table->bins;
+        old_bin_count = table->bin_count;
         cork_hash_table_allocate_bins(table, desired_count);
 
         if (old_bins != NULL) {
-            size_t  i;
-            for (i = 0; i < old_bin_count; i++) {
-                struct cork_dllist  *bin = &old_bins[i];
-                struct cork_dllist_item  *curr = cork_dllist_start(bin);
-                while (!cork_dllist_is_end(bin, curr)) {
-                    struct cork_hash_table_entry_priv  *entry =
-                        cork_container_of
-                        (curr, struct cork_hash_table_entry_priv, in_bucket);
-                    struct cork_dllist_item  *next = curr->next;
-
-                    size_t  bin_index = bin_index(table, entry->public.hash);
-                    DEBUG("      Rehash %p from bin %zu to bin %zu",
-                          entry, i, bin_index);
-                    cork_dllist_add(&table->bins[bin_index], curr);
-
-                    curr = next;
+            if (cork_hash_table_is_incremental(table) &&
+                table->entry_count > 0) {
+                DEBUG("    Start incremental resize from %zu bins",
+                      old_bin_count);
+                table->old_bins = old_bins;
+                table->old_bin_count = old_bin_count;
+                table->rehash_index = 0;
+            } else {
+                size_t  i;
+                for (i = 0; i < old_bin_count; i++) {
+                    cork_hash_table_migrate_bin(table, &old_bins[i]);
                 }
+                cork_cfree
+                    (old_bins, old_bin_count, sizeof(struct cork_dllist));
             }
-
-            cork_cfree(old_bins, old_bin_count, sizeof(struct cork_dllist));
         }
     }
 }
@@ -283,10 +938,13 @@ struct cork_hash_table_entry *
 cork_hash_table_get_entry_hash(const struct cork_hash_table *table,
                                cork_hash hash, const void *key)
 {
-    size_t  bin_index;
     struct cork_dllist  *bin;
     struct cork_dllist_item  *curr;
 
+    if (cork_hash_table_is_flat(table)) {
+        return cork_hash_table_flat_get_entry(table, hash, key);
+    }
+
     if (table->bin_count == 0) {
         DEBUG("(get) Empty table when searching for key %p "
               "(hash 0x%08" PRIx32 ")",
@@ -294,11 +952,8 @@ cork_hash_table_get_entry_hash(const struct cork_hash_table *table,
         return NULL;
     }
 
-    bin_index = bin_index(table, hash);
-    DEBUG("(get) Search for key %p (hash 0x%08" PRIx32 ", bin %zu)",
-          key, hash, bin_index);
-
-    bin = &table->bins[bin_index];
+    DEBUG("(get) Search for key %p (hash 0x%08" PRIx32 ")", key, hash);
+    bin = cork_hash_table_bin(table, hash);
     curr = cork_dllist_start(bin);
     while (!cork_dllist_is_end(bin, curr)) {
         struct cork_hash_table_entry_priv  *entry =
@@ -353,23 +1008,126 @@ cork_hash_table_get(const struct cork_hash_table *table, const void *key)
 }
 
 
+/* The batched lookups are software-pipelined: while we compare the keys for
+ * entry i, we're prefetching the first entry in the bin for key i +
+ * CORK_HASH_TABLE_PREFETCH_DISTANCE, and the bin (or probe group) itself for key
+ * i + 2*CORK_HASH_TABLE_PREFETCH_DISTANCE.  That lets the cache misses for
+ * different keys overlap with each other. */
+#define CORK_HASH_TABLE_PREFETCH_DISTANCE  8
+
+/* cork_hash_table_get_many computes hashes for this many keys at a time. */
+#define CORK_HASH_TABLE_BATCH_SIZE  64
+
+static void
+cork_hash_table_prefetch_bin(const struct cork_hash_table *table,
+                             cork_hash hash)
+{
+    if (cork_hash_table_is_flat(table)) {
+        size_t  base = cork_hash_table_group(table, hash) *
+            CORK_HASH_TABLE_GROUP_SIZE;
+        CORK_PREFETCH(&table->ctrl[base]);
+        CORK_PREFETCH(&table->slots[base]);
+    } else if (table->bin_count > 0) {
+        CORK_PREFETCH(cork_hash_table_bin(table, hash));
+    }
+}
+
+static void
+cork_hash_table_prefetch_entry(const struct cork_hash_table *table,
+                               cork_hash hash)
+{
+    if (cork_hash_table_is_flat(table)) {
+        size_t  base = cork_hash_table_group(table, hash) *
+            CORK_HASH_TABLE_GROUP_SIZE;
+        unsigned int  matches = cork_hash_table_group_match
+            (&table->ctrl[base], cork_hash_table_tag(hash));
+        if (matches != 0) {
+            size_t  slot = base + cork_hash_table_first_bit(matches);
+            CORK_PREFETCH(&table->entries[table->slots[slot]]);
+        }
+    } else if (table->bin_count > 0) {
+        struct cork_dllist  *bin = cork_hash_table_bin(table, hash);
+        CORK_PREFETCH(cork_dllist_start(bin));
+    }
+}
+
+size_t
+cork_hash_table_get_many_hash(const struct cork_hash_table *table,
+                              const cork_hash *hashes,
+                              const void * const *keys, size_t count,
+                              void **values)
+{
+    const size_t  distance = CORK_HASH_TABLE_PREFETCH_DISTANCE;
+    size_t  found = 0;
+    size_t  i;
+
+    for (i = 0; i < count + 2*distance; i++) {
+        if (i < count) {
+            cork_hash_table_prefetch_bin(table, hashes[i]);
+        }
+        if (i >= distance && i - distance < count) {
+            cork_hash_table_prefetch_entry(table, hashes[i - distance]);
+        }
+        if (i >= 2*distance) {
+            size_t  j = i - 2*distance;
+            struct cork_hash_table_entry  *entry =
+                cork_hash_table_get_entry_hash(table, hashes[j], keys[j]);
+            if (entry == NULL) {
+                values[j] = NULL;
+            } else {
+                values[j] = entry->value;
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
+size_t
+cork_hash_table_get_many(const struct cork_hash_table *table,
+                         const void * const *keys, size_t count,
+                         void **values)
+{
+    cork_hash  hashes[CORK_HASH_TABLE_BATCH_SIZE];
+    size_t  found = 0;
+    size_t  i;
+
+    for (i = 0; i < count; i += CORK_HASH_TABLE_BATCH_SIZE) {
+        size_t  batch_size = count - i;
+        size_t  j;
+        if (batch_size > CORK_HASH_TABLE_BATCH_SIZE) {
+            batch_size = CORK_HASH_TABLE_BATCH_SIZE;
+        }
+        for (j = 0; j < batch_size; j++) {
+            hashes[j] = table->hash(table->user_data, keys[i + j]);
+        }
+        found += cork_hash_table_get_many_hash
+            (table, hashes, keys + i, batch_size, values + i);
+    }
+
+    return found;
+}
+
+
 struct cork_hash_table_entry *
 cork_hash_table_get_or_create_hash(struct cork_hash_table *table,
                                    cork_hash hash, void *key, bool *is_new)
 {
     struct cork_hash_table_entry_priv  *entry;
-    size_t  bin_index;
+    struct cork_dllist  *bin;
 
+    if (cork_hash_table_is_flat(table)) {
+        return cork_hash_table_flat_get_or_create(table, hash, key, is_new);
+    }
+
+    cork_hash_table_rehash_step(table, CORK_HASH_TABLE_REHASH_STEP);
     if (table->bin_count > 0) {
-        struct cork_dllist  *bin;
         struct cork_dllist_item  *curr;
 
-        bin_index = bin_index(table, hash);
-        DEBUG("(get_or_create) Search for key %p "
-              "(hash 0x%08" PRIx32 ", bin %zu)",
-              key, hash, bin_index);
-
-        bin = &table->bins[bin_index];
+        DEBUG("(get_or_create) Search for key %p (hash 0x%08" PRIx32 ")",
+              key, hash);
+        bin = cork_hash_table_bin(table, hash);
         curr = cork_dllist_start(bin);
         while (!cork_dllist_is_end(bin, curr)) {
             struct cork_hash_table_entry_priv  *entry =
@@ -393,22 +1151,22 @@ cork_hash_table_get_or_create_hash(struct cork_hash_table *table,
         if ((table->entry_count / table->bin_count) >
             CORK_HASH_TABLE_MAX_DENSITY) {
             cork_hash_table_rehash(table);
-            bin_index = bin_index(table, hash);
+            bin = cork_hash_table_bin(table, hash);
         }
     } else {
         DEBUG("(get_or_create) Search for key %p (hash 0x%08" PRIx32 ")",
               key, hash);
         DEBUG("  Empty table");
         cork_hash_table_rehash(table);
-        bin_index = bin_index(table, hash);
+        bin = cork_hash_table_bin(table, hash);
     }
 
     DEBUG("    Allocate new entry");
     entry = cork_hash_table_new_entry(table, hash, key, NULL);
     DEBUG("    Created new entry %p", entry);
 
-    DEBUG("    Add entry into bin %zu", bin_index);
-    cork_dllist_add(&table->bins[bin_index], &entry->in_bucket);
+    DEBUG("    Add entry into bin");
+    cork_dllist_add(bin, &entry->in_bucket);
 
     table->entry_count++;
     *is_new = true;
@@ -430,17 +1188,20 @@ cork_hash_table_put_hash(struct cork_hash_table *table,
                          bool *is_new, void **old_key, void **old_value)
 {
     struct cork_hash_table_entry_priv  *entry;
-    size_t  bin_index;
+    struct cork_dllist  *bin;
+
+    if (cork_hash_table_is_flat(table)) {
+        cork_hash_table_flat_put
+            (table, hash, key, value, is_new, old_key, old_value);
+        return;
+    }
 
+    cork_hash_table_rehash_step(table, CORK_HASH_TABLE_REHASH_STEP);
     if (table->bin_count > 0) {
-        struct cork_dllist  *bin;
         struct cork_dllist_item  *curr;
 
-        bin_index = bin_index(table, hash);
-        DEBUG("(put) Search for key %p (hash 0x%08" PRIx32 ", bin %zu)",
-              key, hash, bin_index);
-
-        bin = &table->bins[bin_index];
+        DEBUG("(put) Search for key %p (hash 0x%08" PRIx32 ")", key, hash);
+        bin = cork_hash_table_bin(table, hash);
         curr = cork_dllist_start(bin);
         while (!cork_dllist_is_end(bin, curr)) {
             struct cork_hash_table_entry_priv  *entry =
@@ -476,22 +1237,22 @@ cork_hash_table_put_hash(struct cork_hash_table *table,
         if ((table->entry_count / table->bin_count) >
             CORK_HASH_TABLE_MAX_DENSITY) {
             cork_hash_table_rehash(table);
-            bin_index = bin_index(table, hash);
+            bin = cork_hash_table_bin(table, hash);
         }
     } else {
         DEBUG("(put) Search for key %p (hash 0x%08" PRIx32 ")",
               key, hash);
         DEBUG("  Empty table");
         cork_hash_table_rehash(table);
-        bin_index = bin_index(table, hash);
+        bin = cork_hash_table_bin(table, hash);
     }
 
     DEBUG("    Allocate new entry");
     entry = cork_hash_table_new_entry(table, hash, key, value);
     DEBUG("    Created new entry %p", entry);
 
-    DEBUG("    Add entry into bin %zu", bin_index);
-    cork_dllist_add(&table->bins[bin_index], &entry->in_bucket);
+    DEBUG("    Add entry into bin");
+    cork_dllist_add(bin, &entry->in_bucket);
 
     table->entry_count++;
     if (old_key != NULL) {
@@ -520,8 +1281,15 @@ void
 cork_hash_table_delete_entry(struct cork_hash_table *table,
                              struct cork_hash_table_entry *ventry)
 {
-    struct cork_hash_table_entry_priv  *entry =
-        cork_container_of(ventry, struct cork_hash_table_entry_priv, public);
+    struct cork_hash_table_entry_priv  *entry;
+    if (cork_hash_table_is_flat(table)) {
+        cork_hash_table_flat_remove
+            (table, cork_container_of
+             (ventry, struct cork_hash_table_flat_entry, public));
+        return;
+    }
+    entry = cork_container_of
+        (ventry, struct cork_hash_table_entry_priv, public);
     cork_dllist_remove(&entry->in_bucket);
     table->entry_count--;
     cork_hash_table_free_entry(table, entry);
@@ -533,10 +1301,14 @@ cork_hash_table_delete_hash(struct cork_hash_table *table,
                             cork_hash hash, const void *key,
                             void **deleted_key, void **deleted_value)
 {
-    size_t  bin_index;
     struct cork_dllist  *bin;
     struct cork_dllist_item  *curr;
 
+    if (cork_hash_table_is_flat(table)) {
+        return cork_hash_table_flat_delete
+            (table, hash, key, deleted_key, deleted_value);
+    }
+
     if (table->bin_count == 0) {
         DEBUG("(delete) Empty table when searching for key %p "
               "(hash 0x%08" PRIx32 ")",
@@ -544,11 +1316,9 @@ cork_hash_table_delete_hash(struct cork_hash_table *table,
         return false;
     }
 
-    bin_index = bin_index(table, hash);
-    DEBUG("(delete) Search for key %p (hash 0x%08" PRIx32 ", bin %zu)",
-          key, hash, bin_index);
-
-    bin = &table->bins[bin_index];
+    cork_hash_table_rehash_step(table, CORK_HASH_TABLE_REHASH_STEP);
+    DEBUG("(delete) Search for key %p (hash 0x%08" PRIx32 ")", key, hash);
+    bin = cork_hash_table_bin(table, hash);
     curr = cork_dllist_start(bin);
     while (!cork_dllist_is_end(bin, curr)) {
         struct cork_hash_table_entry_priv  *entry =
@@ -565,7 +1335,7 @@ cork_hash_table_delete_hash(struct cork_hash_table *table,
                 *deleted_value = entry->public.value;
             }
 
-            DEBUG("    Remove entry from hash bin %zu", bin_index);
+            DEBUG("    Remove entry from hash bin");
             cork_dllist_remove(curr);
             table->entry_count--;
 
@@ -596,6 +1366,12 @@ cork_hash_table_map(struct cork_hash_table *table, void *user_data,
                     cork_hash_table_map_f map)
 {
     struct cork_dllist_item  *curr;
+
+    if (cork_hash_table_is_flat(table)) {
+        cork_hash_table_flat_map(table, user_data, map);
+        return;
+    }
+
     DEBUG("Map across hash table");
 
     curr = cork_dllist_start(&table->insertion_order);
@@ -630,7 +1406,11 @@ cork_hash_table_iterator_init(struct cork_hash_table *table,
 {
     DEBUG("Iterate through hash table");
     iterator->table = table;
-    iterator->priv = cork_dllist_start(&table->insertion_order);
+    if (cork_hash_table_is_flat(table)) {
+        iterator->priv = table->entries;
+    } else {
+        iterator->priv = cork_dllist_start(&table->insertion_order);
+    }
 }
 
 
@@ -641,6 +1421,22 @@ cork_hash_table_iterator_next(struct cork_hash_table_iterator *iterator)
     struct cork_dllist_item  *curr = iterator->priv;
     struct cork_hash_table_entry_priv  *entry;
 
+    if (cork_hash_table_is_flat(table)) {
+        struct cork_hash_table_flat_entry  *flat = iterator->priv;
+        struct cork_hash_table_flat_entry  *end =
+            table->entries + table->entries_used;
+        while (flat < end && flat->slot == CORK_HASH_TABLE_NO_SLOT) {
+            flat++;
+        }
+        if (flat == end) {
+            iterator->priv = flat;
+            return NULL;
+        }
+        DEBUG("    Return entry %p", flat);
+        iterator->priv = flat + 1;
+        return &flat->public;
+    }
+
     if (cork_dllist_is_end(&table->insertion_order, curr)) {
         return NULL;
     }
@@ -665,6 +1461,14 @@ string_hash(void *user_data, const void *vk)
     return cork_hash_buffer(0, k, len);
 }
 
+static cork_hash
+keyed_string_hash(void *user_data, const void *vk)
+{
+    const char  *k = vk;
+    size_t  len = strlen(k);
+    return cork_keyed_hash_buffer(k, len);
+}
+
 static bool
 string_equals(void *user_data, const void *vk1, const void *vk2)
 {
@@ -677,7 +1481,11 @@ struct cork_hash_table *
 cork_string_hash_table_new(size_t initial_size, unsigned int flags)
 {
     struct cork_hash_table  *table = cork_hash_table_new(initial_size, flags);
-    cork_hash_table_set_hash(table, string_hash);
+    if (flags & CORK_HASH_TABLE_KEYED) {
+        cork_hash_table_set_hash(table, keyed_string_hash);
+    } else {
+        cork_hash_table_set_hash(table, string_hash);
+    }
     cork_hash_table_set_equals(table, string_equals);
     return table;
 }
@@ -687,3 +1495,38 @@ cork_pointer_hash_table_new(size_t initial_size, unsigned int flags)
 {
     return cork_hash_table_new(initial_size, flags);
 }
+
+static cork_hash
+buffer_hash(void *user_data, const void *vk)
+{
+    const struct cork_buffer  *k = vk;
+    return cork_hash_buffer(0, k->buf, k->size);
+}
+
+static cork_hash
+keyed_buffer_hash(void *user_data, const void *vk)
+{
+    const struct cork_buffer  *k = vk;
+    return cork_keyed_hash_buffer(k->buf, k->size);
+}
+
+static bool
+buffer_equals(void *user_data, const void *vk1, const void *vk2)
+{
+    const struct cork_buffer  *k1 = vk1;
+    const struct cork_buffer  *k2 = vk2;
+    return cork_buffer_equal(k1, k2);
+}
+
+struct cork_hash_table *
+cork_buffer_hash_table_new(size_t initial_size, unsigned int flags)
+{
+    struct cork_hash_table  *table = cork_hash_table_new(initial_size, flags);
+    if (flags & CORK_HASH_TABLE_KEYED) {
+        cork_hash_table_set_hash(table, keyed_buffer_hash);
+    } else {
+        cork_hash_table_set_hash(table, buffer_hash);
+    }
+    cork_hash_table_set_equals(table, buffer_equals);
+    return table;
+}
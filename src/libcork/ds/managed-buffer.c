@@ -7,8 +7,14 @@
  * ----------------------------------------------------------------------
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "libcork/core/error.h"
 #include "libcork/core/types.h"
@@ -238,3 +244,125 @@ cork_managed_buffer_slice_offset(struct cork_slice *dest,
             (dest, buffer, offset, buffer->size - offset);
     }
 }
+
+
+/*-----------------------------------------------------------------------
+ * Memory-mapped files
+ */
+
+struct cork_managed_buffer_mmap {
+    struct cork_managed_buffer  parent;
+};
+
+static void
+cork_managed_buffer_mmap__free(struct cork_managed_buffer *vself)
+{
+    struct cork_managed_buffer_mmap  *self =
+        cork_container_of(vself, struct cork_managed_buffer_mmap, parent);
+    /* We don't map anything for an empty file. */
+    if (self->parent.size > 0) {
+        munmap((void *) self->parent.buf, self->parent.size);
+    }
+    cork_delete(struct cork_managed_buffer_mmap, self);
+}
+
+static struct cork_managed_buffer_iface  CORK_MANAGED_BUFFER_MMAP = {
+    cork_managed_buffer_mmap__free
+};
+
+static int
+cork_mmap_advice_to_posix(enum cork_mmap_advice advice)
+{
+    switch (advice) {
+        case CORK_MMAP_SEQUENTIAL:
+            return POSIX_MADV_SEQUENTIAL;
+        case CORK_MMAP_RANDOM:
+            return POSIX_MADV_RANDOM;
+        default:
+            return POSIX_MADV_NORMAL;
+    }
+}
+
+struct cork_managed_buffer *
+cork_managed_buffer_new_mmap(const char *path, enum cork_mmap_advice advice)
+{
+    struct cork_managed_buffer_mmap  *self;
+    struct stat  info;
+    void  *addr = (void *) "";
+    size_t  size;
+    int  fd;
+
+    /* O_NONBLOCK keeps us from hanging if path names a FIFO; it has no
+     * effect on regular files. */
+    do {
+        fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        cork_system_error_set();
+        return NULL;
+    }
+
+    if (fstat(fd, &info) == -1) {
+        goto error;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        /* Only regular files have a size that we can map. */
+        errno = S_ISDIR(info.st_mode)? EISDIR: ENODEV;
+        goto error;
+    }
+    if ((uintmax_t) info.st_size > SIZE_MAX) {
+        errno = EFBIG;
+        goto error;
+    }
+    size = info.st_size;
+
+    if (size > 0) {
+        addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            goto error;
+        }
+        if (advice != CORK_MMAP_NORMAL) {
+            /* This is only a hint, so it doesn't matter if it fails. */
+            posix_madvise(addr, size, cork_mmap_advice_to_posix(advice));
+        }
+    }
+
+    /* The mapping stays valid after we close the file. */
+    close(fd);
+
+    self = cork_new(struct cork_managed_buffer_mmap);
+    self->parent.buf = addr;
+    self->parent.size = size;
+    self->parent.ref_count = 1;
+    self->parent.iface = &CORK_MANAGED_BUFFER_MMAP;
+    return &self->parent;
+
+error:
+    cork_system_error_set();
+    close(fd);
+    return NULL;
+}
+
+int
+cork_slice_init_mmap_ex(struct cork_slice *dest, const char *path,
+                        enum cork_mmap_advice advice)
+{
+    int  rc;
+    struct cork_managed_buffer  *buffer =
+        cork_managed_buffer_new_mmap(path, advice);
+    if (CORK_UNLIKELY(buffer == NULL)) {
+        cork_slice_clear(dest);
+        return -1;
+    }
+
+    /* The slice takes its own reference to the buffer. */
+    rc = cork_managed_buffer_slice_offset(dest, buffer, 0);
+    cork_managed_buffer_unref(buffer);
+    return rc;
+}
+
+int
+cork_slice_init_mmap(struct cork_slice *dest, const char *path)
+{
+    return cork_slice_init_mmap_ex(dest, path, CORK_MMAP_NORMAL);
+}
@@ -0,0 +1,363 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/error.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/dllist.h"
+#include "libcork/ds/managed-buffer.h"
+#include "libcork/ds/rope.h"
+#include "libcork/ds/slice.h"
+#include "libcork/helpers/errors.h"
+
+
+/*-----------------------------------------------------------------------
+ * Error handling
+ */
+
+static void
+cork_rope_invalid_offset_set(size_t rope_size, size_t requested_offset)
+{
+    cork_error_set
+        (CORK_SLICE_ERROR, CORK_SLICE_INVALID_SLICE,
+         "Cannot split %zu-byte rope at %zu", rope_size, requested_offset);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Segments
+ */
+
+struct cork_rope_segment {
+    struct cork_dllist_item  item;
+    struct cork_slice  slice;
+};
+
+#define cork_rope_segment_from_item(curr) \
+    cork_container_of((curr), struct cork_rope_segment, item)
+
+static void
+cork_rope_segment_free(struct cork_rope_segment *segment)
+{
+    cork_slice_finish(&segment->slice);
+    cork_delete(struct cork_rope_segment, segment);
+}
+
+static void
+cork_rope_add_segment(struct cork_rope *rope,
+                      struct cork_rope_segment *segment, bool at_head)
+{
+    if (at_head) {
+        cork_dllist_add_to_head(&rope->segments, &segment->item);
+    } else {
+        cork_dllist_add_to_tail(&rope->segments, &segment->item);
+    }
+    rope->size += segment->slice.size;
+    rope->segment_count++;
+}
+
+static void
+cork_rope_remove_segment(struct cork_rope *rope,
+                         struct cork_rope_segment *segment)
+{
+    cork_dllist_remove(&segment->item);
+    rope->size -= segment->slice.size;
+    rope->segment_count--;
+    cork_rope_segment_free(segment);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Ropes
+ */
+
+void
+cork_rope_init(struct cork_rope *rope)
+{
+    cork_dllist_init(&rope->segments);
+    rope->size = 0;
+    rope->segment_count = 0;
+}
+
+struct cork_rope *
+cork_rope_new(void)
+{
+    struct cork_rope  *rope = cork_new(struct cork_rope);
+    cork_rope_init(rope);
+    return rope;
+}
+
+void
+cork_rope_done(struct cork_rope *rope)
+{
+    cork_rope_clear(rope);
+}
+
+void
+cork_rope_free(struct cork_rope *rope)
+{
+    cork_rope_done(rope);
+    cork_delete(struct cork_rope, rope);
+}
+
+void
+cork_rope_clear(struct cork_rope *rope)
+{
+    struct cork_dllist_item  *curr;
+    struct cork_dllist_item  *next;
+    cork_dllist_foreach_void(&rope->segments, curr, next) {
+        cork_rope_segment_free(cork_rope_segment_from_item(curr));
+    }
+    cork_rope_init(rope);
+}
+
+
+static int
+cork_rope_add_slice(struct cork_rope *rope, const struct cork_slice *slice,
+                    bool at_head)
+{
+    struct cork_rope_segment  *segment;
+    if (slice->size == 0) {
+        return 0;
+    }
+
+    segment = cork_new(struct cork_rope_segment);
+    if (CORK_UNLIKELY(cork_slice_copy
+                      (&segment->slice, slice, 0, slice->size) != 0)) {
+        cork_delete(struct cork_rope_segment, segment);
+        return -1;
+    }
+    cork_rope_add_segment(rope, segment, at_head);
+    return 0;
+}
+
+int
+cork_rope_append_slice(struct cork_rope *rope, const struct cork_slice *slice)
+{
+    return cork_rope_add_slice(rope, slice, false);
+}
+
+int
+cork_rope_prepend_slice(struct cork_rope *rope, const struct cork_slice *slice)
+{
+    return cork_rope_add_slice(rope, slice, true);
+}
+
+
+static int
+cork_rope_add_managed(struct cork_rope *rope,
+                      struct cork_managed_buffer *buffer,
+                      size_t offset, size_t length, bool at_head)
+{
+    struct cork_rope_segment  *segment;
+    if (length == 0) {
+        return 0;
+    }
+
+    segment = cork_new(struct cork_rope_segment);
+    if (CORK_UNLIKELY(cork_managed_buffer_slice
+                      (&segment->slice, buffer, offset, length) != 0)) {
+        cork_delete(struct cork_rope_segment, segment);
+        return -1;
+    }
+    cork_rope_add_segment(rope, segment, at_head);
+    return 0;
+}
+
+int
+cork_rope_append_managed(struct cork_rope *rope,
+                         struct cork_managed_buffer *buffer,
+                         size_t offset, size_t length)
+{
+    return cork_rope_add_managed(rope, buffer, offset, length, false);
+}
+
+int
+cork_rope_prepend_managed(struct cork_rope *rope,
+                          struct cork_managed_buffer *buffer,
+                          size_t offset, size_t length)
+{
+    return cork_rope_add_managed(rope, buffer, offset, length, true);
+}
+
+void
+cork_rope_append_copy(struct cork_rope *rope, const void *src, size_t size)
+{
+    struct cork_managed_buffer  *buffer;
+    if (size == 0) {
+        return;
+    }
+    buffer = cork_managed_buffer_new_copy(src, size);
+    /* The slice can't be invalid, since it covers the entire buffer. */
+    cork_rope_append_managed(rope, buffer, 0, size);
+    cork_managed_buffer_unref(buffer);
+}
+
+void
+cork_rope_append_rope(struct cork_rope *dest, struct cork_rope *src)
+{
+    cork_dllist_add_list_to_tail(&dest->segments, &src->segments);
+    dest->size += src->size;
+    dest->segment_count += src->segment_count;
+    src->size = 0;
+    src->segment_count = 0;
+}
+
+
+int
+cork_rope_split(struct cork_rope *rope, size_t offset, struct cork_rope *dest)
+{
+    struct cork_dllist_item  *first;
+    struct cork_dllist_item  *last;
+    struct cork_rope_segment  *segment;
+    size_t  segment_start = 0;
+    size_t  kept_count = 0;
+
+    if (CORK_UNLIKELY(offset > rope->size)) {
+        cork_rope_invalid_offset_set(rope->size, offset);
+        return -1;
+    }
+    if (offset == rope->size) {
+        return 0;
+    }
+
+    /* Find the segment that contains the byte at `offset`. */
+    for (first = cork_dllist_start(&rope->segments); ; first = first->next) {
+        segment = cork_rope_segment_from_item(first);
+        if (segment_start + segment->slice.size > offset) {
+            break;
+        }
+        segment_start += segment->slice.size;
+        kept_count++;
+    }
+
+    /* If it's in the middle of the segment, split the segment in two. */
+    if (offset > segment_start) {
+        size_t  head_size = offset - segment_start;
+        struct cork_rope_segment  *tail = cork_new(struct cork_rope_segment);
+        if (CORK_UNLIKELY(cork_slice_copy_offset
+                          (&tail->slice, &segment->slice, head_size) != 0)) {
+            cork_delete(struct cork_rope_segment, tail);
+            return -1;
+        }
+        if (CORK_UNLIKELY(cork_slice_slice
+                          (&segment->slice, 0, head_size) != 0)) {
+            cork_rope_segment_free(tail);
+            return -1;
+        }
+        cork_dllist_add_after(&segment->item, &tail->item);
+        rope->segment_count++;
+        kept_count++;
+        first = &tail->item;
+    }
+
+    /* Unlink [first, last] from this rope and link it onto the end of
+     * `dest`. */
+    last = cork_dllist_end(&rope->segments);
+    first->prev->next = &rope->segments.head;
+    rope->segments.head.prev = first->prev;
+    first->prev = cork_dllist_end(&dest->segments);
+    cork_dllist_end(&dest->segments)->next = first;
+    last->next = &dest->segments.head;
+    dest->segments.head.prev = last;
+
+    dest->size += rope->size - offset;
+    dest->segment_count += rope->segment_count - kept_count;
+    rope->size = offset;
+    rope->segment_count = kept_count;
+    return 0;
+}
+
+int
+cork_rope_advance(struct cork_rope *rope, size_t size)
+{
+    struct cork_rope_segment  *segment;
+
+    if (CORK_UNLIKELY(size > rope->size)) {
+        cork_rope_invalid_offset_set(rope->size, size);
+        return -1;
+    }
+
+    while (size > 0) {
+        segment = cork_rope_segment_from_item
+            (cork_dllist_start(&rope->segments));
+        if (size < segment->slice.size) {
+            rii_check(cork_slice_slice_offset(&segment->slice, size));
+            rope->size -= size;
+            return 0;
+        }
+        size -= segment->slice.size;
+        cork_rope_remove_segment(rope, segment);
+    }
+    return 0;
+}
+
+
+size_t
+cork_rope_to_iovec(const struct cork_rope *rope, struct iovec *dest,
+                   size_t count)
+{
+    struct cork_dllist_item  *curr;
+    size_t  i = 0;
+    for (curr = cork_dllist_start(&rope->segments);
+         i < count && !cork_dllist_is_end(&rope->segments, curr);
+         curr = curr->next, i++) {
+        struct cork_rope_segment  *segment = cork_rope_segment_from_item(curr);
+        dest[i].iov_base = (void *) segment->slice.buf;
+        dest[i].iov_len = segment->slice.size;
+    }
+    return i;
+}
+
+void
+cork_rope_append_to_buffer(const struct cork_rope *rope,
+                           struct cork_buffer *dest)
+{
+    struct cork_dllist_item  *curr;
+    cork_buffer_ensure_size(dest, dest->size + rope->size + 1);
+    for (curr = cork_dllist_start(&rope->segments);
+         !cork_dllist_is_end(&rope->segments, curr); curr = curr->next) {
+        struct cork_rope_segment  *segment = cork_rope_segment_from_item(curr);
+        cork_buffer_append(dest, segment->slice.buf, segment->slice.size);
+    }
+}
+
+
+/* The most iovecs we'll pass to a single writev call */
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define CORK_ROPE_IOV_COUNT  IOV_MAX
+#else
+#define CORK_ROPE_IOV_COUNT  64
+#endif
+
+int
+cork_rope_write_fd(struct cork_rope *rope, int fd)
+{
+    struct iovec  iov[CORK_ROPE_IOV_COUNT];
+    while (rope->size > 0) {
+        size_t  count = cork_rope_to_iovec(rope, iov, CORK_ROPE_IOV_COUNT);
+        ssize_t  bytes_written = writev(fd, iov, count);
+        if (bytes_written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cork_system_error_set();
+            return -1;
+        }
+        /* A short write just means that we'll start the next writev in the
+         * middle of a segment. */
+        rii_check(cork_rope_advance(rope, bytes_written));
+    }
+    return 0;
+}
@@ -8,6 +8,7 @@
  */
 
 #include "libcork/ds/stream.h"
+#include "libcork/helpers/errors.h"
 
 /*-----------------------------------------------------------------------
  * Inline declarations
@@ -22,3 +23,74 @@ cork_stream_consumer_eof(struct cork_stream_consumer *consumer);
 
 void
 cork_stream_consumer_free(struct cork_stream_consumer *consumer);
+
+
+/*-----------------------------------------------------------------------
+ * Vectored data
+ */
+
+/* We recognize vectored consumers by their eof method, which is always this
+ * wrapper.  That lets us add vectored consumers without changing the layout of
+ * struct cork_stream_consumer, which existing code allocates and fills in
+ * itself.  (The data method would work too, but it's called much more often,
+ * and eof is only called once per stream.) */
+static int
+cork_stream_consumer_v__eof(struct cork_stream_consumer *consumer)
+{
+    struct cork_stream_consumer_v  *self =
+        cork_container_of(consumer, struct cork_stream_consumer_v, parent);
+    return self->eof(consumer);
+}
+
+void
+cork_stream_consumer_v_init
+    (struct cork_stream_consumer_v *consumer,
+     int (*data)(struct cork_stream_consumer *consumer,
+                 const void *buf, size_t size, bool is_first_chunk),
+     int (*data_v)(struct cork_stream_consumer *consumer,
+                   const struct iovec *iov, size_t count,
+                   bool is_first_chunk),
+     int (*eof)(struct cork_stream_consumer *consumer),
+     void (*free)(struct cork_stream_consumer *consumer))
+{
+    consumer->parent.data = data;
+    consumer->parent.eof = cork_stream_consumer_v__eof;
+    consumer->parent.free = free;
+    consumer->data_v = data_v;
+    consumer->eof = eof;
+}
+
+struct cork_stream_consumer_v *
+cork_stream_consumer_get_v(struct cork_stream_consumer *consumer)
+{
+    if (consumer->eof == cork_stream_consumer_v__eof) {
+        return cork_container_of
+            (consumer, struct cork_stream_consumer_v, parent);
+    } else {
+        return NULL;
+    }
+}
+
+int
+cork_stream_consumer_data_v(struct cork_stream_consumer *consumer,
+                            const struct iovec *iov, size_t count,
+                            bool is_first_chunk)
+{
+    struct cork_stream_consumer_v  *vconsumer =
+        cork_stream_consumer_get_v(consumer);
+    size_t  i;
+
+    if (vconsumer != NULL) {
+        return vconsumer->data_v(consumer, iov, count, is_first_chunk);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (iov[i].iov_len > 0) {
+            rii_check(consumer->data
+                      (consumer, iov[i].iov_base, iov[i].iov_len,
+                       is_first_chunk));
+            is_first_chunk = false;
+        }
+    }
+    return 0;
+}
@@ -8,3 +8,39 @@ Make sure that our stable hash is really stable.
   0x0b0628ee
   $ cork-hash "A longer string"
   0x53a2c885
+
+The wide hash is stable too.
+
+  $ cork-hash -w foo
+  0x22b1876d6152c367
+
+The keyed hash uses an all-zero key on the command line.
+
+  $ cork-hash -k foo
+  0x6a5cdcad01c973fa
+
+The quality tests are deterministic.
+
+  $ cork-hash --quality -s
+  stable   avalanche  4-byte keys         worst bias 0.068  mean bias 0.017
+  stable   avalanche  8-byte keys         worst bias 0.080  mean bias 0.017
+  stable   avalanche 16-byte keys         worst bias 0.094  mean bias 0.018
+  stable   avalanche 64-byte keys         worst bias 0.097  mean bias 0.018
+  stable   buckets sequential 32-bit  mask 0x3fff  chi2/df 1.016  max load 4.00x
+  stable   buckets sequential 32-bit  mask 0xffff  chi2/df 1.010  max load 8.00x
+  stable   buckets sequential 64-bit  mask 0x3fff  chi2/df 0.999  max load 3.00x
+  stable   buckets sequential 64-bit  mask 0xffff  chi2/df 0.999  max load 8.00x
+  stable   buckets ipv4 10.0.0.0/16   mask 0x3fff  chi2/df 0.991  max load 3.50x
+  stable   buckets ipv4 10.0.0.0/16   mask 0xffff  chi2/df 0.999  max load 7.00x
+  stable   buckets decimal strings    mask 0x3fff  chi2/df 1.015  max load 3.50x
+  stable   buckets decimal strings    mask 0xffff  chi2/df 1.002  max load 7.00x
+  stable   buckets random 16-byte     mask 0x3fff  chi2/df 1.011  max load 3.25x
+  stable   buckets random 16-byte     mask 0xffff  chi2/df 1.007  max load 8.00x
+
+The benchmark prints one line per input size.
+
+  $ cork-hash --benchmark --max-size 16 -f
+  family      bytes       GB/s    cycles/hash
+  fastest         1 +[0-9.]+ +[0-9.-]+ (re)
+  fastest         4 +[0-9.]+ +[0-9.-]+ (re)
+  fastest        16 +[0-9.]+ +[0-9.-]+ (re)
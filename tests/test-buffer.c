@@ -10,9 +10,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <check.h>
 
+#include "libcork/core/allocator.h"
 #include "libcork/core/types.h"
 #include "libcork/ds/buffer.h"
 #include "libcork/ds/managed-buffer.h"
@@ -224,6 +226,134 @@ START_TEST(test_buffer_stream)
 END_TEST
 
 
+/* Splits "000abcdefg" (after the "000" that's already in the buffer) into
+ * chunks, some of them empty. */
+static const struct iovec  STREAM_V_CHUNKS[] = {
+    { "ab", 2 }, { "", 0 }, { "c", 1 }, { "defg", 4 }, { "", 0 }
+};
+
+START_TEST(test_buffer_stream_v)
+{
+    static char  EXPECTED[] = "000abcdefg";
+    static size_t  EXPECTED_SIZE = 10;
+
+    struct cork_buffer  buffer1;
+    struct cork_buffer  buffer2;
+    struct cork_stream_consumer  *consumer;
+
+    cork_buffer_init(&buffer1);
+    cork_buffer_append_string(&buffer1, "000");
+    fail_if_error(consumer =
+                  cork_buffer_to_stream_consumer(&buffer1));
+    fail_if(cork_stream_consumer_get_v(consumer) == NULL,
+            "Buffer consumer should be a vectored consumer");
+    fail_if_error(cork_stream_consumer_data_v
+                  (consumer, STREAM_V_CHUNKS, 5, true));
+    fail_if_error(cork_stream_consumer_eof(consumer));
+
+    cork_buffer_init(&buffer2);
+    fail_if_error(cork_buffer_set(&buffer2, EXPECTED, EXPECTED_SIZE));
+    check_buffers(&buffer1, &buffer2);
+
+    cork_stream_consumer_free(consumer);
+    cork_buffer_done(&buffer1);
+    cork_buffer_done(&buffer2);
+}
+END_TEST
+
+
+/* A consumer that isn't vectored, which checks that it receives each non-empty
+ * chunk separately. */
+struct chunk_consumer {
+    struct cork_stream_consumer  parent;
+    struct cork_buffer  chunks;
+};
+
+static int
+chunk_consumer__data(struct cork_stream_consumer *vself,
+                     const void *buf, size_t size, bool is_first_chunk)
+{
+    struct chunk_consumer  *self =
+        cork_container_of(vself, struct chunk_consumer, parent);
+    cork_buffer_append_printf
+        (&self->chunks, "%s%.*s", is_first_chunk? "": ",",
+         (int) size, (const char *) buf);
+    return 0;
+}
+
+START_TEST(test_stream_data_v_fallback)
+{
+    struct chunk_consumer  consumer;
+    consumer.parent.data = chunk_consumer__data;
+    consumer.parent.eof = NULL;
+    consumer.parent.free = NULL;
+    cork_buffer_init(&consumer.chunks);
+
+    fail_if_error(cork_stream_consumer_data_v
+                  (&consumer.parent, STREAM_V_CHUNKS, 5, true));
+    check_buffer(&consumer.chunks, "ab,c,defg");
+    cork_buffer_done(&consumer.chunks);
+}
+END_TEST
+
+
+START_TEST(test_fd_consumer_data_v)
+{
+    /* More chunks than fit into a single writev call, but little enough data
+     * that it all fits into the pipe's buffer.  Every other chunk is
+     * empty. */
+    static const size_t  NUMBER_COUNT = 1000;
+    struct cork_buffer  expected = CORK_BUFFER_INIT();
+    struct cork_buffer  actual = CORK_BUFFER_INIT();
+    struct cork_stream_consumer  *consumer;
+    struct iovec  *iov;
+    size_t  *offsets;
+    int  fds[2];
+    size_t  i;
+
+    offsets = cork_calloc(NUMBER_COUNT + 1, sizeof(size_t));
+    for (i = 0; i < NUMBER_COUNT; i++) {
+        offsets[i] = expected.size;
+        cork_buffer_append_printf(&expected, "%zu,", i);
+    }
+    offsets[NUMBER_COUNT] = expected.size;
+
+    iov = cork_calloc(NUMBER_COUNT * 2, sizeof(struct iovec));
+    for (i = 0; i < NUMBER_COUNT; i++) {
+        iov[i * 2].iov_base = (char *) expected.buf + offsets[i];
+        iov[i * 2].iov_len = offsets[i + 1] - offsets[i];
+        iov[i * 2 + 1].iov_base = NULL;
+        iov[i * 2 + 1].iov_len = 0;
+    }
+
+    fail_unless(pipe(fds) == 0, "Cannot create pipe");
+    fail_if_error(consumer = cork_fd_consumer_new(fds[1]));
+    fail_if_error(cork_stream_consumer_data_v
+                  (consumer, iov, NUMBER_COUNT * 2, true));
+    fail_if_error(cork_stream_consumer_eof(consumer));
+    cork_stream_consumer_free(consumer);
+    close(fds[1]);
+
+    while (true) {
+        char  buf[4096];
+        ssize_t  bytes_read = read(fds[0], buf, sizeof(buf));
+        fail_if(bytes_read < 0, "Cannot read from pipe");
+        if (bytes_read == 0) {
+            break;
+        }
+        cork_buffer_append(&actual, buf, bytes_read);
+    }
+    close(fds[0]);
+    check_buffers(&actual, &expected);
+
+    cork_cfree(iov, NUMBER_COUNT * 2, sizeof(struct iovec));
+    cork_cfree(offsets, NUMBER_COUNT + 1, sizeof(size_t));
+    cork_buffer_done(&expected);
+    cork_buffer_done(&actual);
+}
+END_TEST
+
+
 static void
 check_c_string_(const char *content, size_t length,
                 const char *expected)
@@ -323,10 +453,16 @@ test_suite()
     tcase_add_test(tc_buffer, test_buffer_append);
     tcase_add_test(tc_buffer, test_buffer_slicing);
     tcase_add_test(tc_buffer, test_buffer_stream);
+    tcase_add_test(tc_buffer, test_buffer_stream_v);
     tcase_add_test(tc_buffer, test_buffer_c_string);
     tcase_add_test(tc_buffer, test_buffer_pretty_print);
     suite_add_tcase(s, tc_buffer);
 
+    TCase  *tc_stream = tcase_create("stream");
+    tcase_add_test(tc_stream, test_stream_data_v_fallback);
+    tcase_add_test(tc_stream, test_fd_consumer_data_v);
+    suite_add_tcase(s, tc_stream);
+
     return s;
 }
 
@@ -0,0 +1,325 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <check.h>
+
+#include "libcork/core.h"
+#include "libcork/ds.h"
+#include "libcork/threads.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helper functions
+ */
+
+static cork_hash
+uintptr__hash(void *user_data, const void *vkey)
+{
+    uintptr_t  key = (uintptr_t) vkey;
+    return cork_hash_buffer(0, &key, sizeof(key));
+}
+
+static bool
+uintptr__equals(void *user_data, const void *vkey1, const void *vkey2)
+{
+    return vkey1 == vkey2;
+}
+
+static struct cork_concurrent_hash_table *
+uintptr_table_new(void)
+{
+    struct cork_concurrent_hash_table  *table =
+        cork_concurrent_hash_table_new(0, 0);
+    cork_concurrent_hash_table_set_hash(table, uintptr__hash);
+    cork_concurrent_hash_table_set_equals(table, uintptr__equals);
+    return table;
+}
+
+static void
+uint64__free(void *vi)
+{
+    uint64_t  *i = vi;
+    cork_delete(uint64_t, i);
+}
+
+static uint64_t *
+uint64_new(uint64_t value)
+{
+    uint64_t  *result = cork_new(uint64_t);
+    *result = value;
+    return result;
+}
+
+static enum cork_hash_table_map_result
+uint64_sum(void *vsum, struct cork_hash_table_entry *entry)
+{
+    uint64_t  *sum = vsum;
+    uint64_t  *value = entry->value;
+    *sum += *value;
+    return CORK_HASH_TABLE_MAP_CONTINUE;
+}
+
+static enum cork_hash_table_map_result
+uint64_remove_odd(void *user_data, struct cork_hash_table_entry *entry)
+{
+    uint64_t  *value = entry->value;
+    return (*value % 2 == 1)?
+        CORK_HASH_TABLE_MAP_DELETE: CORK_HASH_TABLE_MAP_CONTINUE;
+}
+
+#define test_sum(table, expected) \
+    do { \
+        uint64_t  __sum = 0; \
+        cork_concurrent_hash_table_map(table, &__sum, uint64_sum); \
+        fail_unless_equal("Sum", "%" PRIu64, expected, __sum); \
+    } while (0)
+
+
+/*-----------------------------------------------------------------------
+ * Single-threaded operations
+ */
+
+#define ENTRY_COUNT  5000
+
+START_TEST(test_concurrent_hash_table)
+{
+    struct cork_concurrent_hash_table  *table = uintptr_table_new();
+    uint64_t  expected_sum = 0;
+    uint64_t  *value;
+    bool  is_new;
+    size_t  i;
+
+    DESCRIBE_TEST;
+    cork_concurrent_hash_table_set_free_value(table, uint64__free);
+
+    fail_if(cork_concurrent_hash_table_get(table, (void *) 1) != NULL,
+            "Unexpected entry in empty table");
+    fail_if(cork_concurrent_hash_table_delete(table, (void *) 1),
+            "Unexpected entry in empty table");
+
+    /* Add enough entries to force several resizes. */
+    for (i = 1; i <= ENTRY_COUNT; i++) {
+        cork_concurrent_hash_table_put
+            (table, (void *) i, uint64_new(i), &is_new);
+        fail_unless(is_new, "Entry %zu should be new", i);
+        expected_sum += i;
+    }
+    fail_unless_equal("Size", "%zu", ENTRY_COUNT,
+                      cork_concurrent_hash_table_size(table));
+    test_sum(table, expected_sum);
+
+    for (i = 1; i <= ENTRY_COUNT; i++) {
+        value = cork_concurrent_hash_table_get(table, (void *) i);
+        fail_if(value == NULL, "Missing entry %zu", i);
+        fail_unless_equal("Value", "%" PRIu64, i, *value);
+    }
+
+    /* Overwriting an entry frees the old value. */
+    cork_concurrent_hash_table_put
+        (table, (void *) 1, uint64_new(10), &is_new);
+    fail_if(is_new, "Entry 1 shouldn't be new");
+    fail_unless_equal("Size", "%zu", ENTRY_COUNT,
+                      cork_concurrent_hash_table_size(table));
+    value = cork_concurrent_hash_table_get(table, (void *) 1);
+    fail_unless_equal("Value", "%" PRIu64, 10, *value);
+    expected_sum += 9;
+    test_sum(table, expected_sum);
+
+    fail_unless(cork_concurrent_hash_table_delete(table, (void *) 2),
+                "Couldn't delete entry 2");
+    fail_if(cork_concurrent_hash_table_delete(table, (void *) 2),
+            "Entry 2 was deleted twice");
+    fail_if(cork_concurrent_hash_table_get(table, (void *) 2) != NULL,
+            "Entry 2 wasn't deleted");
+    expected_sum -= 2;
+    test_sum(table, expected_sum);
+
+    /* Remove every odd entry via map. */
+    cork_concurrent_hash_table_map(table, NULL, uint64_remove_odd);
+    expected_sum = 10;
+    for (i = 4; i <= ENTRY_COUNT; i += 2) {
+        expected_sum += i;
+    }
+    fail_unless_equal("Size", "%zu", ENTRY_COUNT / 2,
+                      cork_concurrent_hash_table_size(table));
+    test_sum(table, expected_sum);
+
+    cork_concurrent_hash_table_free(table);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Multithreaded operations
+ */
+
+static double
+now_seconds(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define THREAD_COUNT  4
+#define KEYS_PER_THREAD  20000
+#define READ_ROUNDS  4
+
+struct cork_cht_thread {
+    struct cork_concurrent_hash_table  *table;
+    size_t  first_key;
+    size_t  missing;
+    size_t  wrong;
+};
+
+static int
+cork_cht_writer__run(void *vself)
+{
+    struct cork_cht_thread  *self = vself;
+    size_t  i;
+    for (i = 0; i < KEYS_PER_THREAD; i++) {
+        uintptr_t  key = self->first_key + i;
+        cork_concurrent_hash_table_put
+            (self->table, (void *) key, (void *) (key * 2), NULL);
+    }
+    /* Delete every other key that we added. */
+    for (i = 0; i < KEYS_PER_THREAD; i += 2) {
+        uintptr_t  key = self->first_key + i;
+        cork_concurrent_hash_table_delete(self->table, (void *) key);
+    }
+    return 0;
+}
+
+static int
+cork_cht_reader__run(void *vself)
+{
+    struct cork_cht_thread  *self = vself;
+    size_t  round;
+    size_t  i;
+    for (round = 0; round < READ_ROUNDS; round++) {
+        for (i = 0; i < KEYS_PER_THREAD; i++) {
+            uintptr_t  key = self->first_key + i;
+            uintptr_t  value = (uintptr_t)
+                cork_concurrent_hash_table_get(self->table, (void *) key);
+            /* The writers might not have gotten to this key yet, but if it's
+             * there, it must have the right value. */
+            if (value == 0) {
+                self->missing++;
+            } else if (value != key * 2) {
+                self->wrong++;
+            }
+        }
+    }
+    return 0;
+}
+
+START_TEST(test_concurrent_hash_table_threads)
+{
+    struct cork_concurrent_hash_table  *table = uintptr_table_new();
+    struct cork_cht_thread  writers[THREAD_COUNT];
+    struct cork_cht_thread  readers[THREAD_COUNT];
+    struct cork_thread  *threads[THREAD_COUNT * 2];
+    size_t  op_count;
+    double  start;
+    double  elapsed;
+    size_t  i;
+
+    DESCRIBE_TEST;
+
+    for (i = 0; i < THREAD_COUNT; i++) {
+        writers[i].table = table;
+        writers[i].first_key = 1 + i * KEYS_PER_THREAD;
+        writers[i].missing = 0;
+        writers[i].wrong = 0;
+        readers[i] = writers[i];
+        fail_if_error(threads[i*2] = cork_thread_new
+                      ("writer", &writers[i], NULL, cork_cht_writer__run));
+        fail_if_error(threads[i*2 + 1] = cork_thread_new
+                      ("reader", &readers[i], NULL, cork_cht_reader__run));
+    }
+
+    start = now_seconds();
+    for (i = 0; i < THREAD_COUNT * 2; i++) {
+        fail_if_error(cork_thread_start(threads[i]));
+    }
+    for (i = 0; i < THREAD_COUNT * 2; i++) {
+        fail_if_error(cork_thread_join(threads[i]));
+    }
+    elapsed = now_seconds() - start;
+
+    /* Each writer does a put for every key and a delete for half of them;
+     * each reader does READ_ROUNDS gets for every key. */
+    op_count = THREAD_COUNT * KEYS_PER_THREAD * (READ_ROUNDS + 1) +
+        THREAD_COUNT * KEYS_PER_THREAD / 2;
+    printf("%zu threads: %zu ops in %.3f s (%.2f Mops/s)\n",
+           (size_t) THREAD_COUNT * 2, op_count, elapsed,
+           op_count / elapsed / 1e6);
+
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_unless_equal("Wrong values", "%zu", 0, readers[i].wrong);
+    }
+
+    fail_unless_equal("Size", "%zu", THREAD_COUNT * KEYS_PER_THREAD / 2,
+                      cork_concurrent_hash_table_size(table));
+    for (i = 1; i <= THREAD_COUNT * KEYS_PER_THREAD; i++) {
+        uintptr_t  value = (uintptr_t)
+            cork_concurrent_hash_table_get(table, (void *) i);
+        if ((i - 1) % 2 == 0) {
+            fail_unless(value == 0, "Entry %zu should be deleted", i);
+        } else {
+            fail_unless(value == i * 2, "Entry %zu has the wrong value", i);
+        }
+    }
+
+    cork_concurrent_hash_table_free(table);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("concurrent_hash_table");
+
+    TCase  *tc_ds = tcase_create("concurrent_hash_table");
+    tcase_set_timeout(tc_ds, 20.0);
+    tcase_add_test(tc_ds, test_concurrent_hash_table);
+    tcase_add_test(tc_ds, test_concurrent_hash_table_threads);
+    suite_add_tcase(s, tc_ds);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    setup_allocator();
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -12,11 +12,18 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
 
 #include <check.h>
 
 #include "libcork/config.h"
+#include "libcork/core/allocator.h"
 #include "libcork/core/byte-order.h"
+#include "libcork/core/checksum.h"
 #include "libcork/core/error.h"
 #include "libcork/core/hash.h"
 #include "libcork/core/id.h"
@@ -106,6 +113,213 @@ START_TEST(test_int_sizeof)
 END_TEST
 
 
+/*-----------------------------------------------------------------------
+ * Allocators
+ */
+
+#define ARENA_CHUNK_SIZE  1024
+
+START_TEST(test_arena_alloc)
+{
+    DESCRIBE_TEST;
+    struct cork_alloc  *arena =
+        cork_arena_alloc_new(cork_allocator, ARENA_CHUNK_SIZE);
+    char  *first;
+    char  *second;
+    char  *grown;
+    char  *large;
+    uint64_t  *zeroed;
+    struct cork_alloc  *empty;
+    size_t  i;
+
+    /* Zero-byte requests succeed on a fresh arena, and on one whose only
+     * chunk came from a large allocation. */
+    empty = cork_arena_alloc_new(cork_allocator, ARENA_CHUNK_SIZE);
+    fail_if(cork_alloc_xmalloc(empty, 0) == NULL,
+            "Zero-byte allocation from a fresh arena failed");
+    fail_if(cork_alloc_malloc(empty, 0) == NULL,
+            "Zero-byte allocation from a fresh arena failed");
+    empty = cork_arena_alloc_new(cork_allocator, ARENA_CHUNK_SIZE);
+    large = cork_alloc_malloc(empty, ARENA_CHUNK_SIZE * 4);
+    fail_if(cork_alloc_xmalloc(empty, 0) == NULL,
+            "Zero-byte allocation after a large allocation failed");
+    fail_if(cork_alloc_calloc(empty, 0, 1) == NULL,
+            "Zero-byte allocation after a large allocation failed");
+
+    /* Allocations come out of the same chunk, one after the other, and are
+     * properly aligned. */
+    first = cork_alloc_malloc(arena, 10);
+    second = cork_alloc_malloc(arena, 10);
+    fail_unless(((uintptr_t) first % 16) == 0, "Misaligned allocation");
+    fail_unless(((uintptr_t) second % 16) == 0, "Misaligned allocation");
+    fail_unless(second == first + 16, "Allocations aren't contiguous");
+    strcpy(first, "hello");
+    strcpy(second, "world");
+
+    /* The most recent allocation can grow in place... */
+    grown = cork_alloc_realloc(arena, second, 10, 100);
+    fail_unless(grown == second, "Tip allocation didn't grow in place");
+    fail_unless(strcmp(grown, "world") == 0, "Unexpected contents");
+
+    /* ...but others have to be copied. */
+    grown = cork_alloc_realloc(arena, first, 10, 20);
+    fail_if(grown == first, "Non-tip allocation grew in place");
+    fail_unless(strcmp(grown, "hello") == 0, "Unexpected contents");
+    fail_unless(strcmp(second, "world") == 0, "Clobbered another object");
+
+    /* Freeing the most recent allocation gives its space back. */
+    cork_alloc_free(arena, grown, 20);
+    fail_unless(cork_alloc_malloc(arena, 1) == grown, "Tip wasn't reclaimed");
+
+    /* Large objects get their own chunks, which can be resized. */
+    large = cork_alloc_malloc(arena, ARENA_CHUNK_SIZE * 4);
+    memset(large, 0xff, ARENA_CHUNK_SIZE * 4);
+    fail_unless(cork_alloc_realloc(arena, large, ARENA_CHUNK_SIZE * 4, 10)
+                == large, "Large tip allocation didn't shrink in place");
+    large = cork_alloc_realloc(arena, large, 10, ARENA_CHUNK_SIZE * 64);
+    for (i = 0; i < 10; i++) {
+        fail_unless(large[i] == (char) 0xff, "Unexpected contents");
+    }
+    memset(large, 0xee, ARENA_CHUNK_SIZE * 64);
+    /* The current chunk isn't affected, so a small allocation still comes
+     * right after the last small one. */
+    fail_unless(cork_alloc_malloc(arena, 1) == grown + 16,
+                "Large allocation disturbed the current chunk");
+    large = cork_alloc_malloc(arena, ARENA_CHUNK_SIZE * 2);
+    cork_alloc_free(arena, large, ARENA_CHUNK_SIZE * 2);
+    zeroed = cork_alloc_calloc(arena, 16, sizeof(uint64_t));
+    for (i = 0; i < 16; i++) {
+        fail_unless(zeroed[i] == 0, "calloc didn't zero memory");
+    }
+
+    /* Fill up several chunks. */
+    for (i = 0; i < 1000; i++) {
+        char  *buf = cork_alloc_malloc(arena, 37);
+        memset(buf, (int) i, 37);
+    }
+
+    /* After a reset, we start over at the beginning of a chunk. */
+    cork_arena_reset(arena);
+    first = cork_alloc_malloc(arena, 10);
+    second = cork_alloc_malloc(arena, 10);
+    fail_unless(second == first + 16, "Allocations aren't contiguous");
+    cork_arena_reset(arena);
+}
+END_TEST
+
+START_TEST(test_slab_alloc)
+{
+    DESCRIBE_TEST;
+    struct cork_alloc  *slab = cork_slab_alloc_new(cork_allocator);
+    char  *objects[1000];
+    char  *first;
+    char  *grown;
+    char  *large;
+    size_t  i;
+
+    /* Freed objects are reused right away. */
+    first = cork_alloc_malloc(slab, 24);
+    cork_alloc_free(slab, first, 24);
+    fail_unless(cork_alloc_malloc(slab, 20) == first,
+                "Object wasn't reused");
+
+    /* Objects whose size is a multiple of 16 are 16-byte aligned. */
+    for (i = 0; i < 1000; i++) {
+        size_t  size = (i % 32 + 1) * 16;
+        objects[i] = cork_alloc_malloc(slab, size);
+        fail_unless(((uintptr_t) objects[i] % 16) == 0,
+                    "Misaligned allocation");
+        memset(objects[i], (int) i, size);
+    }
+    for (i = 0; i < 1000; i++) {
+        size_t  size = (i % 32 + 1) * 16;
+        size_t  j;
+        for (j = 0; j < size; j++) {
+            fail_unless(objects[i][j] == (char) i, "Object %zu was clobbered",
+                        i);
+        }
+        cork_alloc_free(slab, objects[i], size);
+    }
+
+    /* Reallocating within a size class doesn't move the object. */
+    grown = cork_alloc_realloc(slab, first, 20, 24);
+    fail_unless(grown == first, "Object moved within its size class");
+    strcpy(grown, "hello");
+    grown = cork_alloc_realloc(slab, grown, 24, 200);
+    fail_unless(strcmp(grown, "hello") == 0, "Unexpected contents");
+
+    /* Large objects come straight from the parent allocator. */
+    large = cork_alloc_realloc(slab, grown, 200, 4096);
+    fail_unless(strcmp(large, "hello") == 0, "Unexpected contents");
+    large = cork_alloc_realloc(slab, large, 4096, 8192);
+    fail_unless(strcmp(large, "hello") == 0, "Unexpected contents");
+    cork_alloc_free(slab, large, 8192);
+
+    objects[0] = cork_alloc_calloc(slab, 10, 10);
+    for (i = 0; i < 100; i++) {
+        fail_unless(objects[0][i] == 0, "calloc didn't zero memory");
+    }
+    cork_alloc_free(slab, objects[0], 100);
+    cork_slab_alloc_release_thread_cache(slab);
+}
+END_TEST
+
+START_TEST(test_stats_alloc)
+{
+    DESCRIBE_TEST;
+    struct cork_alloc  *stats = cork_stats_alloc_new(cork_allocator);
+    struct cork_alloc_stats  totals;
+    struct cork_alloc_stats  cls;
+    struct cork_buffer  report = CORK_BUFFER_INIT();
+    void  *small[10];
+    void  *big;
+    size_t  i;
+
+    fail_unless_equal("Size class", "%u", 0, cork_stats_alloc_size_class(0));
+    fail_unless_equal("Size class", "%u", 0, cork_stats_alloc_size_class(1));
+    fail_unless_equal("Size class", "%u", 4, cork_stats_alloc_size_class(16));
+    fail_unless_equal("Size class", "%u", 5, cork_stats_alloc_size_class(17));
+
+    cork_stats_alloc_set_sample_rate(stats, 2);
+    for (i = 0; i < 10; i++) {
+        small[i] = cork_alloc_malloc(stats, 16);
+    }
+    big = cork_alloc_calloc(stats, 100, 10);
+    cork_stats_alloc_get_totals(stats, &totals);
+    fail_unless_equal("Live bytes", "%zu", 1160, totals.live_bytes);
+    fail_unless_equal("Alloc count", "%zu", 11, totals.alloc_count);
+
+    /* Reallocating moves an object between size classes. */
+    big = cork_alloc_realloc(stats, big, 1000, 2000);
+    for (i = 0; i < 10; i++) {
+        cork_alloc_free(stats, small[i], 16);
+    }
+    cork_stats_alloc_get_totals(stats, &totals);
+    fail_unless_equal("Live bytes", "%zu", 2000, totals.live_bytes);
+    fail_unless_equal("Peak bytes", "%zu", 3160, totals.peak_bytes);
+    fail_unless_equal("Free count", "%zu", 11, totals.free_count);
+
+    cork_stats_alloc_get_class(stats, cork_stats_alloc_size_class(16), &cls);
+    fail_unless_equal("Live bytes", "%zu", 0, cls.live_bytes);
+    fail_unless_equal("Peak bytes", "%zu", 160, cls.peak_bytes);
+    fail_unless_equal("Alloc count", "%zu", 10, cls.alloc_count);
+    fail_unless_equal("Free count", "%zu", 10, cls.free_count);
+    cork_stats_alloc_get_class(stats, cork_stats_alloc_size_class(1000), &cls);
+    fail_unless_equal("Live bytes", "%zu", 0, cls.live_bytes);
+    fail_unless_equal("Peak bytes", "%zu", 1000, cls.peak_bytes);
+
+    cork_alloc_free(stats, big, 2000);
+    cork_stats_alloc_get_totals(stats, &totals);
+    fail_unless_equal("Live bytes", "%zu", 0, totals.live_bytes);
+
+    cork_stats_alloc_report(stats, &report);
+    fail_if(strstr(report.buf, "Live: 0 bytes (peak 3160 bytes)") == NULL,
+            "Unexpected report:\n%s", (char *) report.buf);
+    cork_buffer_done(&report);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Strings
  */
@@ -416,6 +630,391 @@ START_TEST(test_hash)
 END_TEST
 
 
+START_TEST(test_hash_buffers)
+{
+    DESCRIBE_TEST;
+
+#define KEY_COUNT  37
+    static uint8_t  data[KEY_COUNT * 16];
+    const void  *srcs[KEY_COUNT];
+    size_t  lens[KEY_COUNT];
+    cork_hash  hashes[KEY_COUNT];
+    size_t  i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 131 + 7);
+    }
+
+    for (i = 0; i < KEY_COUNT; i++) {
+        srcs[i] = data + i * 5;
+        lens[i] = i % 20;
+    }
+    cork_hash_buffers(42, srcs, lens, KEY_COUNT, hashes);
+    for (i = 0; i < KEY_COUNT; i++) {
+        fail_unless_equal("Hash", "0x%08" PRIx32,
+                          cork_hash_buffer(42, srcs[i], lens[i]), hashes[i]);
+    }
+
+#define test_fixed_width(width) \
+    do { \
+        cork_hash_buffers_##width(42, data, KEY_COUNT, hashes); \
+        for (i = 0; i < KEY_COUNT; i++) { \
+            fail_unless_equal("Hash", "0x%08" PRIx32, \
+                              cork_hash_buffer(42, data + i * width, width), \
+                              hashes[i]); \
+        } \
+    } while (0)
+
+    test_fixed_width(4);
+    test_fixed_width(8);
+    test_fixed_width(16);
+#undef test_fixed_width
+#undef KEY_COUNT
+}
+END_TEST
+
+
+START_TEST(test_hash64)
+{
+    DESCRIBE_TEST;
+
+    static const char  BUF[] = "test";
+    static const char  LONG_BUF[] =
+        "this is a much longer test string in the hopes that we have to "
+        "go through a few iterations of the hashing loop in order to "
+        "calculate the value of the hash which we are trying to compute.";
+    static uint8_t  data[4096 + 8];
+    static const char  *kernels[] = { "scalar", "sse2", "avx2", "neon" };
+    static const uint64_t  seeds[] = { 0, 1, UINT64_C(0xdeadbeefcafef00d) };
+    size_t  i;
+    size_t  len;
+    size_t  offset;
+    size_t  seed;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 131 + 7);
+    }
+
+    fail_unless_equal("Hash", "%" PRIx64,
+                      UINT64_C(0x9ca6356aa3753ef8),
+                      cork_hash64_buffer(0, "", 0));
+    fail_unless_equal("Hash", "%" PRIx64,
+                      UINT64_C(0x72455bbca75a8991),
+                      cork_hash64_buffer(0, BUF, sizeof(BUF) - 1));
+    fail_unless_equal("Hash", "%" PRIx64,
+                      UINT64_C(0xa70d5c7f79826c5d),
+                      cork_hash64_buffer(0, LONG_BUF, sizeof(LONG_BUF) - 1));
+    fail_unless_equal("Hash", "%" PRIx64,
+                      UINT64_C(0xfa196870fb474620),
+                      cork_hash64_buffer(0, data, 4096));
+    fail_unless_equal("Hash", "%" PRIx64,
+                      UINT64_C(0xf884e958176e2984),
+                      cork_hash64_buffer(0x1234, data, 4096));
+
+    /* Every kernel that this CPU supports must give the same result. */
+    for (len = 0; len <= 3000; len++) {
+        for (offset = 0; offset < 3; offset++) {
+            for (seed = 0; seed < 3; seed++) {
+                uint64_t  expected;
+                fail_if_error(cork_hash64_set_kernel("scalar"));
+                expected = cork_hash64_buffer
+                    (seeds[seed], data + offset, len);
+                for (i = 1; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+                    if (cork_hash64_set_kernel(kernels[i]) == 0) {
+                        fail_unless_equal("Hash", "%" PRIx64, expected,
+                                          cork_hash64_buffer
+                                          (seeds[seed], data + offset, len));
+                    } else {
+                        cork_error_clear();
+                    }
+                }
+            }
+        }
+    }
+
+    fail_if_error(cork_hash64_set_kernel(NULL));
+    fail_unless_error(cork_hash64_set_kernel("no-such-kernel"),
+                      "Shouldn't be able to select a missing kernel");
+}
+END_TEST
+
+
+START_TEST(test_keyed_hash)
+{
+    DESCRIBE_TEST;
+
+    /* Test vectors from the SipHash reference implementation, using the
+     * 1-3 variants: the key is 00 01 02 ..., and the input of each length is
+     * 00 01 02 ... */
+    static const size_t  lens[] = { 0, 1, 7, 8, 15, 16, 63 };
+    static const uint64_t  sip_expected[] = {
+        UINT64_C(0xabac0158050fc4dc), UINT64_C(0xc9f49bf37d57ca93),
+        UINT64_C(0xd3927d989bb11140), UINT64_C(0x369095118d299a8e),
+        UINT64_C(0xd320d86d2a519956), UINT64_C(0xcc4fdd1a7d908b66),
+        UINT64_C(0x9d199062b7bbb3a8)
+    };
+    static const uint32_t  half_expected[] = {
+        0x5814c896, 0xe7e864ca, 0x9d38d9d6, 0x577999b1,
+        0xd0257b04, 0x8b31d501, 0x87178304
+    };
+    uint8_t  key[CORK_SIPHASH_KEY_SIZE];
+    uint8_t  data[64];
+    size_t  i;
+
+    for (i = 0; i < sizeof(key); i++) {
+        key[i] = (uint8_t) i;
+    }
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) i;
+    }
+
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        fail_unless_equal("SipHash", "%" PRIx64, sip_expected[i],
+                          cork_siphash13(key, data, lens[i]));
+        fail_unless_equal("HalfSipHash", "0x%08" PRIx32, half_expected[i],
+                          cork_halfsiphash13(key, data, lens[i]));
+    }
+
+    /* The per-process key is random, but should stay the same until we
+     * replace it. */
+    fail_unless_equal("Keyed hash", "0x%08" PRIx32,
+                      cork_keyed_hash_buffer(data, 15),
+                      cork_keyed_hash_buffer(data, 15));
+    cork_keyed_hash_set_key(key);
+#if CORK_SIZEOF_POINTER == 8
+    fail_unless_equal("Keyed hash", "0x%08" PRIx32,
+                      (cork_hash) sip_expected[4],
+                      cork_keyed_hash_buffer(data, 15));
+#else
+    fail_unless_equal("Keyed hash", "0x%08" PRIx32, half_expected[4],
+                      cork_keyed_hash_buffer(data, 15));
+#endif
+}
+END_TEST
+
+
+/* Sends `len` bytes of `data` to `consumer` through a pipe. */
+static void
+consume_through_pipe(struct cork_stream_consumer *consumer,
+                     const uint8_t *data, size_t len)
+{
+    int  fds[2];
+    fail_if(pipe(fds) == -1, "Cannot create pipe");
+    fail_if(write(fds[1], data, len) != (ssize_t) len,
+            "Cannot write to pipe");
+    close(fds[1]);
+    fail_if_error(cork_consume_fd(consumer, fds[0]));
+    close(fds[0]);
+}
+
+/* Sends `len` bytes of `data` to `consumer` in two chunks. */
+static void
+consume_in_chunks(struct cork_stream_consumer *consumer,
+                  const uint8_t *data, size_t len)
+{
+    fail_if_error(cork_stream_consumer_data(consumer, data, 100, true));
+    fail_if_error(cork_stream_consumer_data
+                  (consumer, data + 100, len - 100, false));
+    fail_if_error(cork_stream_consumer_eof(consumer));
+}
+
+START_TEST(test_hash_stream)
+{
+    DESCRIBE_TEST;
+
+    static uint8_t  data[1000];
+    cork_big_hash  big_seed = {cork_u128_from_64(0x1234, 0x5678)};
+    struct cork_stream_consumer  *consumer;
+    cork_hash  hash;
+    cork_big_hash  big_hash;
+    size_t  len;
+    size_t  chunk_size;
+    size_t  i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 131 + 7);
+    }
+
+    /* Hashing a buffer in pieces must give the same result as hashing it all
+     * at once, no matter how it's split up. */
+    for (len = 0; len <= 300; len++) {
+        for (chunk_size = 1; chunk_size <= 40; chunk_size += 3) {
+            struct cork_hash_state  state;
+            struct cork_big_hash_state  big_state;
+            cork_hash_state_init(&state, 42);
+            cork_big_hash_state_init(&big_state, big_seed);
+            for (i = 0; i < len; i += chunk_size) {
+                size_t  size = (len - i < chunk_size)? len - i: chunk_size;
+                cork_hash_state_update(&state, data + i, size);
+                cork_big_hash_state_update(&big_state, data + i, size);
+            }
+            fail_unless_equal("Hash", "0x%08" PRIx32,
+                              cork_hash_buffer(42, data, len),
+                              cork_hash_state_final(&state));
+            fail_unless(cork_big_hash_equal
+                        (cork_big_hash_buffer(big_seed, data, len),
+                         cork_big_hash_state_final(&big_state)),
+                        "Big hash not equal for length %zu", len);
+        }
+    }
+
+    /* And the stream consumers must give the same result too. */
+    consumer = cork_hash_stream_consumer_new(42, &hash);
+    consume_through_pipe(consumer, data, sizeof(data));
+    cork_stream_consumer_free(consumer);
+    fail_unless_equal("Hash", "0x%08" PRIx32,
+                      cork_hash_buffer(42, data, sizeof(data)), hash);
+
+    consumer = cork_big_hash_stream_consumer_new(big_seed, &big_hash);
+    consume_in_chunks(consumer, data, sizeof(data));
+    fail_unless(cork_big_hash_equal
+                (cork_big_hash_buffer(big_seed, data, sizeof(data)),
+                 big_hash), "Big hash not equal");
+    /* An empty stream */
+    fail_if_error(cork_stream_consumer_eof(consumer));
+    fail_unless(cork_big_hash_equal
+                (cork_big_hash_buffer(big_seed, data, 0), big_hash),
+                "Big hash not equal");
+    cork_stream_consumer_free(consumer);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Checksums
+ */
+
+START_TEST(test_crc32c)
+{
+    DESCRIBE_TEST;
+
+    static uint8_t  data[40000];
+    static const char  *kernels[] = { "table", "sse4.2", "pclmul", "armv8" };
+    uint8_t  zeros[32];
+    uint8_t  ones[32];
+    uint32_t  crc;
+    size_t  len;
+    size_t  offset;
+    size_t  i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 131 + 7);
+    }
+    memset(zeros, 0, sizeof(zeros));
+    memset(ones, 0xff, sizeof(ones));
+
+    /* Test vectors from RFC 3720 */
+    fail_unless_equal("CRC", "0x%08" PRIx32, 0x00000000,
+                      cork_crc32c(CORK_CRC32C_INIT, "", 0));
+    fail_unless_equal("CRC", "0x%08" PRIx32, 0xe3069283,
+                      cork_crc32c(CORK_CRC32C_INIT, "123456789", 9));
+    fail_unless_equal("CRC", "0x%08" PRIx32, 0x8a9136aa,
+                      cork_crc32c(CORK_CRC32C_INIT, zeros, sizeof(zeros)));
+    fail_unless_equal("CRC", "0x%08" PRIx32, 0x62a8ab43,
+                      cork_crc32c(CORK_CRC32C_INIT, ones, sizeof(ones)));
+
+    /* Checksumming in pieces */
+    crc = cork_crc32c(CORK_CRC32C_INIT, "1234", 4);
+    crc = cork_crc32c(crc, "56789", 5);
+    fail_unless_equal("CRC", "0x%08" PRIx32, 0xe3069283, crc);
+
+    /* Every kernel that this CPU supports must give the same result, including
+     * for buffers that are long enough to use the three-way kernels. */
+    for (len = 0; len < sizeof(data) - 8; len += (len < 1000)? 1: 1237) {
+        for (offset = 0; offset < 3; offset++) {
+            uint32_t  expected;
+            fail_if_error(cork_crc32c_set_kernel("table"));
+            expected = cork_crc32c(0x1234, data + offset, len);
+            for (i = 1; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+                if (cork_crc32c_set_kernel(kernels[i]) == 0) {
+                    fail_unless_equal("CRC", "0x%08" PRIx32, expected,
+                                      cork_crc32c(0x1234, data + offset, len));
+                } else {
+                    cork_error_clear();
+                }
+            }
+        }
+    }
+
+    fail_if_error(cork_crc32c_set_kernel(NULL));
+#if defined(__aarch64__) && defined(__linux__)
+    /* The ARMv8 kernel is chosen at runtime, even if the library wasn't
+     * compiled for the CRC32 extension. */
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        fail_unless_streq("Kernel", "armv8", cork_crc32c_get_kernel());
+    }
+#endif
+    fail_unless_error(cork_crc32c_set_kernel("no-such-kernel"),
+                      "Shouldn't be able to select a missing kernel");
+}
+END_TEST
+
+START_TEST(test_adler32)
+{
+    DESCRIBE_TEST;
+
+    static uint8_t  data[20000];
+    uint32_t  adler;
+    size_t  i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = 0xff;
+    }
+
+    fail_unless_equal("Adler-32", "0x%08" PRIx32, 0x00000001,
+                      cork_adler32(CORK_ADLER32_INIT, "", 0));
+    fail_unless_equal("Adler-32", "0x%08" PRIx32, 0x11e60398,
+                      cork_adler32(CORK_ADLER32_INIT, "Wikipedia", 9));
+    fail_unless_equal("Adler-32", "0x%08" PRIx32, 0x091e01de,
+                      cork_adler32(CORK_ADLER32_INIT, "123456789", 9));
+
+    /* Long enough that the sums have to be reduced several times along the
+     * way, in pieces that don't line up with those reductions. */
+    adler = CORK_ADLER32_INIT;
+    for (i = 0; i < sizeof(data); i += 777) {
+        size_t  size = (sizeof(data) - i < 777)? sizeof(data) - i: 777;
+        adler = cork_adler32(adler, data + i, size);
+    }
+    fail_unless_equal("Adler-32", "0x%08" PRIx32,
+                      cork_adler32(CORK_ADLER32_INIT, data, sizeof(data)),
+                      adler);
+    fail_unless_equal("Adler-32", "0x%08" PRIx32, 0x9f51d664, adler);
+}
+END_TEST
+
+START_TEST(test_checksum_stream)
+{
+    DESCRIBE_TEST;
+
+    static uint8_t  data[10000];
+    struct cork_stream_consumer  *consumer;
+    uint32_t  crc;
+    uint32_t  adler;
+    size_t  i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 131 + 7);
+    }
+
+    consumer = cork_crc32c_stream_consumer_new(&crc);
+    consume_through_pipe(consumer, data, sizeof(data));
+    cork_stream_consumer_free(consumer);
+    fail_unless_equal("CRC", "0x%08" PRIx32,
+                      cork_crc32c(CORK_CRC32C_INIT, data, sizeof(data)), crc);
+
+    consumer = cork_adler32_stream_consumer_new(&adler);
+    consume_in_chunks(consumer, data, sizeof(data));
+    fail_unless_equal("Adler-32", "0x%08" PRIx32,
+                      cork_adler32(CORK_ADLER32_INIT, data, sizeof(data)),
+                      adler);
+    /* An empty stream */
+    fail_if_error(cork_stream_consumer_eof(consumer));
+    fail_unless_equal("Adler-32", "0x%08" PRIx32, 0x00000001, adler);
+    cork_stream_consumer_free(consumer);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * IP addresses
  */
@@ -854,6 +1453,12 @@ test_suite()
     tcase_add_test(tc_types, test_int_sizeof);
     suite_add_tcase(s, tc_types);
 
+    TCase  *tc_alloc = tcase_create("allocators");
+    tcase_add_test(tc_alloc, test_arena_alloc);
+    tcase_add_test(tc_alloc, test_slab_alloc);
+    tcase_add_test(tc_alloc, test_stats_alloc);
+    suite_add_tcase(s, tc_alloc);
+
     TCase  *tc_string = tcase_create("string");
     tcase_add_test(tc_string, test_string);
     suite_add_tcase(s, tc_string);
@@ -869,8 +1474,18 @@ test_suite()
 
     TCase  *tc_hash = tcase_create("hash");
     tcase_add_test(tc_hash, test_hash);
+    tcase_add_test(tc_hash, test_hash_buffers);
+    tcase_add_test(tc_hash, test_hash64);
+    tcase_add_test(tc_hash, test_keyed_hash);
+    tcase_add_test(tc_hash, test_hash_stream);
     suite_add_tcase(s, tc_hash);
 
+    TCase  *tc_checksum = tcase_create("checksum");
+    tcase_add_test(tc_checksum, test_crc32c);
+    tcase_add_test(tc_checksum, test_adler32);
+    tcase_add_test(tc_checksum, test_checksum_stream);
+    suite_add_tcase(s, tc_checksum);
+
     TCase  *tc_addresses = tcase_create("net-addresses");
     tcase_add_test(tc_addresses, test_ipv4_address);
     tcase_add_test(tc_addresses, test_ipv6_address);
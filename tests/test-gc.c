@@ -10,6 +10,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <check.h>
 
@@ -17,6 +18,8 @@
 #include "libcork/core/gc.h"
 #include "libcork/core/types.h"
 #include "libcork/helpers/gc.h"
+#include "libcork/threads/atomics.h"
+#include "libcork/threads/basics.h"
 
 #include "helpers.h"
 
@@ -123,6 +126,345 @@ START_TEST(test_gc_cyclic_02)
 END_TEST
 
 
+/* Counts how many tree nodes have been freed. */
+static size_t  freed_count = 0;
+
+struct counted {
+    struct counted  *next;
+    struct counted  *other;
+};
+
+_free_(counted) {
+    cork_size_atomic_add(&freed_count, 1);
+}
+
+_recurse_(counted) {
+    struct counted  *self = obj;
+    recurse(gc, self->next, ud);
+    recurse(gc, self->other, ud);
+}
+
+_gc_(counted);
+
+#define RING_COUNT  500
+#define RING_SIZE  10
+
+/* Creates a ring of RING_SIZE nodes, each of which also points at `other`,
+ * and returns a reference to one of the nodes. */
+static struct counted *
+ring_new(struct counted *other)
+{
+    struct counted  *first = cork_gc_new(counted);
+    struct counted  *curr = first;
+    size_t  i;
+    first->other = cork_gc_incref(other);
+    for (i = 1; i < RING_SIZE; i++) {
+        struct counted  *next = cork_gc_new(counted);
+        next->other = cork_gc_incref(other);
+        curr->next = next;
+        curr = next;
+    }
+    curr->next = cork_gc_incref(first);
+    return first;
+}
+
+static void
+test_rings(size_t threshold, size_t budget, size_t log_size)
+{
+    struct counted  *rings[RING_COUNT];
+    size_t  i;
+
+    cork_gc_init();
+    cork_gc_set_incremental(threshold, budget);
+    cork_gc_set_deferred(log_size);
+    freed_count = 0;
+
+    /* Each ring also points at the previous one, so that the garbage cycles
+     * that we find in one batch of possible roots will reach into other
+     * batches. */
+    rings[0] = ring_new(NULL);
+    for (i = 1; i < RING_COUNT; i++) {
+        rings[i] = ring_new(rings[i-1]);
+    }
+
+    /* Drop every reference in an order that leaves lots of possible roots
+     * behind. */
+    for (i = 0; i < RING_COUNT; i++) {
+        struct counted  *curr = rings[i]->next;
+        while (curr != rings[i]) {
+            cork_gc_incref(curr);
+            cork_gc_decref(curr);
+            curr = curr->next;
+        }
+    }
+    for (i = 0; i < RING_COUNT; i++) {
+        cork_gc_decref(rings[i]);
+    }
+
+    while (cork_gc_collect_step(budget) > 0) {
+        /* keep going */
+    }
+    fail_unless_equal("Freed nodes", "%zu", RING_COUNT * RING_SIZE,
+                      freed_count);
+    cork_gc_done();
+}
+
+START_TEST(test_gc_synchronous_01)
+{
+    DESCRIBE_TEST;
+    test_rings(0, 0, 0);
+}
+END_TEST
+
+START_TEST(test_gc_incremental_01)
+{
+    DESCRIBE_TEST;
+    test_rings(64, 16, 0);
+}
+END_TEST
+
+START_TEST(test_gc_incremental_02)
+{
+    DESCRIBE_TEST;
+    /* A large threshold makes the roots buffer grow. */
+    test_rings(100000, 1, 0);
+}
+END_TEST
+
+START_TEST(test_gc_incremental_03)
+{
+    DESCRIBE_TEST;
+    struct counted  *ring;
+    struct counted  *live[64];
+    size_t  i;
+
+    cork_gc_init();
+    cork_gc_set_incremental(32, 8);
+    freed_count = 0;
+
+    /* The oldest possible root in the buffer is a garbage cycle... */
+    ring = ring_new(NULL);
+    cork_gc_incref(ring->next);
+    cork_gc_decref(ring->next);
+    cork_gc_decref(ring);
+
+    /* ...and there's a steady stream of newer possible roots that aren't.
+     * Each incremental collection has to get to the older roots eventually,
+     * and the buffer shouldn't grow without bound. */
+    for (i = 0; i < 64; i++) {
+        live[i] = cork_gc_new(counted);
+        live[i]->next = NULL;
+        live[i]->other = NULL;
+    }
+    for (i = 0; i < 10000; i++) {
+        cork_gc_incref(live[i % 64]);
+        cork_gc_decref(live[i % 64]);
+    }
+    fail_unless_equal("Freed nodes", "%zu", RING_SIZE, freed_count);
+    fail_unless(cork_gc_collect_step(8) <= 64, "Too many possible roots");
+
+    for (i = 0; i < 64; i++) {
+        cork_gc_decref(live[i]);
+    }
+    cork_gc_done();
+    fail_unless_equal("Freed nodes", "%zu", RING_SIZE + 64, freed_count);
+}
+END_TEST
+
+START_TEST(test_gc_deferred_01)
+{
+    DESCRIBE_TEST;
+    test_rings(0, 0, 256);
+}
+END_TEST
+
+START_TEST(test_gc_deferred_02)
+{
+    DESCRIBE_TEST;
+    /* A tiny log forces lots of evictions. */
+    test_rings(64, 16, 4);
+}
+END_TEST
+
+/* Too large to come from any of the collector's pools. */
+struct large {
+    struct large  *next;
+    char  data[4096];
+};
+
+_free_(large) {
+    cork_size_atomic_add(&freed_count, 1);
+}
+
+_recurse_(large) {
+    struct large  *self = obj;
+    recurse(gc, self->next, ud);
+}
+
+_gc_(large);
+
+START_TEST(test_gc_large_01)
+{
+    DESCRIBE_TEST;
+    struct cork_gc_stats  before;
+    struct cork_gc_stats  after;
+    struct large  *l1;
+    struct large  *l2;
+    struct counted  *small;
+
+    cork_gc_init();
+    freed_count = 0;
+    cork_gc_get_stats(&before);
+
+    /* A cycle of large objects, and a small object that points into it. */
+    l1 = cork_gc_new(large);
+    l2 = cork_gc_new(large);
+    l1->next = cork_gc_incref(l2);
+    l2->next = cork_gc_incref(l1);
+    memset(l1->data, 0xaa, sizeof(l1->data));
+    memset(l2->data, 0x55, sizeof(l2->data));
+    small = cork_gc_new(counted);
+    small->next = (struct counted *) cork_gc_incref(l1);
+    small->other = NULL;
+
+    cork_gc_get_stats(&after);
+    fail_unless(after.live_bytes - before.live_bytes >=
+                2 * sizeof(struct large) + sizeof(struct counted),
+                "Too few live bytes");
+
+    cork_gc_decref(l1);
+    cork_gc_decref(l2);
+    cork_gc_decref(small);
+    cork_gc_done();
+
+    cork_gc_get_stats(&after);
+    fail_unless_equal("Freed objects", "%zu", 3, freed_count);
+    fail_unless_equal("Live bytes", "%zu", before.live_bytes,
+                      after.live_bytes);
+}
+END_TEST
+
+START_TEST(test_gc_stats_01)
+{
+    DESCRIBE_TEST;
+    struct cork_gc_stats  before;
+    struct cork_gc_stats  after;
+    size_t  pause_count = 0;
+    size_t  i;
+
+    cork_gc_get_stats(&before);
+    test_rings(64, 16, 0);
+    cork_gc_get_stats(&after);
+
+    fail_unless_equal("Allocated objects", "%zu", RING_COUNT * RING_SIZE,
+                      after.alloc_count - before.alloc_count);
+    fail_unless_equal("Freed objects", "%zu", RING_COUNT * RING_SIZE,
+                      after.free_count - before.free_count);
+    fail_unless_equal("Live bytes", "%zu", before.live_bytes,
+                      after.live_bytes);
+    fail_if(after.collection_count == before.collection_count,
+            "Should have looked for garbage cycles");
+    fail_if(after.roots_scanned == before.roots_scanned,
+            "Should have scanned possible roots");
+    fail_if(after.garbage_found == before.garbage_found,
+            "Should have found garbage cycles");
+    fail_if(after.garbage_found - before.garbage_found >
+            RING_COUNT * RING_SIZE,
+            "Found too much garbage");
+    for (i = 0; i < CORK_GC_PAUSE_BUCKET_COUNT; i++) {
+        pause_count += after.pause_counts[i] - before.pause_counts[i];
+    }
+    fail_unless_equal("Pauses", "%zu",
+                      after.collection_count - before.collection_count,
+                      pause_count);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Shared garbage collector
+ */
+
+#define THREAD_COUNT  4
+#define ITERATION_COUNT  200
+
+/* Each thread creates rings that point at a ring that some other thread
+ * created, and then passes the new ring on through here. */
+static struct counted * volatile  mailbox = NULL;
+
+static struct counted *
+mailbox_swap(struct counted *ring)
+{
+    struct counted  *old;
+    do {
+        old = cork_atomic_load(&mailbox);
+    } while (cork_ptr_cas(&mailbox, old, ring) != old);
+    return old;
+}
+
+static int
+shared_thread(void *user_data)
+{
+    size_t  i;
+    cork_gc_init_shared();
+    for (i = 0; i < ITERATION_COUNT; i++) {
+        struct counted  *other = mailbox_swap(NULL);
+        struct counted  *ring = ring_new(other);
+        cork_gc_decref(other);
+        cork_gc_decref(mailbox_swap(cork_gc_incref(ring)));
+        cork_gc_decref(ring);
+    }
+    cork_gc_done();
+    return 0;
+}
+
+START_TEST(test_gc_shared_01)
+{
+    DESCRIBE_TEST;
+    struct cork_thread  *threads[THREAD_COUNT];
+    struct cork_gc_stats  before;
+    struct cork_gc_stats  after;
+    size_t  i;
+
+    cork_gc_get_stats(&before);
+    cork_gc_init_shared();
+    /* Collect often, so that threads have to wait for each other. */
+    cork_gc_set_incremental(16, 0);
+    freed_count = 0;
+
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_if_error(threads[i] = cork_thread_new
+                      ("gc", NULL, NULL, shared_thread));
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_if_error(cork_thread_start(threads[i]));
+    }
+    cork_gc_begin_blocking();
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_if_error(cork_thread_join(threads[i]));
+    }
+    cork_gc_end_blocking();
+
+    cork_gc_decref(mailbox_swap(NULL));
+    cork_gc_done();
+    fail_unless_equal("Freed nodes", "%zu",
+                      THREAD_COUNT * ITERATION_COUNT * RING_SIZE,
+                      freed_count);
+
+    /* The worker threads have exited, but their statistics still count. */
+    cork_gc_get_stats(&after);
+    fail_unless_equal("Allocated objects", "%zu",
+                      THREAD_COUNT * ITERATION_COUNT * RING_SIZE,
+                      after.alloc_count - before.alloc_count);
+    fail_unless_equal("Freed objects", "%zu",
+                      THREAD_COUNT * ITERATION_COUNT * RING_SIZE,
+                      after.free_count - before.free_count);
+    fail_unless_equal("Live bytes", "%zu", before.live_bytes,
+                      after.live_bytes);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Testing harness
  */
@@ -136,8 +478,20 @@ test_suite()
     tcase_add_test(tc_gc, test_gc_acyclic_01);
     tcase_add_test(tc_gc, test_gc_cyclic_01);
     tcase_add_test(tc_gc, test_gc_cyclic_02);
+    tcase_add_test(tc_gc, test_gc_synchronous_01);
+    tcase_add_test(tc_gc, test_gc_incremental_01);
+    tcase_add_test(tc_gc, test_gc_incremental_02);
+    tcase_add_test(tc_gc, test_gc_incremental_03);
+    tcase_add_test(tc_gc, test_gc_deferred_01);
+    tcase_add_test(tc_gc, test_gc_deferred_02);
+    tcase_add_test(tc_gc, test_gc_large_01);
+    tcase_add_test(tc_gc, test_gc_stats_01);
     suite_add_tcase(s, tc_gc);
 
+    TCase  *tc_shared = tcase_create("shared");
+    tcase_add_test(tc_shared, test_gc_shared_01);
+    suite_add_tcase(s, tc_shared);
+
     return s;
 }
 
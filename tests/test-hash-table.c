@@ -136,7 +136,8 @@ test_iterator_to_string(struct cork_hash_table *table, const char *expected)
     cork_buffer_done(&buf);
 }
 
-START_TEST(test_uint64_hash_table)
+static void
+test_uint64_hash_table_flags(unsigned int flags)
 {
     struct cork_hash_table  *table;
     uint64_t  key, *key_ptr, *old_key;
@@ -145,7 +146,7 @@ START_TEST(test_uint64_hash_table)
     bool  is_new;
     struct cork_hash_table_entry  *entry;
 
-    table = cork_hash_table_new(0, 0);
+    table = cork_hash_table_new(0, flags);
     cork_hash_table_set_hash(table, uint64__hash);
     cork_hash_table_set_equals(table, uint64__equals);
     cork_hash_table_set_free_key(table, uint64__free);
@@ -263,6 +264,186 @@ START_TEST(test_uint64_hash_table)
     /* And we're done, so let's free everything. */
     cork_hash_table_free(table);
 }
+
+START_TEST(test_uint64_hash_table)
+{
+    test_uint64_hash_table_flags(0);
+}
+END_TEST
+
+START_TEST(test_flat_uint64_hash_table)
+{
+    test_uint64_hash_table_flags(CORK_HASH_TABLE_FLAT);
+}
+END_TEST
+
+START_TEST(test_incremental_uint64_hash_table)
+{
+    test_uint64_hash_table_flags(CORK_HASH_TABLE_INCREMENTAL);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Larger hash tables
+ */
+
+static cork_hash
+uintptr__hash(void *user_data, const void *vkey)
+{
+    uintptr_t  key = (uintptr_t) vkey;
+    return (cork_hash) (key * 0x9e3779b1);
+}
+
+/* Looks up keys [first, first + count) using a batched lookup.  Every odd key
+ * less than `end`, and every even key in [even_start, end), should be present,
+ * with a value one greater than the key. */
+#define key_present(key, even_start, end) \
+    ((key) < (end) && ((key) % 2 == 1 || (key) >= (even_start)))
+
+static void
+test_get_many(struct cork_hash_table *table, uintptr_t first, size_t count,
+              uintptr_t even_start, uintptr_t end)
+{
+    const void  **keys = cork_calloc(count, sizeof(void *));
+    void  **values = cork_calloc(count, sizeof(void *));
+    size_t  expected_found = 0;
+    size_t  i;
+
+    for (i = 0; i < count; i++) {
+        keys[i] = (void *) (first + i);
+    }
+    for (i = 0; i < count; i++) {
+        uintptr_t  key = first + i;
+        if (key_present(key, even_start, end)) {
+            expected_found++;
+        }
+    }
+
+    fail_unless_equal("Found count", "%zu", expected_found,
+                      cork_hash_table_get_many(table, keys, count, values));
+    for (i = 0; i < count; i++) {
+        uintptr_t  key = first + i;
+        if (key_present(key, even_start, end)) {
+            fail_unless(values[i] == (void *) (key + 1),
+                        "Unexpected value for %zu", (size_t) key);
+        } else {
+            fail_unless(values[i] == NULL,
+                        "Unexpected entry for %zu", (size_t) key);
+        }
+    }
+
+    cork_cfree(keys, count, sizeof(void *));
+    cork_cfree(values, count, sizeof(void *));
+}
+
+static void
+test_many_entries_flags(unsigned int flags, struct cork_mempool *entry_pool)
+{
+#define ENTRY_COUNT  5000
+    struct cork_hash_table  *table;
+    struct cork_hash_table_iterator  iterator;
+    struct cork_hash_table_entry  *entry;
+    uintptr_t  i;
+    uintptr_t  expected;
+    bool  is_new;
+
+    table = cork_hash_table_new(0, flags);
+    cork_hash_table_set_hash(table, uintptr__hash);
+    cork_hash_table_set_allocator(table, entry_pool);
+
+    for (i = 0; i < ENTRY_COUNT; i++) {
+        fail_if_error(cork_hash_table_put
+                      (table, (void *) i, (void *) (i + 1),
+                       &is_new, NULL, NULL));
+        fail_unless(is_new, "Should create new {%zu=>X} entry", (size_t) i);
+    }
+    fail_unless_equal("Table size", "%zu", (size_t) ENTRY_COUNT,
+                      cork_hash_table_size(table));
+
+    /* Delete all of the even keys. */
+    for (i = 0; i < ENTRY_COUNT; i += 2) {
+        fail_unless(cork_hash_table_delete(table, (void *) i, NULL, NULL),
+                    "Couldn't delete {%zu=>X}", (size_t) i);
+    }
+    fail_unless_equal("Table size", "%zu", (size_t) ENTRY_COUNT / 2,
+                      cork_hash_table_size(table));
+
+    for (i = 0; i < ENTRY_COUNT; i++) {
+        void  *value = cork_hash_table_get(table, (void *) i);
+        if (i % 2 == 0) {
+            fail_unless(value == NULL, "Unexpected entry for %zu", (size_t) i);
+        } else {
+            fail_unless(value == (void *) (i + 1),
+                        "Unexpected value for %zu", (size_t) i);
+        }
+    }
+    test_get_many(table, 0, ENTRY_COUNT, ENTRY_COUNT, ENTRY_COUNT);
+    test_get_many(table, 3, 5, ENTRY_COUNT, ENTRY_COUNT);
+    test_get_many(table, 0, 0, ENTRY_COUNT, ENTRY_COUNT);
+
+    /* Add a bunch of new keys, which should reuse the deleted space. */
+    for (i = ENTRY_COUNT; i < 2 * ENTRY_COUNT; i++) {
+        fail_if_error(entry = cork_hash_table_get_or_create
+                      (table, (void *) i, &is_new));
+        fail_unless(is_new, "Should create new {%zu=>X} entry", (size_t) i);
+        entry->value = (void *) (i + 1);
+    }
+    fail_unless_equal("Table size", "%zu", (size_t) ENTRY_COUNT * 3 / 2,
+                      cork_hash_table_size(table));
+
+    /* The entries should still be in insertion order. */
+    expected = 1;
+    cork_hash_table_iterator_init(table, &iterator);
+    while ((entry = cork_hash_table_iterator_next(&iterator)) != NULL) {
+        fail_unless_equal("Key", "%zu", (size_t) expected,
+                          (size_t) (uintptr_t) entry->key);
+        fail_unless_equal("Value", "%zu", (size_t) expected + 1,
+                          (size_t) (uintptr_t) entry->value);
+        expected += (expected < ENTRY_COUNT - 1)? 2: 1;
+    }
+    fail_unless_equal("Final key", "%zu", (size_t) 2 * ENTRY_COUNT,
+                      (size_t) expected);
+
+    cork_hash_table_ensure_size(table, 4 * ENTRY_COUNT);
+    test_get_many(table, 0, 2 * ENTRY_COUNT + 10,
+                  ENTRY_COUNT, 2 * ENTRY_COUNT);
+    for (i = ENTRY_COUNT; i < 2 * ENTRY_COUNT; i++) {
+        fail_unless(cork_hash_table_get(table, (void *) i) == (void *) (i + 1),
+                    "Unexpected value for %zu", (size_t) i);
+    }
+
+    cork_hash_table_free(table);
+#undef ENTRY_COUNT
+}
+
+START_TEST(test_many_entries)
+{
+    test_many_entries_flags(0, NULL);
+}
+END_TEST
+
+START_TEST(test_flat_many_entries)
+{
+    test_many_entries_flags(CORK_HASH_TABLE_FLAT, NULL);
+}
+END_TEST
+
+START_TEST(test_incremental_many_entries)
+{
+    test_many_entries_flags(CORK_HASH_TABLE_INCREMENTAL, NULL);
+}
+END_TEST
+
+START_TEST(test_pooled_many_entries)
+{
+    struct cork_mempool  *entry_pool = cork_hash_table_entry_mempool_new();
+    /* Use the pool for two tables in a row, to make sure that the first one
+     * returns all of its entries. */
+    test_many_entries_flags(0, entry_pool);
+    test_many_entries_flags(CORK_HASH_TABLE_INCREMENTAL, entry_pool);
+    cork_mempool_free(entry_pool);
+}
 END_TEST
 
 
@@ -270,13 +451,14 @@ END_TEST
  * String hash tables
  */
 
-START_TEST(test_string_hash_table)
+static void
+test_string_hash_table_flags(unsigned int flags)
 {
     struct cork_hash_table  *table;
     char  key[256];
     void  *value;
 
-    table = cork_string_hash_table_new(0, 0);
+    table = cork_string_hash_table_new(0, flags);
 
     fail_if_error(cork_hash_table_put
                   (table, "key1", (void *) (uintptr_t) 1, NULL, NULL, NULL));
@@ -296,6 +478,62 @@ START_TEST(test_string_hash_table)
 
     cork_hash_table_free(table);
 }
+
+START_TEST(test_string_hash_table)
+{
+    test_string_hash_table_flags(0);
+}
+END_TEST
+
+START_TEST(test_keyed_string_hash_table)
+{
+    test_string_hash_table_flags(CORK_HASH_TABLE_KEYED);
+    test_string_hash_table_flags(CORK_HASH_TABLE_KEYED | CORK_HASH_TABLE_FLAT);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Buffer hash tables
+ */
+
+static void
+test_buffer_hash_table_flags(unsigned int flags)
+{
+    struct cork_hash_table  *table;
+    struct cork_buffer  key1 = CORK_BUFFER_INIT();
+    struct cork_buffer  key2 = CORK_BUFFER_INIT();
+    void  *value;
+
+    table = cork_buffer_hash_table_new(0, flags);
+
+    /* Keys can contain NULs, and are compared by content. */
+    cork_buffer_set(&key1, "key\0" "1", 5);
+    fail_if_error(cork_hash_table_put
+                  (table, &key1, (void *) (uintptr_t) 1, NULL, NULL, NULL));
+    fail_unless(cork_hash_table_size(table) == 1,
+                "Unexpected size after adding {key1->1}");
+
+    cork_buffer_set(&key2, "key\0" "1", 5);
+    fail_if((value = cork_hash_table_get(table, &key2)) == NULL,
+            "No entry for key1");
+    fail_unless(value == (void *) (uintptr_t) 1,
+                "Unexpected value for key1");
+
+    cork_buffer_set(&key2, "key\0" "2", 5);
+    fail_unless((value = cork_hash_table_get(table, &key2)) == NULL,
+                "Unexpected entry for key2");
+
+    cork_hash_table_free(table);
+    cork_buffer_done(&key1);
+    cork_buffer_done(&key2);
+}
+
+START_TEST(test_buffer_hash_table)
+{
+    test_buffer_hash_table_flags(0);
+    test_buffer_hash_table_flags(CORK_HASH_TABLE_KEYED);
+}
 END_TEST
 
 
@@ -342,7 +580,15 @@ test_suite()
 
     TCase  *tc_ds = tcase_create("hash_table");
     tcase_add_test(tc_ds, test_uint64_hash_table);
+    tcase_add_test(tc_ds, test_flat_uint64_hash_table);
+    tcase_add_test(tc_ds, test_incremental_uint64_hash_table);
+    tcase_add_test(tc_ds, test_many_entries);
+    tcase_add_test(tc_ds, test_flat_many_entries);
+    tcase_add_test(tc_ds, test_incremental_many_entries);
+    tcase_add_test(tc_ds, test_pooled_many_entries);
     tcase_add_test(tc_ds, test_string_hash_table);
+    tcase_add_test(tc_ds, test_keyed_string_hash_table);
+    tcase_add_test(tc_ds, test_buffer_hash_table);
     tcase_add_test(tc_ds, test_pointer_hash_table);
     suite_add_tcase(s, tc_ds);
 
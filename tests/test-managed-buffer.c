@@ -9,6 +9,9 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <check.h>
 
@@ -291,6 +294,102 @@ START_TEST(test_slice_equals_02)
 END_TEST
 
 
+/*-----------------------------------------------------------------------
+ * Memory-mapped files
+ */
+
+/* Creates a temporary file with the given contents, storing its name into
+ * `path`, which must be at least 32 bytes long. */
+static void
+create_temp_file(char *path, const void *content, size_t size)
+{
+    int  fd;
+    strcpy(path, "test-mmap-XXXXXX");
+    fail_if((fd = mkstemp(path)) == -1, "Cannot create temporary file");
+    fail_unless(write(fd, content, size) == (ssize_t) size,
+                "Cannot write temporary file");
+    close(fd);
+}
+
+START_TEST(test_mmap_slice)
+{
+    static const char  CONTENT[] = "Hello, world!";
+    static const size_t  CONTENT_SIZE = sizeof(CONTENT) - 1;
+    char  path[32];
+    struct cork_slice  slice;
+    struct cork_slice  copy;
+
+    create_temp_file(path, CONTENT, CONTENT_SIZE);
+    fail_if_error(cork_slice_init_mmap(&slice, path));
+    fail_unless(slice.size == CONTENT_SIZE &&
+                memcmp(slice.buf, CONTENT, CONTENT_SIZE) == 0,
+                "Unexpected contents in memory-mapped slice");
+
+    /* The copy should share the mapping, which must stay valid after the
+     * original slice is finished. */
+    fail_if_error(cork_slice_copy(&copy, &slice, 7, 5));
+    fail_unless(copy.buf == slice.buf + 7,
+                "Copy should share the original slice's mapping");
+    cork_slice_finish(&slice);
+    fail_unless(copy.size == 5 && memcmp(copy.buf, "world", 5) == 0,
+                "Unexpected contents in copy of memory-mapped slice");
+    cork_slice_finish(&copy);
+
+    fail_if_error(cork_slice_init_mmap_ex(&slice, path, CORK_MMAP_SEQUENTIAL));
+    fail_unless(slice.size == CONTENT_SIZE &&
+                memcmp(slice.buf, CONTENT, CONTENT_SIZE) == 0,
+                "Unexpected contents in memory-mapped slice");
+    cork_slice_finish(&slice);
+    fail_if_error(cork_slice_init_mmap_ex(&slice, path, CORK_MMAP_RANDOM));
+    fail_unless(slice.size == CONTENT_SIZE, "Unexpected slice size");
+    cork_slice_finish(&slice);
+
+    unlink(path);
+    fail_unless_error(cork_slice_init_mmap(&slice, path),
+                      "Shouldn't be able to map a missing file");
+}
+END_TEST
+
+START_TEST(test_mmap_empty_file)
+{
+    char  path[32];
+    struct cork_managed_buffer  *buffer;
+    struct cork_slice  slice;
+
+    create_temp_file(path, "", 0);
+    fail_if_error(buffer = cork_managed_buffer_new_mmap
+                  (path, CORK_MMAP_NORMAL));
+    fail_unless(buffer->size == 0, "Unexpected buffer size");
+    fail_if_error(cork_managed_buffer_slice_offset(&slice, buffer, 0));
+    cork_managed_buffer_unref(buffer);
+    fail_unless(slice.size == 0, "Unexpected slice size");
+    cork_slice_finish(&slice);
+    unlink(path);
+}
+END_TEST
+
+START_TEST(test_mmap_not_regular)
+{
+    char  path[32];
+
+    strcpy(path, "test-mmap-XXXXXX");
+    fail_if(mkdtemp(path) == NULL, "Cannot create temporary directory");
+    fail_unless_error(cork_managed_buffer_new_mmap(path, CORK_MMAP_NORMAL),
+                      "Shouldn't be able to map a directory");
+    rmdir(path);
+
+    /* Opening a FIFO that has no writer must not block. */
+    strcpy(path, "test-mmap-XXXXXX");
+    fail_if(mkdtemp(path) == NULL, "Cannot create temporary directory");
+    rmdir(path);
+    fail_if(mkfifo(path, 0600) == -1, "Cannot create FIFO");
+    fail_unless_error(cork_managed_buffer_new_mmap(path, CORK_MMAP_NORMAL),
+                      "Shouldn't be able to map a FIFO");
+    unlink(path);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Testing harness
  */
@@ -319,6 +418,12 @@ test_suite()
     tcase_add_test(tc_slice_equality, test_slice_equals_02);
     suite_add_tcase(s, tc_slice_equality);
 
+    TCase  *tc_mmap = tcase_create("mmap");
+    tcase_add_test(tc_mmap, test_mmap_slice);
+    tcase_add_test(tc_mmap, test_mmap_empty_file);
+    tcase_add_test(tc_mmap, test_mmap_not_regular);
+    suite_add_tcase(s, tc_mmap);
+
     return s;
 }
 
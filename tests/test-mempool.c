@@ -14,8 +14,10 @@
 
 #include <check.h>
 
+#include "libcork/core/allocator.h"
 #include "libcork/core/mempool.h"
 #include "libcork/core/types.h"
+#include "libcork/threads/basics.h"
 
 #include "helpers.h"
 
@@ -57,6 +59,69 @@ START_TEST(test_mempool_01)
 }
 END_TEST
 
+START_TEST(test_mempool_bulk_01)
+{
+#define BULK_COUNT  100
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    int64_t  *objects[BULK_COUNT];
+    int64_t  *again[BULK_COUNT];
+    size_t  i;
+    size_t  j;
+    mp = cork_mempool_new_ex(int64_t, 4096);
+
+    /* A fresh block hands out its objects in address order. */
+    cork_mempool_reserve(mp, BULK_COUNT);
+    cork_mempool_new_objects(mp, BULK_COUNT, (void **) objects);
+    for (i = 0; i < BULK_COUNT; i++) {
+        *objects[i] = i;
+        if (i > 0) {
+            fail_unless(objects[i] > objects[i-1],
+                        "Objects aren't in address order");
+        }
+    }
+    cork_mempool_free_objects(mp, BULK_COUNT, (void **) objects);
+
+    /* Freed objects are reused by the next bulk allocation. */
+    cork_mempool_new_objects(mp, BULK_COUNT, (void **) again);
+    for (i = 0; i < BULK_COUNT; i++) {
+        for (j = 0; j < BULK_COUNT; j++) {
+            if (again[i] == objects[j]) {
+                break;
+            }
+        }
+        fail_if(j == BULK_COUNT, "Freed objects weren't reused");
+    }
+    cork_mempool_free_objects(mp, BULK_COUNT, (void **) again);
+
+    cork_mempool_free(mp);
+}
+END_TEST
+
+START_TEST(test_mempool_bulk_02)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    void  *objects[OBJECT_COUNT * 10];
+    size_t  i;
+    /* Small enough that we'll have to allocate a bunch of blocks */
+    mp = cork_mempool_new_ex(int64_t, 64);
+    cork_mempool_new_objects(mp, OBJECT_COUNT * 10, objects);
+    for (i = 0; i < OBJECT_COUNT * 10; i++) {
+        *(int64_t *) objects[i] = i;
+    }
+    for (i = 0; i < OBJECT_COUNT * 10; i++) {
+        fail_unless(*(int64_t *) objects[i] == (int64_t) i,
+                    "Object %zu was clobbered", i);
+    }
+    cork_mempool_free_objects(mp, OBJECT_COUNT * 5, objects);
+    for (i = OBJECT_COUNT * 5; i < OBJECT_COUNT * 10; i++) {
+        cork_mempool_free_object(mp, objects[i]);
+    }
+    cork_mempool_free(mp);
+}
+END_TEST
+
 START_TEST(test_mempool_fail_01)
 {
     DESCRIBE_TEST;
@@ -131,6 +196,363 @@ START_TEST(test_mempool_reuse_01)
 END_TEST
 
 
+#define TRIM_BLOCK_SIZE  1024
+#define TRIM_OBJECT_COUNT  1000
+
+/* Counts the blocks that a pool has allocated, using an allocator that wraps
+ * the current one. */
+static size_t  live_blocks = 0;
+static const struct cork_alloc  *block_parent;
+
+static void *
+counting__xmalloc(const struct cork_alloc *alloc, size_t size)
+{
+    if (size == TRIM_BLOCK_SIZE) {
+        live_blocks++;
+    }
+    return cork_alloc_xmalloc(block_parent, size);
+}
+
+static void
+counting__free(const struct cork_alloc *alloc, void *ptr, size_t size)
+{
+    if (size == TRIM_BLOCK_SIZE) {
+        live_blocks--;
+    }
+    cork_alloc_free(block_parent, ptr, size);
+}
+
+static void
+use_counting_allocator(void)
+{
+    struct cork_alloc  *counting;
+    block_parent = cork_allocator;
+    counting = cork_alloc_new_alloc(block_parent);
+    cork_alloc_set_xmalloc(counting, counting__xmalloc);
+    cork_alloc_set_free(counting, counting__free);
+    cork_set_allocator(counting);
+}
+
+START_TEST(test_mempool_trim_01)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    void  *objects[TRIM_OBJECT_COUNT];
+    size_t  per_block = OBJECTS_PER_BLOCK(TRIM_BLOCK_SIZE, sizeof(int64_t));
+    size_t  object_size = sizeof(int64_t) + CORK_SIZEOF_POINTER;
+    size_t  done_call_count = 0;
+    size_t  i;
+
+    use_counting_allocator();
+    mp = cork_mempool_new_ex(int64_t, TRIM_BLOCK_SIZE);
+    cork_mempool_set_user_data(mp, &done_call_count, NULL);
+    cork_mempool_set_done_object(mp, int64_done);
+    cork_mempool_new_objects(mp, TRIM_OBJECT_COUNT, objects);
+    fail_unless_equal("Blocks", "%zu",
+                      (TRIM_OBJECT_COUNT + per_block - 1) / per_block,
+                      live_blocks);
+
+    /* Free every other object; no block is completely free, so nothing can
+     * be released. */
+    for (i = 0; i < TRIM_OBJECT_COUNT; i += 2) {
+        cork_mempool_free_object(mp, objects[i]);
+    }
+    cork_mempool_trim(mp, 0);
+    fail_unless_equal("Blocks", "%zu",
+                      (TRIM_OBJECT_COUNT + per_block - 1) / per_block,
+                      live_blocks);
+
+    /* Once everything is free, we can release all but the blocks we're asked
+     * to keep. */
+    for (i = 1; i < TRIM_OBJECT_COUNT; i += 2) {
+        cork_mempool_free_object(mp, objects[i]);
+    }
+    cork_mempool_trim(mp, 2 * per_block * object_size);
+    fail_unless_equal("Blocks", "%zu", 2, live_blocks);
+    cork_mempool_trim(mp, 0);
+    fail_unless_equal("Blocks", "%zu", 0, live_blocks);
+    fail_unless_equal("done_object calls", "%zu",
+                      (TRIM_OBJECT_COUNT + per_block - 1) / per_block *
+                      per_block, done_call_count);
+
+    /* The pool still works after being trimmed. */
+    cork_mempool_new_objects(mp, TRIM_OBJECT_COUNT, objects);
+    cork_mempool_free_objects(mp, TRIM_OBJECT_COUNT, objects);
+    cork_mempool_free(mp);
+    fail_unless_equal("Blocks", "%zu", 0, live_blocks);
+}
+END_TEST
+
+START_TEST(test_mempool_trim_02)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    void  *objects[TRIM_OBJECT_COUNT];
+    size_t  per_block = OBJECTS_PER_BLOCK(TRIM_BLOCK_SIZE, sizeof(int64_t));
+    size_t  object_size = sizeof(int64_t) + CORK_SIZEOF_POINTER;
+    size_t  round;
+
+    use_counting_allocator();
+    mp = cork_mempool_new_ex(int64_t, TRIM_BLOCK_SIZE);
+    cork_mempool_set_high_watermark
+        (mp, 4 * per_block * object_size, per_block * object_size);
+
+    /* After each burst, the pool shrinks back down on its own. */
+    for (round = 0; round < 3; round++) {
+        cork_mempool_new_objects(mp, TRIM_OBJECT_COUNT, objects);
+        cork_mempool_free_objects(mp, TRIM_OBJECT_COUNT, objects);
+        fail_unless(live_blocks <= 4, "Pool didn't shrink (%zu blocks)",
+                    live_blocks);
+    }
+
+    cork_mempool_free(mp);
+}
+END_TEST
+
+START_TEST(test_mempool_trim_threads_01)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    void  *objects[TRIM_OBJECT_COUNT];
+    size_t  peak_blocks;
+
+    use_counting_allocator();
+    mp = cork_mempool_new_ex(int64_t, TRIM_BLOCK_SIZE);
+    cork_mempool_set_thread_safe(mp);
+    cork_mempool_new_objects(mp, TRIM_OBJECT_COUNT, objects);
+    peak_blocks = live_blocks;
+    cork_mempool_free_objects(mp, TRIM_OBJECT_COUNT, objects);
+    /* Objects in the depot can be released, but the few that are in our
+     * thread cache can't. */
+    cork_mempool_trim(mp, 0);
+    fail_unless(live_blocks < peak_blocks / 2,
+                "Pool didn't shrink (%zu blocks)", live_blocks);
+    cork_mempool_release_thread_cache(mp);
+    cork_mempool_trim(mp, 0);
+    fail_unless_equal("Blocks", "%zu", 0, live_blocks);
+    cork_mempool_free(mp);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Thread-safe memory pools
+ */
+
+#define THREAD_COUNT  4
+#define THREAD_OBJECT_COUNT  1000
+#define THREAD_ROUNDS  50
+
+struct mempool_thread {
+    struct cork_mempool  *mp;
+    int64_t  id;
+    int64_t  **objects;
+    size_t  errors;
+};
+
+/* Repeatedly allocates a batch of objects, tags them with the thread's ID, and
+ * then makes sure that no other thread has touched them before freeing them. */
+static int
+mempool_churn__run(void *vself)
+{
+    struct mempool_thread  *self = vself;
+    int64_t  *objects[THREAD_OBJECT_COUNT];
+    size_t  round;
+    size_t  i;
+    for (round = 0; round < THREAD_ROUNDS; round++) {
+        for (i = 0; i < THREAD_OBJECT_COUNT; i++) {
+            objects[i] = cork_mempool_new_object(self->mp);
+            *objects[i] = self->id;
+        }
+        for (i = 0; i < THREAD_OBJECT_COUNT; i++) {
+            if (*objects[i] != self->id) {
+                self->errors++;
+            }
+            cork_mempool_free_object(self->mp, objects[i]);
+        }
+    }
+    cork_mempool_release_thread_cache(self->mp);
+    return 0;
+}
+
+/* Like mempool_churn__run, but allocates and frees each batch at once. */
+static int
+mempool_bulk_churn__run(void *vself)
+{
+    struct mempool_thread  *self = vself;
+    int64_t  *objects[THREAD_OBJECT_COUNT];
+    size_t  round;
+    size_t  i;
+    for (round = 0; round < THREAD_ROUNDS; round++) {
+        cork_mempool_new_objects
+            (self->mp, THREAD_OBJECT_COUNT, (void **) objects);
+        for (i = 0; i < THREAD_OBJECT_COUNT; i++) {
+            *objects[i] = self->id;
+        }
+        for (i = 0; i < THREAD_OBJECT_COUNT; i++) {
+            if (*objects[i] != self->id) {
+                self->errors++;
+            }
+        }
+        cork_mempool_free_objects
+            (self->mp, THREAD_OBJECT_COUNT, (void **) objects);
+    }
+    cork_mempool_release_thread_cache(self->mp);
+    return 0;
+}
+
+static int
+mempool_produce__run(void *vself)
+{
+    struct mempool_thread  *self = vself;
+    size_t  i;
+    for (i = 0; i < THREAD_OBJECT_COUNT; i++) {
+        self->objects[i] = cork_mempool_new_object(self->mp);
+        *self->objects[i] = i;
+    }
+    return 0;
+}
+
+static int
+mempool_consume__run(void *vself)
+{
+    struct mempool_thread  *self = vself;
+    size_t  i;
+    for (i = 0; i < THREAD_OBJECT_COUNT; i++) {
+        if (*self->objects[i] != (int64_t) i) {
+            self->errors++;
+        }
+        cork_mempool_free_object(self->mp, self->objects[i]);
+    }
+    return 0;
+}
+
+static void
+mempool_churn_test(cork_run_f run)
+{
+    struct cork_mempool  *mp;
+    struct mempool_thread  bodies[THREAD_COUNT];
+    struct cork_thread  *threads[THREAD_COUNT];
+    size_t  i;
+
+    mp = cork_mempool_new(int64_t);
+    cork_mempool_set_thread_safe(mp);
+
+    for (i = 0; i < THREAD_COUNT; i++) {
+        bodies[i].mp = mp;
+        bodies[i].id = i + 1;
+        bodies[i].errors = 0;
+        fail_if_error(threads[i] = cork_thread_new
+                      ("churn", &bodies[i], NULL, run));
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_if_error(cork_thread_start(threads[i]));
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        fail_if_error(cork_thread_join(threads[i]));
+        fail_unless_equal("Errors", "%zu", 0, bodies[i].errors);
+    }
+
+    /* This will abort if any objects were lost. */
+    cork_mempool_free(mp);
+}
+
+START_TEST(test_mempool_threads_01)
+{
+    DESCRIBE_TEST;
+    mempool_churn_test(mempool_churn__run);
+}
+END_TEST
+
+START_TEST(test_mempool_threads_02)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    struct mempool_thread  body;
+    struct cork_thread  *thread;
+    size_t  round;
+
+    /* Allocate objects in one thread and free them in another.  Objects freed
+     * by the consumer must make their way back to the producer. */
+    mp = cork_mempool_new(int64_t);
+    cork_mempool_set_thread_safe(mp);
+    body.mp = mp;
+    body.errors = 0;
+    body.objects = cork_calloc(THREAD_OBJECT_COUNT, sizeof(int64_t *));
+
+    for (round = 0; round < 4; round++) {
+        fail_if_error(thread = cork_thread_new
+                      ("producer", &body, NULL, mempool_produce__run));
+        fail_if_error(cork_thread_start(thread));
+        fail_if_error(cork_thread_join(thread));
+        fail_if_error(thread = cork_thread_new
+                      ("consumer", &body, NULL, mempool_consume__run));
+        fail_if_error(cork_thread_start(thread));
+        fail_if_error(cork_thread_join(thread));
+    }
+    fail_unless_equal("Errors", "%zu", 0, body.errors);
+
+    cork_cfree(body.objects, THREAD_OBJECT_COUNT, sizeof(int64_t *));
+    cork_mempool_free(mp);
+}
+END_TEST
+
+START_TEST(test_mempool_threads_03)
+{
+    DESCRIBE_TEST;
+    mempool_churn_test(mempool_bulk_churn__run);
+}
+END_TEST
+
+/* Allocates and frees some objects, and then exits without releasing the
+ * thread's cache. */
+static int
+mempool_exit__run(void *vself)
+{
+    struct mempool_thread  *self = vself;
+    int64_t  *objects[THREAD_OBJECT_COUNT];
+    cork_mempool_new_objects(self->mp, THREAD_OBJECT_COUNT, (void **) objects);
+    cork_mempool_free_objects(self->mp, THREAD_OBJECT_COUNT, (void **) objects);
+    return 0;
+}
+
+START_TEST(test_mempool_threads_04)
+{
+    DESCRIBE_TEST;
+    struct cork_mempool  *mp;
+    struct mempool_thread  body;
+    struct cork_thread  *thread;
+    size_t  round;
+
+    /* Each thread's cache should be released when the thread exits, so once
+     * all of the threads are done, every block in the pool is free. */
+    use_counting_allocator();
+    mp = cork_mempool_new_ex(int64_t, TRIM_BLOCK_SIZE);
+    cork_mempool_set_thread_safe(mp);
+    body.mp = mp;
+    for (round = 0; round < 16; round++) {
+        fail_if_error(thread = cork_thread_new
+                      ("exit", &body, NULL, mempool_exit__run));
+        fail_if_error(cork_thread_start(thread));
+        fail_if_error(cork_thread_join(thread));
+    }
+    cork_mempool_trim(mp, 0);
+    fail_unless_equal("Blocks", "%zu", 0, live_blocks);
+
+    /* Releasing a cache by hand should work too, and the thread should be
+     * able to keep using the pool afterwards. */
+    cork_mempool_free_object(mp, cork_mempool_new_object(mp));
+    cork_mempool_release_thread_cache(mp);
+    cork_mempool_trim(mp, 0);
+    fail_unless_equal("Blocks", "%zu", 0, live_blocks);
+    cork_mempool_free_object(mp, cork_mempool_new_object(mp));
+    cork_mempool_release_thread_cache(mp);
+    cork_mempool_release_thread_cache(mp);
+    cork_mempool_free(mp);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Testing harness
  */
@@ -142,6 +564,8 @@ test_suite()
 
     TCase  *tc_mempool = tcase_create("mempool");
     tcase_add_test(tc_mempool, test_mempool_01);
+    tcase_add_test(tc_mempool, test_mempool_bulk_01);
+    tcase_add_test(tc_mempool, test_mempool_bulk_02);
 #if NDEBUG
     /* If we're not compiling assertions then this test won't abort */
     tcase_add_test(tc_mempool, test_mempool_fail_01);
@@ -149,8 +573,18 @@ test_suite()
     tcase_add_test_raise_signal(tc_mempool, test_mempool_fail_01, SIGABRT);
 #endif
     tcase_add_test(tc_mempool, test_mempool_reuse_01);
+    tcase_add_test(tc_mempool, test_mempool_trim_01);
+    tcase_add_test(tc_mempool, test_mempool_trim_02);
     suite_add_tcase(s, tc_mempool);
 
+    TCase  *tc_threads = tcase_create("threads");
+    tcase_add_test(tc_threads, test_mempool_threads_01);
+    tcase_add_test(tc_threads, test_mempool_threads_02);
+    tcase_add_test(tc_threads, test_mempool_threads_03);
+    tcase_add_test(tc_threads, test_mempool_threads_04);
+    tcase_add_test(tc_threads, test_mempool_trim_threads_01);
+    suite_add_tcase(s, tc_threads);
+
     return s;
 }
 
@@ -0,0 +1,329 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2026, libcork authors
+ * All rights reserved.
+ *
+ * Please see the COPYING file in this distribution for license details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "libcork/core/allocator.h"
+#include "libcork/core/types.h"
+#include "libcork/ds/buffer.h"
+#include "libcork/ds/managed-buffer.h"
+#include "libcork/ds/rope.h"
+#include "libcork/ds/slice.h"
+#include "libcork/helpers/errors.h"
+
+#include "helpers.h"
+
+
+/*-----------------------------------------------------------------------
+ * Helper functions
+ */
+
+struct flag_buffer {
+    struct cork_managed_buffer  parent;
+    bool  *flag;
+};
+
+static void
+set_flag_on_free(struct cork_managed_buffer *mbuf)
+{
+    struct flag_buffer  *fbuf =
+        cork_container_of(mbuf, struct flag_buffer, parent);
+    *fbuf->flag = true;
+    cork_delete(struct flag_buffer, fbuf);
+}
+
+static struct cork_managed_buffer_iface  FLAG__MANAGED_BUFFER = {
+    set_flag_on_free
+};
+
+static struct cork_managed_buffer *
+flag_buffer_new(const void *buf, size_t size, bool *flag)
+{
+    struct flag_buffer  *fbuf = cork_new(struct flag_buffer);
+    fbuf->parent.buf = buf;
+    fbuf->parent.size = size;
+    fbuf->parent.ref_count = 1;
+    fbuf->parent.iface = &FLAG__MANAGED_BUFFER;
+    fbuf->flag = flag;
+    return &fbuf->parent;
+}
+
+static void
+check_rope(const struct cork_rope *rope, const char *expected)
+{
+    struct cork_buffer  buf = CORK_BUFFER_INIT();
+    size_t  expected_size = strlen(expected);
+    cork_rope_append_to_buffer(rope, &buf);
+    fail_unless(rope->size == expected_size,
+                "Unexpected rope size (got %zu, expected %zu)",
+                rope->size, expected_size);
+    fail_unless(buf.size == expected_size &&
+                memcmp(buf.buf, expected, expected_size) == 0,
+                "Unexpected rope contents (got \"%.*s\", expected \"%s\")",
+                (int) buf.size, (char *) buf.buf, expected);
+    cork_buffer_done(&buf);
+}
+
+/* Creates a rope containing "abc" + "defg" + "hij" */
+static void
+make_rope(struct cork_rope *rope)
+{
+    struct cork_managed_buffer  *mbuf;
+    cork_rope_init(rope);
+    cork_rope_append_copy(rope, "defg", 4);
+    cork_rope_append_copy(rope, "", 0);
+    cork_rope_append_copy(rope, "hij", 3);
+    mbuf = cork_managed_buffer_new_copy("abc", 3);
+    fail_if_error(cork_rope_prepend_managed(rope, mbuf, 0, 3));
+    cork_managed_buffer_unref(mbuf);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Ropes
+ */
+
+START_TEST(test_rope_append)
+{
+    static const char  HELLO[] = "hello ";
+    struct cork_rope  *rope;
+    struct cork_slice  slice;
+    struct cork_managed_buffer  *mbuf;
+
+    rope = cork_rope_new();
+    check_rope(rope, "");
+
+    cork_rope_append_copy(rope, "world", 5);
+    cork_slice_init_static(&slice, HELLO, sizeof(HELLO) - 1);
+    fail_if_error(cork_rope_prepend_slice(rope, &slice));
+    cork_slice_finish(&slice);
+    check_rope(rope, "hello world");
+
+    mbuf = cork_managed_buffer_new_copy("<<!>>", 5);
+    fail_if_error(cork_rope_append_managed(rope, mbuf, 2, 1));
+    fail_if_error(cork_rope_prepend_managed(rope, mbuf, 0, 2));
+    fail_unless_error(cork_rope_append_managed(rope, mbuf, 3, 3),
+                      "Shouldn't be able to add an invalid slice");
+    cork_managed_buffer_unref(mbuf);
+    check_rope(rope, "<<hello world!");
+    fail_unless(rope->segment_count == 4,
+                "Unexpected segment count %zu", rope->segment_count);
+
+    cork_rope_clear(rope);
+    check_rope(rope, "");
+    fail_unless(rope->segment_count == 0,
+                "Unexpected segment count %zu", rope->segment_count);
+    cork_rope_free(rope);
+}
+END_TEST
+
+START_TEST(test_rope_refcount)
+{
+    static const char  SRC[] = "0123456789";
+    bool  flag = false;
+    struct cork_rope  rope1;
+    struct cork_rope  rope2;
+    struct cork_managed_buffer  *mbuf;
+
+    /* The ropes should share the managed buffer without copying it, and it
+     * should only be freed once both ropes are done with it. */
+    cork_rope_init(&rope1);
+    cork_rope_init(&rope2);
+    mbuf = flag_buffer_new(SRC, sizeof(SRC) - 1, &flag);
+    fail_if_error(cork_rope_append_managed(&rope1, mbuf, 0, 10));
+    cork_managed_buffer_unref(mbuf);
+    fail_if_error(cork_rope_split(&rope1, 4, &rope2));
+    check_rope(&rope1, "0123");
+    check_rope(&rope2, "456789");
+
+    cork_rope_done(&rope1);
+    fail_if(flag, "Managed buffer freed too early");
+    cork_rope_done(&rope2);
+    fail_unless(flag, "Managed buffer free function never called");
+}
+END_TEST
+
+START_TEST(test_rope_split)
+{
+    static const char  EXPECTED[] = "abcdefghij";
+    struct cork_rope  rope;
+    struct cork_rope  tail;
+    size_t  i;
+
+    make_rope(&rope);
+    check_rope(&rope, EXPECTED);
+
+    for (i = 0; i <= 10; i++) {
+        char  head_expected[16];
+        make_rope(&rope);
+        cork_rope_init(&tail);
+        cork_rope_append_copy(&tail, "_", 1);
+        fail_if_error(cork_rope_split(&rope, i, &tail));
+        snprintf(head_expected, sizeof(head_expected), "%.*s",
+                 (int) i, EXPECTED);
+        check_rope(&rope, head_expected);
+        {
+            char  tail_expected[16];
+            snprintf(tail_expected, sizeof(tail_expected), "_%s",
+                     EXPECTED + i);
+            check_rope(&tail, tail_expected);
+        }
+
+        /* Putting them back together should give the original. */
+        fail_if_error(cork_rope_advance(&tail, 1));
+        cork_rope_append_rope(&rope, &tail);
+        check_rope(&rope, EXPECTED);
+        check_rope(&tail, "");
+        cork_rope_done(&rope);
+        cork_rope_done(&tail);
+    }
+
+    make_rope(&rope);
+    cork_rope_init(&tail);
+    fail_unless_error(cork_rope_split(&rope, 11, &tail),
+                      "Shouldn't be able to split past the end of a rope");
+    check_rope(&rope, EXPECTED);
+    cork_rope_done(&rope);
+    cork_rope_done(&tail);
+}
+END_TEST
+
+START_TEST(test_rope_advance)
+{
+    struct cork_rope  rope;
+
+    make_rope(&rope);
+    fail_if_error(cork_rope_advance(&rope, 0));
+    check_rope(&rope, "abcdefghij");
+    fail_if_error(cork_rope_advance(&rope, 2));
+    check_rope(&rope, "cdefghij");
+    fail_if_error(cork_rope_advance(&rope, 5));
+    check_rope(&rope, "hij");
+    fail_unless(rope.segment_count == 1,
+                "Unexpected segment count %zu", rope.segment_count);
+    fail_unless_error(cork_rope_advance(&rope, 4),
+                      "Shouldn't be able to advance past the end of a rope");
+    fail_if_error(cork_rope_advance(&rope, 3));
+    check_rope(&rope, "");
+    cork_rope_done(&rope);
+}
+END_TEST
+
+START_TEST(test_rope_iovec)
+{
+    struct cork_rope  rope;
+    struct iovec  iov[4];
+
+    make_rope(&rope);
+    fail_if_error(cork_rope_advance(&rope, 1));
+    fail_unless(cork_rope_to_iovec(&rope, iov, 4) == 3,
+                "Unexpected iovec count");
+    fail_unless(iov[0].iov_len == 2 && memcmp(iov[0].iov_base, "bc", 2) == 0,
+                "Unexpected iovec 0");
+    fail_unless(iov[1].iov_len == 4 &&
+                memcmp(iov[1].iov_base, "defg", 4) == 0,
+                "Unexpected iovec 1");
+    fail_unless(iov[2].iov_len == 3 && memcmp(iov[2].iov_base, "hij", 3) == 0,
+                "Unexpected iovec 2");
+    fail_unless(cork_rope_to_iovec(&rope, iov, 2) == 2,
+                "Unexpected iovec count");
+    cork_rope_done(&rope);
+}
+END_TEST
+
+START_TEST(test_rope_write_fd)
+{
+    /* More segments than fit into a single writev call */
+    static const size_t  SEGMENT_COUNT = 1000;
+    struct cork_rope  rope;
+    struct cork_buffer  expected = CORK_BUFFER_INIT();
+    char  *actual;
+    size_t  actual_size = 0;
+    int  fds[2];
+    size_t  i;
+
+    cork_rope_init(&rope);
+    for (i = 0; i < SEGMENT_COUNT; i++) {
+        char  segment[16];
+        int  len = snprintf(segment, sizeof(segment), "%zu,", i);
+        cork_rope_append_copy(&rope, segment, len);
+        cork_buffer_append(&expected, segment, len);
+    }
+
+    /* The whole rope fits into the pipe's buffer, so we can write it all
+     * before reading any of it. */
+    fail_unless(pipe(fds) == 0, "Cannot create pipe");
+    fail_if_error(cork_rope_write_fd(&rope, fds[1]));
+    check_rope(&rope, "");
+    close(fds[1]);
+
+    actual = cork_malloc(expected.size + 1);
+    while (true) {
+        ssize_t  bytes_read =
+            read(fds[0], actual + actual_size, expected.size + 1 - actual_size);
+        fail_if(bytes_read < 0, "Cannot read from pipe");
+        if (bytes_read == 0) {
+            break;
+        }
+        actual_size += bytes_read;
+    }
+    close(fds[0]);
+
+    fail_unless(actual_size == expected.size &&
+                memcmp(actual, expected.buf, expected.size) == 0,
+                "Unexpected data written to pipe");
+
+    cork_free(actual, expected.size + 1);
+    cork_buffer_done(&expected);
+    cork_rope_done(&rope);
+}
+END_TEST
+
+
+/*-----------------------------------------------------------------------
+ * Testing harness
+ */
+
+Suite *
+test_suite()
+{
+    Suite  *s = suite_create("rope");
+
+    TCase  *tc_rope = tcase_create("rope");
+    tcase_add_test(tc_rope, test_rope_append);
+    tcase_add_test(tc_rope, test_rope_refcount);
+    tcase_add_test(tc_rope, test_rope_split);
+    tcase_add_test(tc_rope, test_rope_advance);
+    tcase_add_test(tc_rope, test_rope_iovec);
+    tcase_add_test(tc_rope, test_rope_write_fd);
+    suite_add_tcase(s, tc_rope);
+
+    return s;
+}
+
+
+int
+main(int argc, const char **argv)
+{
+    int  number_failed;
+    Suite  *suite = test_suite();
+    SRunner  *runner = srunner_create(suite);
+
+    setup_allocator();
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0)? EXIT_SUCCESS: EXIT_FAILURE;
+}
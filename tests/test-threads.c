@@ -282,6 +282,168 @@ START_TEST(test_threads_error_01)
 END_TEST
 
 
+/*-----------------------------------------------------------------------
+ * Slab allocator
+ */
+
+#define SLAB_THREAD_COUNT  4
+#define SLAB_OBJECT_COUNT  2000
+#define SLAB_ROUNDS  20
+
+#define slab_object_size(i)  (((i) % 64) * 8 + 1)
+
+struct cork_slab_thread {
+    const struct cork_alloc  *slab;
+    char  tag;
+    /* Objects that this thread allocates and leaves for another thread to
+     * free. */
+    char  *objects[SLAB_OBJECT_COUNT];
+    size_t  errors;
+};
+
+static void
+cork_slab_thread_fill(struct cork_slab_thread *self)
+{
+    size_t  i;
+    for (i = 0; i < SLAB_OBJECT_COUNT; i++) {
+        self->objects[i] = cork_alloc_malloc(self->slab, slab_object_size(i));
+        memset(self->objects[i], self->tag, slab_object_size(i));
+    }
+}
+
+static void
+cork_slab_thread_drain(struct cork_slab_thread *self,
+                       struct cork_slab_thread *other)
+{
+    size_t  i;
+    for (i = 0; i < SLAB_OBJECT_COUNT; i++) {
+        size_t  j;
+        for (j = 0; j < slab_object_size(i); j++) {
+            if (other->objects[i][j] != other->tag) {
+                self->errors++;
+                break;
+            }
+        }
+        cork_alloc_free(self->slab, other->objects[i], slab_object_size(i));
+    }
+}
+
+static int
+cork_slab_thread__run(void *vself)
+{
+    struct cork_slab_thread  *self = vself;
+    struct cork_slab_thread  scratch;
+    size_t  round;
+    scratch.slab = self->slab;
+    scratch.tag = self->tag;
+    scratch.errors = 0;
+    for (round = 0; round < SLAB_ROUNDS; round++) {
+        cork_slab_thread_fill(&scratch);
+        cork_slab_thread_drain(self, &scratch);
+    }
+    /* Leave one set of objects behind for another thread to free. */
+    cork_slab_thread_fill(self);
+    cork_slab_alloc_release_thread_cache(self->slab);
+    return 0;
+}
+
+static int
+cork_slab_drain_thread__run(void *vself)
+{
+    struct cork_slab_thread  *self = vself;
+    cork_slab_thread_drain(self, self - 1);
+    cork_slab_alloc_release_thread_cache(self->slab);
+    return 0;
+}
+
+START_TEST(test_slab_threads)
+{
+    struct cork_alloc  *slab = cork_slab_alloc_new(cork_allocator);
+    struct cork_slab_thread  *threads;
+    struct cork_thread  *t[SLAB_THREAD_COUNT];
+    size_t  i;
+
+    DESCRIBE_TEST;
+    threads = cork_calloc(SLAB_THREAD_COUNT, sizeof(struct cork_slab_thread));
+    for (i = 0; i < SLAB_THREAD_COUNT; i++) {
+        threads[i].slab = slab;
+        threads[i].tag = 'a' + i;
+    }
+
+    /* Each even thread churns through objects on its own, and then leaves
+     * some for the next odd thread to free. */
+    for (i = 0; i < SLAB_THREAD_COUNT; i += 2) {
+        fail_if_error(t[i] = cork_thread_new
+                      ("slab", &threads[i], NULL, cork_slab_thread__run));
+        fail_if_error(cork_thread_start(t[i]));
+    }
+    for (i = 0; i < SLAB_THREAD_COUNT; i += 2) {
+        fail_if_error(cork_thread_join(t[i]));
+    }
+    for (i = 1; i < SLAB_THREAD_COUNT; i += 2) {
+        fail_if_error(t[i] = cork_thread_new
+                      ("slab", &threads[i], NULL,
+                       cork_slab_drain_thread__run));
+        fail_if_error(cork_thread_start(t[i]));
+    }
+    for (i = 1; i < SLAB_THREAD_COUNT; i += 2) {
+        fail_if_error(cork_thread_join(t[i]));
+    }
+
+    for (i = 0; i < SLAB_THREAD_COUNT; i++) {
+        fail_unless_equal("Errors", "%zu", 0, threads[i].errors);
+    }
+    cork_cfree(threads, SLAB_THREAD_COUNT, sizeof(struct cork_slab_thread));
+}
+END_TEST
+
+/* Churns through some objects, and then exits without releasing the thread's
+ * cache. */
+static int
+cork_slab_exit_thread__run(void *vself)
+{
+    struct cork_slab_thread  *self = vself;
+    cork_slab_thread_fill(self);
+    cork_slab_thread_drain(self, self);
+    return 0;
+}
+
+START_TEST(test_slab_thread_exit)
+{
+    struct cork_alloc  *stats = cork_stats_alloc_new(cork_allocator);
+    struct cork_alloc  *slab = cork_slab_alloc_new(stats);
+    struct cork_slab_thread  body;
+    struct cork_thread  *t;
+    struct cork_alloc_stats  before;
+    struct cork_alloc_stats  after;
+    size_t  i;
+
+    DESCRIBE_TEST;
+    body.slab = slab;
+    body.tag = 'x';
+    body.errors = 0;
+    fail_if_error(t = cork_thread_new
+                  ("slab", &body, NULL, cork_slab_exit_thread__run));
+    fail_if_error(cork_thread_start(t));
+    fail_if_error(cork_thread_join(t));
+    cork_stats_alloc_get_totals(stats, &before);
+
+    /* Each thread's cache is freed when the thread exits, and its objects go
+     * back to the slab, where the next thread can reuse them.  So running
+     * more threads shouldn't need any more memory from the parent. */
+    for (i = 0; i < 16; i++) {
+        fail_if_error(t = cork_thread_new
+                      ("slab", &body, NULL, cork_slab_exit_thread__run));
+        fail_if_error(cork_thread_start(t));
+        fail_if_error(cork_thread_join(t));
+    }
+    cork_stats_alloc_get_totals(stats, &after);
+    fail_unless_equal("Live bytes", "%zu", before.live_bytes, after.live_bytes);
+    fail_unless_equal("Errors", "%zu", 0, body.errors);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Testing harness
  */
@@ -310,6 +472,8 @@ test_suite()
     tcase_add_test(tc_threads, test_threads_03);
     tcase_add_test(tc_threads, test_threads_04);
     tcase_add_test(tc_threads, test_threads_error_01);
+    tcase_add_test(tc_threads, test_slab_threads);
+    tcase_add_test(tc_threads, test_slab_thread_exit);
     suite_add_tcase(s, tc_threads);
 
     return s;